@@ -66,20 +66,71 @@ DEFINE_string(
     descriptor,
     "SIFT",
     "Type of feature descriptor to use. Must be one of the following: "
-    "SIFT");
+    "SIFT, AKAZE, BINARY_AKAZE");
 DEFINE_string(feature_density,
               "NORMAL",
               "Set to SPARSE, NORMAL, or DENSE to extract fewer or more "
               "features from each image.");
+DEFINE_int32(max_num_features,
+             16384,
+             "The maximum number of features to extract from each image. The "
+             "strongest features are selected so that they are spread over "
+             "the image.");
+DEFINE_int32(max_image_dimension,
+             0,
+             "If positive, images are downsampled so that their width and "
+             "height are no larger than this before features are extracted.");
+DEFINE_int32(max_tile_dimension,
+             0,
+             "If positive, features are extracted from larger images in "
+             "overlapping tiles of at most this size to bound the memory of "
+             "each extraction thread.");
+DEFINE_string(descriptor_precision,
+              "FLOAT",
+              "Set to FLOAT or UINT8. UINT8 stores SIFT descriptors with one "
+              "byte per dimension, which reduces the memory and disk space of "
+              "the features by a factor of four.");
 DEFINE_string(matching_strategy,
               "CASCADE_HASHING",
-              "Strategy used to match features. Must be BRUTE_FORCE "
-              " or CASCADE_HASHING");
+              "Strategy used to match features. Must be BRUTE_FORCE, "
+              "BLOCKED_BRUTE_FORCE, CASCADE_HASHING, MULTI_INDEX_HASHING or "
+              "KD_TREE. Binary descriptors require BRUTE_FORCE or "
+              "MULTI_INDEX_HASHING.");
 DEFINE_string(matching_working_directory,
               "",
               "Directory used during matching to store features for "
               "out-of-core matching.");
+DEFINE_int32(num_prefetch_threads,
+             2,
+             "Number of threads that read the features of upcoming image pairs "
+             "from the matching database while other pairs are matched.");
+DEFINE_int32(num_verification_threads,
+             0,
+             "If greater than 0, geometric verification runs on this many "
+             "threads of its own, fed by the --num_threads matching threads. "
+             "If set to 0, the matching threads also verify the matches.");
+DEFINE_int32(max_cache_memory_mb,
+             0,
+             "Memory budget in MB of the per-image caches used during "
+             "matching, i.e. the features and keypoint coordinates caches of "
+             "the matching database and the hashed images of the feature "
+             "matcher. If set to 0, a fixed number of images is cached "
+             "regardless of their size.");
 DEFINE_double(lowes_ratio, 0.8, "Lowes ratio used for feature matching.");
+DEFINE_int32(num_features_for_preemptive_matching,
+             0,
+             "If greater than 0, image pairs are first matched with only this "
+             "many features of the largest scale per image, and pairs with "
+             "fewer than --min_num_preemptive_matches matches are rejected "
+             "before all features are matched.");
+DEFINE_int32(min_num_preemptive_matches,
+             4,
+             "Minimum number of preemptive matches for an image pair to be "
+             "fully matched.");
+DEFINE_int32(kd_tree_max_num_checks,
+             256,
+             "Maximum number of leaves visited per descriptor by KD_TREE "
+             "matching. Higher values are more accurate but slower.");
 DEFINE_double(max_sampson_error_for_verified_match,
               4.0,
               "Maximum sampson error for a match to be considered "
@@ -104,6 +155,11 @@ DEFINE_int32(num_nearest_neighbors_for_global_descriptor_matching,
              100,
              "Number of nearest neighbor images to use for full descriptor "
              "matching.");
+DEFINE_string(fisher_vector_gmm_file,
+              "",
+              "GMM to use for FISHER_VECTOR global image descriptors. If the "
+              "file does not exist, the GMM is trained on the features of the "
+              "images and written to this file.");
 DEFINE_int32(num_gmm_clusters_for_fisher_vector,
              16,
              "Number of clusters to use for the GMM with Fisher Vectors for "
@@ -112,6 +168,29 @@ DEFINE_int32(max_num_features_for_fisher_vector_training,
              1000000,
              "Number of features to use to train the Fisher Vector kernel for "
              "global image descriptor extraction.");
+DEFINE_string(global_descriptor_extractor,
+              "FISHER_VECTOR",
+              "Global image descriptor used to select the image pairs to "
+              "match. Must be FISHER_VECTOR or VOCABULARY_TREE.");
+DEFINE_string(vocabulary_tree_file,
+              "",
+              "Vocabulary tree to use for VOCABULARY_TREE image retrieval. If "
+              "the file does not exist, the vocabulary tree is trained on the "
+              "features of the images and written to this file.");
+DEFINE_int32(vocabulary_tree_branching_factor,
+             10,
+             "Number of children of each node of the vocabulary tree.");
+DEFINE_int32(vocabulary_tree_num_levels,
+             5,
+             "Number of levels of the vocabulary tree.");
+DEFINE_int32(max_num_features_for_vocabulary_tree_training,
+             1000000,
+             "Number of features to use to train the vocabulary tree.");
+DEFINE_bool(incremental_matching,
+            false,
+            "Only match the image pairs that contain a new image, i.e. an "
+            "image without features in the matching database or that was "
+            "not matched by a previous run.");
 
 // Reconstruction building options.
 DEFINE_string(reconstruction_estimator,
@@ -312,6 +391,21 @@ using theia::Reconstruction;
 using theia::ReconstructionBuilder;
 using theia::ReconstructionBuilderOptions;
 
+// The memory budget of --max_cache_memory_mb in bytes.
+size_t MaxCacheMemoryInBytes() {
+  CHECK_GE(FLAGS_max_cache_memory_mb, 0);
+  return static_cast<size_t>(FLAGS_max_cache_memory_mb) << 20;
+}
+
+// The deserialized features are several times larger than the hashed images
+// that the matcher creates from them, so most of the budget is given to the
+// caches of the database and the rest to the feature matcher.
+size_t MaxDatabaseCacheMemoryInBytes() {
+  static const double kDatabaseCacheMemoryFraction = 0.75;
+  return static_cast<size_t>(kDatabaseCacheMemoryFraction *
+                             MaxCacheMemoryInBytes());
+}
+
 // Sets the feature extraction, matching, and reconstruction options based on
 // the command line flags. There are many more options beside just these located
 // in //theia/vision/sfm/reconstruction_builder.h
@@ -321,11 +415,27 @@ ReconstructionBuilderOptions SetReconstructionBuilderOptions() {
 
   options.descriptor_type = StringToDescriptorExtractorType(FLAGS_descriptor);
   options.feature_density = StringToFeatureDensity(FLAGS_feature_density);
+  options.max_num_features = FLAGS_max_num_features;
+  options.max_image_dimension = FLAGS_max_image_dimension;
+  options.max_tile_dimension = FLAGS_max_tile_dimension;
+  options.descriptor_precision =
+      StringToDescriptorPrecision(FLAGS_descriptor_precision);
   options.features_and_matches_database_directory =
       FLAGS_matching_working_directory;
   options.matching_strategy =
       StringToMatchingStrategyType(FLAGS_matching_strategy);
   options.matching_options.lowes_ratio = FLAGS_lowes_ratio;
+  options.matching_options.num_features_for_preemptive_matching =
+      FLAGS_num_features_for_preemptive_matching;
+  options.matching_options.min_num_preemptive_matches =
+      FLAGS_min_num_preemptive_matches;
+  options.matching_options.kd_tree_max_num_checks =
+      FLAGS_kd_tree_max_num_checks;
+  options.matching_options.num_prefetch_threads = FLAGS_num_prefetch_threads;
+  options.matching_options.num_verification_threads =
+      FLAGS_num_verification_threads;
+  options.matching_options.max_cache_size_in_bytes =
+      MaxCacheMemoryInBytes() - MaxDatabaseCacheMemoryInBytes();
   options.matching_options.keep_only_symmetric_matches =
       FLAGS_keep_only_symmetric_matches;
   options.min_num_inlier_matches = FLAGS_min_num_inliers_for_valid_match;
@@ -346,10 +456,20 @@ ReconstructionBuilderOptions SetReconstructionBuilderOptions() {
       FLAGS_select_image_pairs_with_global_image_descriptor_matching;
   options.num_nearest_neighbors_for_global_descriptor_matching =
       FLAGS_num_nearest_neighbors_for_global_descriptor_matching;
+  options.fisher_vector_gmm_filepath = FLAGS_fisher_vector_gmm_file;
   options.num_gmm_clusters_for_fisher_vector =
       FLAGS_num_gmm_clusters_for_fisher_vector;
   options.max_num_features_for_fisher_vector_training =
       FLAGS_max_num_features_for_fisher_vector_training;
+  options.global_descriptor_extractor_type =
+      StringToGlobalDescriptorExtractorType(FLAGS_global_descriptor_extractor);
+  options.vocabulary_tree_filepath = FLAGS_vocabulary_tree_file;
+  options.vocabulary_tree_branching_factor =
+      FLAGS_vocabulary_tree_branching_factor;
+  options.vocabulary_tree_num_levels = FLAGS_vocabulary_tree_num_levels;
+  options.max_num_features_for_vocabulary_tree_training =
+      FLAGS_max_num_features_for_vocabulary_tree_training;
+  options.incremental_matching = FLAGS_incremental_matching;
 
   options.min_track_length = FLAGS_min_track_length;
   options.max_track_length = FLAGS_max_track_length;
@@ -590,7 +710,7 @@ int main(int argc, char* argv[]) {
   // Initialize the features and matches database.
   std::unique_ptr<FeaturesAndMatchesDatabase> features_and_matches_database(
       new theia::RocksDbFeaturesAndMatchesDatabase(
-          FLAGS_matching_working_directory));
+          FLAGS_matching_working_directory, MaxDatabaseCacheMemoryInBytes()));
 
   // Create the reconstruction builder.
   const ReconstructionBuilderOptions options =
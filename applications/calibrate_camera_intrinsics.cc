@@ -68,15 +68,17 @@ DEFINE_string(
     descriptor,
     "SIFT",
     "Type of feature descriptor to use. Must be one of the following: "
-    "SIFT");
+    "SIFT, AKAZE, BINARY_AKAZE");
 DEFINE_string(feature_density,
               "NORMAL",
               "Set to SPARSE, NORMAL, or DENSE to extract fewer or more "
               "features from each image.");
 DEFINE_string(matching_strategy,
               "CASCADE_HASHING",
-              "Strategy used to match features. Must be BRUTE_FORCE "
-              " or CASCADE_HASHING");
+              "Strategy used to match features. Must be BRUTE_FORCE, "
+              "BLOCKED_BRUTE_FORCE, CASCADE_HASHING, MULTI_INDEX_HASHING or "
+              "KD_TREE. Binary descriptors require BRUTE_FORCE or "
+              "MULTI_INDEX_HASHING.");
 DEFINE_string(matching_working_directory,
               "",
               "Directory used during matching to store features for "
@@ -43,7 +43,9 @@
 #include <sstream>
 
 using theia::DescriptorExtractorType;
+using theia::DescriptorPrecision;
 using theia::FeatureDensity;
+using theia::GlobalDescriptorExtractorType;
 using theia::GlobalPositionEstimatorType;
 using theia::GlobalRotationEstimatorType;
 using theia::LossFunctionType;
@@ -57,6 +59,8 @@ inline DescriptorExtractorType StringToDescriptorExtractorType(
     return DescriptorExtractorType::SIFT;
   } else if (descriptor == "AKAZE") {
     return DescriptorExtractorType::AKAZE;
+  } else if (descriptor == "BINARY_AKAZE") {
+    return DescriptorExtractorType::BINARY_AKAZE;
   } else {
     LOG(FATAL) << "Invalid DescriptorExtractor specified. Using SIFT instead.";
     return DescriptorExtractorType::SIFT;
@@ -78,12 +82,31 @@ inline FeatureDensity StringToFeatureDensity(
   }
 }
 
+inline DescriptorPrecision StringToDescriptorPrecision(
+    const std::string& descriptor_precision) {
+  if (descriptor_precision == "FLOAT") {
+    return DescriptorPrecision::FLOAT;
+  } else if (descriptor_precision == "UINT8") {
+    return DescriptorPrecision::UINT8;
+  } else {
+    LOG(FATAL) << "Invalid descriptor precision requested. Please use FLOAT "
+                  "or UINT8.";
+    return DescriptorPrecision::FLOAT;
+  }
+}
+
 inline MatchingStrategy StringToMatchingStrategyType(
     const std::string& matching_strategy) {
   if (matching_strategy == "BRUTE_FORCE") {
     return MatchingStrategy::BRUTE_FORCE;
   } else if (matching_strategy == "CASCADE_HASHING") {
     return MatchingStrategy::CASCADE_HASHING;
+  } else if (matching_strategy == "BLOCKED_BRUTE_FORCE") {
+    return MatchingStrategy::BLOCKED_BRUTE_FORCE;
+  } else if (matching_strategy == "MULTI_INDEX_HASHING") {
+    return MatchingStrategy::MULTI_INDEX_HASHING;
+  } else if (matching_strategy == "KD_TREE") {
+    return MatchingStrategy::KD_TREE;
   } else {
     LOG(FATAL)
         << "Invalid matching strategy specified. Using BRUTE_FORCE instead.";
@@ -91,6 +114,19 @@ inline MatchingStrategy StringToMatchingStrategyType(
   }
 }
 
+inline GlobalDescriptorExtractorType StringToGlobalDescriptorExtractorType(
+    const std::string& global_descriptor_extractor) {
+  if (global_descriptor_extractor == "FISHER_VECTOR") {
+    return GlobalDescriptorExtractorType::FISHER_VECTOR;
+  } else if (global_descriptor_extractor == "VOCABULARY_TREE") {
+    return GlobalDescriptorExtractorType::VOCABULARY_TREE;
+  } else {
+    LOG(FATAL) << "Invalid global descriptor extractor specified. Please use "
+                  "FISHER_VECTOR or VOCABULARY_TREE.";
+    return GlobalDescriptorExtractorType::FISHER_VECTOR;
+  }
+}
+
 inline ReconstructionEstimatorType StringToReconstructionEstimatorType(
     const std::string& reconstruction_estimator) {
   if (reconstruction_estimator == "GLOBAL") {
@@ -60,7 +60,7 @@ DEFINE_string(
     descriptor,
     "SIFT",
     "Type of feature descriptor to use. Must be one of the following: "
-    "SIFT");
+    "SIFT, AKAZE, BINARY_AKAZE");
 DEFINE_string(feature_density,
               "NORMAL",
               "Set to SPARSE, NORMAL, or DENSE to extract fewer or more "
@@ -68,7 +68,9 @@ DEFINE_string(feature_density,
 DEFINE_string(matching_strategy,
               "CASCADE_HASHING",
               "Strategy used to match features. Must be BRUTE_FORCE, "
-              "or CASCADE_HASHING");
+              "BLOCKED_BRUTE_FORCE, CASCADE_HASHING, MULTI_INDEX_HASHING or "
+              "KD_TREE. Binary descriptors require BRUTE_FORCE or "
+              "MULTI_INDEX_HASHING.");
 DEFINE_double(lowes_ratio, 0.75, "Lowes ratio used for feature matching.");
 DEFINE_double(
     max_sampson_error_for_verified_match,
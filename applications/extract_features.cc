@@ -52,10 +52,25 @@ DEFINE_int32(num_threads, 1,
 DEFINE_string(
     descriptor, "SIFT",
     "Type of feature descriptor to use. Must be one of the following: "
-    "SIFT");
+    "SIFT, AKAZE, BINARY_AKAZE");
 DEFINE_string(feature_density, "NORMAL",
               "Set to SPARSE, NORMAL, or DENSE to extract fewer or more "
               "features from each image.");
+DEFINE_int32(max_num_features, 16384,
+             "The maximum number of features to extract from each image. The "
+             "strongest features are selected so that they are spread over "
+             "the image.");
+DEFINE_int32(max_image_dimension, 0,
+             "If positive, images are downsampled so that their width and "
+             "height are no larger than this before features are extracted.");
+DEFINE_int32(max_tile_dimension, 0,
+             "If positive, features are extracted from larger images in "
+             "overlapping tiles of at most this size to bound the memory of "
+             "each extraction thread.");
+DEFINE_string(descriptor_precision, "FLOAT",
+              "Set to FLOAT or UINT8. UINT8 writes SIFT descriptors with one "
+              "byte per dimension, which reduces the size of the features "
+              "files by a factor of four.");
 
 int main(int argc, char *argv[]) {
   THEIA_GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
@@ -72,6 +87,11 @@ int main(int argc, char *argv[]) {
   options.descriptor_extractor_type =
       StringToDescriptorExtractorType(FLAGS_descriptor);
   options.feature_density = StringToFeatureDensity(FLAGS_feature_density);
+  options.max_num_features = FLAGS_max_num_features;
+  options.max_image_dimension = FLAGS_max_image_dimension;
+  options.max_tile_dimension = FLAGS_max_tile_dimension;
+  options.descriptor_precision =
+      StringToDescriptorPrecision(FLAGS_descriptor_precision);
   options.num_threads = FLAGS_num_threads;
   options.output_directory = FLAGS_features_output_directory;
 
@@ -39,13 +39,19 @@
 #include "theia/image/descriptor/akaze_descriptor.h"
 #include "theia/image/descriptor/create_descriptor_extractor.h"
 #include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor_pool.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/descriptor_quantization.h"
 #include "theia/image/descriptor/sift_descriptor.h"
+#include "theia/image/descriptor/tiled_descriptor_extractor.h"
 #include "theia/image/image.h"
 #include "theia/image/image_cache.h"
 #include "theia/image/keypoint_detector/keypoint.h"
 #include "theia/image/keypoint_detector/keypoint_detector.h"
+#include "theia/image/keypoint_detector/keypoint_selection.h"
 #include "theia/image/keypoint_detector/sift_detector.h"
 #include "theia/image/keypoint_detector/sift_parameters.h"
+#include "theia/image/keypoint_detector/sift_scale_space.h"
 #include "theia/io/bundler_file_reader.h"
 #include "theia/io/eigen_serializable.h"
 #include "theia/io/import_nvm_file.h"
@@ -64,9 +70,11 @@
 #include "theia/io/write_keypoints_and_descriptors.h"
 #include "theia/io/write_nvm_file.h"
 #include "theia/io/write_ply_file.h"
+#include "theia/matching/blocked_brute_force_feature_matcher.h"
 #include "theia/matching/brute_force_feature_matcher.h"
 #include "theia/matching/cascade_hasher.h"
 #include "theia/matching/cascade_hashing_feature_matcher.h"
+#include "theia/matching/compact_image_pair_match.h"
 #include "theia/matching/create_feature_matcher.h"
 #include "theia/matching/distance.h"
 #include "theia/matching/feature_correspondence.h"
@@ -76,12 +84,19 @@
 #include "theia/matching/features_and_matches_database.h"
 #include "theia/matching/fisher_vector_extractor.h"
 #include "theia/matching/global_descriptor_extractor.h"
+#include "theia/matching/global_descriptor_nearest_neighbors.h"
 #include "theia/matching/guided_epipolar_matcher.h"
+#include "theia/matching/hamming_distance.h"
 #include "theia/matching/image_pair_match.h"
 #include "theia/matching/indexed_feature_match.h"
 #include "theia/matching/in_memory_features_and_matches_database.h"
+#include "theia/matching/kd_tree_feature_matcher.h"
 #include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/matching/multi_index_hasher.h"
+#include "theia/matching/multi_index_hashing_feature_matcher.h"
+#include "theia/matching/quantized_l2_distance.h"
 #include "theia/matching/rocksdb_features_and_matches_database.h"
+#include "theia/matching/vocabulary_tree.h"
 #include "theia/math/closed_form_polynomial_solver.h"
 #include "theia/math/constrained_l1_solver.h"
 #include "theia/math/distribution.h"
@@ -237,6 +252,8 @@
 #include "theia/solvers/ransac.h"
 #include "theia/solvers/sample_consensus_estimator.h"
 #include "theia/solvers/sampler.h"
+#include "theia/util/bounded_queue.h"
+#include "theia/util/concurrent_lru_cache.h"
 #include "theia/util/enable_enum_bitmask_operators.h"
 #include "theia/util/filesystem.h"
 #include "theia/util/hash.h"
@@ -462,8 +462,11 @@ void AKAZE::Compute_Descriptors(std::vector<AKAZEKeypoint>& kpts,
       t = options_.descriptor_size;
     }
 
+    // The descriptor bits are packed into bytes and set with bitwise or, so
+    // the storage must be zero initialized.
+    const int num_bytes = (t + 7) / 8;
     for (int i = 0; i < desc.binary_descriptor.size(); i++) {
-      desc.binary_descriptor[i].resize(t);
+      desc.binary_descriptor[i].setZero(num_bytes);
     }
   }
 
@@ -41,10 +41,19 @@
 #include "akaze/src/AKAZE.h"
 #include "glog/logging.h"
 
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/image/image.h"
 #include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/image/keypoint_detector/keypoint_selection.h"
 
 namespace theia {
+
+AkazeDescriptorExtractor::AkazeDescriptorExtractor(
+    const AkazeParameters& detector_params)
+    : akaze_params_(detector_params) {}
+
+AkazeDescriptorExtractor::~AkazeDescriptorExtractor() {}
+
 bool AkazeDescriptorExtractor::ComputeDescriptor(const FloatImage& image,
                                                  const Keypoint& keypoint,
                                                  Eigen::VectorXf* descriptor) {
@@ -55,21 +64,19 @@ bool AkazeDescriptorExtractor::ComputeDescriptor(const FloatImage& image,
                 "instead.";
 }
 
-bool AkazeDescriptorExtractor::DetectAndExtractDescriptors(
-    const FloatImage& image,
-    std::vector<Keypoint>* keypoints,
-    std::vector<Eigen::VectorXf>* descriptors) {
-  // Try to convert the image to grayscale and eigen type.
-  const FloatImage& gray_image = image.AsGrayscaleImage();
-  libAKAZE::RowMatrixXf img_32 =
-      Eigen::Map<const Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic,
-                                     Eigen::RowMajor> >(
-          gray_image.Data(), gray_image.Rows(), gray_image.Cols());
+void AkazeDescriptorExtractor::InitializeScaleSpace(const int width,
+                                                    const int height) {
+  // The grayscale pixels hold the previous image, which has the size that the
+  // scale space was created for.
+  if (scale_space_ && grayscale_pixels_.cols() == width &&
+      grayscale_pixels_.rows() == height) {
+    return;
+  }
 
   // Set the akaze options.
   libAKAZE::AKAZEOptions options;
-  options.img_width = img_32.cols();
-  options.img_height = img_32.rows();
+  options.img_width = width;
+  options.img_height = height;
   options.num_threads = 1;
   options.soffset = 1.6f;
   options.derivative_factor = 1.5f;
@@ -79,7 +86,8 @@ bool AkazeDescriptorExtractor::DetectAndExtractDescriptors(
   options.min_dthreshold = 0.00001f;
 
   options.diffusivity = libAKAZE::PM_G2;
-  options.descriptor = libAKAZE::MSURF;
+  options.descriptor = akaze_params_.binary_descriptors ? libAKAZE::MLDB
+                                                        : libAKAZE::MSURF;
   options.descriptor_size = 0;
   options.descriptor_channels = 3;
   options.descriptor_pattern_size = 10;
@@ -91,15 +99,54 @@ bool AkazeDescriptorExtractor::DetectAndExtractDescriptors(
 
   options.verbosity = false;
 
+  // The evolution of the scale space is allocated once for all images of this
+  // size and overwritten by each image.
+  scale_space_.reset(new libAKAZE::AKAZE(options));
+}
+
+void AkazeDescriptorExtractor::DetectAndComputeAkazeDescriptors(
+    const FloatImage& image,
+    std::vector<Keypoint>* keypoints,
+    libAKAZE::AKAZEDescriptors* akaze_descriptors) {
+  InitializeScaleSpace(image.Cols(), image.Rows());
+
+  // Convert the image to grayscale into the buffer that is reused across
+  // images.
+  image.GetGrayscalePixels(&grayscale_pixels_);
+
   // Extract features.
   std::vector<libAKAZE::AKAZEKeypoint> akaze_keypoints;
-  libAKAZE::AKAZE evolution(options);
-  evolution.Create_Nonlinear_Scale_Space(img_32);
-  evolution.Feature_Detection(akaze_keypoints);
+  scale_space_->Create_Nonlinear_Scale_Space(grayscale_pixels_);
+  scale_space_->Feature_Detection(akaze_keypoints);
+
+  // Select the keypoints to keep before their descriptors are computed.
+  if (akaze_params_.max_num_features > 0 &&
+      akaze_keypoints.size() > akaze_params_.max_num_features) {
+    std::vector<Keypoint> candidate_keypoints;
+    candidate_keypoints.reserve(akaze_keypoints.size());
+    for (const auto& akaze_keypoint : akaze_keypoints) {
+      Keypoint keypoint(akaze_keypoint.pt.x(), akaze_keypoint.pt.y(),
+                        Keypoint::AKAZE);
+      keypoint.set_strength(akaze_keypoint.response);
+      candidate_keypoints.emplace_back(keypoint);
+    }
+    std::vector<bool> keep;
+    SelectSpatiallyBalancedKeypoints(candidate_keypoints,
+                                     image.Cols(),
+                                     image.Rows(),
+                                     akaze_params_.max_num_features,
+                                     &keep);
+    int num_kept = 0;
+    for (int i = 0; i < akaze_keypoints.size(); i++) {
+      if (keep[i]) {
+        akaze_keypoints[num_kept++] = akaze_keypoints[i];
+      }
+    }
+    akaze_keypoints.resize(num_kept);
+  }
 
   // Compute descriptors.
-  libAKAZE::AKAZEDescriptors akaze_descriptors;
-  evolution.Compute_Descriptors(akaze_keypoints, akaze_descriptors);
+  scale_space_->Compute_Descriptors(akaze_keypoints, *akaze_descriptors);
 
   // Set the output keypoints.
   keypoints->reserve(akaze_keypoints.size());
@@ -111,9 +158,54 @@ bool AkazeDescriptorExtractor::DetectAndExtractDescriptors(
     keypoint.set_orientation(akaze_keypoint.angle);
     keypoints->emplace_back(keypoint);
   }
+}
+
+bool AkazeDescriptorExtractor::DetectAndExtractDescriptors(
+    const FloatImage& image,
+    std::vector<Keypoint>* keypoints,
+    DescriptorMatrix* descriptors) {
+  if (akaze_params_.binary_descriptors) {
+    LOG(ERROR) << "The Akaze extractor was configured to extract binary "
+                  "descriptors. Please use "
+                  "AkazeDescriptorExtractor::"
+                  "DetectAndExtractBinaryDescriptors() instead.";
+    return false;
+  }
+
+  libAKAZE::AKAZEDescriptors akaze_descriptors;
+  DetectAndComputeAkazeDescriptors(image, keypoints, &akaze_descriptors);
 
   // Set the output descriptors.
-  std::swap(*descriptors, akaze_descriptors.float_descriptor);
+  *descriptors =
+      DescriptorMatrixFromVectors(akaze_descriptors.float_descriptor);
+  return true;
+}
+
+bool AkazeDescriptorExtractor::DetectAndExtractBinaryDescriptors(
+    const FloatImage& image,
+    std::vector<Keypoint>* keypoints,
+    BinaryDescriptorMatrix* descriptors) {
+  if (!akaze_params_.binary_descriptors) {
+    LOG(ERROR) << "The Akaze extractor was configured to extract float "
+                  "descriptors. Please set AkazeParameters::"
+                  "binary_descriptors to extract binary descriptors.";
+    return false;
+  }
+
+  libAKAZE::AKAZEDescriptors akaze_descriptors;
+  DetectAndComputeAkazeDescriptors(image, keypoints, &akaze_descriptors);
+
+  // Copy the packed descriptor bytes into the output matrix.
+  const int num_descriptors = akaze_descriptors.binary_descriptor.size();
+  if (num_descriptors == 0) {
+    descriptors->resize(0, 0);
+    return true;
+  }
+  descriptors->resize(num_descriptors,
+                      akaze_descriptors.binary_descriptor[0].size());
+  for (int i = 0; i < num_descriptors; i++) {
+    descriptors->row(i) = akaze_descriptors.binary_descriptor[i].transpose();
+  }
   return true;
 }
 
@@ -35,11 +35,18 @@
 #ifndef THEIA_IMAGE_DESCRIPTOR_AKAZE_DESCRIPTOR_H_
 #define THEIA_IMAGE_DESCRIPTOR_AKAZE_DESCRIPTOR_H_
 
+#include <Eigen/Core>
+#include <memory>
 #include <vector>
 
 #include "theia/image/descriptor/descriptor_extractor.h"
 #include "theia/util/util.h"
 
+namespace libAKAZE {
+class AKAZE;
+struct AKAZEDescriptors;
+}  // namespace libAKAZE
+
 namespace theia {
 
 class FloatImage;
@@ -51,13 +58,23 @@ struct AkazeParameters {
   int num_sublevels = 4;
   // Lowering this threshold will increase the number of features.
   float hessian_threshold = 0.001f;
+  // If true, the binary M-LDB descriptor is extracted instead of the
+  // real-valued M-SURF descriptor. Binary descriptors are 486 bits packed into
+  // 61 bytes and must be matched with the Hamming distance.
+  bool binary_descriptors = false;
+  // If positive, at most this many keypoints are kept. The keypoints are
+  // selected by their response in a way that spreads them over the image (see
+  // SelectSpatiallyBalancedKeypoints) before their descriptors are computed.
+  int max_num_features = 0;
 };
 
+// The nonlinear scale space and the grayscale conversion of the image are kept
+// alive across calls, so extracting features from many images of the same size
+// with one extractor does not reallocate them for each image.
 class AkazeDescriptorExtractor : public DescriptorExtractor {
  public:
-  explicit AkazeDescriptorExtractor(const AkazeParameters& detector_params)
-      : akaze_params_(detector_params) {}
-  ~AkazeDescriptorExtractor() {}
+  explicit AkazeDescriptorExtractor(const AkazeParameters& detector_params);
+  ~AkazeDescriptorExtractor();
 
   // NOTE: This method will gracefully fail with a fatal logging method. AKAZE
   // must use its own keypoints so only DetectAndExtract can be used.
@@ -69,10 +86,37 @@ class AkazeDescriptorExtractor : public DescriptorExtractor {
   // same time.
   bool DetectAndExtractDescriptors(const FloatImage& image,
                                    std::vector<Keypoint>* keypoints,
-                                   std::vector<Eigen::VectorXf>* descriptors);
+                                   DescriptorMatrix* descriptors) override;
+
+  using DescriptorExtractor::DetectAndExtractDescriptors;
+
+  // Returns true if the extractor was configured to output M-LDB descriptors.
+  bool ProducesBinaryDescriptors() const override {
+    return akaze_params_.binary_descriptors;
+  }
+
+  // Detects Akaze keypoints and extracts bit-packed M-LDB descriptors for them.
+  bool DetectAndExtractBinaryDescriptors(
+      const FloatImage& image,
+      std::vector<Keypoint>* keypoints,
+      BinaryDescriptorMatrix* descriptors) override;
 
  private:
+  // Runs the Akaze detector and computes the descriptors of the configured
+  // type. The keypoints are appended to the output container.
+  void DetectAndComputeAkazeDescriptors(
+      const FloatImage& image,
+      std::vector<Keypoint>* keypoints,
+      libAKAZE::AKAZEDescriptors* akaze_descriptors);
+
+  // Creates a new nonlinear scale space if there is none yet or if it was
+  // created for images of a different size.
+  void InitializeScaleSpace(const int width, const int height);
+
   const AkazeParameters akaze_params_;
+  std::unique_ptr<libAKAZE::AKAZE> scale_space_;
+  Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      grayscale_pixels_;
 
   DISALLOW_COPY_AND_ASSIGN(AkazeDescriptorExtractor);
 };
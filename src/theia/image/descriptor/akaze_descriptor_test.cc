@@ -62,4 +62,28 @@ TEST(AkazeDescriptor, Sanity) {
                                                           &descriptors));
 }
 
+TEST(AkazeDescriptor, BinarySanity) {
+  FloatImage input_img(img_filename);
+
+  AkazeParameters options;
+  options.binary_descriptors = true;
+  AkazeDescriptorExtractor akaze_extractor(options);
+  EXPECT_TRUE(akaze_extractor.ProducesBinaryDescriptors());
+
+  std::vector<Keypoint> keypoints;
+  BinaryDescriptorMatrix descriptors;
+  EXPECT_TRUE(akaze_extractor.DetectAndExtractBinaryDescriptors(
+      input_img, &keypoints, &descriptors));
+  EXPECT_EQ(descriptors.rows(), keypoints.size());
+  // The full M-LDB descriptor has 486 bits which are packed into 61 bytes.
+  if (descriptors.rows() > 0) {
+    EXPECT_EQ(descriptors.cols(), 61);
+  }
+
+  // Float descriptors cannot be extracted with the binary configuration.
+  DescriptorMatrix float_descriptors;
+  EXPECT_FALSE(akaze_extractor.DetectAndExtractDescriptors(
+      input_img, &keypoints, &float_descriptors));
+}
+
 }  // namespace theia
@@ -82,19 +82,45 @@ inline AkazeParameters FeatureDensityToAkazeParameters(
 
 }  // namespace
 
+bool IsBinaryDescriptorExtractorType(
+    const DescriptorExtractorType& descriptor_type) {
+  return descriptor_type == DescriptorExtractorType::BINARY_AKAZE;
+}
+
 std::unique_ptr<DescriptorExtractor> CreateDescriptorExtractor(
     const DescriptorExtractorType& descriptor_type,
     const FeatureDensity& feature_density) {
+  return CreateDescriptorExtractor(descriptor_type, feature_density, 0);
+}
+
+std::unique_ptr<DescriptorExtractor> CreateDescriptorExtractor(
+    const DescriptorExtractorType& descriptor_type,
+    const FeatureDensity& feature_density,
+    const int max_num_features) {
   std::unique_ptr<DescriptorExtractor> descriptor_extractor;
   switch (descriptor_type) {
-    case DescriptorExtractorType::SIFT:
-      descriptor_extractor.reset(new SiftDescriptorExtractor(
-          FeatureDensityToSiftParameters(feature_density)));
+    case DescriptorExtractorType::SIFT: {
+      SiftParameters sift_params =
+          FeatureDensityToSiftParameters(feature_density);
+      sift_params.max_num_features = max_num_features;
+      descriptor_extractor.reset(new SiftDescriptorExtractor(sift_params));
+      break;
+    }
+    case DescriptorExtractorType::AKAZE: {
+      AkazeParameters akaze_params =
+          FeatureDensityToAkazeParameters(feature_density);
+      akaze_params.max_num_features = max_num_features;
+      descriptor_extractor.reset(new AkazeDescriptorExtractor(akaze_params));
       break;
-    case DescriptorExtractorType::AKAZE:
-      descriptor_extractor.reset(new AkazeDescriptorExtractor(
-          FeatureDensityToAkazeParameters(feature_density)));
+    }
+    case DescriptorExtractorType::BINARY_AKAZE: {
+      AkazeParameters akaze_params =
+          FeatureDensityToAkazeParameters(feature_density);
+      akaze_params.binary_descriptors = true;
+      akaze_params.max_num_features = max_num_features;
+      descriptor_extractor.reset(new AkazeDescriptorExtractor(akaze_params));
       break;
+    }
     default:
       LOG(ERROR) << "Invalid Descriptor Extractor specified.";
   }
@@ -47,6 +47,9 @@ class DescriptorExtractor;
 enum class DescriptorExtractorType {
   SIFT = 0,
   AKAZE = 1,
+  // Akaze keypoints with bit-packed M-LDB descriptors. These descriptors must
+  // be matched with the Hamming distance.
+  BINARY_AKAZE = 2,
 };
 
 // Users may specify feature density to target their specific
@@ -60,11 +63,25 @@ enum class FeatureDensity {
   DENSE = 2
 };
 
+// Returns true if the descriptor type is a bit-packed binary descriptor. These
+// descriptors must be extracted with
+// DescriptorExtractor::DetectAndExtractBinaryDescriptors.
+bool IsBinaryDescriptorExtractorType(
+    const DescriptorExtractorType& descriptor_type);
+
 // Factory method to create the keypoint detector and descriptor extractor.
 std::unique_ptr<DescriptorExtractor> CreateDescriptorExtractor(
     const DescriptorExtractorType& descriptor_type,
     const FeatureDensity& feature_density);
 
+// Same as above, but if max_num_features is positive the extractor selects at
+// most max_num_features spatially balanced keypoints before it computes their
+// descriptors.
+std::unique_ptr<DescriptorExtractor> CreateDescriptorExtractor(
+    const DescriptorExtractorType& descriptor_type,
+    const FeatureDensity& feature_density,
+    const int max_num_features);
+
 }  // namespace theia
 
 #endif  // THEIA_IMAGE_DESCRIPTOR_CREATE_DESCRIPTOR_EXTRACTOR_H_
@@ -35,32 +35,73 @@
 #include "theia/image/descriptor/descriptor_extractor.h"
 
 #include <Eigen/Core>
+#include <glog/logging.h>
+#include <algorithm>
+#include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/image/image.h"
 #include "theia/image/keypoint_detector/keypoint.h"
 
 namespace theia {
 
 // Compute the descriptor for multiple keypoints in a given image.
-bool DescriptorExtractor::ComputeDescriptors(
-    const FloatImage& image,
-    std::vector<Keypoint>* keypoints,
-    std::vector<Eigen::VectorXf>* descriptors) {
+bool DescriptorExtractor::ComputeDescriptors(const FloatImage& image,
+                                             std::vector<Keypoint>* keypoints,
+                                             DescriptorMatrix* descriptors) {
   const FloatImage& gray_image = image.AsGrayscaleImage();
-  descriptors->reserve(keypoints->size());
 
-  auto keypoint_it = keypoints->begin();
-  while (keypoint_it != keypoints->end()) {
+  std::vector<Keypoint> valid_keypoints;
+  valid_keypoints.reserve(keypoints->size());
+  for (const Keypoint& keypoint : *keypoints) {
     Eigen::VectorXf descriptor;
-    if (!ComputeDescriptor(gray_image,
-                           *keypoint_it,
-                           &descriptor)) {
-      keypoint_it = keypoints->erase(keypoint_it);
+    if (!ComputeDescriptor(gray_image, keypoint, &descriptor)) {
       continue;
     }
 
-    descriptors->push_back(descriptor);
+    // Allocate the descriptor matrix once the descriptor dimension is known.
+    if (valid_keypoints.empty()) {
+      descriptors->resize(keypoints->size(), descriptor.size());
+    }
+    descriptors->row(valid_keypoints.size()) = descriptor.transpose();
+    valid_keypoints.emplace_back(keypoint);
+  }
+
+  descriptors->conservativeResize(valid_keypoints.size(), Eigen::NoChange);
+  std::swap(*keypoints, valid_keypoints);
+  return true;
+}
+
+bool DescriptorExtractor::DetectAndExtractBinaryDescriptors(
+    const FloatImage& image,
+    std::vector<Keypoint>* keypoints,
+    BinaryDescriptorMatrix* descriptors) {
+  LOG(ERROR) << "This descriptor extractor does not produce binary "
+                "descriptors.";
+  return false;
+}
+
+bool DescriptorExtractor::ComputeDescriptors(
+    const FloatImage& image,
+    std::vector<Keypoint>* keypoints,
+    std::vector<Eigen::VectorXf>* descriptors) {
+  DescriptorMatrix descriptor_matrix;
+  if (!ComputeDescriptors(image, keypoints, &descriptor_matrix)) {
+    return false;
+  }
+  *descriptors = DescriptorVectorsFromMatrix(descriptor_matrix);
+  return true;
+}
+
+bool DescriptorExtractor::DetectAndExtractDescriptors(
+    const FloatImage& image,
+    std::vector<Keypoint>* keypoints,
+    std::vector<Eigen::VectorXf>* descriptors) {
+  DescriptorMatrix descriptor_matrix;
+  if (!DetectAndExtractDescriptors(image, keypoints, &descriptor_matrix)) {
+    return false;
   }
+  *descriptors = DescriptorVectorsFromMatrix(descriptor_matrix);
   return true;
 }
 
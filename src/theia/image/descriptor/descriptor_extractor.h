@@ -38,6 +38,7 @@
 #include <Eigen/Core>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/util/util.h"
 
 namespace theia {
@@ -65,20 +66,41 @@ class DescriptorExtractor {
   // Compute the descriptors for multiple keypoints in a given image. This
   // method will return all descriptors that could be extracted. If any
   // descriptors could not be extracted at a given keypoint, that keypoint will
-  // be removed from the container. Returns true on success and false on
-  // failure.
-  virtual bool ComputeDescriptors(
-      const FloatImage& image,
-      std::vector<Keypoint>* keypoints,
-      std::vector<Eigen::VectorXf>* descriptors);
+  // be removed from the container. Row i of the descriptor matrix is the
+  // descriptor of keypoint i. Returns true on success and false on failure.
+  virtual bool ComputeDescriptors(const FloatImage& image,
+                                  std::vector<Keypoint>* keypoints,
+                                  DescriptorMatrix* descriptors);
 
   // Detects keypoints using the default method for the given descriptor. This
   // can be more efficient (e.g., with SIFT) because there is some overhead
   // required for creating the keypoint and descriptor objects.
-  virtual bool DetectAndExtractDescriptors(
+  virtual bool DetectAndExtractDescriptors(const FloatImage& image,
+                                           std::vector<Keypoint>* keypoints,
+                                           DescriptorMatrix* descriptors) = 0;
+
+  // Returns true if the extractor outputs bit-packed binary descriptors. Such
+  // extractors must be run with DetectAndExtractBinaryDescriptors and the
+  // descriptors should be matched with the Hamming distance.
+  virtual bool ProducesBinaryDescriptors() const { return false; }
+
+  // Detects keypoints and extracts binary descriptors for them. Row i of the
+  // descriptor matrix holds the packed bits of the descriptor of keypoint i.
+  // The default implementation fails since most descriptors are real-valued.
+  virtual bool DetectAndExtractBinaryDescriptors(
       const FloatImage& image,
       std::vector<Keypoint>* keypoints,
-      std::vector<Eigen::VectorXf>* descriptors) = 0;
+      BinaryDescriptorMatrix* descriptors);
+
+  // Same as above, but the descriptors are output as individual vectors. These
+  // are provided for compatibility and copy the descriptor matrix computed by
+  // the methods above.
+  bool ComputeDescriptors(const FloatImage& image,
+                          std::vector<Keypoint>* keypoints,
+                          std::vector<Eigen::VectorXf>* descriptors);
+  bool DetectAndExtractDescriptors(const FloatImage& image,
+                                   std::vector<Keypoint>* keypoints,
+                                   std::vector<Eigen::VectorXf>* descriptors);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(DescriptorExtractor);
@@ -0,0 +1,115 @@
+// Copyright (C) 2015 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/image/descriptor/descriptor_extractor_pool.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "theia/image/descriptor/create_descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/descriptor/tiled_descriptor_extractor.h"
+
+namespace theia {
+
+DescriptorExtractorPool::DescriptorExtractorPool(
+    const DescriptorExtractorType& descriptor_type,
+    const FeatureDensity& feature_density)
+    : DescriptorExtractorPool(descriptor_type, feature_density, 0, 0) {}
+
+DescriptorExtractorPool::DescriptorExtractorPool(
+    const DescriptorExtractorType& descriptor_type,
+    const FeatureDensity& feature_density,
+    const int max_num_features,
+    const int max_tile_dimension)
+    : descriptor_type_(descriptor_type),
+      feature_density_(feature_density),
+      max_num_features_(max_num_features),
+      max_tile_dimension_(max_tile_dimension),
+      num_extractors_(0) {}
+
+DescriptorExtractorPool::~DescriptorExtractorPool() {
+  CHECK_EQ(available_extractors_.size(), num_extractors_)
+      << "The descriptor extractor pool was destroyed while some of its "
+         "extractors are in use.";
+}
+
+DescriptorExtractorPool::Handle DescriptorExtractorPool::Acquire() {
+  const auto release = [this](DescriptorExtractor* descriptor_extractor) {
+    Release(descriptor_extractor);
+  };
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!available_extractors_.empty()) {
+      Handle descriptor_extractor(available_extractors_.back().release(),
+                                  release);
+      available_extractors_.pop_back();
+      return descriptor_extractor;
+    }
+    ++num_extractors_;
+  }
+
+  // Create the extractor outside of the lock since initializing it may be
+  // expensive.
+  std::unique_ptr<DescriptorExtractor> descriptor_extractor =
+      CreateDescriptorExtractor(
+          descriptor_type_, feature_density_, max_num_features_);
+  if (max_tile_dimension_ > 0) {
+    TiledDescriptorExtractor::Options tiled_options;
+    tiled_options.max_tile_dimension = max_tile_dimension_;
+    tiled_options.tile_overlap =
+        std::min(tiled_options.tile_overlap, max_tile_dimension_ / 2);
+    descriptor_extractor.reset(new TiledDescriptorExtractor(
+        tiled_options, std::move(descriptor_extractor)));
+  }
+  return Handle(descriptor_extractor.release(), release);
+}
+
+int DescriptorExtractorPool::NumExtractors() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_extractors_;
+}
+
+void DescriptorExtractorPool::Release(
+    DescriptorExtractor* descriptor_extractor) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  available_extractors_.emplace_back(descriptor_extractor);
+}
+
+}  // namespace theia
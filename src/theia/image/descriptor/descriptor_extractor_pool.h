@@ -0,0 +1,105 @@
+// Copyright (C) 2015 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_EXTRACTOR_POOL_H_
+#define THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_EXTRACTOR_POOL_H_
+
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <vector>
+
+#include "theia/image/descriptor/create_descriptor_extractor.h"
+#include "theia/util/util.h"
+
+namespace theia {
+class DescriptorExtractor;
+
+// A thread-safe pool of descriptor extractors of the same type. Creating a
+// descriptor extractor for each image allocates the scale space of the detector
+// and the grayscale copy of the image for every image. Instead, each worker
+// acquires an extractor from the pool while it processes an image and returns
+// it to the pool afterwards, so that the buffers of the extractor are reused
+// for the next image. Since the extractors only reallocate their buffers when
+// the image size changes, this removes all per-image allocations for images of
+// the same resolution. The pool creates at most as many extractors as there are
+// concurrent users.
+//
+// If max_num_features is positive, the extractors select at most this many
+// keypoints (of each tile, if tiles are used) before computing descriptors. If
+// max_tile_dimension is positive, the extractors process images that are wider
+// or taller than max_tile_dimension in tiles (see TiledDescriptorExtractor),
+// which bounds the memory of each extractor.
+class DescriptorExtractorPool {
+ public:
+  // A descriptor extractor that is returned to the pool when it is destroyed.
+  typedef std::unique_ptr<DescriptorExtractor,
+                          std::function<void(DescriptorExtractor*)> >
+      Handle;
+
+  DescriptorExtractorPool(const DescriptorExtractorType& descriptor_type,
+                          const FeatureDensity& feature_density);
+  DescriptorExtractorPool(const DescriptorExtractorType& descriptor_type,
+                          const FeatureDensity& feature_density,
+                          const int max_num_features,
+                          const int max_tile_dimension);
+  ~DescriptorExtractorPool();
+
+  // Returns an extractor that is not used by any other caller. A new extractor
+  // is created if all extractors of the pool are in use. The pool must outlive
+  // the returned handle.
+  Handle Acquire();
+
+  // The number of extractors that were created by the pool.
+  int NumExtractors() const;
+
+ private:
+  // Returns the extractor to the pool so that it may be acquired again.
+  void Release(DescriptorExtractor* descriptor_extractor);
+
+  const DescriptorExtractorType descriptor_type_;
+  const FeatureDensity feature_density_;
+  const int max_num_features_;
+  const int max_tile_dimension_;
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<DescriptorExtractor> > available_extractors_;
+  int num_extractors_;
+
+  DISALLOW_COPY_AND_ASSIGN(DescriptorExtractorPool);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_EXTRACTOR_POOL_H_
@@ -0,0 +1,106 @@
+// Copyright (C) 2015 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <Eigen/Core>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "theia/image/descriptor/create_descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor_pool.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/image.h"
+#include "theia/image/keypoint_detector/keypoint.h"
+
+namespace theia {
+
+namespace {
+const std::string kImageFilename =
+    THEIA_DATA_DIR + std::string("/image/descriptor/img1.png");
+}  // namespace
+
+TEST(DescriptorExtractorPool, ReusesReleasedExtractors) {
+  DescriptorExtractorPool pool(DescriptorExtractorType::SIFT,
+                               FeatureDensity::NORMAL);
+  DescriptorExtractor* first_extractor = nullptr;
+  {
+    DescriptorExtractorPool::Handle extractor1 = pool.Acquire();
+    DescriptorExtractorPool::Handle extractor2 = pool.Acquire();
+    EXPECT_NE(extractor1.get(), extractor2.get());
+    EXPECT_EQ(pool.NumExtractors(), 2);
+    first_extractor = extractor1.get();
+  }
+
+  // Both extractors were returned to the pool, so no new extractor is created.
+  DescriptorExtractorPool::Handle extractor1 = pool.Acquire();
+  DescriptorExtractorPool::Handle extractor2 = pool.Acquire();
+  EXPECT_TRUE(extractor1.get() == first_extractor ||
+              extractor2.get() == first_extractor);
+  EXPECT_EQ(pool.NumExtractors(), 2);
+}
+
+TEST(DescriptorExtractorPool, ReusedExtractorsExtractIdenticalFeatures) {
+  const FloatImage image(kImageFilename);
+  for (const DescriptorExtractorType descriptor_type :
+       {DescriptorExtractorType::SIFT, DescriptorExtractorType::AKAZE}) {
+    DescriptorExtractorPool pool(descriptor_type, FeatureDensity::NORMAL);
+
+    // Extract the features of the image twice with the same extractor so that
+    // the second extraction reuses the buffers of the first.
+    std::vector<Keypoint> keypoints1, keypoints2;
+    DescriptorMatrix descriptors1, descriptors2;
+    {
+      DescriptorExtractorPool::Handle extractor = pool.Acquire();
+      ASSERT_TRUE(extractor->DetectAndExtractDescriptors(
+          image, &keypoints1, &descriptors1));
+    }
+    {
+      DescriptorExtractorPool::Handle extractor = pool.Acquire();
+      ASSERT_TRUE(extractor->DetectAndExtractDescriptors(
+          image, &keypoints2, &descriptors2));
+    }
+    EXPECT_EQ(pool.NumExtractors(), 1);
+
+    ASSERT_GT(keypoints1.size(), 0);
+    ASSERT_EQ(keypoints1.size(), keypoints2.size());
+    for (int i = 0; i < keypoints1.size(); i++) {
+      EXPECT_EQ(keypoints1[i].x(), keypoints2[i].x());
+      EXPECT_EQ(keypoints1[i].y(), keypoints2[i].y());
+    }
+    EXPECT_EQ(descriptors1, descriptors2);
+  }
+}
+
+}  // namespace theia
@@ -0,0 +1,162 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_MATRIX_H_
+#define THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_MATRIX_H_
+
+#include <Eigen/Core>
+#include <stdint.h>
+#include <vector>
+
+namespace theia {
+
+// All descriptors of an image are stored in a single block of memory with one
+// descriptor per row. The row-major layout keeps each descriptor contiguous so
+// that scanning through the descriptors of an image is linear in memory, and
+// the dynamic allocation is aligned by Eigen for vectorized operations.
+typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    DescriptorMatrix;
+
+// Binary descriptors (e.g., AKAZE's M-LDB) are stored with the same layout,
+// but each row holds the bits of one descriptor packed into bytes. Bit b of a
+// descriptor is bit (b % 8) of byte (b / 8) of its row.
+typedef Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    BinaryDescriptorMatrix;
+
+// Float descriptors may also be stored quantized to one byte per dimension (see
+// descriptor_quantization.h), which reduces their memory footprint by a factor
+// of four. Quantized descriptors have the same layout as binary descriptors but
+// a different distance, so they are a distinct type that does not convert to or
+// from a BinaryDescriptorMatrix. This way an overload for binary descriptors
+// can never be called with quantized descriptors or vice versa. Only the matrix
+// operations that are needed for descriptors are exposed, and matrix() gives
+// access to the underlying matrix for anything else.
+class QuantizedDescriptorMatrix
+    : private Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic,
+                            Eigen::RowMajor> {
+ public:
+  typedef Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic,
+                        Eigen::RowMajor> MatrixType;
+
+  QuantizedDescriptorMatrix() {}
+  QuantizedDescriptorMatrix(const int rows, const int cols)
+      : MatrixType(rows, cols) {}
+
+  // Assigns an expression of quantized values, e.g. the result of casting
+  // scaled float descriptors to uint8_t.
+  template <typename OtherDerived>
+  QuantizedDescriptorMatrix& operator=(
+      const Eigen::DenseBase<OtherDerived>& other) {
+    MatrixType::operator=(other);
+    return *this;
+  }
+
+  using MatrixType::cast;
+  using MatrixType::cols;
+  using MatrixType::conservativeResize;
+  using MatrixType::data;
+  using MatrixType::resize;
+  using MatrixType::row;
+  using MatrixType::rows;
+  using MatrixType::size;
+  using MatrixType::operator();
+
+  const MatrixType& matrix() const { return *this; }
+  MatrixType& matrix() { return *this; }
+
+  bool operator==(const QuantizedDescriptorMatrix& other) const {
+    return rows() == other.rows() && cols() == other.cols() &&
+           matrix() == other.matrix();
+  }
+  bool operator!=(const QuantizedDescriptorMatrix& other) const {
+    return !(*this == other);
+  }
+
+  // Templated method for disk I/O with cereal. The quantized descriptors are
+  // written in the same way as the underlying matrix (see
+  // theia/io/eigen_serializable.h, which must be included to serialize them).
+  template <class Archive>
+  void serialize(Archive& ar) {  // NOLINT
+    ar(matrix());
+  }
+};
+
+// Helper methods to convert between the descriptor matrix and a container of
+// individual descriptors. These are only meant for compatibility with code that
+// operates on descriptors one at a time; the conversion copies every
+// descriptor.
+inline DescriptorMatrix DescriptorMatrixFromVectors(
+    const std::vector<Eigen::VectorXf>& descriptors) {
+  if (descriptors.empty()) {
+    return DescriptorMatrix();
+  }
+
+  DescriptorMatrix descriptor_matrix(descriptors.size(), descriptors[0].size());
+  for (int i = 0; i < descriptors.size(); i++) {
+    descriptor_matrix.row(i) = descriptors[i].transpose();
+  }
+  return descriptor_matrix;
+}
+
+inline std::vector<Eigen::VectorXf> DescriptorVectorsFromMatrix(
+    const DescriptorMatrix& descriptor_matrix) {
+  std::vector<Eigen::VectorXf> descriptors(descriptor_matrix.rows());
+  for (int i = 0; i < descriptor_matrix.rows(); i++) {
+    descriptors[i] = descriptor_matrix.row(i).transpose();
+  }
+  return descriptors;
+}
+
+// Removes the descriptors (i.e., rows) for which keep[i] is false. The order of
+// the remaining descriptors is preserved. This works for both float and binary
+// descriptor matrices.
+template <typename DescriptorMatrixType>
+void FilterDescriptorRows(const std::vector<bool>& keep,
+                          DescriptorMatrixType* descriptor_matrix) {
+  int num_kept = 0;
+  for (int i = 0; i < descriptor_matrix->rows(); i++) {
+    if (!keep[i]) {
+      continue;
+    }
+    if (num_kept != i) {
+      descriptor_matrix->row(num_kept) = descriptor_matrix->row(i);
+    }
+    ++num_kept;
+  }
+  descriptor_matrix->conservativeResize(num_kept, Eigen::NoChange);
+}
+
+}  // namespace theia
+
+#endif  // THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_MATRIX_H_
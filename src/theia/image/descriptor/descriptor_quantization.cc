@@ -0,0 +1,63 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/image/descriptor/descriptor_quantization.h"
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+
+namespace theia {
+
+void QuantizeDescriptors(const DescriptorMatrix& descriptors,
+                         QuantizedDescriptorMatrix* quantized_descriptors) {
+  CHECK_NOTNULL(quantized_descriptors);
+  *quantized_descriptors =
+      (descriptors.array() * kDescriptorQuantizationScale)
+          .round()
+          .max(0.0f)
+          .min(255.0f)
+          .cast<uint8_t>();
+}
+
+void DequantizeDescriptors(
+    const QuantizedDescriptorMatrix& quantized_descriptors,
+    DescriptorMatrix* descriptors) {
+  CHECK_NOTNULL(descriptors);
+  *descriptors = quantized_descriptors.cast<float>() /
+                 kDescriptorQuantizationScale;
+}
+
+}  // namespace theia
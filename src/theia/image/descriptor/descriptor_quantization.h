@@ -0,0 +1,69 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_QUANTIZATION_H_
+#define THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_QUANTIZATION_H_
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+
+namespace theia {
+
+// The precision that float descriptors (e.g., SIFT) are stored with. UINT8
+// descriptors use a quarter of the memory and disk space of FLOAT descriptors
+// and are matched with integer distance kernels.
+enum class DescriptorPrecision {
+  FLOAT = 0,
+  UINT8 = 1,
+};
+
+// Descriptors are quantized by scaling each dimension by this factor and
+// rounding to the nearest integer in [0, 255]. This is the standard scaling for
+// unit norm SIFT descriptors (e.g., as used by VLFeat and SiftGPU), for which
+// no dimension is much larger than 0.5.
+static const float kDescriptorQuantizationScale = 512.0f;
+
+// Quantizes float descriptors to one byte per dimension. Dimensions outside of
+// the representable range are clamped.
+void QuantizeDescriptors(const DescriptorMatrix& descriptors,
+                         QuantizedDescriptorMatrix* quantized_descriptors);
+
+// Converts quantized descriptors back to float descriptors. This is only
+// needed by code that does not operate on quantized descriptors directly.
+void DequantizeDescriptors(
+    const QuantizedDescriptorMatrix& quantized_descriptors,
+    DescriptorMatrix* descriptors);
+
+}  // namespace theia
+
+#endif  // THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_QUANTIZATION_H_
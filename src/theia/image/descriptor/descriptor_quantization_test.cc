@@ -0,0 +1,87 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <Eigen/Core>
+#include <type_traits>
+#include "gtest/gtest.h"
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/descriptor_quantization.h"
+
+namespace theia {
+
+TEST(DescriptorQuantization, RoundsAndClamps) {
+  DescriptorMatrix descriptors(1, 5);
+  descriptors << 0.0f, 0.1f, 0.49f, 0.6f, -0.1f;
+  QuantizedDescriptorMatrix quantized_descriptors;
+  QuantizeDescriptors(descriptors, &quantized_descriptors);
+
+  ASSERT_EQ(quantized_descriptors.rows(), 1);
+  ASSERT_EQ(quantized_descriptors.cols(), 5);
+  EXPECT_EQ(quantized_descriptors(0, 0), 0);
+  EXPECT_EQ(quantized_descriptors(0, 1), 51);
+  EXPECT_EQ(quantized_descriptors(0, 2), 251);
+  EXPECT_EQ(quantized_descriptors(0, 3), 255);
+  EXPECT_EQ(quantized_descriptors(0, 4), 0);
+}
+
+TEST(DescriptorQuantization, RoundTrip) {
+  static const int kNumDescriptors = 10;
+  static const int kNumDimensions = 128;
+  DescriptorMatrix descriptors =
+      DescriptorMatrix::Random(kNumDescriptors, kNumDimensions).cwiseAbs() *
+      0.4f;
+
+  QuantizedDescriptorMatrix quantized_descriptors;
+  QuantizeDescriptors(descriptors, &quantized_descriptors);
+  DescriptorMatrix dequantized_descriptors;
+  DequantizeDescriptors(quantized_descriptors, &dequantized_descriptors);
+
+  ASSERT_EQ(dequantized_descriptors.rows(), kNumDescriptors);
+  ASSERT_EQ(dequantized_descriptors.cols(), kNumDimensions);
+  // The rounding error is at most half of one quantization step.
+  EXPECT_LE((dequantized_descriptors - descriptors).cwiseAbs().maxCoeff(),
+            0.5f / kDescriptorQuantizationScale + 1e-6f);
+}
+
+TEST(DescriptorQuantization, QuantizedDescriptorsAreNotBinaryDescriptors) {
+  // The quantized and binary descriptors have the same layout, but they must
+  // not be mixed up by the overloads that take either of them.
+  EXPECT_FALSE((std::is_convertible<QuantizedDescriptorMatrix,
+                                    BinaryDescriptorMatrix>::value));
+  EXPECT_FALSE((std::is_convertible<BinaryDescriptorMatrix,
+                                    QuantizedDescriptorMatrix>::value));
+}
+
+}  // namespace theia
@@ -35,6 +35,7 @@
 #include "theia/image/descriptor/sift_descriptor.h"
 
 #include <algorithm>
+#include <limits>
 extern "C" {
 #include "vl/sift.h"
 }
@@ -42,8 +43,11 @@ extern "C" {
 
 #include "glog/logging.h"
 #include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/image/image.h"
 #include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/image/keypoint_detector/keypoint_selection.h"
+#include "theia/image/keypoint_detector/sift_scale_space.h"
 #include <Eigen/Core>
 
 namespace theia {
@@ -71,7 +75,7 @@ double GetValidFirstOctave(const int first_octave,
 
 SiftDescriptorExtractor::SiftDescriptorExtractor(
     const SiftParameters& detector_params)
-    : sift_params_(detector_params), sift_filter_(nullptr, vl_sift_delete) {}
+    : sift_params_(detector_params) {}
 
 SiftDescriptorExtractor::SiftDescriptorExtractor(int num_octaves,
                                                  int num_levels,
@@ -80,64 +84,74 @@ SiftDescriptorExtractor::SiftDescriptorExtractor(int num_octaves,
                    num_levels,
                    first_octave,
                    10.0f,
-                   255.0 * 0.02 / num_levels),
-      sift_filter_(nullptr, vl_sift_delete) {}
+                   255.0 * 0.02 / num_levels) {}
 
 SiftDescriptorExtractor::SiftDescriptorExtractor()
     : SiftDescriptorExtractor(-1, 3, -1) {}
 
 SiftDescriptorExtractor::~SiftDescriptorExtractor() {}
 
+void SiftDescriptorExtractor::InitializeScaleSpace(const FloatImage& image) {
+  // If the scale space has been set, but is not usable for the input image
+  // (i.e. the width and height are different) then we must make a new scale
+  // space. Adding this statement will save the function from regenerating the
+  // scale space for successive calls with images of the same size (e.g. a
+  // video sequence).
+  if (scale_space_ && scale_space_->Width() == image.Cols() &&
+      scale_space_->Height() == image.Rows()) {
+    return;
+  }
+
+  SiftParameters sift_params = sift_params_;
+  sift_params.first_octave = GetValidFirstOctave(
+      sift_params_.first_octave, image.Rows(), image.Cols());
+  scale_space_.reset(
+      new SiftScaleSpace(image.Cols(), image.Rows(), sift_params));
+}
+
+const float* SiftDescriptorExtractor::GetGrayscalePixels(
+    const FloatImage& image) {
+  // The scale space only reads the input image to compute the gaussian
+  // pyramids, so a grayscale image does not need to be copied.
+  if (image.Channels() == 1) {
+    return image.Data();
+  }
+  image.GetGrayscalePixels(&grayscale_pixels_);
+  return grayscale_pixels_.data();
+}
+
 bool SiftDescriptorExtractor::ComputeDescriptor(const FloatImage& image,
                                                 const Keypoint& keypoint,
                                                 Eigen::VectorXf* descriptor) {
   CHECK(keypoint.has_scale() && keypoint.has_orientation())
       << "Keypoint must have scale and orientation to compute a SIFT "
       << "descriptor.";
-  // If the filter has been set, but is not usable for the input image (i.e. the
-  // width and height are different) then we must make a new filter. Adding this
-  // statement will save the function from regenerating the filter for
-  // successive calls with images of the same size (e.g. a video sequence).
-  if (!sift_filter_ || (sift_filter_->width != image.Cols() ||
-                        sift_filter_->height != image.Rows())) {
-    const int first_octave = GetValidFirstOctave(
-        sift_params_.first_octave, image.Rows(), image.Cols());
-    sift_filter_.reset(vl_sift_new(image.Cols(),
-                                   image.Rows(),
-                                   sift_params_.num_octaves,
-                                   sift_params_.num_levels,
-                                   first_octave));
-  }
+  InitializeScaleSpace(image);
 
   // Create the vl sift keypoint from the one passed in.
   VlSiftKeypoint sift_keypoint;
-  vl_sift_keypoint_init(sift_filter_.get(),
+  vl_sift_keypoint_init(scale_space_->filter(),
                         &sift_keypoint,
                         keypoint.x(),
                         keypoint.y(),
                         keypoint.scale());
 
-  // The VLFeat functions take in a non-const image pointer so that it can
-  // calculate gaussian pyramids. Obviously, we do not want to break our const
-  // input, so the best solution (for now) is to copy the image.
-  FloatImage mutable_image = image.AsGrayscaleImage();
-
   // Calculate the first octave to process.
-  int vl_status =
-      vl_sift_process_first_octave(sift_filter_.get(), mutable_image.Data());
+  bool has_octave = scale_space_->ProcessFirstOctave(GetGrayscalePixels(image));
   // Proceed through the octaves we reach the same one as the keypoint.
-  while (sift_keypoint.o != sift_filter_->o_cur) {
-    vl_sift_process_next_octave(sift_filter_.get());
+  while (has_octave && sift_keypoint.o != scale_space_->filter()->o_cur) {
+    has_octave = scale_space_->ProcessNextOctave();
   }
 
-  if (vl_status == VL_ERR_EOF) {
+  if (!has_octave) {
     LOG(FATAL) << "could not extract sift descriptors";
   }
+  scale_space_->ComputeGradients();
 
   // Calculate the sift feature. Note that we are passing in a direct pointer to
   // the descriptor's underlying data.
   CHECK_NOTNULL(descriptor)->resize(128);
-  vl_sift_calc_keypoint_descriptor(sift_filter_.get(),
+  vl_sift_calc_keypoint_descriptor(scale_space_->filter(),
                                    descriptor->data(),
                                    &sift_keypoint,
                                    keypoint.orientation());
@@ -150,21 +164,8 @@ bool SiftDescriptorExtractor::ComputeDescriptor(const FloatImage& image,
 bool SiftDescriptorExtractor::ComputeDescriptors(
     const FloatImage& image,
     std::vector<Keypoint>* keypoints,
-    std::vector<Eigen::VectorXf>* descriptors) {
-  // If the filter has been set, but is not usable for the input image (i.e. the
-  // width and height are different) then we must make a new filter. Adding this
-  // statement will save the function from regenerating the filter for
-  // successive calls with images of the same size (e.g. a video sequence).
-  if (!sift_filter_ || (sift_filter_->width != image.Cols() ||
-                        sift_filter_->height != image.Rows())) {
-    const int first_octave = GetValidFirstOctave(
-        sift_params_.first_octave, image.Rows(), image.Cols());
-    sift_filter_.reset(vl_sift_new(image.Cols(),
-                                   image.Rows(),
-                                   sift_params_.num_octaves,
-                                   sift_params_.num_levels,
-                                   first_octave));
-  }
+    DescriptorMatrix* descriptors) {
+  InitializeScaleSpace(image);
 
   // Create the vl sift keypoint from the one passed in.
   std::vector<VlSiftKeypoint> sift_keypoints(keypoints->size());
@@ -172,42 +173,39 @@ bool SiftDescriptorExtractor::ComputeDescriptors(
     CHECK((*keypoints)[i].has_scale() && (*keypoints)[i].has_orientation())
         << "Keypoint must have scale and orientation to compute a SIFT "
         << "descriptor.";
-    vl_sift_keypoint_init(sift_filter_.get(),
+    vl_sift_keypoint_init(scale_space_->filter(),
                           &sift_keypoints[i],
                           (*keypoints)[i].x(),
                           (*keypoints)[i].y(),
                           (*keypoints)[i].scale());
   }
-  // The VLFeat functions take in a non-const image pointer so that it can
-  // calculate gaussian pyramids. Obviously, we do not want to break our const
-  // input, so the best solution (for now) is to copy the image.
-  FloatImage mutable_image = image.AsGrayscaleImage();
 
   // Calculate the first octave to process.
-  int vl_status =
-      vl_sift_process_first_octave(sift_filter_.get(), mutable_image.Data());
+  bool has_octave = scale_space_->ProcessFirstOctave(GetGrayscalePixels(image));
 
   // Proceed through the octaves we reach the same one as the keypoint.  We
-  // first resize the descriptors vector so that the keypoint indicies will be
-  // properly matched to the descriptors.
-  descriptors->resize(keypoints->size(), Eigen::VectorXf(128));
-  while (vl_status != VL_ERR_EOF) {
-    // Go through each keypoint to see if it came from this octave.
+  // first resize the descriptor matrix so that the keypoint indicies will be
+  // properly matched to the descriptors. Each row of the matrix is contiguous
+  // so VLFeat can write directly into it.
+  descriptors->resize(keypoints->size(), kNumSiftDimensions);
+  while (has_octave) {
+    // Go through each keypoint to see if it came from this octave. The
+    // gradients of the octave are only computed if it has a keypoint.
+    VlSiftFilt* sift_filter = scale_space_->filter();
     for (int i = 0; i < sift_keypoints.size(); i++) {
-      if (sift_keypoints[i].o != sift_filter_->o_cur) continue;
+      if (sift_keypoints[i].o != sift_filter->o_cur) continue;
 
-      vl_sift_calc_keypoint_descriptor(sift_filter_.get(),
-                                       (*descriptors)[i].data(),
+      scale_space_->ComputeGradients();
+      vl_sift_calc_keypoint_descriptor(sift_filter,
+                                       descriptors->row(i).data(),
                                        &sift_keypoints[i],
                                        (*keypoints)[i].orientation());
     }
-    vl_status = vl_sift_process_next_octave(sift_filter_.get());
+    has_octave = scale_space_->ProcessNextOctave();
   }
 
   if (sift_params_.root_sift) {
-    for (int i = 0; i < descriptors->size(); i++) {
-      ConvertToRootSift(&(*descriptors)[i]);
-    }
+    ConvertToRootSift(descriptors);
   }
 
   return true;
@@ -216,78 +214,243 @@ bool SiftDescriptorExtractor::ComputeDescriptors(
 bool SiftDescriptorExtractor::DetectAndExtractDescriptors(
     const FloatImage& image,
     std::vector<Keypoint>* keypoints,
-    std::vector<Eigen::VectorXf>* descriptors) {
-  // If the filter has been set, but is not usable for the input image (i.e. the
-  // width and height are different) then we must make a new filter. Adding this
-  // statement will save the function from regenerating the filter for
-  // successive calls with images of the same size (e.g. a video sequence).
-  if (!sift_filter_ || (sift_filter_->width != image.Cols() ||
-                        sift_filter_->height != image.Rows())) {
-    const int first_octave = GetValidFirstOctave(
-        sift_params_.first_octave, image.Rows(), image.Cols());
-    sift_filter_.reset(vl_sift_new(image.Cols(),
-                                   image.Rows(),
-                                   sift_params_.num_octaves,
-                                   sift_params_.num_levels,
-                                   first_octave));
-    vl_sift_set_edge_thresh(sift_filter_.get(), sift_params_.edge_threshold);
-    vl_sift_set_peak_thresh(sift_filter_.get(), sift_params_.peak_threshold);
+    DescriptorMatrix* descriptors) {
+  InitializeScaleSpace(image);
+  const float* grayscale_pixels = GetGrayscalePixels(image);
+
+  // The number of keypoints is not known until all octaves have been
+  // processed, so the descriptors are accumulated in a single contiguous buffer
+  // with a fixed stride and copied into the descriptor matrix at the end. The
+  // buffer keeps its capacity across images.
+  descriptor_buffer_.clear();
+
+  num_scale_space_passes_ = 1;
+  if (sift_params_.max_num_features > 0) {
+    DetectAndExtractSelectedDescriptors(image, grayscale_pixels, keypoints);
+  } else {
+    // Calculate the first octave to process.
+    VlSiftFilt* sift_filter = scale_space_->filter();
+    bool has_octave = scale_space_->ProcessFirstOctave(grayscale_pixels);
+    // Process octaves until you can't anymore.
+    int num_extra_orientations = std::numeric_limits<int>::max();
+    while (has_octave) {
+      // Detect the keypoints and extract their descriptors.
+      scale_space_->Detect();
+      ExtractDescriptorsOfOctave(vl_sift_get_keypoints(sift_filter),
+                                 scale_space_->keypoint_responses().data(),
+                                 vl_sift_get_nkeypoints(sift_filter),
+                                 &num_extra_orientations,
+                                 keypoints,
+                                 nullptr);
+      // Attempt to process the next octave.
+      has_octave = scale_space_->ProcessNextOctave();
+    }
   }
 
-  // The VLFeat functions take in a non-const image pointer so that it can
-  // calculate gaussian pyramids. Obviously, we do not want to break our const
-  // input, so the best solution (for now) is to copy the image.
-  FloatImage mutable_image = image.AsGrayscaleImage();
+  *descriptors = Eigen::Map<const DescriptorMatrix>(
+      descriptor_buffer_.data(),
+      descriptor_buffer_.size() / kNumSiftDimensions,
+      kNumSiftDimensions);
 
-  // Calculate the first octave to process.
-  int vl_status =
-      vl_sift_process_first_octave(sift_filter_.get(), mutable_image.Data());
-  // Process octaves until you can't anymore.
-  while (vl_status != VL_ERR_EOF) {
-    // Detect the keypoints.
-    vl_sift_detect(sift_filter_.get());
-
-    // Get the keypoints.
-    const VlSiftKeypoint* vl_keypoints =
-        vl_sift_get_keypoints(sift_filter_.get());
-    const int num_keypoints = vl_sift_get_nkeypoints(sift_filter_.get());
-
-    for (int i = 0; i < num_keypoints; ++i) {
-      // Calculate (up to 4) orientations of the keypoint.
-      double angles[4];
-      int num_angles = vl_sift_calc_keypoint_orientations(
-          sift_filter_.get(), angles, &vl_keypoints[i]);
-      // If upright sift is enabled, only use the first keypoint at a given
-      // pixel location.
-      if (sift_params_.upright_sift && num_angles > 1) {
-        num_angles = 1;
-      }
+  if (sift_params_.root_sift) {
+    ConvertToRootSift(descriptors);
+    CHECK(!descriptors->hasNaN());
+  }
 
-      Eigen::VectorXf descriptor(kNumSiftDimensions);
-      for (int j = 0; j < num_angles; ++j) {
-        descriptor.setZero();
-        vl_sift_calc_keypoint_descriptor(
-            sift_filter_.get(), descriptor.data(), &vl_keypoints[i], angles[j]);
-        descriptors->push_back(descriptor);
-
-        Keypoint keypoint(vl_keypoints[i].x, vl_keypoints[i].y, Keypoint::SIFT);
-        keypoint.set_scale(vl_keypoints[i].sigma);
-        keypoint.set_orientation(angles[j]);
-        keypoints->push_back(keypoint);
+  return true;
+}
+
+void SiftDescriptorExtractor::DetectAndExtractSelectedDescriptors(
+    const FloatImage& image,
+    const float* grayscale_pixels,
+    std::vector<Keypoint>* keypoints) {
+  const int max_num_features = sift_params_.max_num_features;
+  const int first_feature = keypoints->size();
+  VlSiftFilt* sift_filter = scale_space_->filter();
+
+  // Detect the keypoints of all octaves. While the number of keypoints found so
+  // far does not exceed the maximum, all of them are kept, so the octaves are
+  // described right away. Once the maximum is exceeded, the remaining octaves
+  // are only searched for keypoints.
+  std::vector<Keypoint> candidate_keypoints;
+  candidate_keypoints_.clear();
+  candidate_keypoint_responses_.clear();
+  // The index of the candidate keypoint of each feature that was extracted.
+  std::vector<int> feature_candidates;
+  int num_described_candidates = 0;
+  bool describe_octaves = true;
+  int num_extra_orientations = std::numeric_limits<int>::max();
+  bool has_octave = scale_space_->ProcessFirstOctave(grayscale_pixels);
+  while (has_octave) {
+    scale_space_->Detect();
+    const VlSiftKeypoint* vl_keypoints = vl_sift_get_keypoints(sift_filter);
+    const int num_keypoints = vl_sift_get_nkeypoints(sift_filter);
+    const int first_candidate = candidate_keypoints.size();
+    for (int i = 0; i < num_keypoints; i++) {
+      Keypoint keypoint(vl_keypoints[i].x, vl_keypoints[i].y, Keypoint::SIFT);
+      keypoint.set_scale(vl_keypoints[i].sigma);
+      keypoint.set_strength(scale_space_->keypoint_responses()[i]);
+      candidate_keypoints.emplace_back(keypoint);
+      candidate_keypoints_.emplace_back(vl_keypoints[i]);
+      candidate_keypoint_responses_.emplace_back(
+          scale_space_->keypoint_responses()[i]);
+    }
+
+    describe_octaves =
+        describe_octaves &&
+        static_cast<int>(candidate_keypoints.size()) <= max_num_features;
+    if (describe_octaves) {
+      const int num_features = feature_candidates.size();
+      ExtractDescriptorsOfOctave(vl_keypoints,
+                                 scale_space_->keypoint_responses().data(),
+                                 num_keypoints,
+                                 &num_extra_orientations,
+                                 keypoints,
+                                 &feature_candidates);
+      for (int j = num_features; j < feature_candidates.size(); j++) {
+        feature_candidates[j] += first_candidate;
       }
+      num_described_candidates = candidate_keypoints.size();
     }
-    // Attempt to process the next octave.
-    vl_status = vl_sift_process_next_octave(sift_filter_.get());
+    has_octave = scale_space_->ProcessNextOctave();
   }
 
-  if (sift_params_.root_sift) {
-    for (auto& descriptor : *descriptors) {
-      ConvertToRootSift(&descriptor);
-      CHECK(!descriptor.hasNaN());
+  // Select the keypoints to keep if there are too many of them. The selected
+  // keypoints stay ordered by octave.
+  std::vector<bool> keep_candidate(candidate_keypoints.size(), true);
+  if (!describe_octaves) {
+    SelectSpatiallyBalancedKeypoints(candidate_keypoints,
+                                     image.Cols(),
+                                     image.Rows(),
+                                     max_num_features,
+                                     &keep_candidate);
+  }
+
+  // Each selected keypoint has at least one orientation. Additional
+  // orientations are only kept while the total number of features stays within
+  // the maximum.
+  num_extra_orientations = max_num_features;
+  for (const bool keep : keep_candidate) {
+    num_extra_orientations -= keep;
+  }
+  std::vector<bool> keep_feature(feature_candidates.size());
+  for (int i = 0; i < feature_candidates.size(); i++) {
+    const bool is_extra_orientation =
+        i > 0 && feature_candidates[i] == feature_candidates[i - 1];
+    keep_feature[i] = keep_candidate[feature_candidates[i]];
+    if (keep_feature[i] && is_extra_orientation) {
+      keep_feature[i] = num_extra_orientations > 0;
+      num_extra_orientations -= keep_feature[i];
     }
   }
+  int num_kept_features = 0;
+  for (int i = 0; i < keep_feature.size(); i++) {
+    if (!keep_feature[i]) {
+      continue;
+    }
+    if (num_kept_features != i) {
+      (*keypoints)[first_feature + num_kept_features] =
+          (*keypoints)[first_feature + i];
+      std::copy_n(descriptor_buffer_.begin() + i * kNumSiftDimensions,
+                  kNumSiftDimensions,
+                  descriptor_buffer_.begin() +
+                      num_kept_features * kNumSiftDimensions);
+    }
+    ++num_kept_features;
+  }
+  keypoints->resize(first_feature + num_kept_features);
+  descriptor_buffer_.resize(num_kept_features * kNumSiftDimensions);
+  if (describe_octaves) {
+    return;
+  }
 
-  return true;
+  // The scale space is computed again to describe the selected keypoints of the
+  // octaves that were not described. The gradients of the octaves that were
+  // already described are not computed again.
+  int num_selected_keypoints = 0;
+  for (int i = num_described_candidates; i < candidate_keypoints.size(); i++) {
+    if (keep_candidate[i]) {
+      candidate_keypoints_[num_selected_keypoints] = candidate_keypoints_[i];
+      candidate_keypoint_responses_[num_selected_keypoints] =
+          candidate_keypoint_responses_[i];
+      ++num_selected_keypoints;
+    }
+  }
+
+  ++num_scale_space_passes_;
+  int first_keypoint_of_octave = 0;
+  has_octave = scale_space_->ProcessFirstOctave(grayscale_pixels);
+  while (has_octave && first_keypoint_of_octave < num_selected_keypoints) {
+    int num_keypoints_of_octave = 0;
+    while (first_keypoint_of_octave + num_keypoints_of_octave <
+               num_selected_keypoints &&
+           candidate_keypoints_[first_keypoint_of_octave +
+                                num_keypoints_of_octave].o ==
+               sift_filter->o_cur) {
+      ++num_keypoints_of_octave;
+    }
+    ExtractDescriptorsOfOctave(
+        candidate_keypoints_.data() + first_keypoint_of_octave,
+        candidate_keypoint_responses_.data() + first_keypoint_of_octave,
+        num_keypoints_of_octave,
+        &num_extra_orientations,
+        keypoints,
+        nullptr);
+    first_keypoint_of_octave += num_keypoints_of_octave;
+    has_octave = scale_space_->ProcessNextOctave();
+  }
+}
+
+void SiftDescriptorExtractor::ExtractDescriptorsOfOctave(
+    const VlSiftKeypoint* vl_keypoints,
+    const float* responses,
+    const int num_keypoints,
+    int* num_extra_orientations,
+    std::vector<Keypoint>* keypoints,
+    std::vector<int>* keypoint_indices) {
+  if (num_keypoints == 0) {
+    return;
+  }
+
+  VlSiftFilt* sift_filter = scale_space_->filter();
+  scale_space_->ComputeGradients();
+  for (int i = 0; i < num_keypoints; ++i) {
+    // Calculate (up to 4) orientations of the keypoint.
+    double angles[4];
+    int num_angles = vl_sift_calc_keypoint_orientations(
+        sift_filter, angles, &vl_keypoints[i]);
+    // If upright sift is enabled, only use the first keypoint at a given
+    // pixel location.
+    if (sift_params_.upright_sift && num_angles > 1) {
+      num_angles = 1;
+    }
+    if (num_angles > 1) {
+      const int num_extra_angles =
+          std::min(num_angles - 1, *num_extra_orientations);
+      num_angles = 1 + num_extra_angles;
+      *num_extra_orientations -= num_extra_angles;
+    }
+
+    for (int j = 0; j < num_angles; ++j) {
+      descriptor_buffer_.resize(
+          descriptor_buffer_.size() + kNumSiftDimensions, 0.0f);
+      vl_sift_calc_keypoint_descriptor(
+          sift_filter,
+          descriptor_buffer_.data() + descriptor_buffer_.size() -
+              kNumSiftDimensions,
+          &vl_keypoints[i],
+          angles[j]);
+
+      Keypoint keypoint(vl_keypoints[i].x, vl_keypoints[i].y, Keypoint::SIFT);
+      keypoint.set_scale(vl_keypoints[i].sigma);
+      keypoint.set_strength(responses[i]);
+      keypoint.set_orientation(angles[j]);
+      keypoints->push_back(keypoint);
+      if (keypoint_indices != nullptr) {
+        keypoint_indices->push_back(i);
+      }
+    }
+  }
 }
 
 // Converts to a RootSIFT descriptor which is proven to provide better matches
@@ -302,4 +465,16 @@ void SiftDescriptorExtractor::ConvertToRootSift(Eigen::VectorXf* descriptor) {
   }
 }
 
+void SiftDescriptorExtractor::ConvertToRootSift(DescriptorMatrix* descriptors) {
+  static const double kTolerance = 1e-8;
+  for (int i = 0; i < descriptors->rows(); i++) {
+    auto descriptor = descriptors->row(i);
+    const double l1_norm = descriptor.lpNorm<1>();
+    if (l1_norm > kTolerance) {
+      descriptor /= l1_norm;
+      descriptor = descriptor.array().sqrt().matrix();
+    }
+  }
+}
+
 }  // namespace theia
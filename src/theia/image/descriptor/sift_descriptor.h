@@ -35,15 +35,13 @@
 #ifndef THEIA_IMAGE_DESCRIPTOR_SIFT_DESCRIPTOR_H_
 #define THEIA_IMAGE_DESCRIPTOR_SIFT_DESCRIPTOR_H_
 
-extern "C" {
-#include <vl/sift.h>
-}
-
+#include <Eigen/Core>
 #include <memory>
 #include <vector>
 
 #include "theia/image/descriptor/descriptor_extractor.h"
 #include "theia/image/keypoint_detector/sift_parameters.h"
+#include "theia/image/keypoint_detector/sift_scale_space.h"
 #include "theia/util/util.h"
 
 namespace theia {
@@ -51,6 +49,9 @@ namespace theia {
 class FloatImage;
 class Keypoint;
 
+// The scale space, the grayscale conversion of the image and the descriptor
+// buffer are kept alive across calls, so extracting features from many images
+// of the same size with one extractor does not reallocate them for each image.
 class SiftDescriptorExtractor : public DescriptorExtractor {
  public:
   //  We only implement the standard 128-dimension descriptor. Specify the
@@ -69,20 +70,67 @@ class SiftDescriptorExtractor : public DescriptorExtractor {
   // Compute multiple descriptors for keypoints from a single image.
   bool ComputeDescriptors(const FloatImage& image,
                           std::vector<Keypoint>* keypoints,
-                          std::vector<Eigen::VectorXf>* descriptors);
+                          DescriptorMatrix* descriptors) override;
 
   // Detect keypoints using the Sift keypoint detector and extracts them at the
   // same time.
   bool DetectAndExtractDescriptors(const FloatImage& image,
                                    std::vector<Keypoint>* keypoints,
-                                   std::vector<Eigen::VectorXf>* descriptors);
+                                   DescriptorMatrix* descriptors) override;
+
+  using DescriptorExtractor::ComputeDescriptors;
+  using DescriptorExtractor::DetectAndExtractDescriptors;
 
   // This method is only public so that we can easily test it.
   static void ConvertToRootSift(Eigen::VectorXf* descriptor);
+  static void ConvertToRootSift(DescriptorMatrix* descriptors);
+
+  // The number of times that the scale space of the last image passed to
+  // DetectAndExtractDescriptors was computed. This is 2 if keypoints were
+  // discarded to extract at most max_num_features features, and 1 otherwise.
+  int NumScaleSpacePasses() const { return num_scale_space_passes_; }
 
  private:
+  // Creates a new scale space if there is no scale space yet or if the scale
+  // space was created for images of a different size.
+  void InitializeScaleSpace(const FloatImage& image);
+
+  // Returns a pointer to the grayscale pixels of the image. Grayscale images
+  // are used as they are, and other images are converted into
+  // grayscale_pixels_.
+  const float* GetGrayscalePixels(const FloatImage& image);
+
+  // Extracts at most max_num_features features. The octaves are described as
+  // they are detected while there are no more keypoints than the maximum. If
+  // there are more, the keypoints are selected with
+  // SelectSpatiallyBalancedKeypoints, and the scale space is computed a second
+  // time to describe the selected keypoints of the octaves that were not
+  // described yet.
+  void DetectAndExtractSelectedDescriptors(const FloatImage& image,
+                                           const float* grayscale_pixels,
+                                           std::vector<Keypoint>* keypoints);
+
+  // Computes the orientations and descriptors of keypoints of the current
+  // octave and appends them to the keypoints and descriptor_buffer_. At most
+  // num_extra_orientations orientations beyond the first orientation of each
+  // keypoint are added, and num_extra_orientations is decreased by the number
+  // of extra orientations that were added. If keypoint_indices is not null, the
+  // index into vl_keypoints of each added feature is appended to it.
+  void ExtractDescriptorsOfOctave(const VlSiftKeypoint* vl_keypoints,
+                                  const float* responses,
+                                  const int num_keypoints,
+                                  int* num_extra_orientations,
+                                  std::vector<Keypoint>* keypoints,
+                                  std::vector<int>* keypoint_indices);
+
   const SiftParameters sift_params_;
-  std::unique_ptr<VlSiftFilt, void (*)(VlSiftFilt*)> sift_filter_;
+  std::unique_ptr<SiftScaleSpace> scale_space_;
+  Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      grayscale_pixels_;
+  std::vector<float> descriptor_buffer_;
+  std::vector<VlSiftKeypoint> candidate_keypoints_;
+  std::vector<float> candidate_keypoint_responses_;
+  int num_scale_space_passes_ = 0;
   DISALLOW_COPY_AND_ASSIGN(SiftDescriptorExtractor);
 };
 
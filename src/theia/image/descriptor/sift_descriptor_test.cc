@@ -37,8 +37,10 @@
 #include <string>
 #include "gtest/gtest.h"
 
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/image/image.h"
 #include "theia/image/keypoint_detector/sift_detector.h"
+#include "theia/image/keypoint_detector/sift_parameters.h"
 #include "theia/image/descriptor/sift_descriptor.h"
 
 DEFINE_string(test_img, "image/descriptor/img1.png",
@@ -103,4 +105,72 @@ TEST(SiftDescriptor, DifferentImageSizes) {
                                                          &descriptors));
 }
 
+TEST(SiftDescriptor, MaxNumFeatures) {
+  FloatImage input_img(img_filename);
+
+  SiftDescriptorExtractor sift_extractor;
+  std::vector<Keypoint> keypoints;
+  DescriptorMatrix descriptors;
+  EXPECT_TRUE(sift_extractor.DetectAndExtractDescriptors(input_img,
+                                                         &keypoints,
+                                                         &descriptors));
+
+  SiftParameters sift_params;
+  sift_params.max_num_features = keypoints.size() / 2;
+  SiftDescriptorExtractor capped_sift_extractor(sift_params);
+  std::vector<Keypoint> capped_keypoints;
+  DescriptorMatrix capped_descriptors;
+  EXPECT_TRUE(capped_sift_extractor.DetectAndExtractDescriptors(
+      input_img, &capped_keypoints, &capped_descriptors));
+  EXPECT_LE(capped_keypoints.size(), sift_params.max_num_features);
+  EXPECT_EQ(capped_descriptors.rows(), capped_keypoints.size());
+  EXPECT_EQ(capped_sift_extractor.NumScaleSpacePasses(), 2);
+
+  // The selected keypoints must have the same descriptors as without the cap.
+  for (int i = 0; i < capped_keypoints.size(); i++) {
+    bool found_keypoint = false;
+    for (int j = 0; j < keypoints.size(); j++) {
+      if (capped_keypoints[i].x() == keypoints[j].x() &&
+          capped_keypoints[i].y() == keypoints[j].y() &&
+          capped_keypoints[i].scale() == keypoints[j].scale() &&
+          capped_descriptors.row(i) == descriptors.row(j)) {
+        found_keypoint = true;
+        break;
+      }
+    }
+    EXPECT_TRUE(found_keypoint);
+  }
+}
+
+TEST(SiftDescriptor, MaxNumFeaturesNotReached) {
+  FloatImage input_img(img_filename);
+
+  SiftDescriptorExtractor sift_extractor;
+  std::vector<Keypoint> keypoints;
+  DescriptorMatrix descriptors;
+  EXPECT_TRUE(sift_extractor.DetectAndExtractDescriptors(input_img,
+                                                         &keypoints,
+                                                         &descriptors));
+  EXPECT_EQ(sift_extractor.NumScaleSpacePasses(), 1);
+
+  // If there are no more features than the maximum, the features must be
+  // extracted in a single pass and be the same as without the maximum.
+  SiftParameters sift_params;
+  sift_params.max_num_features = keypoints.size();
+  SiftDescriptorExtractor capped_sift_extractor(sift_params);
+  std::vector<Keypoint> capped_keypoints;
+  DescriptorMatrix capped_descriptors;
+  EXPECT_TRUE(capped_sift_extractor.DetectAndExtractDescriptors(
+      input_img, &capped_keypoints, &capped_descriptors));
+  EXPECT_EQ(capped_sift_extractor.NumScaleSpacePasses(), 1);
+  ASSERT_EQ(capped_keypoints.size(), keypoints.size());
+  EXPECT_EQ(capped_descriptors, descriptors);
+  for (int i = 0; i < keypoints.size(); i++) {
+    EXPECT_EQ(capped_keypoints[i].x(), keypoints[i].x());
+    EXPECT_EQ(capped_keypoints[i].y(), keypoints[i].y());
+    EXPECT_EQ(capped_keypoints[i].scale(), keypoints[i].scale());
+    EXPECT_EQ(capped_keypoints[i].orientation(), keypoints[i].orientation());
+  }
+}
+
 }  // namespace theia
@@ -0,0 +1,269 @@
+// Copyright (C) 2015 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/image/descriptor/tiled_descriptor_extractor.h"
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/image.h"
+#include "theia/image/keypoint_detector/keypoint.h"
+
+namespace theia {
+namespace {
+
+// The tiles start at multiples of this many pixels. The scale space of the
+// detectors halves the resolution at each octave, so aligned tiles sample the
+// same pixels at each of the first octaves as the scale space of the whole
+// image.
+static const int kTileAlignment = 32;
+
+// The pixels [begin, end) of the image along one axis are covered by the tile,
+// and the keypoints in [owned_begin, owned_end) are kept for the tile.
+struct TileRange {
+  int begin;
+  int end;
+  int owned_begin;
+  int owned_end;
+};
+
+// Splits the pixels of one image axis into tiles of at most max_tile_size
+// pixels that overlap by at least tile_overlap pixels. The keypoints in the
+// overlap of two tiles are split at the center of the overlap.
+std::vector<TileRange> ComputeTileRanges(const int image_size,
+                                         const int max_tile_size,
+                                         const int tile_overlap) {
+  const int stride =
+      std::max((max_tile_size - tile_overlap) / kTileAlignment, 1) *
+      kTileAlignment;
+
+  std::vector<TileRange> tile_ranges;
+  TileRange tile_range;
+  tile_range.begin = 0;
+  tile_range.owned_begin = 0;
+  while (true) {
+    tile_range.end = std::min(tile_range.begin + max_tile_size, image_size);
+    if (tile_range.end == image_size) {
+      tile_range.owned_end = image_size;
+      tile_ranges.emplace_back(tile_range);
+      return tile_ranges;
+    }
+
+    const int next_begin = tile_range.begin + stride;
+    tile_range.owned_end = (next_begin + tile_range.end) / 2;
+    tile_ranges.emplace_back(tile_range);
+
+    tile_range.begin = next_begin;
+    tile_range.owned_begin = tile_ranges.back().owned_end;
+  }
+}
+
+// Copies the pixels of the tile into a row-major buffer.
+void CopyTile(const FloatImage& image,
+              const TileRange& x_range,
+              const TileRange& y_range,
+              std::vector<float>* tile_pixels) {
+  const int num_channels = image.Channels();
+  const int row_size = (x_range.end - x_range.begin) * num_channels;
+  tile_pixels->resize(row_size * (y_range.end - y_range.begin));
+  for (int y = y_range.begin; y < y_range.end; y++) {
+    const float* row =
+        image.Data() + (y * image.Width() + x_range.begin) * num_channels;
+    std::copy(row,
+              row + row_size,
+              tile_pixels->data() + (y - y_range.begin) * row_size);
+  }
+}
+
+// Runs the detector and extracts float or binary descriptors depending on the
+// type of the descriptor matrix.
+bool DetectAndExtractTileDescriptors(DescriptorExtractor* descriptor_extractor,
+                                     const FloatImage& tile,
+                                     std::vector<Keypoint>* keypoints,
+                                     DescriptorMatrix* descriptors) {
+  return descriptor_extractor->DetectAndExtractDescriptors(
+      tile, keypoints, descriptors);
+}
+
+bool DetectAndExtractTileDescriptors(DescriptorExtractor* descriptor_extractor,
+                                     const FloatImage& tile,
+                                     std::vector<Keypoint>* keypoints,
+                                     BinaryDescriptorMatrix* descriptors) {
+  return descriptor_extractor->DetectAndExtractBinaryDescriptors(
+      tile, keypoints, descriptors);
+}
+
+}  // namespace
+
+TiledDescriptorExtractor::TiledDescriptorExtractor(
+    const Options& options,
+    std::unique_ptr<DescriptorExtractor> descriptor_extractor)
+    : options_(options),
+      descriptor_extractor_(std::move(descriptor_extractor)) {
+  CHECK_NOTNULL(descriptor_extractor_.get());
+  CHECK_GE(options_.tile_overlap, 0);
+  CHECK_GT(options_.max_tile_dimension, options_.tile_overlap)
+      << "The tiles must be larger than their overlap.";
+}
+
+TiledDescriptorExtractor::~TiledDescriptorExtractor() {}
+
+bool TiledDescriptorExtractor::Initialize() {
+  return descriptor_extractor_->Initialize();
+}
+
+bool TiledDescriptorExtractor::ComputeDescriptor(const FloatImage& image,
+                                                 const Keypoint& keypoint,
+                                                 Eigen::VectorXf* descriptor) {
+  return descriptor_extractor_->ComputeDescriptor(image, keypoint, descriptor);
+}
+
+bool TiledDescriptorExtractor::ComputeDescriptors(
+    const FloatImage& image,
+    std::vector<Keypoint>* keypoints,
+    DescriptorMatrix* descriptors) {
+  return descriptor_extractor_->ComputeDescriptors(
+      image, keypoints, descriptors);
+}
+
+bool TiledDescriptorExtractor::DetectAndExtractDescriptors(
+    const FloatImage& image,
+    std::vector<Keypoint>* keypoints,
+    DescriptorMatrix* descriptors) {
+  return DetectAndExtractInTiles(image, keypoints, descriptors);
+}
+
+bool TiledDescriptorExtractor::ProducesBinaryDescriptors() const {
+  return descriptor_extractor_->ProducesBinaryDescriptors();
+}
+
+bool TiledDescriptorExtractor::DetectAndExtractBinaryDescriptors(
+    const FloatImage& image,
+    std::vector<Keypoint>* keypoints,
+    BinaryDescriptorMatrix* descriptors) {
+  return DetectAndExtractInTiles(image, keypoints, descriptors);
+}
+
+template <class DescriptorMatrixType>
+bool TiledDescriptorExtractor::DetectAndExtractInTiles(
+    const FloatImage& image,
+    std::vector<Keypoint>* keypoints,
+    DescriptorMatrixType* descriptors) {
+  if (image.Width() <= options_.max_tile_dimension &&
+      image.Height() <= options_.max_tile_dimension) {
+    return DetectAndExtractTileDescriptors(
+        descriptor_extractor_.get(), image, keypoints, descriptors);
+  }
+
+  const std::vector<TileRange> x_ranges = ComputeTileRanges(
+      image.Width(), options_.max_tile_dimension, options_.tile_overlap);
+  const std::vector<TileRange> y_ranges = ComputeTileRanges(
+      image.Height(), options_.max_tile_dimension, options_.tile_overlap);
+  VLOG(2) << "Extracting features from " << x_ranges.size() * y_ranges.size()
+          << " tiles of a " << image.Width() << " x " << image.Height()
+          << " image.";
+
+  keypoints->clear();
+  descriptors->resize(0, 0);
+  std::vector<Keypoint> tile_keypoints;
+  DescriptorMatrixType tile_descriptors;
+  std::vector<int> owned_keypoints;
+  // The descriptors of the keypoints owned by each tile are collected and
+  // copied into the output once their total number is known.
+  std::vector<DescriptorMatrixType> owned_tile_descriptors;
+  int num_descriptors = 0;
+  for (const TileRange& y_range : y_ranges) {
+    for (const TileRange& x_range : x_ranges) {
+      CopyTile(image, x_range, y_range, &tile_pixels_);
+      const FloatImage tile(x_range.end - x_range.begin,
+                            y_range.end - y_range.begin,
+                            image.Channels(),
+                            tile_pixels_.data());
+
+      tile_keypoints.clear();
+      if (!DetectAndExtractTileDescriptors(descriptor_extractor_.get(),
+                                           tile,
+                                           &tile_keypoints,
+                                           &tile_descriptors)) {
+        return false;
+      }
+
+      // Keep the keypoints that belong to this tile and move them to image
+      // coordinates.
+      owned_keypoints.clear();
+      for (int i = 0; i < tile_keypoints.size(); i++) {
+        Keypoint& keypoint = tile_keypoints[i];
+        keypoint.set_x(keypoint.x() + x_range.begin);
+        keypoint.set_y(keypoint.y() + y_range.begin);
+        if (keypoint.x() >= x_range.owned_begin &&
+            keypoint.x() < x_range.owned_end &&
+            keypoint.y() >= y_range.owned_begin &&
+            keypoint.y() < y_range.owned_end) {
+          owned_keypoints.emplace_back(i);
+        }
+      }
+      if (owned_keypoints.empty()) {
+        continue;
+      }
+
+      DescriptorMatrixType owned_descriptors(owned_keypoints.size(),
+                                             tile_descriptors.cols());
+      for (int i = 0; i < owned_keypoints.size(); i++) {
+        keypoints->emplace_back(tile_keypoints[owned_keypoints[i]]);
+        owned_descriptors.row(i) = tile_descriptors.row(owned_keypoints[i]);
+      }
+      num_descriptors += owned_descriptors.rows();
+      owned_tile_descriptors.emplace_back(std::move(owned_descriptors));
+    }
+  }
+
+  if (owned_tile_descriptors.empty()) {
+    return true;
+  }
+  descriptors->resize(num_descriptors, owned_tile_descriptors[0].cols());
+  int row = 0;
+  for (const DescriptorMatrixType& owned_descriptors : owned_tile_descriptors) {
+    descriptors->middleRows(row, owned_descriptors.rows()) = owned_descriptors;
+    row += owned_descriptors.rows();
+  }
+  return true;
+}
+
+}  // namespace theia
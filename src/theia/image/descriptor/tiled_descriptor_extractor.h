@@ -0,0 +1,125 @@
+// Copyright (C) 2015 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IMAGE_DESCRIPTOR_TILED_DESCRIPTOR_EXTRACTOR_H_
+#define THEIA_IMAGE_DESCRIPTOR_TILED_DESCRIPTOR_EXTRACTOR_H_
+
+#include <Eigen/Core>
+#include <memory>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/util/util.h"
+
+namespace theia {
+
+class FloatImage;
+class Keypoint;
+
+// Detects and extracts features from large images one tile at a time with
+// another descriptor extractor. The memory of the scale space of the detector
+// grows with the image area, so very large images (e.g., gigapixel panoramas or
+// orthomosaics) are split into overlapping tiles that are no larger than
+// max_tile_dimension pixels wide and tall, and only one tile is processed at a
+// time. Each tile only keeps the keypoints that are closer to its center than
+// to the center of the neighboring tiles, i.e. the overlaps are split in half
+// between the tiles, so no keypoint is extracted twice. Images that fit into a
+// single tile are passed to the wrapped extractor as they are.
+//
+// The overlap should be large enough to contain the support region of the
+// largest features that should be kept, since the features at the tile borders
+// are computed from the pixels of the tile only.
+class TiledDescriptorExtractor : public DescriptorExtractor {
+ public:
+  struct Options {
+    // The maximum width and height of a tile in pixels.
+    int max_tile_dimension = 4096;
+
+    // The minimum number of pixels by which adjacent tiles overlap.
+    int tile_overlap = 256;
+  };
+
+  TiledDescriptorExtractor(
+      const Options& options,
+      std::unique_ptr<DescriptorExtractor> descriptor_extractor);
+  ~TiledDescriptorExtractor();
+
+  bool Initialize() override;
+
+  // Descriptors at given keypoints are computed on the whole image by the
+  // wrapped extractor.
+  bool ComputeDescriptor(const FloatImage& image,
+                         const Keypoint& keypoint,
+                         Eigen::VectorXf* descriptor) override;
+  bool ComputeDescriptors(const FloatImage& image,
+                          std::vector<Keypoint>* keypoints,
+                          DescriptorMatrix* descriptors) override;
+
+  // Detects keypoints and extracts their descriptors tile by tile.
+  bool DetectAndExtractDescriptors(const FloatImage& image,
+                                   std::vector<Keypoint>* keypoints,
+                                   DescriptorMatrix* descriptors) override;
+
+  bool ProducesBinaryDescriptors() const override;
+
+  bool DetectAndExtractBinaryDescriptors(
+      const FloatImage& image,
+      std::vector<Keypoint>* keypoints,
+      BinaryDescriptorMatrix* descriptors) override;
+
+  using DescriptorExtractor::ComputeDescriptors;
+  using DescriptorExtractor::DetectAndExtractDescriptors;
+
+ private:
+  // Runs the wrapped extractor on each tile of the image and gathers the
+  // keypoints that belong to the tiles in image coordinates.
+  template <class DescriptorMatrixType>
+  bool DetectAndExtractInTiles(const FloatImage& image,
+                               std::vector<Keypoint>* keypoints,
+                               DescriptorMatrixType* descriptors);
+
+  const Options options_;
+  std::unique_ptr<DescriptorExtractor> descriptor_extractor_;
+
+  // The pixels of the current tile. This buffer is reused for all tiles and
+  // images.
+  std::vector<float> tile_pixels_;
+
+  DISALLOW_COPY_AND_ASSIGN(TiledDescriptorExtractor);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_IMAGE_DESCRIPTOR_TILED_DESCRIPTOR_EXTRACTOR_H_
@@ -0,0 +1,168 @@
+// Copyright (C) 2015 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "theia/image/descriptor/create_descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/tiled_descriptor_extractor.h"
+#include "theia/image/image.h"
+#include "theia/image/keypoint_detector/keypoint.h"
+
+namespace theia {
+
+namespace {
+const std::string kImageFilename =
+    THEIA_DATA_DIR + std::string("/image/descriptor/img1.png");
+
+bool SameKeypoint(const Keypoint& keypoint1, const Keypoint& keypoint2) {
+  static const double kTolerance = 1e-2;
+  return std::abs(keypoint1.x() - keypoint2.x()) < kTolerance &&
+         std::abs(keypoint1.y() - keypoint2.y()) < kTolerance &&
+         std::abs(keypoint1.scale() - keypoint2.scale()) < kTolerance &&
+         std::abs(keypoint1.orientation() - keypoint2.orientation()) <
+             kTolerance;
+}
+
+}  // namespace
+
+TEST(TiledDescriptorExtractor, ImagesThatFitIntoATileAreNotTiled) {
+  const FloatImage image(kImageFilename);
+  TiledDescriptorExtractor::Options options;
+  options.max_tile_dimension = std::max(image.Width(), image.Height());
+  TiledDescriptorExtractor tiled_extractor(
+      options,
+      CreateDescriptorExtractor(DescriptorExtractorType::SIFT,
+                                FeatureDensity::NORMAL));
+  std::unique_ptr<DescriptorExtractor> extractor = CreateDescriptorExtractor(
+      DescriptorExtractorType::SIFT, FeatureDensity::NORMAL);
+
+  std::vector<Keypoint> tiled_keypoints, keypoints;
+  DescriptorMatrix tiled_descriptors, descriptors;
+  ASSERT_TRUE(tiled_extractor.DetectAndExtractDescriptors(
+      image, &tiled_keypoints, &tiled_descriptors));
+  ASSERT_TRUE(
+      extractor->DetectAndExtractDescriptors(image, &keypoints, &descriptors));
+
+  ASSERT_EQ(tiled_keypoints.size(), keypoints.size());
+  for (int i = 0; i < keypoints.size(); i++) {
+    EXPECT_EQ(tiled_keypoints[i].x(), keypoints[i].x());
+    EXPECT_EQ(tiled_keypoints[i].y(), keypoints[i].y());
+  }
+  EXPECT_EQ(tiled_descriptors, descriptors);
+}
+
+TEST(TiledDescriptorExtractor, TilesFindTheKeypointsOfTheWholeImage) {
+  static const double kMaxScale = 8.0;
+  static const double kMinFractionOfKeypointsFound = 0.9;
+
+  const FloatImage image(kImageFilename);
+  TiledDescriptorExtractor::Options options;
+  options.max_tile_dimension = 384;
+  options.tile_overlap = 128;
+  TiledDescriptorExtractor tiled_extractor(
+      options,
+      CreateDescriptorExtractor(DescriptorExtractorType::SIFT,
+                                FeatureDensity::NORMAL));
+  std::unique_ptr<DescriptorExtractor> extractor = CreateDescriptorExtractor(
+      DescriptorExtractorType::SIFT, FeatureDensity::NORMAL);
+
+  std::vector<Keypoint> tiled_keypoints, keypoints;
+  DescriptorMatrix tiled_descriptors, descriptors;
+  ASSERT_TRUE(tiled_extractor.DetectAndExtractDescriptors(
+      image, &tiled_keypoints, &tiled_descriptors));
+  ASSERT_TRUE(
+      extractor->DetectAndExtractDescriptors(image, &keypoints, &descriptors));
+  ASSERT_EQ(tiled_keypoints.size(), tiled_descriptors.rows());
+
+  // The keypoints in the overlaps of the tiles are only kept once.
+  for (int i = 0; i < tiled_keypoints.size(); i++) {
+    EXPECT_GE(tiled_keypoints[i].x(), 0);
+    EXPECT_LT(tiled_keypoints[i].x(), image.Width());
+    EXPECT_GE(tiled_keypoints[i].y(), 0);
+    EXPECT_LT(tiled_keypoints[i].y(), image.Height());
+    for (int j = i + 1; j < tiled_keypoints.size(); j++) {
+      EXPECT_FALSE(SameKeypoint(tiled_keypoints[i], tiled_keypoints[j]));
+    }
+  }
+
+  // The smoothing of the tiles only differs from the smoothing of the whole
+  // image close to the tile borders, so the keypoints that are small compared
+  // to the overlap are found in the tiles.
+  int num_small_keypoints = 0;
+  int num_small_keypoints_found = 0;
+  for (const Keypoint& keypoint : keypoints) {
+    if (keypoint.scale() > kMaxScale) {
+      continue;
+    }
+    ++num_small_keypoints;
+    for (const Keypoint& tiled_keypoint : tiled_keypoints) {
+      if (SameKeypoint(keypoint, tiled_keypoint)) {
+        ++num_small_keypoints_found;
+        break;
+      }
+    }
+  }
+  ASSERT_GT(num_small_keypoints, 0);
+  EXPECT_GE(num_small_keypoints_found,
+            kMinFractionOfKeypointsFound * num_small_keypoints);
+}
+
+TEST(TiledDescriptorExtractor, BinaryDescriptors) {
+  const FloatImage image(kImageFilename);
+  TiledDescriptorExtractor::Options options;
+  options.max_tile_dimension = 384;
+  options.tile_overlap = 128;
+  TiledDescriptorExtractor tiled_extractor(
+      options,
+      CreateDescriptorExtractor(DescriptorExtractorType::BINARY_AKAZE,
+                                FeatureDensity::NORMAL));
+  EXPECT_TRUE(tiled_extractor.ProducesBinaryDescriptors());
+
+  std::vector<Keypoint> keypoints;
+  BinaryDescriptorMatrix descriptors;
+  ASSERT_TRUE(tiled_extractor.DetectAndExtractBinaryDescriptors(
+      image, &keypoints, &descriptors));
+  EXPECT_GT(keypoints.size(), 0);
+  EXPECT_EQ(keypoints.size(), descriptors.rows());
+}
+
+}  // namespace theia
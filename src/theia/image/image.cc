@@ -36,6 +36,7 @@
 
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
+#include <OpenImageIO/imagecache.h>
 #include <glog/logging.h>
 #include <Eigen/Core>
 
@@ -216,6 +217,28 @@ void FloatImage::ConvertToRGBImage() {
   }
 }
 
+void FloatImage::GetGrayscalePixels(
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>*
+        pixels) const {
+  CHECK_NOTNULL(pixels)->resize(Rows(), Cols());
+  const int num_channels = Channels();
+  const Eigen::Map<const Eigen::MatrixXf> interleaved_pixels(
+      Data(), num_channels, Rows() * Cols());
+  Eigen::Map<Eigen::RowVectorXf> grayscale_pixels(pixels->data(),
+                                                  Rows() * Cols());
+
+  // Images with fewer than three channels are grayscale images, possibly with
+  // an alpha channel. Otherwise the luminance is computed with the same weights
+  // as ConvertToGrayscaleImage.
+  if (num_channels < 3) {
+    grayscale_pixels = interleaved_pixels.row(0);
+  } else {
+    const Eigen::Vector3f luma_weights(.2126, .7152, .0722);
+    grayscale_pixels.noalias() =
+        luma_weights.transpose() * interleaved_pixels.topRows<3>();
+  }
+}
+
 FloatImage FloatImage::AsGrayscaleImage() const {
   if (Channels() == 1) {
     VLOG(2) << "Image is already a grayscale image. No conversion necessary.";
@@ -246,6 +269,92 @@ void FloatImage::Read(const std::string& filename) {
   image_.read(0, 0, true, oiio::TypeDesc::FLOAT);
 }
 
+int FloatImage::ReadWithMaxDimension(const std::string& filename,
+                                     const int max_dimension) {
+  // The spec is read from the file header without decoding any pixels.
+  oiio::ImageBuf source(filename);
+  CHECK(source.init_spec(filename, 0, 0))
+      << "Could not read the image " << filename << ": " << source.geterror();
+  const int full_resolution_dimension =
+      std::max(source.spec().width, source.spec().height);
+  if (max_dimension <= 0 || full_resolution_dimension <= max_dimension) {
+    Read(filename);
+    return 1;
+  }
+
+  // Use the coarsest MIP level that is at least max_dimension pixels wide or
+  // tall so that the decoder does the bulk of the downsampling.
+  int miplevel = 0;
+  int mip_factor = 1;
+  while (miplevel + 1 < source.nmiplevels() &&
+         full_resolution_dimension / (2 * mip_factor) >= max_dimension) {
+    ++miplevel;
+    mip_factor *= 2;
+  }
+  if (miplevel > 0) {
+    source.reset(filename, 0, miplevel);
+    CHECK(source.init_spec(filename, 0, miplevel))
+        << "Could not read MIP level " << miplevel << " of the image "
+        << filename << ": " << source.geterror();
+  }
+
+  // Average the pixels over area_factor x area_factor blocks. The remaining
+  // rows and columns at the bottom and right border that do not fill a whole
+  // block are dropped.
+  const int width = source.spec().width;
+  const int height = source.spec().height;
+  const int num_channels = source.nchannels();
+  const int area_factor =
+      (std::max(width, height) + max_dimension - 1) / max_dimension;
+  const int downsampled_width = std::max(width / area_factor, 1);
+  const int downsampled_height = std::max(height / area_factor, 1);
+  image_.reset(oiio::ImageSpec(downsampled_width,
+                               downsampled_height,
+                               num_channels,
+                               oiio::TypeDesc::FLOAT));
+
+  // Only one stripe of area_factor rows is converted to floating point at a
+  // time. The pixels of the stripe are interleaved, so each block of
+  // area_factor pixels is a column of num_channels * area_factor values.
+  const int stripe_width = std::min(downsampled_width * area_factor, width);
+  const int stripe_height = std::min(area_factor, height);
+  const int block_size = num_channels * (stripe_width / downsampled_width);
+  std::vector<float> stripe(stripe_width * stripe_height * num_channels);
+  Eigen::ArrayXf stripe_sum(stripe_width * num_channels);
+  const float normalization = 1.0f / (stripe_width * stripe_height /
+                                      downsampled_width);
+  for (int y = 0; y < downsampled_height; y++) {
+    const oiio::ROI roi(0, stripe_width,
+                        y * stripe_height, (y + 1) * stripe_height,
+                        0, 1,
+                        0, num_channels);
+    CHECK(source.get_pixels(roi, oiio::TypeDesc::FLOAT, stripe.data()))
+        << "Could not read the image " << filename << ": "
+        << source.geterror();
+
+    // Sum the rows of the stripe, then the pixels of each block.
+    stripe_sum = Eigen::Map<const Eigen::ArrayXXf>(
+        stripe.data(), stripe_width * num_channels, stripe_height)
+        .rowwise().sum();
+    const Eigen::Map<const Eigen::ArrayXXf> blocks(
+        stripe_sum.data(), block_size, downsampled_width);
+    Eigen::Map<Eigen::ArrayXXf> downsampled_row(
+        Data() + y * downsampled_width * num_channels,
+        num_channels,
+        downsampled_width);
+    downsampled_row = blocks.topRows(num_channels);
+    for (int i = num_channels; i < block_size; i += num_channels) {
+      downsampled_row += blocks.middleRows(i, num_channels);
+    }
+    downsampled_row *= normalization;
+  }
+
+  // Release the pixels that the image cache may hold for the file.
+  source.clear();
+  oiio::ImageCache::create(true)->invalidate(oiio::ustring(filename));
+  return mip_factor * area_factor;
+}
+
 void FloatImage::Write(const std::string& filename) const {
   image_.write(filename);
 }
@@ -133,11 +133,32 @@ class FloatImage {
   void ConvertToGrayscaleImage();
   void ConvertToRGBImage();
 
+  // Writes the grayscale intensity of each pixel to a row-major matrix with the
+  // same number of rows and columns as the image. The matrix is only resized if
+  // its size differs from the image size, so reusing the same matrix for many
+  // images of the same size avoids reallocating it for each image.
+  void GetGrayscalePixels(
+      Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>*
+          pixels) const;
+
   // Scale all the pixel values by a scale factor.
   void ScalePixels(float scale);
 
   // Write image to file.
   void Read(const std::string& filename);
+
+  // Reads the image and downsamples it by an integer factor so that neither its
+  // width nor its height is larger than max_dimension. Files that store
+  // multiple resolutions (e.g. tiled pyramidal TIFF) are decoded from the
+  // coarsest level that is still large enough. Otherwise the pixels are
+  // averaged over the downsampling area in stripes of rows, so the full
+  // resolution image is never converted to floating point. Returns the
+  // downsampling factor: pixel (x, y) of the image covers the full resolution
+  // pixels from (factor * x, factor * y) to (factor * x + factor - 1,
+  // factor * y + factor - 1). The image is read as it is and 1 is returned if
+  // max_dimension is not positive or the image is small enough.
+  int ReadWithMaxDimension(const std::string& filename,
+                           const int max_dimension);
   void Write(const std::string& filename) const;
 
   // Get a pointer to the data.
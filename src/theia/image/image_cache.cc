@@ -38,8 +38,8 @@
 #include <string>
 
 #include "theia/image/image.h"
+#include "theia/util/concurrent_lru_cache.h"
 #include "theia/util/filesystem.h"
-#include "theia/util/lru_cache.h"
 #include "theia/util/string.h"
 
 namespace theia {
@@ -57,6 +57,29 @@ ImageCache::ImageCache(const std::string& image_directory,
   images_.reset(new ImageLRUCache(fetch_images, max_num_images_in_cache));
 }
 
+ImageCache::ImageCache(const std::string& image_directory,
+                       const size_t max_cache_size_in_bytes)
+    : image_directory_(image_directory) {
+  AppendTrailingSlashIfNeeded(&image_directory_);
+
+  // Set up the LRU image cache. Images are large compared to the capacity, so a
+  // single shard is used in order to evict images in LRU order across the whole
+  // cache.
+  const std::function<std::shared_ptr<const FloatImage>(const std::string)>
+      fetch_images = std::bind(&ImageCache::FetchImagesFromDisk,
+                               this,
+                               std::placeholders::_1);
+  const std::function<size_t(const std::shared_ptr<const FloatImage>&)>
+      image_size = [](const std::shared_ptr<const FloatImage>& image) {
+        return sizeof(FloatImage) + static_cast<size_t>(image->Width()) *
+                                        image->Height() * image->Channels() *
+                                        sizeof(float);
+      };
+  static const int kNumShards = 1;
+  images_.reset(new ImageLRUCache(
+      fetch_images, image_size, max_cache_size_in_bytes, kNumShards));
+}
+
 ImageCache::~ImageCache() {}
 
 const std::shared_ptr<const FloatImage> ImageCache::FetchImage(
@@ -38,7 +38,7 @@
 #include <memory>
 #include <string>
 
-#include "theia/util/lru_cache.h"
+#include "theia/util/concurrent_lru_cache.h"
 
 namespace theia {
 class FloatImage;
@@ -57,6 +57,11 @@ public:
  // depending on how much memory is available.
  ImageCache(const std::string& image_directory,
             const int max_num_images_in_cache);
+
+ // Same as above, but the capacity of the cache is the total number of bytes
+ // of the images that may be in the cache at any given time.
+ ImageCache(const std::string& image_directory,
+            const size_t max_cache_size_in_bytes);
  ~ImageCache();
 
  // Returns the image corresponding to the view id, or a nullptr if the view
@@ -68,7 +73,8 @@ public:
      const std::string& image_filename) const;
 
  private:
-  typedef LRUCache<std::string, std::shared_ptr<const theia::FloatImage> >
+  typedef ConcurrentLRUCache<std::string,
+                             std::shared_ptr<const theia::FloatImage> >
       ImageLRUCache;
 
   // Method to fetch images from disk.
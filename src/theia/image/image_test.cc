@@ -33,6 +33,7 @@
 // Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
 
 #include <Eigen/Core>
+#include <algorithm>
 #include <gflags/gflags.h>
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
@@ -200,6 +201,45 @@ TEST(Image, Resize) {
   EXPECT_EQ(theia_img.Height(), kHeight);
 }
 
+TEST(Image, ReadWithMaxDimension) {
+  static const float kTolerance = 1e-5;
+
+  FloatImage theia_img(img_filename);
+  const int max_dimension = std::max(theia_img.Width(), theia_img.Height()) / 3;
+
+  // Images that are small enough are read as they are.
+  FloatImage full_resolution_img;
+  EXPECT_EQ(full_resolution_img.ReadWithMaxDimension(img_filename, 0), 1);
+  EXPECT_EQ(full_resolution_img.Width(), theia_img.Width());
+  EXPECT_EQ(full_resolution_img.Height(), theia_img.Height());
+
+  FloatImage downsampled_img;
+  const int factor =
+      downsampled_img.ReadWithMaxDimension(img_filename, max_dimension);
+  EXPECT_GT(factor, 1);
+  EXPECT_LE(downsampled_img.Width(), max_dimension);
+  EXPECT_LE(downsampled_img.Height(), max_dimension);
+  EXPECT_EQ(downsampled_img.Width(), theia_img.Width() / factor);
+  EXPECT_EQ(downsampled_img.Height(), theia_img.Height() / factor);
+  ASSERT_EQ(downsampled_img.Channels(), theia_img.Channels());
+
+  // Each pixel is the average of the pixels it covers in the full image.
+  for (int y = 0; y < downsampled_img.Height(); y++) {
+    for (int x = 0; x < downsampled_img.Width(); x++) {
+      for (int c = 0; c < downsampled_img.Channels(); c++) {
+        double sum = 0;
+        for (int i = 0; i < factor; i++) {
+          for (int j = 0; j < factor; j++) {
+            sum += theia_img.GetXY(factor * x + j, factor * y + i, c);
+          }
+        }
+        ASSERT_NEAR(downsampled_img.GetXY(x, y, c), sum / (factor * factor),
+                    kTolerance);
+      }
+    }
+  }
+}
+
 TEST(Image, ResizeUninitialized) {
   static const int kWidth = 800;
   static const int kHeight = 600;
@@ -115,6 +115,24 @@ class Keypoint {
   }
 };
 
+// Maps keypoints that were detected in an image which was downsampled by an
+// integer factor (see FloatImage::ReadWithMaxDimension) to the full resolution
+// image. Each downsampled pixel is centered on the area of full resolution
+// pixels that it covers.
+inline void ScaleKeypointsToFullResolution(const int downsampling_factor,
+                                           std::vector<Keypoint>* keypoints) {
+  if (downsampling_factor == 1) {
+    return;
+  }
+  for (Keypoint& keypoint : *keypoints) {
+    keypoint.set_x((keypoint.x() + 0.5) * downsampling_factor - 0.5);
+    keypoint.set_y((keypoint.y() + 0.5) * downsampling_factor - 0.5);
+    if (keypoint.has_scale()) {
+      keypoint.set_scale(keypoint.scale() * downsampling_factor);
+    }
+  }
+}
+
 }  // namespace theia
 
 CEREAL_CLASS_VERSION(theia::Keypoint, 0);
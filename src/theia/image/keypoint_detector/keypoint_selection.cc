@@ -0,0 +1,124 @@
+// Copyright (C) 2013 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/image/keypoint_detector/keypoint_selection.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include "theia/image/keypoint_detector/keypoint.h"
+
+namespace theia {
+namespace {
+
+// The grid has about this many cells per selected keypoint, so that a
+// spatially uniform set of keypoints fills each cell with a few keypoints.
+static const double kNumCellsPerKeypoint = 0.25;
+
+// Returns the index of the grid cell along one axis.
+int GetCell(const double position,
+            const double cell_size,
+            const int num_cells) {
+  const int cell = static_cast<int>(std::floor(position / cell_size));
+  return std::min(std::max(cell, 0), num_cells - 1);
+}
+
+}  // namespace
+
+void SelectSpatiallyBalancedKeypoints(const std::vector<Keypoint>& keypoints,
+                                      const int image_width,
+                                      const int image_height,
+                                      const int max_num_keypoints,
+                                      std::vector<bool>* keep) {
+  CHECK_GT(image_width, 0);
+  CHECK_GT(image_height, 0);
+  CHECK_GE(max_num_keypoints, 0);
+  const int num_keypoints = keypoints.size();
+  if (num_keypoints <= max_num_keypoints) {
+    CHECK_NOTNULL(keep)->assign(num_keypoints, true);
+    return;
+  }
+  CHECK_NOTNULL(keep)->assign(num_keypoints, false);
+  if (max_num_keypoints == 0) {
+    return;
+  }
+
+  // Size the square cells so that the grid has the desired number of cells.
+  const double num_cells =
+      std::max(kNumCellsPerKeypoint * max_num_keypoints, 1.0);
+  const double cell_size =
+      std::sqrt(static_cast<double>(image_width) * image_height / num_cells);
+  const int num_cols =
+      std::max(static_cast<int>(std::ceil(image_width / cell_size)), 1);
+  const int num_rows =
+      std::max(static_cast<int>(std::ceil(image_height / cell_size)), 1);
+
+  // Order the keypoints by decreasing strength.
+  const auto strength = [&keypoints](const int i) {
+    return keypoints[i].has_strength() ? keypoints[i].strength()
+                                       : -std::numeric_limits<double>::max();
+  };
+  std::vector<int> order(num_keypoints);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&strength](const int i,
+                                                           const int j) {
+    return strength(i) > strength(j);
+  });
+
+  // Rank the keypoints by strength within their cell.
+  std::vector<int> num_keypoints_in_cell(num_cols * num_rows, 0);
+  std::vector<int> rank(num_keypoints);
+  for (const int i : order) {
+    const int cell =
+        GetCell(keypoints[i].y(), cell_size, num_rows) * num_cols +
+        GetCell(keypoints[i].x(), cell_size, num_cols);
+    rank[i] = num_keypoints_in_cell[cell]++;
+  }
+
+  // Select the keypoints round by round. The stable sort keeps the keypoints of
+  // each round ordered by decreasing strength.
+  std::stable_sort(order.begin(), order.end(), [&rank](const int i,
+                                                       const int j) {
+    return rank[i] < rank[j];
+  });
+  for (int i = 0; i < max_num_keypoints; i++) {
+    (*keep)[order[i]] = true;
+  }
+}
+
+}  // namespace theia
@@ -0,0 +1,63 @@
+// Copyright (C) 2013 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IMAGE_KEYPOINT_DETECTOR_KEYPOINT_SELECTION_H_
+#define THEIA_IMAGE_KEYPOINT_DETECTOR_KEYPOINT_SELECTION_H_
+
+#include <vector>
+
+namespace theia {
+class Keypoint;
+
+// Selects at most max_num_keypoints of the keypoints such that the selected
+// keypoints are strong and spread evenly over the image. The image is divided
+// into a grid of square cells and the keypoints are ranked by strength within
+// their cell. Keypoints are then selected in rounds: each round takes the
+// strongest remaining keypoint of every cell, starting with the strongest one,
+// until max_num_keypoints keypoints are selected. This way the best keypoints
+// of sparsely textured regions are kept before the weaker keypoints of densely
+// textured regions. Keypoints without a strength are ranked below all keypoints
+// with a strength.
+//
+// keep[i] is set to true if keypoint i is selected. All keypoints are selected
+// if there are at most max_num_keypoints.
+void SelectSpatiallyBalancedKeypoints(const std::vector<Keypoint>& keypoints,
+                                      const int image_width,
+                                      const int image_height,
+                                      const int max_num_keypoints,
+                                      std::vector<bool>* keep);
+
+}  // namespace theia
+
+#endif  // THEIA_IMAGE_KEYPOINT_DETECTOR_KEYPOINT_SELECTION_H_
@@ -0,0 +1,120 @@
+// Copyright (C) 2013 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <algorithm>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/image/keypoint_detector/keypoint_selection.h"
+
+namespace theia {
+
+namespace {
+
+static const int kImageSize = 1000;
+
+Keypoint MakeKeypoint(const double x, const double y, const double strength) {
+  Keypoint keypoint(x, y, Keypoint::OTHER);
+  keypoint.set_strength(strength);
+  return keypoint;
+}
+
+}  // namespace
+
+TEST(SelectSpatiallyBalancedKeypoints, KeepsAllKeypointsIfThereAreFewEnough) {
+  const std::vector<Keypoint> keypoints = {MakeKeypoint(10, 10, 1.0),
+                                           MakeKeypoint(20, 20, 2.0),
+                                           MakeKeypoint(30, 30, 3.0)};
+  std::vector<bool> keep;
+  SelectSpatiallyBalancedKeypoints(keypoints, kImageSize, kImageSize, 3, &keep);
+  EXPECT_EQ(keep, std::vector<bool>(3, true));
+}
+
+TEST(SelectSpatiallyBalancedKeypoints, KeepsTheStrongestKeypoints) {
+  // Keypoints at the same location are ranked by their strength only.
+  std::vector<Keypoint> keypoints;
+  for (int i = 0; i < 100; i++) {
+    keypoints.emplace_back(MakeKeypoint(500, 500, (i * 37) % 100));
+  }
+
+  std::vector<bool> keep;
+  SelectSpatiallyBalancedKeypoints(keypoints, kImageSize, kImageSize, 10,
+                                   &keep);
+  ASSERT_EQ(keep.size(), keypoints.size());
+  EXPECT_EQ(std::count(keep.begin(), keep.end(), true), 10);
+  for (int i = 0; i < keypoints.size(); i++) {
+    EXPECT_EQ(keep[i], keypoints[i].strength() >= 90);
+  }
+}
+
+TEST(SelectSpatiallyBalancedKeypoints, KeepsKeypointsOfSparseRegions) {
+  static const int kMaxNumKeypoints = 20;
+
+  // A dense cluster of strong keypoints in a corner of the image and weak
+  // keypoints spread over the image.
+  std::vector<Keypoint> keypoints;
+  for (int i = 0; i < 100; i++) {
+    keypoints.emplace_back(MakeKeypoint(i % 10, i / 10, 10.0 + i));
+  }
+  const int num_clustered_keypoints = keypoints.size();
+  for (const int y : {250, 750}) {
+    for (const int x : {250, 750}) {
+      if (x > 500 || y > 500) {
+        keypoints.emplace_back(MakeKeypoint(x, y, 1.0));
+      }
+    }
+  }
+  const int num_spread_keypoints = keypoints.size() - num_clustered_keypoints;
+  ASSERT_LT(num_spread_keypoints, kMaxNumKeypoints);
+
+  std::vector<bool> keep;
+  SelectSpatiallyBalancedKeypoints(keypoints, kImageSize, kImageSize,
+                                   kMaxNumKeypoints, &keep);
+  EXPECT_EQ(std::count(keep.begin(), keep.end(), true), kMaxNumKeypoints);
+
+  // All weak keypoints are kept since they are alone in their regions, and the
+  // remaining keypoints are the strongest ones of the cluster.
+  for (int i = num_clustered_keypoints; i < keypoints.size(); i++) {
+    EXPECT_TRUE(keep[i]);
+  }
+  const int num_kept_clustered_keypoints =
+      kMaxNumKeypoints - num_spread_keypoints;
+  for (int i = 0; i < num_clustered_keypoints; i++) {
+    EXPECT_EQ(keep[i], i >= num_clustered_keypoints -
+                                num_kept_clustered_keypoints);
+  }
+}
+
+}  // namespace theia
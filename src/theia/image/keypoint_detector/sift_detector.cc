@@ -42,54 +42,54 @@ extern "C" {
 
 #include "theia/image/image.h"
 #include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/image/keypoint_detector/keypoint_selection.h"
 
 namespace theia {
-SiftDetector::~SiftDetector() {
-  if (sift_filter_ != nullptr)
-    vl_sift_delete(sift_filter_);
-}
+SiftDetector::~SiftDetector() {}
 
 bool SiftDetector::DetectKeypoints(const FloatImage& image,
                                    std::vector<Keypoint>* keypoints) {
-  // If the filter has been set, but is not usable for the input image (i.e. the
-  // width and height are different) then we must make a new filter. Adding this
-  // statement will save the function from regenerating the filter for
-  // successive calls with images of the same size (e.g. a video sequence).
-  if (sift_filter_ == nullptr || (sift_filter_->width != image.Cols() ||
-                                  sift_filter_->height != image.Rows())) {
-    vl_sift_delete(sift_filter_);
-    sift_filter_ = vl_sift_new(image.Cols(), image.Rows(),
-                               sift_params_.num_octaves,
-                               sift_params_.num_levels,
-                               sift_params_.first_octave);
-    vl_sift_set_edge_thresh(sift_filter_, sift_params_.edge_threshold);
-    vl_sift_set_peak_thresh(sift_filter_, sift_params_.peak_threshold);
+  // If the scale space has been set, but is not usable for the input image
+  // (i.e. the width and height are different) then we must make a new scale
+  // space. Adding this statement will save the function from regenerating the
+  // scale space for successive calls with images of the same size (e.g. a
+  // video sequence).
+  if (scale_space_ == nullptr || (scale_space_->Width() != image.Cols() ||
+                                  scale_space_->Height() != image.Rows())) {
+    scale_space_.reset(
+        new SiftScaleSpace(image.Cols(), image.Rows(), sift_params_));
   }
 
-  // The VLFeat functions take in a non-const image pointer so that it can
-  // calculate gaussian pyramids. Obviously, we do not want to break our const
-  // input, so the best solution (for now) is to copy the image.
-  FloatImage mutable_image(image.AsGrayscaleImage());
+  // The scale space only reads the input image, so a grayscale image does not
+  // need to be copied.
+  const float* grayscale_pixels = image.Data();
+  if (image.Channels() != 1) {
+    image.GetGrayscalePixels(&grayscale_pixels_);
+    grayscale_pixels = grayscale_pixels_.data();
+  }
 
   // Calculate the first octave to process.
-  int vl_status = vl_sift_process_first_octave(sift_filter_,
-                                               mutable_image.Data());
+  bool has_octave = scale_space_->ProcessFirstOctave(grayscale_pixels);
   // Reserve an amount that is slightly larger than what a typical detector
   // would return.
   keypoints->reserve(2000);
 
   // Process octaves until you can't anymore.
-  while (vl_status != VL_ERR_EOF) {
+  VlSiftFilt* sift_filter = scale_space_->filter();
+  while (has_octave) {
     // Detect the keypoints.
-    vl_sift_detect(sift_filter_);
+    scale_space_->Detect();
     // Get the keypoints.
-    const VlSiftKeypoint* vl_keypoints = vl_sift_get_keypoints(sift_filter_);
-    int num_keypoints = vl_sift_get_nkeypoints(sift_filter_);
+    const VlSiftKeypoint* vl_keypoints = vl_sift_get_keypoints(sift_filter);
+    int num_keypoints = vl_sift_get_nkeypoints(sift_filter);
+    if (num_keypoints > 0) {
+      scale_space_->ComputeGradients();
+    }
 
     for (int i = 0; i < num_keypoints; i++) {
       // Calculate (up to 4) orientations of the keypoint.
       double angles[4];
-      int num_angles = vl_sift_calc_keypoint_orientations(sift_filter_,
+      int num_angles = vl_sift_calc_keypoint_orientations(sift_filter,
                                                           angles,
                                                           &vl_keypoints[i]);
       // If upright sift is enabled, only use the first keypoint at a given
@@ -100,12 +100,31 @@ bool SiftDetector::DetectKeypoints(const FloatImage& image,
       for (int j = 0; j < num_angles; j++) {
         Keypoint keypoint(vl_keypoints[i].x, vl_keypoints[i].y, Keypoint::SIFT);
         keypoint.set_scale(vl_keypoints[i].sigma);
+        keypoint.set_strength(scale_space_->keypoint_responses()[i]);
         keypoint.set_orientation(angles[j]);
         keypoints->push_back(keypoint);
       }
     }
     // Attempt to process the next octave.
-    vl_status = vl_sift_process_next_octave(sift_filter_);
+    has_octave = scale_space_->ProcessNextOctave();
+  }
+
+  // Keep the strongest keypoints while spreading them over the image.
+  if (sift_params_.max_num_features > 0 &&
+      keypoints->size() > sift_params_.max_num_features) {
+    std::vector<bool> keep;
+    SelectSpatiallyBalancedKeypoints(*keypoints,
+                                     image.Cols(),
+                                     image.Rows(),
+                                     sift_params_.max_num_features,
+                                     &keep);
+    int num_kept = 0;
+    for (int i = 0; i < keypoints->size(); i++) {
+      if (keep[i]) {
+        (*keypoints)[num_kept++] = (*keypoints)[i];
+      }
+    }
+    keypoints->resize(num_kept);
   }
   return true;
 }
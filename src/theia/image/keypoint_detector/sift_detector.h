@@ -35,14 +35,13 @@
 #ifndef THEIA_IMAGE_KEYPOINT_DETECTOR_SIFT_DETECTOR_H_
 #define THEIA_IMAGE_KEYPOINT_DETECTOR_SIFT_DETECTOR_H_
 
-extern "C" {
-#include <vl/sift.h>
-}
-
+#include <Eigen/Core>
+#include <memory>
 #include <vector>
 
 #include "theia/image/keypoint_detector/keypoint_detector.h"
 #include "theia/image/keypoint_detector/sift_parameters.h"
+#include "theia/image/keypoint_detector/sift_scale_space.h"
 #include "theia/util/util.h"
 
 namespace theia {
@@ -50,18 +49,18 @@ class FloatImage;
 class Keypoint;
 
 // SIFT detector as originally proposed by David Lowe. This relies on the open
-// source software VLFeat (www.vlfeat.org) to detect keypoints.
+// source software VLFeat (www.vlfeat.org) to compute the keypoint orientations,
+// and on SiftScaleSpace for the scale space and the keypoint detection.
 class SiftDetector : public KeypointDetector {
  public:
   //  We only implement the standard 128-dimension descriptor. Specify the
   //  number of image octaves, number of scale levels per octave, and where the
   //  first octave should start.
   explicit SiftDetector(const SiftParameters& sift_params) :
-      sift_params_(sift_params), sift_filter_(nullptr) {}
+      sift_params_(sift_params) {}
   SiftDetector(int num_octaves, int num_levels, int first_octave)
-      : sift_params_(num_octaves, num_levels, first_octave),
-        sift_filter_(nullptr) {}
-  SiftDetector() : sift_filter_(nullptr) {}
+      : sift_params_(num_octaves, num_levels, first_octave) {}
+  SiftDetector() {}
   ~SiftDetector();
 
   // Given an image, detect keypoints using the sift descriptor.
@@ -69,7 +68,9 @@ class SiftDetector : public KeypointDetector {
                        std::vector<Keypoint>* keypoints);
  private:
   const SiftParameters sift_params_;
-  VlSiftFilt* sift_filter_;
+  std::unique_ptr<SiftScaleSpace> scale_space_;
+  Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+      grayscale_pixels_;
 
   DISALLOW_COPY_AND_ASSIGN(SiftDetector);
 };
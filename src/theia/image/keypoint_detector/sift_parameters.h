@@ -70,6 +70,11 @@ struct SiftParameters {
   // location. This is useful for SfM for a number of reasons, especially during
   // geometric verification.
   bool upright_sift = true;
+  // If positive, at most this many keypoints are kept. The keypoints are
+  // selected by their response in a way that spreads them over the image (see
+  // SelectSpatiallyBalancedKeypoints), and orientations and descriptors are
+  // only computed for the selected keypoints.
+  int max_num_features = 0;
 };
 
 }  // namespace theia
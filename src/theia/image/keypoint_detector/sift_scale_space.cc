@@ -0,0 +1,593 @@
+// Copyright (C) 2013 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/image/keypoint_detector/sift_scale_space.h"
+
+extern "C" {
+#include <vl/generic.h>
+#include <vl/sift.h>
+}
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace theia {
+namespace {
+
+typedef Eigen::Map<Eigen::ArrayXf> ArrayXfMap;
+typedef Eigen::Map<const Eigen::ArrayXf> ConstArrayXfMap;
+
+// Doubles the size of the row-major image by linear interpolation of the rows
+// and then of the columns, replicating the last row and column as VLFeat does.
+void UpsampleImage(const float* image,
+                   const int width,
+                   const int height,
+                   float* upsampled_image) {
+  const int upsampled_width = 2 * width;
+  for (int y = 0; y < height; y++) {
+    const float* row = image + y * width;
+    float* upsampled_row = upsampled_image + 2 * y * upsampled_width;
+    for (int x = 0; x < width - 1; x++) {
+      upsampled_row[2 * x] = row[x];
+      upsampled_row[2 * x + 1] = 0.5f * (row[x] + row[x + 1]);
+    }
+    upsampled_row[upsampled_width - 2] = row[width - 1];
+    upsampled_row[upsampled_width - 1] = row[width - 1];
+  }
+
+  // The odd rows interpolate the even rows that were just computed.
+  for (int y = 0; y < height - 1; y++) {
+    ArrayXfMap(upsampled_image + (2 * y + 1) * upsampled_width,
+               upsampled_width) =
+        0.5f * (ConstArrayXfMap(upsampled_image + 2 * y * upsampled_width,
+                                upsampled_width) +
+                ConstArrayXfMap(upsampled_image + (2 * y + 2) * upsampled_width,
+                                upsampled_width));
+  }
+  std::memcpy(upsampled_image + (2 * height - 1) * upsampled_width,
+              upsampled_image + (2 * height - 2) * upsampled_width,
+              sizeof(float) * upsampled_width);
+}
+
+// Keeps every step-th pixel of every step-th row of the row-major image. The
+// downsampled image is floor(width / step) pixels wide and floor(height / step)
+// pixels high.
+void DownsampleImage(const float* image,
+                     const int width,
+                     const int height,
+                     const int step,
+                     float* downsampled_image) {
+  const int downsampled_width = width / step;
+  const int downsampled_height = height / step;
+  for (int y = 0; y < downsampled_height; y++) {
+    ArrayXfMap(downsampled_image + y * downsampled_width, downsampled_width) =
+        Eigen::Map<const Eigen::ArrayXf, 0, Eigen::InnerStride<> >(
+            image + y * step * width,
+            downsampled_width,
+            Eigen::InnerStride<>(step));
+  }
+}
+
+// Returns true if the difference of Gaussians at dog compares favorably to its
+// 26 neighbors in space and scale, i.e., compare(*dog, neighbor) holds for all
+// neighbors.
+template <class Compare>
+bool IsExtremum(const float* dog,
+                const int y_stride,
+                const int s_stride,
+                const Compare& compare) {
+  const float value = *dog;
+  for (int ds = -1; ds <= 1; ds++) {
+    for (int dy = -1; dy <= 1; dy++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        if (ds == 0 && dy == 0 && dx == 0) {
+          continue;
+        }
+        if (!compare(value, dog[ds * s_stride + dy * y_stride + dx])) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// Solves the 3x3 system A * b = rhs in place with the Gauss elimination of
+// VLFeat. The solution is zero if the system is singular.
+void SolveRefinementSystem(Eigen::Matrix3d* A, Eigen::Vector3d* b) {
+  Eigen::Matrix3d& a = *A;
+  Eigen::Vector3d& rhs = *b;
+  for (int j = 0; j < 3; j++) {
+    // Look for the maximally stable pivot.
+    double max_a = 0;
+    double max_abs_a = 0;
+    int max_i = -1;
+    for (int i = j; i < 3; i++) {
+      if (std::abs(a(i, j)) > max_abs_a) {
+        max_a = a(i, j);
+        max_abs_a = std::abs(a(i, j));
+        max_i = i;
+      }
+    }
+
+    // Give up if the system is singular.
+    if (max_abs_a < 1e-10f) {
+      rhs.setZero();
+      return;
+    }
+
+    // Swap the j-th row with the pivot row, normalize it and eliminate the
+    // j-th column of the rows below.
+    for (int jj = j; jj < 3; jj++) {
+      std::swap(a(max_i, jj), a(j, jj));
+      a(j, jj) /= max_a;
+    }
+    std::swap(rhs(j), rhs(max_i));
+    rhs(j) /= max_a;
+    for (int ii = j + 1; ii < 3; ii++) {
+      const double x = a(ii, j);
+      for (int jj = j; jj < 3; jj++) {
+        a(ii, jj) -= x * a(j, jj);
+      }
+      rhs(ii) -= x * rhs(j);
+    }
+  }
+
+  // Backward substitution.
+  for (int i = 2; i > 0; i--) {
+    for (int ii = i - 1; ii >= 0; ii--) {
+      rhs(ii) -= rhs(i) * a(ii, i);
+    }
+  }
+}
+
+}  // namespace
+
+SiftScaleSpace::SiftScaleSpace(const int width,
+                               const int height,
+                               const SiftParameters& sift_params)
+    : sift_filter_(vl_sift_new(width,
+                               height,
+                               sift_params.num_octaves,
+                               sift_params.num_levels,
+                               sift_params.first_octave),
+                   vl_sift_delete),
+      gaussian_filter_sigma_(0),
+      gaussian_filter_half_width_(0) {
+  vl_sift_set_edge_thresh(sift_filter_.get(), sift_params.edge_threshold);
+  vl_sift_set_peak_thresh(sift_filter_.get(), sift_params.peak_threshold);
+}
+
+SiftScaleSpace::~SiftScaleSpace() {}
+
+int SiftScaleSpace::Width() const { return sift_filter_->width; }
+
+int SiftScaleSpace::Height() const { return sift_filter_->height; }
+
+void SiftScaleSpace::SetCurrentOctave(const int octave) {
+  VlSiftFilt* filter = sift_filter_.get();
+  filter->o_cur = octave;
+  filter->nkeys = 0;
+  keypoint_responses_.clear();
+  filter->octave_width = VL_SHIFT_LEFT(filter->width, -octave);
+  filter->octave_height = VL_SHIFT_LEFT(filter->height, -octave);
+  // VLFeat only recomputes the gradients when the octave index changes, which
+  // does not happen if the same octave of a new image is processed.
+  filter->grad_o = filter->o_min - 1;
+}
+
+bool SiftScaleSpace::ProcessFirstOctave(const float* image) {
+  VlSiftFilt* filter = sift_filter_.get();
+  SetCurrentOctave(filter->o_min);
+  if (filter->O == 0) {
+    return false;
+  }
+
+  // Resample the image to the resolution of the first octave. Upsampling
+  // alternates between the first two levels of the octave so that the last
+  // upsampling writes to the first level.
+  const int s_min = filter->s_min;
+  float* first_level = vl_sift_get_octave(filter, s_min);
+  if (filter->o_min < 0) {
+    float* second_level = vl_sift_get_octave(filter, s_min + 1);
+    const int num_upsamplings = -filter->o_min;
+    const float* source = image;
+    int width = filter->width;
+    int height = filter->height;
+    for (int i = 0; i < num_upsamplings; i++) {
+      float* destination =
+          (num_upsamplings - 1 - i) % 2 == 0 ? first_level : second_level;
+      UpsampleImage(source, width, height, destination);
+      source = destination;
+      width *= 2;
+      height *= 2;
+    }
+  } else if (filter->o_min > 0) {
+    DownsampleImage(image,
+                    filter->width,
+                    filter->height,
+                    1 << filter->o_min,
+                    first_level);
+  } else {
+    std::memcpy(first_level,
+                image,
+                sizeof(float) * filter->width * filter->height);
+  }
+
+  // The input image is assumed to have a nominal smoothing of sigman, which is
+  // completed to the smoothing of the first level.
+  const double sa = filter->sigma0 * std::pow(filter->sigmak, s_min);
+  const double sb = filter->sigman * std::pow(2.0, -filter->o_min);
+  if (sa > sb) {
+    Smooth(first_level, first_level, std::sqrt(sa * sa - sb * sb));
+  }
+
+  for (int s = s_min + 1; s <= filter->s_max; s++) {
+    Smooth(vl_sift_get_octave(filter, s - 1),
+           vl_sift_get_octave(filter, s),
+           filter->dsigma0 * std::pow(filter->sigmak, s));
+  }
+  return true;
+}
+
+bool SiftScaleSpace::ProcessNextOctave() {
+  VlSiftFilt* filter = sift_filter_.get();
+  if (filter->o_cur == filter->o_min + filter->O - 1) {
+    return false;
+  }
+
+  // The first level of the next octave is the downsampled level of the current
+  // octave whose smoothing is closest to it.
+  const int s_min = filter->s_min;
+  const int s_best = std::min(s_min + filter->S, filter->s_max);
+  DownsampleImage(vl_sift_get_octave(filter, s_best),
+                  filter->octave_width,
+                  filter->octave_height,
+                  2,
+                  filter->octave);
+  SetCurrentOctave(filter->o_cur + 1);
+
+  // NOTE: VLFeat computes these powers in single precision.
+  const float sigmak = filter->sigmak;
+  const double sa =
+      filter->sigma0 * std::pow(sigmak, static_cast<float>(s_min));
+  const double sb =
+      filter->sigma0 * std::pow(sigmak, static_cast<float>(s_best - filter->S));
+  if (sa > sb) {
+    Smooth(filter->octave, filter->octave, std::sqrt(sa * sa - sb * sb));
+  }
+
+  for (int s = s_min + 1; s <= filter->s_max; s++) {
+    Smooth(vl_sift_get_octave(filter, s - 1),
+           vl_sift_get_octave(filter, s),
+           filter->dsigma0 * std::pow(filter->sigmak, s));
+  }
+  return true;
+}
+
+void SiftScaleSpace::UpdateGaussianFilter(const double sigma) {
+  if (sigma == gaussian_filter_sigma_) {
+    return;
+  }
+
+  // The taps are computed and normalized in single precision over the whole
+  // filter like VLFeat does.
+  const int half_width = std::max(static_cast<int>(std::ceil(4.0 * sigma)), 1);
+  Eigen::ArrayXf taps(2 * half_width + 1);
+  float sum = 0;
+  for (int i = 0; i < taps.size(); i++) {
+    const float d =
+        static_cast<float>(i - half_width) / static_cast<float>(sigma);
+    taps(i) = static_cast<float>(std::exp(-0.5 * (d * d)));
+    sum += taps(i);
+  }
+  gaussian_filter_ = taps.tail(half_width + 1) / sum;
+  gaussian_filter_half_width_ = half_width;
+  gaussian_filter_sigma_ = sigma;
+}
+
+void SiftScaleSpace::Smooth(const float* input,
+                            float* output,
+                            const double sigma) {
+  UpdateGaussianFilter(sigma);
+  const int width = sift_filter_->octave_width;
+  const int height = sift_filter_->octave_height;
+  const int half_width = gaussian_filter_half_width_;
+  float* temp = sift_filter_->temp;
+
+  // Filter the columns by accumulating whole rows, with the rows outside of
+  // the image replaced by the first and last rows. The input is only read in
+  // this pass, so it may be the same image as the output.
+  for (int y = 0; y < height; y++) {
+    ArrayXfMap filtered_row(temp + y * width, width);
+    filtered_row = gaussian_filter_(0) * ConstArrayXfMap(input + y * width,
+                                                         width);
+    for (int k = 1; k <= half_width; k++) {
+      const int above = std::max(y - k, 0);
+      const int below = std::min(y + k, height - 1);
+      filtered_row += gaussian_filter_(k) *
+                      (ConstArrayXfMap(input + above * width, width) +
+                       ConstArrayXfMap(input + below * width, width));
+    }
+  }
+
+  // Filter the rows. Each row is padded with copies of its first and last
+  // pixels so that the filter taps are applied to contiguous segments.
+  padded_row_.resize(width + 2 * half_width);
+  for (int y = 0; y < height; y++) {
+    const float* row = temp + y * width;
+    padded_row_.head(half_width).setConstant(row[0]);
+    padded_row_.segment(half_width, width) = ConstArrayXfMap(row, width);
+    padded_row_.tail(half_width).setConstant(row[width - 1]);
+
+    ArrayXfMap filtered_row(output + y * width, width);
+    filtered_row = gaussian_filter_(0) * padded_row_.segment(half_width, width);
+    for (int k = 1; k <= half_width; k++) {
+      filtered_row += gaussian_filter_(k) *
+                      (padded_row_.segment(half_width - k, width) +
+                       padded_row_.segment(half_width + k, width));
+    }
+  }
+}
+
+void SiftScaleSpace::Detect() {
+  VlSiftFilt* filter = sift_filter_.get();
+  const int width = filter->octave_width;
+  const int height = filter->octave_height;
+  const int s_min = filter->s_min;
+  const int s_max = filter->s_max;
+  const int level_size = width * height;
+
+  // Compute the difference of Gaussians.
+  for (int s = s_min; s < s_max; s++) {
+    ArrayXfMap(filter->dog + (s - s_min) * level_size, level_size) =
+        ConstArrayXfMap(vl_sift_get_octave(filter, s + 1), level_size) -
+        ConstArrayXfMap(vl_sift_get_octave(filter, s), level_size);
+  }
+
+  // Find the local extrema of the difference of Gaussians. Most pixels are
+  // rejected by the threshold, so their neighborhoods are never inspected.
+  const double threshold = 0.8 * filter->peak_thresh;
+  extrema_.clear();
+  for (int s = s_min + 1; s <= s_max - 2; s++) {
+    for (int y = 1; y < height - 1; y++) {
+      const float* row = filter->dog + (s - s_min) * level_size + y * width;
+      for (int x = 1; x < width - 1; x++) {
+        const float* dog = row + x;
+        if ((*dog >= threshold &&
+             IsExtremum(dog, width, level_size, std::greater<float>())) ||
+            (*dog <= -threshold &&
+             IsExtremum(dog, width, level_size, std::less<float>()))) {
+          VlSiftKeypoint keypoint;
+          keypoint.ix = x;
+          keypoint.iy = y;
+          keypoint.is = s;
+          extrema_.emplace_back(keypoint);
+        }
+      }
+    }
+  }
+
+  // Refine the extrema and keep the ones that pass the thresholds.
+  int num_keypoints = 0;
+  keypoint_responses_.clear();
+  for (int i = 0; i < extrema_.size(); i++) {
+    float response;
+    if (RefineKeypoint(&extrema_[i], &response)) {
+      extrema_[num_keypoints++] = extrema_[i];
+      keypoint_responses_.emplace_back(response);
+    }
+  }
+
+  // Store the keypoints in the filter so that VLFeat can compute their
+  // orientations and descriptors.
+  if (num_keypoints > filter->keys_res) {
+    filter->keys_res = num_keypoints;
+    filter->keys = static_cast<VlSiftKeypoint*>(
+        filter->keys == nullptr
+            ? vl_malloc(filter->keys_res * sizeof(VlSiftKeypoint))
+            : vl_realloc(filter->keys,
+                         filter->keys_res * sizeof(VlSiftKeypoint)));
+  }
+  std::copy(extrema_.begin(), extrema_.begin() + num_keypoints, filter->keys);
+  filter->nkeys = num_keypoints;
+}
+
+bool SiftScaleSpace::RefineKeypoint(VlSiftKeypoint* keypoint,
+                                    float* response) const {
+  const VlSiftFilt* filter = sift_filter_.get();
+  const int width = filter->octave_width;
+  const int height = filter->octave_height;
+  const int y_stride = width;
+  const int s_stride = width * height;
+  const int s_min = filter->s_min;
+  const int s_max = filter->s_max;
+  const double edge_threshold = filter->edge_thresh;
+
+  int x = keypoint->ix;
+  int y = keypoint->iy;
+  const int s = keypoint->is;
+  const float* dog = nullptr;
+  const auto at = [&dog, y_stride, s_stride](const int dx,
+                                             const int dy,
+                                             const int ds) {
+    return dog[dx + dy * y_stride + ds * s_stride];
+  };
+
+  // Fit a quadratic to the difference of Gaussians around the extremum, and
+  // move the extremum to the neighboring pixel if the offset of the peak of the
+  // quadratic is larger than 0.6 pixels.
+  double Dx = 0, Dy = 0, Ds = 0, Dxx = 0, Dyy = 0, Dss = 0, Dxy = 0, Dxs = 0,
+         Dys = 0;
+  Eigen::Vector3d b;
+  int dx = 0;
+  int dy = 0;
+  for (int iteration = 0; iteration < 5; iteration++) {
+    x += dx;
+    y += dy;
+    dog = filter->dog + x + y * y_stride + (s - s_min) * s_stride;
+
+    // Compute the gradient and the Hessian.
+    Dx = 0.5 * (at(+1, 0, 0) - at(-1, 0, 0));
+    Dy = 0.5 * (at(0, +1, 0) - at(0, -1, 0));
+    Ds = 0.5 * (at(0, 0, +1) - at(0, 0, -1));
+    Dxx = (at(+1, 0, 0) + at(-1, 0, 0) - 2.0 * at(0, 0, 0));
+    Dyy = (at(0, +1, 0) + at(0, -1, 0) - 2.0 * at(0, 0, 0));
+    Dss = (at(0, 0, +1) + at(0, 0, -1) - 2.0 * at(0, 0, 0));
+    Dxy = 0.25 *
+          (at(+1, +1, 0) + at(-1, -1, 0) - at(-1, +1, 0) - at(+1, -1, 0));
+    Dxs = 0.25 *
+          (at(+1, 0, +1) + at(-1, 0, -1) - at(-1, 0, +1) - at(+1, 0, -1));
+    Dys = 0.25 *
+          (at(0, +1, +1) + at(0, -1, -1) - at(0, -1, +1) - at(0, +1, -1));
+
+    Eigen::Matrix3d A;
+    A << Dxx, Dxy, Dxs,
+         Dxy, Dyy, Dys,
+         Dxs, Dys, Dss;
+    b << -Dx, -Dy, -Ds;
+    SolveRefinementSystem(&A, &b);
+
+    dx = ((b[0] > 0.6 && x < width - 2) ? 1 : 0) +
+         ((b[0] < -0.6 && x > 1) ? -1 : 0);
+    dy = ((b[1] > 0.6 && y < height - 2) ? 1 : 0) +
+         ((b[1] < -0.6 && y > 1) ? -1 : 0);
+    if (dx == 0 && dy == 0) {
+      break;
+    }
+  }
+
+  // Check the peak threshold, the edge threshold on the ratio of the principal
+  // curvatures, and that the refined keypoint stays close to the extremum.
+  const double value = at(0, 0, 0) + 0.5 * (Dx * b[0] + Dy * b[1] + Ds * b[2]);
+  const double score = (Dxx + Dyy) * (Dxx + Dyy) / (Dxx * Dyy - Dxy * Dxy);
+  const double xn = x + b[0];
+  const double yn = y + b[1];
+  const double sn = s + b[2];
+  const bool good =
+      std::abs(value) > filter->peak_thresh &&
+      score < (edge_threshold + 1) * (edge_threshold + 1) / edge_threshold &&
+      score >= 0 && std::abs(b[0]) < 1.5 && std::abs(b[1]) < 1.5 &&
+      std::abs(b[2]) < 1.5 && xn >= 0 && xn <= width - 1 && yn >= 0 &&
+      yn <= height - 1 && sn >= s_min && sn <= s_max;
+  if (!good) {
+    return false;
+  }
+
+  const double octave_scale = std::pow(2.0, filter->o_cur);
+  keypoint->o = filter->o_cur;
+  keypoint->ix = x;
+  keypoint->iy = y;
+  keypoint->is = s;
+  keypoint->s = sn;
+  keypoint->x = xn * octave_scale;
+  keypoint->y = yn * octave_scale;
+  keypoint->sigma =
+      filter->sigma0 * std::pow(2.0, sn / filter->S) * octave_scale;
+  *response = std::abs(value);
+  return true;
+}
+
+void SiftScaleSpace::ComputeGradients() {
+  VlSiftFilt* filter = sift_filter_.get();
+  if (filter->grad_o == filter->o_cur) {
+    return;
+  }
+
+  const int width = filter->octave_width;
+  const int height = filter->octave_height;
+  const int level_size = width * height;
+  CHECK_GE(width, 2);
+  CHECK_GE(height, 2);
+
+  // The gradients are stored as interleaved (magnitude, orientation) pairs for
+  // the levels that keypoints may be detected in. Central differences are used
+  // inside of the image and one-sided differences on its border. The
+  // orientation uses the same approximation of atan2 as VLFeat.
+  static const float kPi = M_PI;
+  static const float kC1 = 0.9675f;
+  static const float kC3 = 0.1821f;
+  gradient_x_.resize(width);
+  gradient_y_.resize(width);
+  for (int s = filter->s_min + 1; s <= filter->s_max - 2; s++) {
+    const float* level = vl_sift_get_octave(filter, s);
+    float* gradients = filter->grad + 2 * level_size * (s - filter->s_min - 1);
+    for (int y = 0; y < height; y++) {
+      const float* row = level + y * width;
+      gradient_x_(0) = row[1] - row[0];
+      gradient_x_.segment(1, width - 2) =
+          0.5f * (ConstArrayXfMap(row + 2, width - 2) -
+                  ConstArrayXfMap(row, width - 2));
+      gradient_x_(width - 1) = row[width - 1] - row[width - 2];
+
+      const float* row_above = y > 0 ? row - width : row;
+      const float* row_below = y < height - 1 ? row + width : row;
+      const float scale = (y > 0 && y < height - 1) ? 0.5f : 1.0f;
+      gradient_y_ = scale * (ConstArrayXfMap(row_below, width) -
+                             ConstArrayXfMap(row_above, width));
+
+      const Eigen::ArrayXf squared_magnitude =
+          gradient_x_.square() + gradient_y_.square();
+      const Eigen::ArrayXf abs_y = gradient_y_.abs() + FLT_EPSILON;
+      const auto positive_x = gradient_x_ >= 0.0f;
+      const Eigen::ArrayXf r =
+          positive_x.select((gradient_x_ - abs_y) / (gradient_x_ + abs_y),
+                            (gradient_x_ + abs_y) / (abs_y - gradient_x_));
+      Eigen::ArrayXf angle =
+          positive_x.select(Eigen::ArrayXf::Constant(width, 0.25f * kPi),
+                            Eigen::ArrayXf::Constant(width, 0.75f * kPi)) +
+          (kC3 * r.square() - kC1) * r;
+      angle = (gradient_y_ < 0.0f).select(-angle, angle) + 2.0f * kPi;
+      angle = (angle > 2.0f * kPi).select(angle - 2.0f * kPi, angle);
+
+      Eigen::Map<Eigen::Array<float, 2, Eigen::Dynamic> > row_gradients(
+          gradients + 2 * y * width, 2, width);
+      row_gradients.row(0) =
+          (squared_magnitude < 1e-8f)
+              .select(0.0f, squared_magnitude.sqrt())
+              .transpose();
+      row_gradients.row(1) = angle.transpose();
+    }
+  }
+  filter->grad_o = filter->o_cur;
+}
+
+}  // namespace theia
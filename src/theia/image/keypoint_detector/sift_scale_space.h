@@ -0,0 +1,153 @@
+// Copyright (C) 2013 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IMAGE_KEYPOINT_DETECTOR_SIFT_SCALE_SPACE_H_
+#define THEIA_IMAGE_KEYPOINT_DETECTOR_SIFT_SCALE_SPACE_H_
+
+extern "C" {
+#include <vl/sift.h>
+}
+
+#include <Eigen/Core>
+#include <memory>
+#include <vector>
+
+#include "theia/image/keypoint_detector/sift_parameters.h"
+#include "theia/util/util.h"
+
+namespace theia {
+
+// Computes the SIFT scale space of an image octave by octave and detects the
+// keypoints of each octave. This replaces the scale space computations of
+// VLFeat, which are the bulk of the SIFT extraction time, with vectorized
+// implementations:
+//
+//   - The Gaussian smoothing is a separable convolution that filters whole
+//     image rows at a time instead of VLFeat's column-wise convolutions with
+//     transposes.
+//   - The difference of Gaussians and the gradients are computed one row at a
+//     time with array operations.
+//   - The extrema detection only inspects the neighborhood of the pixels with a
+//     large enough difference of Gaussians.
+//
+// The results are written into a VLFeat SIFT filter with the same scale space
+// geometry and the same sampling, smoothing and keypoint refinement as VLFeat,
+// so the keypoint orientations and descriptors are computed with
+// vl_sift_calc_keypoint_orientations and vl_sift_calc_keypoint_descriptor on
+// filter(). The output is identical to VLFeat up to floating point round-off.
+class SiftScaleSpace {
+ public:
+  // Creates the scale space for images of the given size. The first octave,
+  // the number of octaves and levels, and the edge and peak thresholds are set
+  // from the SIFT parameters.
+  SiftScaleSpace(const int width,
+                 const int height,
+                 const SiftParameters& sift_params);
+  ~SiftScaleSpace();
+
+  // The size of the images that this scale space processes.
+  int Width() const;
+  int Height() const;
+
+  // Computes the Gaussian scale space of the first octave of the image, which
+  // must be a row-major grayscale image with the size of the scale space. The
+  // image must remain valid until the next call. Returns false if there is no
+  // octave to process.
+  bool ProcessFirstOctave(const float* image);
+
+  // Computes the Gaussian scale space of the next octave. Returns false if all
+  // octaves have been processed.
+  bool ProcessNextOctave();
+
+  // Computes the difference of Gaussians of the current octave and detects the
+  // keypoints at its extrema. The keypoints are refined to subpixel accuracy
+  // and filtered by the peak and edge thresholds exactly as vl_sift_detect
+  // does, and may be retrieved with vl_sift_get_keypoints(filter()).
+  void Detect();
+
+  // The absolute value of the difference of Gaussians at the refined position
+  // of each keypoint of the current octave, in the order of
+  // vl_sift_get_keypoints(filter()). This is the contrast of the keypoint and
+  // is used as its strength.
+  const std::vector<float>& keypoint_responses() const {
+    return keypoint_responses_;
+  }
+
+  // Computes the gradient magnitudes and orientations of the current octave
+  // that VLFeat uses for the keypoint orientations and descriptors. This is a
+  // no-op if the gradients of the current octave are already computed.
+  void ComputeGradients();
+
+  // The VLFeat filter that holds the scale space of the current octave.
+  VlSiftFilt* filter() { return sift_filter_.get(); }
+
+ private:
+  // Updates the filter for the given octave and invalidates its gradients.
+  void SetCurrentOctave(const int octave);
+
+  // Smooths the image of the current octave size with a Gaussian of standard
+  // deviation sigma. The input and output may be the same image.
+  void Smooth(const float* input, float* output, const double sigma);
+
+  // Computes the VLFeat Gaussian filter for the standard deviation sigma.
+  void UpdateGaussianFilter(const double sigma);
+
+  // Refines the position of a detected extremum of the difference of
+  // Gaussians. Returns false if the refined keypoint does not pass the peak and
+  // edge thresholds. Otherwise the response of the keypoint is returned.
+  bool RefineKeypoint(VlSiftKeypoint* keypoint, float* response) const;
+
+  std::unique_ptr<VlSiftFilt, void (*)(VlSiftFilt*)> sift_filter_;
+
+  // The half-width and the taps of the current Gaussian filter. Only the taps
+  // at offsets 0 to half-width are stored since the filter is symmetric.
+  double gaussian_filter_sigma_;
+  int gaussian_filter_half_width_;
+  Eigen::ArrayXf gaussian_filter_;
+
+  // Scratch buffers for the convolution and the gradients of one row.
+  Eigen::ArrayXf padded_row_;
+  Eigen::ArrayXf gradient_x_;
+  Eigen::ArrayXf gradient_y_;
+
+  // The keypoints detected in the current octave before they are refined.
+  std::vector<VlSiftKeypoint> extrema_;
+  std::vector<float> keypoint_responses_;
+
+  DISALLOW_COPY_AND_ASSIGN(SiftScaleSpace);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_IMAGE_KEYPOINT_DETECTOR_SIFT_SCALE_SPACE_H_
@@ -0,0 +1,179 @@
+// Copyright (C) 2013 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+extern "C" {
+#include <vl/sift.h>
+}
+
+#include <Eigen/Core>
+#include <gflags/gflags.h>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "theia/image/image.h"
+#include "theia/image/keypoint_detector/sift_parameters.h"
+#include "theia/image/keypoint_detector/sift_scale_space.h"
+
+DEFINE_string(test_img, "image/keypoint_detector/img1.png",
+              "Name of test image file.");
+
+namespace theia {
+namespace {
+
+std::string img_filename = THEIA_DATA_DIR + std::string("/") + FLAGS_test_img;
+
+static const float kLevelTolerance = 1e-5;
+static const float kPositionTolerance = 1e-3;
+static const float kDescriptorTolerance = 1e-3;
+
+typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    RowMajorMatrixXf;
+
+// Processes all octaves of the image with the scale space and with VLFeat, and
+// checks that the Gaussian levels, the keypoints and their descriptors match.
+void CompareToVLFeat(const RowMajorMatrixXf& image,
+                     const SiftParameters& sift_params) {
+  SiftScaleSpace scale_space(image.cols(), image.rows(), sift_params);
+  VlSiftFilt* vl_filter = vl_sift_new(image.cols(),
+                                      image.rows(),
+                                      sift_params.num_octaves,
+                                      sift_params.num_levels,
+                                      sift_params.first_octave);
+  vl_sift_set_edge_thresh(vl_filter, sift_params.edge_threshold);
+  vl_sift_set_peak_thresh(vl_filter, sift_params.peak_threshold);
+
+  bool has_octave = scale_space.ProcessFirstOctave(image.data());
+  int vl_status = vl_sift_process_first_octave(vl_filter, image.data());
+  int num_keypoints = 0;
+  while (vl_status != VL_ERR_EOF) {
+    ASSERT_TRUE(has_octave);
+    VlSiftFilt* filter = scale_space.filter();
+    ASSERT_EQ(filter->o_cur, vl_filter->o_cur);
+    ASSERT_EQ(filter->octave_width, vl_filter->octave_width);
+    ASSERT_EQ(filter->octave_height, vl_filter->octave_height);
+
+    // The Gaussian levels of the octave.
+    const int octave_size = filter->octave_width * filter->octave_height *
+                            (filter->s_max - filter->s_min + 1);
+    for (int i = 0; i < octave_size; i++) {
+      EXPECT_NEAR(filter->octave[i], vl_filter->octave[i], kLevelTolerance);
+    }
+
+    // The keypoints of the octave, which are detected in the same order.
+    scale_space.Detect();
+    vl_sift_detect(vl_filter);
+    ASSERT_EQ(vl_sift_get_nkeypoints(filter),
+              vl_sift_get_nkeypoints(vl_filter));
+    const VlSiftKeypoint* keypoints = vl_sift_get_keypoints(filter);
+    const VlSiftKeypoint* vl_keypoints = vl_sift_get_keypoints(vl_filter);
+    if (vl_sift_get_nkeypoints(filter) > 0) {
+      scale_space.ComputeGradients();
+    }
+    for (int i = 0; i < vl_sift_get_nkeypoints(filter); i++) {
+      EXPECT_NEAR(keypoints[i].x, vl_keypoints[i].x, kPositionTolerance);
+      EXPECT_NEAR(keypoints[i].y, vl_keypoints[i].y, kPositionTolerance);
+      EXPECT_NEAR(keypoints[i].sigma, vl_keypoints[i].sigma,
+                  kPositionTolerance);
+
+      // Compute the descriptors with the same orientation so that they are
+      // comparable even if an orientation is at the boundary of a bin.
+      double angles[4];
+      ASSERT_GT(vl_sift_calc_keypoint_orientations(filter, angles,
+                                                   &keypoints[i]),
+                0);
+      Eigen::Matrix<float, 128, 1> descriptor, vl_descriptor;
+      vl_sift_calc_keypoint_descriptor(filter, descriptor.data(),
+                                       &keypoints[i], angles[0]);
+      vl_sift_calc_keypoint_descriptor(vl_filter, vl_descriptor.data(),
+                                       &vl_keypoints[i], angles[0]);
+      EXPECT_LT((descriptor - vl_descriptor).lpNorm<Eigen::Infinity>(),
+                kDescriptorTolerance);
+    }
+    num_keypoints += vl_sift_get_nkeypoints(filter);
+
+    has_octave = scale_space.ProcessNextOctave();
+    vl_status = vl_sift_process_next_octave(vl_filter);
+  }
+  EXPECT_FALSE(has_octave);
+  EXPECT_GT(num_keypoints, 0);
+  vl_sift_delete(vl_filter);
+}
+
+}  // namespace
+
+TEST(SiftScaleSpace, MatchesVLFeat) {
+  FloatImage input_img(img_filename);
+  RowMajorMatrixXf image;
+  input_img.GetGrayscalePixels(&image);
+
+  for (const int first_octave : {-1, 0, 1}) {
+    SiftParameters sift_params;
+    sift_params.first_octave = first_octave;
+    CompareToVLFeat(image, sift_params);
+  }
+}
+
+TEST(SiftScaleSpace, ReusedScaleSpaceRecomputesGradients) {
+  FloatImage input_img(img_filename);
+  RowMajorMatrixXf image;
+  input_img.GetGrayscalePixels(&image);
+  const RowMajorMatrixXf flipped_image = image.colwise().reverse();
+
+  // Process the image with a fresh scale space and with a scale space that was
+  // used for another image of the same size. The gradients of the second must
+  // not be those of the previous image.
+  SiftParameters sift_params;
+  SiftScaleSpace fresh_scale_space(image.cols(), image.rows(), sift_params);
+  SiftScaleSpace reused_scale_space(image.cols(), image.rows(), sift_params);
+  ASSERT_TRUE(reused_scale_space.ProcessFirstOctave(flipped_image.data()));
+  reused_scale_space.ComputeGradients();
+
+  ASSERT_TRUE(fresh_scale_space.ProcessFirstOctave(image.data()));
+  ASSERT_TRUE(reused_scale_space.ProcessFirstOctave(image.data()));
+  fresh_scale_space.ComputeGradients();
+  reused_scale_space.ComputeGradients();
+
+  const VlSiftFilt* fresh_filter = fresh_scale_space.filter();
+  const VlSiftFilt* reused_filter = reused_scale_space.filter();
+  const int gradient_size = 2 * fresh_filter->octave_width *
+                            fresh_filter->octave_height *
+                            (fresh_filter->s_max - fresh_filter->s_min - 2);
+  for (int i = 0; i < gradient_size; i++) {
+    EXPECT_EQ(fresh_filter->grad[i], reused_filter->grad[i]);
+  }
+}
+
+}  // namespace theia
@@ -47,18 +47,23 @@
 #include <vector>
 
 #include "theia/alignment/alignment.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/descriptor_quantization.h"
 #include "theia/image/keypoint_detector/keypoint.h"
 #include "theia/io/eigen_serializable.h"
+#include "theia/io/write_keypoints_and_descriptors.h"
 
 namespace theia {
 
-// Reads the features from a file.
-bool ReadKeypointsAndDescriptors(const std::string& features_file,
-                                 std::vector<Keypoint>* keypoints,
-                                 std::vector<Eigen::VectorXf>* descriptors) {
-  CHECK_NOTNULL(keypoints)->clear();
-  CHECK_NOTNULL(descriptors)->clear();
+namespace {
 
+// Reads the features from a file. Each file holds a float, a binary and a
+// quantized descriptor matrix, at most one of which is non-empty.
+bool ReadFeaturesFile(const std::string& features_file,
+                      std::vector<Keypoint>* keypoints,
+                      DescriptorMatrix* descriptors,
+                      BinaryDescriptorMatrix* binary_descriptors,
+                      QuantizedDescriptorMatrix* quantized_descriptors) {
   // Return false if the file cannot be opened.
   std::ifstream features_reader(features_file, std::ios::in | std::ios::binary);
   if (!features_reader.is_open()) {
@@ -67,9 +72,115 @@ bool ReadKeypointsAndDescriptors(const std::string& features_file,
     return false;
   }
 
-  cereal::PortableBinaryInputArchive input_archive(features_reader);
-  input_archive(*keypoints, *descriptors);
+  // A truncated or corrupt file makes the archive throw.
+  try {
+    cereal::PortableBinaryInputArchive input_archive(features_reader);
+    uint32_t version;
+    input_archive(version);
+    if (version != kFeaturesFileVersion) {
+      LOG(ERROR) << "The feature file: " << features_file
+                 << " was written with version " << version
+                 << " of the features file layout, but version "
+                 << kFeaturesFileVersion << " is required.";
+      return false;
+    }
+    input_archive(
+        *keypoints, *descriptors, *binary_descriptors, *quantized_descriptors);
+  } catch (const cereal::Exception& e) {
+    LOG(ERROR) << "Could not read the feature file: " << features_file << ": "
+               << e.what();
+    keypoints->clear();
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+bool ReadKeypointsAndDescriptors(const std::string& features_file,
+                                 std::vector<Keypoint>* keypoints,
+                                 DescriptorMatrix* descriptors) {
+  CHECK_NOTNULL(keypoints)->clear();
+  CHECK_NOTNULL(descriptors)->resize(0, 0);
+
+  BinaryDescriptorMatrix binary_descriptors;
+  QuantizedDescriptorMatrix quantized_descriptors;
+  if (!ReadFeaturesFile(features_file,
+                        keypoints,
+                        descriptors,
+                        &binary_descriptors,
+                        &quantized_descriptors)) {
+    return false;
+  }
+
+  if (binary_descriptors.rows() > 0) {
+    LOG(ERROR) << "The feature file: " << features_file
+               << " contains binary descriptors and cannot be read as float "
+                  "descriptors.";
+    keypoints->clear();
+    return false;
+  }
+
+  if (quantized_descriptors.rows() > 0) {
+    DequantizeDescriptors(quantized_descriptors, descriptors);
+  }
+  return true;
+}
+
+bool ReadKeypointsAndDescriptors(const std::string& features_file,
+                                 std::vector<Keypoint>* keypoints,
+                                 BinaryDescriptorMatrix* descriptors) {
+  CHECK_NOTNULL(keypoints)->clear();
+  CHECK_NOTNULL(descriptors)->resize(0, 0);
+
+  DescriptorMatrix float_descriptors;
+  QuantizedDescriptorMatrix quantized_descriptors;
+  if (!ReadFeaturesFile(features_file,
+                        keypoints,
+                        &float_descriptors,
+                        descriptors,
+                        &quantized_descriptors)) {
+    return false;
+  }
+
+  if (float_descriptors.rows() > 0 || quantized_descriptors.rows() > 0) {
+    LOG(ERROR) << "The feature file: " << features_file
+               << " contains float descriptors and cannot be read as binary "
+                  "descriptors.";
+    keypoints->clear();
+    return false;
+  }
+  return true;
+}
 
+bool ReadKeypointsAndDescriptors(const std::string& features_file,
+                                 std::vector<Keypoint>* keypoints,
+                                 QuantizedDescriptorMatrix* descriptors) {
+  CHECK_NOTNULL(keypoints)->clear();
+  CHECK_NOTNULL(descriptors)->resize(0, 0);
+
+  DescriptorMatrix float_descriptors;
+  BinaryDescriptorMatrix binary_descriptors;
+  if (!ReadFeaturesFile(features_file,
+                        keypoints,
+                        &float_descriptors,
+                        &binary_descriptors,
+                        descriptors)) {
+    return false;
+  }
+
+  if (binary_descriptors.rows() > 0) {
+    LOG(ERROR) << "The feature file: " << features_file
+               << " contains binary descriptors and cannot be read as "
+                  "quantized descriptors.";
+    keypoints->clear();
+    return false;
+  }
+
+  if (float_descriptors.rows() > 0) {
+    QuantizeDescriptors(float_descriptors, descriptors);
+  }
   return true;
 }
 
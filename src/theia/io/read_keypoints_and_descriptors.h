@@ -39,13 +39,32 @@
 #include <string>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
+
 namespace theia {
 class Keypoint;
 
-// Reads the features from a single file.
+// Reads the features from a single file. The descriptors of all features are
+// stored contiguously with one descriptor per row. Quantized descriptors are
+// converted to float descriptors. Returns false if the file cannot be read, if
+// it was written with a different kFeaturesFileVersion, or if it contains
+// binary descriptors.
+bool ReadKeypointsAndDescriptors(const std::string& features_file,
+                                 std::vector<Keypoint>* keypoints,
+                                 DescriptorMatrix* descriptors);
+
+// Same as above, but reads bit-packed binary descriptors. Returns false if the
+// file cannot be read or if it contains float descriptors.
+bool ReadKeypointsAndDescriptors(const std::string& features_file,
+                                 std::vector<Keypoint>* keypoints,
+                                 BinaryDescriptorMatrix* descriptors);
+
+// Same as above, but reads float descriptors that are quantized to one byte per
+// dimension. Float descriptors are quantized when they are read. Returns false
+// if the file cannot be read or if it contains binary descriptors.
 bool ReadKeypointsAndDescriptors(const std::string& features_file,
                                  std::vector<Keypoint>* keypoints,
-                                 std::vector<Eigen::VectorXf>* descriptors);
+                                 QuantizedDescriptorMatrix* descriptors);
 
 }  // namespace theia
 
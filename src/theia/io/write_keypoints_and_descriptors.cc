@@ -47,16 +47,21 @@
 #include <vector>
 
 #include "theia/alignment/alignment.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/image/keypoint_detector/keypoint.h"
 #include "theia/io/eigen_serializable.h"
 
 namespace theia {
 
-// Writes the features from a file.
-bool WriteKeypointsAndDescriptors(
-    const std::string& features_file,
-    const std::vector<Keypoint>& keypoints,
-    const std::vector<Eigen::VectorXf>& descriptors) {
+namespace {
+
+// Writes the features to a file. A float, a binary and a quantized descriptor
+// matrix are written so that features files may hold any type of descriptor.
+bool WriteFeaturesFile(const std::string& features_file,
+                       const std::vector<Keypoint>& keypoints,
+                       const DescriptorMatrix& descriptors,
+                       const BinaryDescriptorMatrix& binary_descriptors,
+                       const QuantizedDescriptorMatrix& quantized_descriptors) {
   // Return false if the file cannot be opened.
   std::ofstream features_writer(features_file, std::ios::out | std::ios::binary);
   if (!features_writer.is_open()) {
@@ -66,10 +71,48 @@ bool WriteKeypointsAndDescriptors(
   }
 
   cereal::PortableBinaryOutputArchive output_archive(features_writer);
-  output_archive(keypoints, descriptors);
+  output_archive(kFeaturesFileVersion,
+                 keypoints,
+                 descriptors,
+                 binary_descriptors,
+                 quantized_descriptors);
 
   return true;
+}
 
+}  // namespace
+
+bool WriteKeypointsAndDescriptors(
+    const std::string& features_file,
+    const std::vector<Keypoint>& keypoints,
+    const DescriptorMatrix& descriptors) {
+  return WriteFeaturesFile(features_file,
+                           keypoints,
+                           descriptors,
+                           BinaryDescriptorMatrix(),
+                           QuantizedDescriptorMatrix());
+}
+
+bool WriteKeypointsAndDescriptors(
+    const std::string& features_file,
+    const std::vector<Keypoint>& keypoints,
+    const BinaryDescriptorMatrix& descriptors) {
+  return WriteFeaturesFile(features_file,
+                           keypoints,
+                           DescriptorMatrix(),
+                           descriptors,
+                           QuantizedDescriptorMatrix());
+}
+
+bool WriteKeypointsAndDescriptors(
+    const std::string& features_file,
+    const std::vector<Keypoint>& keypoints,
+    const QuantizedDescriptorMatrix& descriptors) {
+  return WriteFeaturesFile(features_file,
+                           keypoints,
+                           DescriptorMatrix(),
+                           BinaryDescriptorMatrix(),
+                           descriptors);
 }
 
 }  // namespace theia
@@ -36,17 +36,39 @@
 #define THEIA_IO_WRITE_KEYPOINTS_AND_DESCRIPTORS_H_
 
 #include <Eigen/Core>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
+
 namespace theia {
 class Keypoint;
 
-// Writes the features to a single file.
+// The version of the layout of the features files. It is written at the start
+// of each features file and checked when the file is read, so it must be
+// incremented whenever the layout changes.
+static const uint32_t kFeaturesFileVersion = 1;
+
+// Writes the features to a single file. The descriptor matrix is written as a
+// single contiguous block.
+bool WriteKeypointsAndDescriptors(
+    const std::string& features_file,
+    const std::vector<Keypoint>& keypoints,
+    const DescriptorMatrix& descriptors);
+
+// Same as above, but writes bit-packed binary descriptors.
+bool WriteKeypointsAndDescriptors(
+    const std::string& features_file,
+    const std::vector<Keypoint>& keypoints,
+    const BinaryDescriptorMatrix& descriptors);
+
+// Same as above, but writes float descriptors that are quantized to one byte
+// per dimension.
 bool WriteKeypointsAndDescriptors(
     const std::string& features_file,
     const std::vector<Keypoint>& keypoints,
-    const std::vector<Eigen::VectorXf>& descriptors);
+    const QuantizedDescriptorMatrix& descriptors);
 
 }  // namespace theia
 
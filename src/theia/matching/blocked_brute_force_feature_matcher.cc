@@ -0,0 +1,204 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/blocked_brute_force_feature_matcher.h"
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/descriptor_quantization.h"
+#include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+
+namespace theia {
+
+namespace {
+
+// The number of descriptors from each image that are compared against each
+// other in a single tile. A tile of distances holds kTileSize x kTileSize
+// floats (256 KB) so that the tile and the descriptor blocks it was computed
+// from stay in the L2 cache while the nearest neighbors are updated.
+static const int kTileSize = 256;
+
+// The two nearest neighbors found so far for a single feature.
+struct NearestNeighbors {
+  int best_index = -1;
+  float best_distance = std::numeric_limits<float>::max();
+  float second_best_distance = std::numeric_limits<float>::max();
+
+  void Update(const int index, const float distance) {
+    if (distance < best_distance) {
+      second_best_distance = best_distance;
+      best_distance = distance;
+      best_index = index;
+    } else if (distance < second_best_distance) {
+      second_best_distance = distance;
+    }
+  }
+};
+
+// Returns true if a nearest neighbor was found and it passes the lowes ratio
+// test (if the ratio test is used).
+bool IsValidNearestNeighbor(const NearestNeighbors& nearest_neighbors,
+                            const bool use_lowes_ratio,
+                            const float sq_lowes_ratio) {
+  if (nearest_neighbors.best_index < 0) {
+    return false;
+  }
+  return !use_lowes_ratio ||
+         nearest_neighbors.best_distance <
+             sq_lowes_ratio * nearest_neighbors.second_best_distance;
+}
+
+}  // namespace
+
+bool BlockedBruteForceFeatureMatcher::MatchImagePair(
+    const KeypointsAndDescriptors& features1,
+    const KeypointsAndDescriptors& features2,
+    std::vector<IndexedFeatureMatch>* matches) {
+  CHECK(!features1.HasBinaryDescriptors() && !features2.HasBinaryDescriptors())
+      << "Blocked brute force matching can only be used with float "
+         "descriptors. Please use BRUTE_FORCE or MULTI_INDEX_HASHING for "
+         "binary descriptors.";
+  // Quantized descriptors are converted to float descriptors for the matrix
+  // products. This is linear in the number of descriptors, while the matching
+  // is quadratic.
+  DescriptorMatrix dequantized_descriptors1, dequantized_descriptors2;
+  if (features1.HasQuantizedDescriptors()) {
+    DequantizeDescriptors(features1.quantized_descriptors,
+                          &dequantized_descriptors1);
+  }
+  if (features2.HasQuantizedDescriptors()) {
+    DequantizeDescriptors(features2.quantized_descriptors,
+                          &dequantized_descriptors2);
+  }
+  const DescriptorMatrix& descriptors1 = features1.HasQuantizedDescriptors()
+                                             ? dequantized_descriptors1
+                                             : features1.descriptors;
+  const DescriptorMatrix& descriptors2 = features2.HasQuantizedDescriptors()
+                                             ? dequantized_descriptors2
+                                             : features2.descriptors;
+  const int num_descriptors1 = descriptors1.rows();
+  const int num_descriptors2 = descriptors2.rows();
+  if (num_descriptors1 == 0 || num_descriptors2 == 0) {
+    return false;
+  }
+  CHECK_EQ(descriptors1.cols(), descriptors2.cols())
+      << "The descriptors must have the same dimension.";
+
+  const bool use_lowes_ratio = this->options_.use_lowes_ratio;
+  const float sq_lowes_ratio =
+      this->options_.lowes_ratio * this->options_.lowes_ratio;
+  const bool compute_reverse_matches =
+      this->options_.keep_only_symmetric_matches;
+
+  // The squared L2 distance is |a|^2 + |b|^2 - 2 * a^T * b, so only the dot
+  // products need to be computed for each pair of descriptors.
+  const Eigen::VectorXf sq_norms1 = descriptors1.rowwise().squaredNorm();
+  const Eigen::VectorXf sq_norms2 = descriptors2.rowwise().squaredNorm();
+
+  std::vector<NearestNeighbors> forward_nearest_neighbors(num_descriptors1);
+  std::vector<NearestNeighbors> reverse_nearest_neighbors(
+      compute_reverse_matches ? num_descriptors2 : 0);
+
+  // Compute the distances one tile at a time and update the nearest neighbors
+  // of the features in both images from each tile.
+  DescriptorMatrix dot_products(kTileSize, kTileSize);
+  for (int row_start = 0; row_start < num_descriptors1;
+       row_start += kTileSize) {
+    const int num_rows = std::min(kTileSize, num_descriptors1 - row_start);
+    const auto descriptors1_block = descriptors1.middleRows(row_start, num_rows);
+
+    for (int col_start = 0; col_start < num_descriptors2;
+         col_start += kTileSize) {
+      const int num_cols = std::min(kTileSize, num_descriptors2 - col_start);
+      auto tile = dot_products.topLeftCorner(num_rows, num_cols);
+      tile.noalias() = descriptors1_block *
+                       descriptors2.middleRows(col_start, num_cols).transpose();
+
+      for (int i = 0; i < num_rows; i++) {
+        const int index1 = row_start + i;
+        const float sq_norm1 = sq_norms1(index1);
+        NearestNeighbors& forward_nearest_neighbor =
+            forward_nearest_neighbors[index1];
+        for (int j = 0; j < num_cols; j++) {
+          const int index2 = col_start + j;
+          // Clamp the distance to avoid small negative values caused by
+          // floating point round-off for (nearly) identical descriptors.
+          const float distance = std::max(
+              sq_norm1 + sq_norms2(index2) - 2.0f * tile(i, j), 0.0f);
+          forward_nearest_neighbor.Update(index2, distance);
+          if (compute_reverse_matches) {
+            reverse_nearest_neighbors[index2].Update(index1, distance);
+          }
+        }
+      }
+    }
+  }
+
+  // Only the winning nearest neighbors are turned into matches.
+  matches->reserve(num_descriptors1);
+  for (int i = 0; i < num_descriptors1; i++) {
+    const NearestNeighbors& forward_nearest_neighbor =
+        forward_nearest_neighbors[i];
+    if (!IsValidNearestNeighbor(
+            forward_nearest_neighbor, use_lowes_ratio, sq_lowes_ratio)) {
+      continue;
+    }
+
+    // The match is symmetric if feature i is also the nearest neighbor of its
+    // match in the second image.
+    if (compute_reverse_matches) {
+      const NearestNeighbors& reverse_nearest_neighbor =
+          reverse_nearest_neighbors[forward_nearest_neighbor.best_index];
+      if (reverse_nearest_neighbor.best_index != i ||
+          !IsValidNearestNeighbor(
+              reverse_nearest_neighbor, use_lowes_ratio, sq_lowes_ratio)) {
+        continue;
+      }
+    }
+
+    matches->emplace_back(i,
+                          forward_nearest_neighbor.best_index,
+                          forward_nearest_neighbor.best_distance);
+  }
+
+  return matches->size() >= this->options_.min_num_feature_matches;
+}
+
+}  // namespace theia
@@ -0,0 +1,75 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_BLOCKED_BRUTE_FORCE_FEATURE_MATCHER_H_
+#define THEIA_MATCHING_BLOCKED_BRUTE_FORCE_FEATURE_MATCHER_H_
+
+#include <vector>
+
+#include "theia/matching/feature_matcher.h"
+#include "theia/matching/features_and_matches_database.h"
+#include "theia/util/util.h"
+
+namespace theia {
+struct FeatureMatcherOptions;
+struct IndexedFeatureMatch;
+struct KeypointsAndDescriptors;
+
+// Performs exhaustive feature matching between two sets of features, producing
+// the same matches as the BruteForceFeatureMatcher. Instead of computing the
+// distance between every pair of descriptors one at a time, the squared L2
+// distances are computed as |a|^2 + |b|^2 - 2 * a^T * b (i.e. 2 - 2 * a^T * b
+// for unit-norm descriptors) with a matrix-matrix product over cache-sized
+// tiles of the two descriptor matrices. The two nearest neighbors of each
+// feature in both images are updated from the same tile, so the forward and
+// reverse (symmetric) matches are found in a single pass over the distances.
+class BlockedBruteForceFeatureMatcher : public FeatureMatcher {
+ public:
+  BlockedBruteForceFeatureMatcher(
+      const FeatureMatcherOptions& options,
+      FeaturesAndMatchesDatabase* features_and_matches_database)
+      : FeatureMatcher(options, features_and_matches_database) {}
+  ~BlockedBruteForceFeatureMatcher() {}
+
+ private:
+  bool MatchImagePair(
+      const KeypointsAndDescriptors& features1,
+      const KeypointsAndDescriptors& features2,
+      std::vector<IndexedFeatureMatch>* matched_featuers) override;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockedBruteForceFeatureMatcher);
+};
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_BLOCKED_BRUTE_FORCE_FEATURE_MATCHER_H_
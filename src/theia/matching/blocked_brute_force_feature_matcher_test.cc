@@ -0,0 +1,274 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <vector>
+
+#include "theia/matching/blocked_brute_force_feature_matcher.h"
+#include "theia/matching/brute_force_feature_matcher.h"
+#include "theia/matching/distance.h"
+#include "theia/matching/feature_matcher.h"
+#include "theia/matching/image_pair_match.h"
+#include "theia/matching/in_memory_features_and_matches_database.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/util/random.h"
+
+#include "gtest/gtest.h"
+
+namespace theia {
+
+using Eigen::VectorXf;
+
+static const int kNumDescriptors = 10;
+static const int kNumDescriptorDimensions = 10;
+
+TEST(BlockedBruteForceFeatureMatcherTest, NoOptions) {
+  // Set up descriptors.
+  KeypointsAndDescriptors features1, features2;
+  features1.descriptors.resize(kNumDescriptors, kNumDescriptorDimensions);
+  features2.descriptors.resize(kNumDescriptors, kNumDescriptorDimensions);
+  for (int i = 0; i < kNumDescriptors; i++) {
+    // Avoid a zero vector.
+    features1.descriptors.row(i).setConstant(1);
+    features2.descriptors.row(i).setConstant(1);
+    features1.descriptors.row(i).normalize();
+    features2.descriptors.row(i).normalize();
+  }
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = false;
+  options.use_lowes_ratio = false;
+  options.perform_geometric_verification = false;
+
+  // Add features.
+  features1.keypoints.resize(features1.descriptors.rows());
+  features2.keypoints.resize(features2.descriptors.rows());
+  InMemoryFeaturesAndMatchesDatabase database;
+  database.PutFeatures("1", features1);
+  database.PutFeatures("2", features2);
+
+  BlockedBruteForceFeatureMatcher matcher(options, &database);
+  matcher.AddImage("1");
+  matcher.AddImage("2");
+
+  // Match features
+  matcher.MatchImages();
+
+  // Check that the results are valid.
+  EXPECT_GT(database.NumMatches(), 0);
+}
+
+TEST(BlockedBruteForceFeatureMatcherTest, RatioTest) {
+  // Set up descriptors.
+  KeypointsAndDescriptors features1, features2;
+  features1.descriptors.resize(1, kNumDescriptorDimensions);
+  features2.descriptors.resize(2, kNumDescriptorDimensions);
+
+  features1.descriptors.row(0).setConstant(1);
+  features1.descriptors.row(0).normalize();
+
+  // Set the two descriptors to be very close to each other so that they do not
+  // pass the ratio test.
+  features2.descriptors.row(0).setConstant(1);
+  features2.descriptors(0, 0) = 0.9;
+  features2.descriptors.row(0).normalize();
+  features2.descriptors.row(1).setConstant(1);
+  features2.descriptors(1, 0) = 0.89;
+  features2.descriptors.row(1).normalize();
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = false;
+  options.use_lowes_ratio = true;
+  options.perform_geometric_verification = false;
+
+  // Add features.
+  features1.keypoints.resize(features1.descriptors.rows());
+  features2.keypoints.resize(features2.descriptors.rows());
+
+  InMemoryFeaturesAndMatchesDatabase database;
+  database.PutFeatures("1", features1);
+  database.PutFeatures("2", features2);
+
+  BlockedBruteForceFeatureMatcher matcher(options, &database);
+  matcher.AddImage("1");
+  matcher.AddImage("2");
+
+  // Match features.
+  matcher.MatchImages();
+
+  // Check that the results are valid.
+  EXPECT_GT(database.NumMatches(), 0);
+}
+
+TEST(BlockedBruteForceFeatureMatcherTest, SymmetricMatches) {
+  // Set up descriptors.
+  KeypointsAndDescriptors features1, features2;
+  features1.descriptors.resize(2, kNumDescriptorDimensions);
+  features2.descriptors.resize(2, kNumDescriptorDimensions);
+
+  features1.descriptors.row(0).setConstant(1);
+  features1.descriptors.row(0).normalize();
+  features1.descriptors.row(1).setZero();
+  features1.descriptors(1, 0) = 1.0;
+
+  // Set the two descriptors to be closer to features1.descriptors.row(0) so that
+  // the symmetric matching produces only 1 match.
+  features2.descriptors.row(0).setConstant(1);
+  features2.descriptors(0, 0) = 0;
+  features2.descriptors.row(0).normalize();
+  features2.descriptors.row(1).setConstant(1);
+  features2.descriptors(1, 1) = 0;
+  features2.descriptors(1, 2) = 0;
+  features2.descriptors.row(1).normalize();
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = true;
+  options.use_lowes_ratio = false;
+  options.perform_geometric_verification = false;
+
+  // Add features.
+  features1.keypoints.resize(features1.descriptors.rows());
+  features2.keypoints.resize(features2.descriptors.rows());
+
+  InMemoryFeaturesAndMatchesDatabase database;
+  database.PutFeatures("1", features1);
+  database.PutFeatures("2", features2);
+
+  BlockedBruteForceFeatureMatcher matcher(options, &database);
+  matcher.AddImage("1");
+  matcher.AddImage("2");
+
+  // Match features.
+  matcher.MatchImages();
+
+  // Check that the results are valid.
+  EXPECT_EQ(database.NumMatches(), 1);
+}
+
+// Returns the sorted matches between images "1" and "2" in the database. The
+// keypoint x-coordinates are set to the feature indices, so the matches can be
+// compared directly.
+std::vector<std::pair<int, int> > GetSortedMatchIndices(
+    InMemoryFeaturesAndMatchesDatabase* database) {
+  const ImagePairMatch match = database->GetImagePairMatch("1", "2");
+  std::vector<std::pair<int, int> > match_indices;
+  for (const FeatureCorrespondence& correspondence : match.correspondences) {
+    match_indices.emplace_back(static_cast<int>(correspondence.feature1.x()),
+                               static_cast<int>(correspondence.feature2.x()));
+  }
+  std::sort(match_indices.begin(), match_indices.end());
+  return match_indices;
+}
+
+void TestMatchesAgreeWithBruteForceMatcher(const bool use_lowes_ratio,
+                                           const bool symmetric_matches) {
+  // Use enough features so that the descriptors span multiple tiles in both
+  // images.
+  static const int kNumFeatures1 = 600;
+  static const int kNumFeatures2 = 700;
+  static const int kNumSiftDimensions = 128;
+  RandomNumberGenerator rng(59);
+
+  KeypointsAndDescriptors features1, features2;
+  features1.descriptors.resize(kNumFeatures1, kNumSiftDimensions);
+  features2.descriptors.resize(kNumFeatures2, kNumSiftDimensions);
+  rng.SetRandom(&features1.descriptors);
+  rng.SetRandom(&features2.descriptors);
+  // Make a subset of the features in the second image close to features in the
+  // first image so that there are good matches.
+  for (int i = 0; i < kNumFeatures1; i += 2) {
+    Eigen::VectorXf noise(kNumSiftDimensions);
+    rng.SetRandom(&noise);
+    features2.descriptors.row(i) =
+        features1.descriptors.row(i) + 0.1 * noise.transpose();
+  }
+  features1.descriptors.rowwise().normalize();
+  features2.descriptors.rowwise().normalize();
+  for (int i = 0; i < kNumFeatures1; i++) {
+    features1.keypoints.emplace_back(i, 0, Keypoint::OTHER);
+  }
+  for (int i = 0; i < kNumFeatures2; i++) {
+    features2.keypoints.emplace_back(i, 0, Keypoint::OTHER);
+  }
+
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = symmetric_matches;
+  options.use_lowes_ratio = use_lowes_ratio;
+  options.perform_geometric_verification = false;
+
+  InMemoryFeaturesAndMatchesDatabase brute_force_database;
+  brute_force_database.PutFeatures("1", features1);
+  brute_force_database.PutFeatures("2", features2);
+  BruteForceFeatureMatcher brute_force_matcher(options, &brute_force_database);
+  brute_force_matcher.AddImage("1");
+  brute_force_matcher.AddImage("2");
+  brute_force_matcher.MatchImages();
+
+  InMemoryFeaturesAndMatchesDatabase blocked_database;
+  blocked_database.PutFeatures("1", features1);
+  blocked_database.PutFeatures("2", features2);
+  BlockedBruteForceFeatureMatcher blocked_matcher(options, &blocked_database);
+  blocked_matcher.AddImage("1");
+  blocked_matcher.AddImage("2");
+  blocked_matcher.MatchImages();
+
+  const std::vector<std::pair<int, int> > expected_matches =
+      GetSortedMatchIndices(&brute_force_database);
+  const std::vector<std::pair<int, int> > matches =
+      GetSortedMatchIndices(&blocked_database);
+  EXPECT_GT(matches.size(), 0);
+  EXPECT_EQ(matches, expected_matches);
+}
+
+TEST(BlockedBruteForceFeatureMatcherTest, AgreesWithBruteForce) {
+  TestMatchesAgreeWithBruteForceMatcher(false, false);
+}
+
+TEST(BlockedBruteForceFeatureMatcherTest, AgreesWithBruteForceRatioTest) {
+  TestMatchesAgreeWithBruteForceMatcher(true, false);
+}
+
+TEST(BlockedBruteForceFeatureMatcherTest, AgreesWithBruteForceSymmetric) {
+  TestMatchesAgreeWithBruteForceMatcher(true, true);
+}
+
+}  // namespace theia
@@ -39,47 +39,187 @@
 #include <algorithm>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/descriptor_quantization.h"
 #include "theia/matching/distance.h"
+#include "theia/matching/feature_matcher_options.h"
 #include "theia/matching/feature_matcher_utils.h"
+#include "theia/matching/hamming_distance.h"
 #include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/matching/quantized_l2_distance.h"
 
 namespace theia {
 
+namespace {
 
-bool BruteForceFeatureMatcher::MatchImagePair(
-    const KeypointsAndDescriptors& features1,
-    const KeypointsAndDescriptors& features2,
-    std::vector<IndexedFeatureMatch>* matches) {
+// The distance kernels for each type of descriptor. Each kernel computes the
+// distances between descriptor i of descriptors1 and all descriptors of
+// descriptors2.
 
-  const std::vector<Eigen::VectorXf>& descriptors1 = features1.descriptors;
-  const std::vector<Eigen::VectorXf>& descriptors2 = features2.descriptors;
-  matches->reserve(descriptors1.size());
+// The squared L2 distance is used for float descriptors.
+struct L2DistanceKernel {
+  typedef DescriptorMatrix DescriptorMatrixType;
 
-  const double sq_lowes_ratio =
-      this->options_.lowes_ratio * this->options_.lowes_ratio;
+  static void ComputeDistances(const DescriptorMatrix& descriptors1,
+                               const int i,
+                               const DescriptorMatrix& descriptors2,
+                               std::vector<IndexedFeatureMatch>* matches) {
+    L2 distance;
+    for (int j = 0; j < descriptors2.rows(); j++) {
+      (*matches)[j] = IndexedFeatureMatch(
+          i, j, distance(descriptors1.row(i), descriptors2.row(j)));
+    }
+  }
+};
 
-  // Compute forward matches.
-  L2 distance;
-  std::vector<IndexedFeatureMatch> temp_matches(descriptors2.size());
-  for (int i = 0; i < descriptors1.size(); i++) {
-    for (int j = 0; j < descriptors2.size(); j++) {
-      temp_matches[j] =
-          IndexedFeatureMatch(i, j, distance(descriptors1[i], descriptors2[j]));
+// The Hamming distance is used for binary descriptors. All distances are
+// computed with a single call to the popcount kernel.
+struct HammingDistanceKernel {
+  typedef BinaryDescriptorMatrix DescriptorMatrixType;
+
+  static void ComputeDistances(const BinaryDescriptorMatrix& descriptors1,
+                               const int i,
+                               const BinaryDescriptorMatrix& descriptors2,
+                               std::vector<IndexedFeatureMatch>* matches) {
+    std::vector<int> distances(descriptors2.rows());
+    ComputeHammingDistances(descriptors1.row(i).data(),
+                            descriptors2.data(),
+                            descriptors2.cols(),
+                            descriptors2.rows(),
+                            distances.data());
+    for (int j = 0; j < descriptors2.rows(); j++) {
+      (*matches)[j] = IndexedFeatureMatch(i, j, distances[j]);
+    }
+  }
+};
+
+// The squared L2 distance of quantized float descriptors is computed with the
+// integer kernel. The distances are scaled back so that they are comparable to
+// the distances of float descriptors.
+struct QuantizedL2DistanceKernel {
+  typedef QuantizedDescriptorMatrix DescriptorMatrixType;
+
+  static void ComputeDistances(const QuantizedDescriptorMatrix& descriptors1,
+                               const int i,
+                               const QuantizedDescriptorMatrix& descriptors2,
+                               std::vector<IndexedFeatureMatch>* matches) {
+    static const float kDistanceScale =
+        1.0f / (kDescriptorQuantizationScale * kDescriptorQuantizationScale);
+    std::vector<int> distances(descriptors2.rows());
+    ComputeQuantizedSquaredL2Distances(descriptors1.row(i).data(),
+                                       descriptors2.data(),
+                                       descriptors2.cols(),
+                                       descriptors2.rows(),
+                                       distances.data());
+    for (int j = 0; j < descriptors2.rows(); j++) {
+      (*matches)[j] = IndexedFeatureMatch(i, j, distances[j] * kDistanceScale);
     }
+  }
+};
+
+// Finds the nearest neighbor in descriptors2 of each descriptor in
+// descriptors1. If use_lowes_ratio is true, only matches whose distance is
+// less than lowes_ratio times the distance of the second nearest neighbor are
+// kept, so no matches are found if descriptors2 has a single descriptor.
+template <class DistanceKernel>
+void ComputeOneWayMatches(
+    const typename DistanceKernel::DescriptorMatrixType& descriptors1,
+    const typename DistanceKernel::DescriptorMatrixType& descriptors2,
+    const bool use_lowes_ratio,
+    const double lowes_ratio,
+    std::vector<IndexedFeatureMatch>* matches) {
+  const int num_nearest_neighbors = use_lowes_ratio ? 2 : 1;
+  if (descriptors2.rows() < num_nearest_neighbors) {
+    return;
+  }
+
+  std::vector<IndexedFeatureMatch> temp_matches(descriptors2.rows());
+  for (int i = 0; i < descriptors1.rows(); i++) {
+    DistanceKernel::ComputeDistances(
+        descriptors1, i, descriptors2, &temp_matches);
 
     // Get the lowest distance matches.
     std::partial_sort(temp_matches.begin(),
-                      temp_matches.begin() + 2,
+                      temp_matches.begin() + num_nearest_neighbors,
                       temp_matches.end(),
                       CompareFeaturesByDistance);
 
     // Add to the matches vector if lowes ratio test is turned off or it is
     // turned on and passes the test.
-    if (!this->options_.use_lowes_ratio ||
-        temp_matches[0].distance < sq_lowes_ratio * temp_matches[1].distance) {
+    if (!use_lowes_ratio ||
+        temp_matches[0].distance < lowes_ratio * temp_matches[1].distance) {
       matches->emplace_back(temp_matches[0]);
     }
   }
+}
+
+// Matches the descriptors of features1 to the descriptors of features2 with the
+// distance that corresponds to the type of the descriptors.
+void ComputeOneWayMatches(const KeypointsAndDescriptors& features1,
+                          const KeypointsAndDescriptors& features2,
+                          const bool use_lowes_ratio,
+                          const double lowes_ratio,
+                          std::vector<IndexedFeatureMatch>* matches) {
+  if (features1.HasBinaryDescriptors()) {
+    ComputeOneWayMatches<HammingDistanceKernel>(features1.binary_descriptors,
+                                                features2.binary_descriptors,
+                                                use_lowes_ratio,
+                                                lowes_ratio,
+                                                matches);
+  } else if (features1.HasQuantizedDescriptors()) {
+    ComputeOneWayMatches<QuantizedL2DistanceKernel>(
+        features1.quantized_descriptors,
+        features2.quantized_descriptors,
+        use_lowes_ratio,
+        lowes_ratio,
+        matches);
+  } else {
+    ComputeOneWayMatches<L2DistanceKernel>(features1.descriptors,
+                                           features2.descriptors,
+                                           use_lowes_ratio,
+                                           lowes_ratio,
+                                           matches);
+  }
+}
+
+// Checks that the features can be matched to each other and returns the ratio
+// that the distances of the nearest neighbors are compared with. The L2
+// distance is squared while the Hamming distance is not, so the ratio is
+// adjusted accordingly.
+double LowesRatioForDescriptors(const FeatureMatcherOptions& options,
+                                const KeypointsAndDescriptors& features1,
+                                const KeypointsAndDescriptors& features2) {
+  CHECK_EQ(features1.HasBinaryDescriptors(), features2.HasBinaryDescriptors())
+      << "Cannot match binary descriptors to float descriptors.";
+  CHECK_EQ(features1.HasQuantizedDescriptors(),
+           features2.HasQuantizedDescriptors())
+      << "Cannot match quantized descriptors to float descriptors.";
+  return features1.HasBinaryDescriptors()
+             ? options.lowes_ratio
+             : options.lowes_ratio * options.lowes_ratio;
+}
+
+}  // namespace
+
+bool BruteForceFeatureMatcher::MatchImagePair(
+    const KeypointsAndDescriptors& features1,
+    const KeypointsAndDescriptors& features2,
+    std::vector<IndexedFeatureMatch>* matches) {
+  // The descriptor type cannot be determined for images without features.
+  if (features1.keypoints.empty() || features2.keypoints.empty()) {
+    return false;
+  }
+  const double lowes_ratio =
+      LowesRatioForDescriptors(this->options_, features1, features2);
+  matches->reserve(features1.keypoints.size());
+
+  // Compute forward matches.
+  ComputeOneWayMatches(features1,
+                       features2,
+                       this->options_.use_lowes_ratio,
+                       lowes_ratio,
+                       matches);
 
   if (matches->size() < this->options_.min_num_feature_matches) {
     return false;
@@ -88,32 +228,38 @@ bool BruteForceFeatureMatcher::MatchImagePair(
   // Compute the symmetric matches, if applicable.
   if (this->options_.keep_only_symmetric_matches) {
     std::vector<IndexedFeatureMatch> reverse_matches;
-    temp_matches.resize(descriptors1.size());
-    // Only compute the distances for the valid matches.
-    for (int i = 0; i < descriptors2.size(); i++) {
-      for (int j = 0; j < descriptors1.size(); j++) {
-        temp_matches[j] = IndexedFeatureMatch(
-            i, j, distance(descriptors2[i], descriptors1[j]));
-      }
-
-      // Get the lowest distance matches.
-      std::partial_sort(temp_matches.begin(),
-                        temp_matches.begin() + 2,
-                        temp_matches.end(),
-                        CompareFeaturesByDistance);
-
-      // Add to the matches vector if lowes ratio test is turned off or it is
-      // turned on and passes the test.
-      if (!this->options_.use_lowes_ratio ||
-          temp_matches[0].distance <
-              sq_lowes_ratio * temp_matches[1].distance) {
-        reverse_matches.emplace_back(temp_matches[0]);
-      }
-    }
+    ComputeOneWayMatches(features2,
+                         features1,
+                         this->options_.use_lowes_ratio,
+                         lowes_ratio,
+                         &reverse_matches);
     IntersectMatches(reverse_matches, matches);
   }
 
   return matches->size() >= this->options_.min_num_feature_matches;
 }
 
+void ComputeBruteForceFeatureMatches(
+    const FeatureMatcherOptions& options,
+    const KeypointsAndDescriptors& features1,
+    const KeypointsAndDescriptors& features2,
+    std::vector<IndexedFeatureMatch>* matches) {
+  if (features1.keypoints.empty() || features2.keypoints.empty()) {
+    return;
+  }
+  const double lowes_ratio =
+      LowesRatioForDescriptors(options, features1, features2);
+  ComputeOneWayMatches(
+      features1, features2, options.use_lowes_ratio, lowes_ratio, matches);
+  if (options.keep_only_symmetric_matches) {
+    std::vector<IndexedFeatureMatch> reverse_matches;
+    ComputeOneWayMatches(features2,
+                         features1,
+                         options.use_lowes_ratio,
+                         lowes_ratio,
+                         &reverse_matches);
+    IntersectMatches(reverse_matches, matches);
+  }
+}
+
 }  // namespace theia
@@ -47,7 +47,8 @@ struct IndexedFeatureMatch;
 struct KeypointsAndDescriptors;
 
 // Performs features matching between two sets of features using a brute force
-// matching method.
+// matching method. Float descriptors are matched with the L2 distance and
+// binary descriptors are matched with the Hamming distance.
 class BruteForceFeatureMatcher : public FeatureMatcher {
  public:
   BruteForceFeatureMatcher(
@@ -64,6 +65,18 @@ class BruteForceFeatureMatcher : public FeatureMatcher {
 
   DISALLOW_COPY_AND_ASSIGN(BruteForceFeatureMatcher);
 };
+
+// Matches the descriptors of features1 to those of features2 by exhaustive
+// search with the lowes ratio test and symmetric matching as set in the
+// options. Unlike the BruteForceFeatureMatcher, all matches are returned
+// regardless of options.min_num_feature_matches. This allows small subsets of
+// features to be matched without a matcher (e.g., for preemptive matching).
+void ComputeBruteForceFeatureMatches(
+    const FeatureMatcherOptions& options,
+    const KeypointsAndDescriptors& features1,
+    const KeypointsAndDescriptors& features2,
+    std::vector<IndexedFeatureMatch>* matches);
+
 }  // namespace theia
 
 #endif  // THEIA_MATCHING_BRUTE_FORCE_FEATURE_MATCHER_H_
@@ -33,8 +33,10 @@
 // Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
 
 #include <Eigen/Core>
+#include <string>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_quantization.h"
 #include "theia/matching/brute_force_feature_matcher.h"
 #include "theia/matching/distance.h"
 #include "theia/matching/feature_matcher.h"
@@ -54,14 +56,14 @@ static const int kNumDescriptorDimensions = 10;
 TEST(BruteForceFeatureMatcherTest, NoOptions) {
   // Set up descriptors.
   KeypointsAndDescriptors features1, features2;
-  features1.descriptors.resize(kNumDescriptors);
-  features2.descriptors.resize(kNumDescriptors);
+  features1.descriptors.resize(kNumDescriptors, kNumDescriptorDimensions);
+  features2.descriptors.resize(kNumDescriptors, kNumDescriptorDimensions);
   for (int i = 0; i < kNumDescriptors; i++) {
     // Avoid a zero vector.
-    features1.descriptors[i] = VectorXf::Constant(kNumDescriptorDimensions, 1);
-    features2.descriptors[i] = VectorXf::Constant(kNumDescriptorDimensions, 1);
-    features1.descriptors[i].normalize();
-    features2.descriptors[i].normalize();
+    features1.descriptors.row(i).setConstant(1);
+    features2.descriptors.row(i).setConstant(1);
+    features1.descriptors.row(i).normalize();
+    features2.descriptors.row(i).normalize();
   }
 
   // Set options.
@@ -72,8 +74,8 @@ TEST(BruteForceFeatureMatcherTest, NoOptions) {
   options.perform_geometric_verification = false;
 
   // Add features.
-  features1.keypoints.resize(features1.descriptors.size());
-  features2.keypoints.resize(features2.descriptors.size());
+  features1.keypoints.resize(features1.descriptors.rows());
+  features2.keypoints.resize(features2.descriptors.rows());
   InMemoryFeaturesAndMatchesDatabase database;
   database.PutFeatures("1", features1);
   database.PutFeatures("2", features2);
@@ -89,23 +91,156 @@ TEST(BruteForceFeatureMatcherTest, NoOptions) {
   EXPECT_GT(database.NumMatches(), 0);
 }
 
+// Prefetching the features must not change the matches.
+TEST(BruteForceFeatureMatcherTest, PrefetchThreads) {
+  static const int kNumImages = 20;
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.num_threads = 4;
+  options.num_prefetch_threads = 2;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = false;
+  options.use_lowes_ratio = false;
+  options.perform_geometric_verification = false;
+
+  InMemoryFeaturesAndMatchesDatabase database;
+  BruteForceFeatureMatcher matcher(options, &database);
+  for (int i = 0; i < kNumImages; i++) {
+    KeypointsAndDescriptors features;
+    features.image_name = std::to_string(i);
+    features.descriptors.resize(kNumDescriptors, kNumDescriptorDimensions);
+    features.descriptors.setConstant(1);
+    features.descriptors.rowwise().normalize();
+    features.keypoints.resize(kNumDescriptors);
+    database.PutFeatures(features.image_name, features);
+    matcher.AddImage(features.image_name);
+  }
+
+  // Match features.
+  matcher.MatchImages();
+
+  // Check that all image pairs were matched.
+  EXPECT_EQ(database.NumMatches(), kNumImages * (kNumImages - 1) / 2);
+}
+
+// Running matching, verification and writing as a pipeline of separate
+// threads must not change the matches.
+TEST(BruteForceFeatureMatcherTest, VerificationThreads) {
+  static const int kNumImages = 20;
+
+  // Set options. The small queues make the matching threads block on the
+  // verification threads.
+  FeatureMatcherOptions options;
+  options.num_threads = 4;
+  options.num_verification_threads = 2;
+  options.num_database_writer_threads = 1;
+  options.max_num_queued_image_pairs = 2;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = false;
+  options.use_lowes_ratio = false;
+  options.perform_geometric_verification = false;
+
+  InMemoryFeaturesAndMatchesDatabase database;
+  BruteForceFeatureMatcher matcher(options, &database);
+  for (int i = 0; i < kNumImages; i++) {
+    KeypointsAndDescriptors features;
+    features.image_name = std::to_string(i);
+    features.descriptors.resize(kNumDescriptors, kNumDescriptorDimensions);
+    features.descriptors.setConstant(1);
+    features.descriptors.rowwise().normalize();
+    features.keypoints.resize(kNumDescriptors);
+    database.PutFeatures(features.image_name, features);
+    matcher.AddImage(features.image_name);
+  }
+
+  // Match features.
+  matcher.MatchImages();
+
+  // Check that all image pairs were matched with all of their features.
+  EXPECT_EQ(database.NumMatches(), kNumImages * (kNumImages - 1) / 2);
+  for (int i = 0; i < kNumImages; i++) {
+    for (int j = i + 1; j < kNumImages; j++) {
+      EXPECT_EQ(database
+                    .GetImagePairMatch(std::to_string(i), std::to_string(j))
+                    .correspondences.size(),
+                kNumDescriptors);
+    }
+  }
+}
+
+// Preemptive matching rejects the image pairs whose largest features do not
+// match before all features are matched.
+TEST(BruteForceFeatureMatcherTest, PreemptiveMatching) {
+  static const int kNumFeatures = 50;
+  static const int kNumPreemptiveFeatures = 10;
+  static const int kNumDimensions = 64;
+
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.perform_geometric_verification = false;
+  options.num_features_for_preemptive_matching = kNumPreemptiveFeatures;
+  options.min_num_preemptive_matches = 4;
+
+  // Images 0 and 1 share all features, while the features of image 2 are
+  // unrelated. The features are listed in order of increasing scale so that
+  // preemptive matching has to select the last ones.
+  KeypointsAndDescriptors features[3];
+  features[0].descriptors.setRandom(kNumFeatures, kNumDimensions);
+  features[0].descriptors.rowwise().normalize();
+  features[1].descriptors = features[0].descriptors;
+  features[2].descriptors.setRandom(kNumFeatures, kNumDimensions);
+  features[2].descriptors.rowwise().normalize();
+
+  InMemoryFeaturesAndMatchesDatabase database;
+  BruteForceFeatureMatcher matcher(options, &database);
+  for (int i = 0; i < 3; i++) {
+    features[i].image_name = std::to_string(i);
+    features[i].keypoints.resize(kNumFeatures);
+    for (int j = 0; j < kNumFeatures; j++) {
+      features[i].keypoints[j].set_scale(j + 1.0);
+    }
+    database.PutFeatures(features[i].image_name, features[i]);
+    matcher.AddImage(features[i].image_name);
+  }
+
+  matcher.MatchImages();
+
+  // Only the pair of overlapping images is matched, with all of its features.
+  EXPECT_EQ(database.NumMatches(), 1);
+  EXPECT_EQ(database.GetImagePairMatch("0", "1").correspondences.size(),
+            kNumFeatures);
+
+  // Without preemptive matching, the other pairs are matched as well since no
+  // minimum number of matches is required.
+  options.num_features_for_preemptive_matching = 0;
+  InMemoryFeaturesAndMatchesDatabase all_pairs_database;
+  BruteForceFeatureMatcher all_pairs_matcher(options, &all_pairs_database);
+  for (int i = 0; i < 3; i++) {
+    all_pairs_database.PutFeatures(features[i].image_name, features[i]);
+    all_pairs_matcher.AddImage(features[i].image_name);
+  }
+  all_pairs_matcher.MatchImages();
+  EXPECT_EQ(all_pairs_database.NumMatches(), 3);
+}
+
 TEST(BruteForceFeatureMatcherTest, RatioTest) {
   // Set up descriptors.
   KeypointsAndDescriptors features1, features2;
-  features1.descriptors.resize(1);
-  features2.descriptors.resize(2);
+  features1.descriptors.resize(1, kNumDescriptorDimensions);
+  features2.descriptors.resize(2, kNumDescriptorDimensions);
 
-  features1.descriptors[0] =
-      VectorXf::Constant(kNumDescriptorDimensions, 1).normalized();
+  features1.descriptors.row(0).setConstant(1);
+  features1.descriptors.row(0).normalize();
 
   // Set the two descriptors to be very close to each other so that they do not
   // pass the ratio test.
-  features2.descriptors[0] = VectorXf::Constant(kNumDescriptorDimensions, 1);
-  features2.descriptors[0](0) = 0.9;
-  features2.descriptors[0].normalize();
-  features2.descriptors[1] = VectorXf::Constant(kNumDescriptorDimensions, 1);
-  features2.descriptors[1](0) = 0.89;
-  features2.descriptors[1].normalize();
+  features2.descriptors.row(0).setConstant(1);
+  features2.descriptors(0, 0) = 0.9;
+  features2.descriptors.row(0).normalize();
+  features2.descriptors.row(1).setConstant(1);
+  features2.descriptors(1, 0) = 0.89;
+  features2.descriptors.row(1).normalize();
 
   // Set options.
   FeatureMatcherOptions options;
@@ -115,8 +250,8 @@ TEST(BruteForceFeatureMatcherTest, RatioTest) {
   options.perform_geometric_verification = false;
 
   // Add features.
-  features1.keypoints.resize(features1.descriptors.size());
-  features2.keypoints.resize(features2.descriptors.size());
+  features1.keypoints.resize(features1.descriptors.rows());
+  features2.keypoints.resize(features2.descriptors.rows());
 
   InMemoryFeaturesAndMatchesDatabase database;
   database.PutFeatures("1", features1);
@@ -136,23 +271,23 @@ TEST(BruteForceFeatureMatcherTest, RatioTest) {
 TEST(BruteForceFeatureMatcherTest, SymmetricMatches) {
   // Set up descriptors.
   KeypointsAndDescriptors features1, features2;
-  features1.descriptors.resize(2);
-  features2.descriptors.resize(2);
+  features1.descriptors.resize(2, kNumDescriptorDimensions);
+  features2.descriptors.resize(2, kNumDescriptorDimensions);
 
-  features1.descriptors[0] =
-      VectorXf::Constant(kNumDescriptorDimensions, 1).normalized();
-  features1.descriptors[1] = VectorXf::Constant(kNumDescriptorDimensions, 0);
-  features1.descriptors[1](0) = 1.0;
+  features1.descriptors.row(0).setConstant(1);
+  features1.descriptors.row(0).normalize();
+  features1.descriptors.row(1).setZero();
+  features1.descriptors(1, 0) = 1.0;
 
-  // Set the two descriptors to be closer to features1.descriptors[0] so that
+  // Set the two descriptors to be closer to features1.descriptors.row(0) so that
   // the symmetric matching produces only 1 match.
-  features2.descriptors[0] = VectorXf::Constant(kNumDescriptorDimensions, 1);
-  features2.descriptors[0](0) = 0;
-  features2.descriptors[0].normalize();
-  features2.descriptors[1] = VectorXf::Constant(kNumDescriptorDimensions, 1);
-  features2.descriptors[1](1) = 0;
-  features2.descriptors[1](2) = 0;
-  features2.descriptors[1].normalize();
+  features2.descriptors.row(0).setConstant(1);
+  features2.descriptors(0, 0) = 0;
+  features2.descriptors.row(0).normalize();
+  features2.descriptors.row(1).setConstant(1);
+  features2.descriptors(1, 1) = 0;
+  features2.descriptors(1, 2) = 0;
+  features2.descriptors.row(1).normalize();
 
   // Set options.
   FeatureMatcherOptions options;
@@ -162,8 +297,8 @@ TEST(BruteForceFeatureMatcherTest, SymmetricMatches) {
   options.perform_geometric_verification = false;
 
   // Add features.
-  features1.keypoints.resize(features1.descriptors.size());
-  features2.keypoints.resize(features2.descriptors.size());
+  features1.keypoints.resize(features1.descriptors.rows());
+  features2.keypoints.resize(features2.descriptors.rows());
 
   InMemoryFeaturesAndMatchesDatabase database;
   database.PutFeatures("1", features1);
@@ -180,4 +315,129 @@ TEST(BruteForceFeatureMatcherTest, SymmetricMatches) {
   EXPECT_EQ(database.NumMatches(), 1);
 }
 
+TEST(BruteForceFeatureMatcherTest, SingleCandidate) {
+  // The second image has a single descriptor, so there is no second nearest
+  // neighbor for the ratio test.
+  KeypointsAndDescriptors features1, features2;
+  features1.descriptors =
+      DescriptorMatrix::Random(kNumDescriptors, kNumDescriptorDimensions);
+  features2.descriptors = features1.descriptors.topRows(1);
+  features1.keypoints.resize(kNumDescriptors);
+  features2.keypoints.resize(1);
+
+  FeatureMatcherOptions options;
+  options.keep_only_symmetric_matches = false;
+  options.use_lowes_ratio = false;
+  std::vector<IndexedFeatureMatch> matches;
+  ComputeBruteForceFeatureMatches(options, features1, features2, &matches);
+  ASSERT_EQ(matches.size(), kNumDescriptors);
+  for (int i = 0; i < matches.size(); i++) {
+    EXPECT_EQ(matches[i].feature1_ind, i);
+    EXPECT_EQ(matches[i].feature2_ind, 0);
+  }
+
+  options.keep_only_symmetric_matches = true;
+  matches.clear();
+  ComputeBruteForceFeatureMatches(options, features1, features2, &matches);
+  ASSERT_EQ(matches.size(), 1);
+  EXPECT_EQ(matches[0].feature1_ind, 0);
+  EXPECT_EQ(matches[0].feature2_ind, 0);
+
+  // The single candidate cannot pass the ratio test.
+  options.use_lowes_ratio = true;
+  matches.clear();
+  ComputeBruteForceFeatureMatches(options, features1, features2, &matches);
+  EXPECT_TRUE(matches.empty());
+}
+
+TEST(BruteForceFeatureMatcherTest, BinaryDescriptors) {
+  static const int kNumBytes = 8;
+
+  // Set up random binary descriptors such that descriptor i of features2
+  // differs from descriptor i of features1 in a single bit.
+  KeypointsAndDescriptors features1, features2;
+  features1.binary_descriptors.resize(kNumDescriptors, kNumBytes);
+  for (int i = 0; i < kNumDescriptors; i++) {
+    for (int j = 0; j < kNumBytes; j++) {
+      features1.binary_descriptors(i, j) = rand() % 256;
+    }
+  }
+  features2.binary_descriptors = features1.binary_descriptors;
+  for (int i = 0; i < kNumDescriptors; i++) {
+    features2.binary_descriptors(i, i % kNumBytes) ^= 0x01;
+  }
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = true;
+  options.use_lowes_ratio = false;
+  options.perform_geometric_verification = false;
+
+  // Add features.
+  features1.keypoints.resize(features1.binary_descriptors.rows());
+  features2.keypoints.resize(features2.binary_descriptors.rows());
+  InMemoryFeaturesAndMatchesDatabase database;
+  database.PutFeatures("1", features1);
+  database.PutFeatures("2", features2);
+
+  BruteForceFeatureMatcher matcher(options, &database);
+  matcher.AddImage("1");
+  matcher.AddImage("2");
+
+  // Match features.
+  matcher.MatchImages();
+
+  // Check that each descriptor was matched to its perturbed copy.
+  EXPECT_EQ(database.NumMatches(), 1);
+  const ImagePairMatch match = database.GetImagePairMatch("1", "2");
+  EXPECT_EQ(match.correspondences.size(), kNumDescriptors);
+}
+
+TEST(BruteForceFeatureMatcherTest, QuantizedDescriptors) {
+  static const int kNumSiftDimensions = 128;
+
+  // Set up random unit norm descriptors with non-negative entries (like SIFT)
+  // such that descriptor i of features2 is a small perturbation of descriptor
+  // i of features1.
+  DescriptorMatrix descriptors1 =
+      DescriptorMatrix::Random(kNumDescriptors, kNumSiftDimensions).cwiseAbs();
+  DescriptorMatrix descriptors2 =
+      descriptors1 +
+      0.05 * DescriptorMatrix::Random(kNumDescriptors, kNumSiftDimensions);
+  descriptors1.rowwise().normalize();
+  descriptors2 = descriptors2.cwiseAbs();
+  descriptors2.rowwise().normalize();
+
+  KeypointsAndDescriptors features1, features2;
+  QuantizeDescriptors(descriptors1, &features1.quantized_descriptors);
+  QuantizeDescriptors(descriptors2, &features2.quantized_descriptors);
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = true;
+  options.use_lowes_ratio = true;
+  options.perform_geometric_verification = false;
+
+  // Add features.
+  features1.keypoints.resize(kNumDescriptors);
+  features2.keypoints.resize(kNumDescriptors);
+  InMemoryFeaturesAndMatchesDatabase database;
+  database.PutFeatures("1", features1);
+  database.PutFeatures("2", features2);
+
+  BruteForceFeatureMatcher matcher(options, &database);
+  matcher.AddImage("1");
+  matcher.AddImage("2");
+
+  // Match features.
+  matcher.MatchImages();
+
+  // Check that each descriptor was matched to its perturbed copy.
+  EXPECT_EQ(database.NumMatches(), 1);
+  const ImagePairMatch match = database.GetImagePairMatch("1", "2");
+  EXPECT_EQ(match.correspondences.size(), kNumDescriptors);
+}
+
 }  // namespace theia
@@ -43,22 +43,59 @@
 #include <utility>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_quantization.h"
 #include "theia/matching/distance.h"
 #include "theia/matching/feature_matcher.h"
+#include "theia/matching/hamming_distance.h"
 #include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/quantized_l2_distance.h"
 #include "theia/util/random.h"
 
 namespace theia {
 
+static_assert(kHashCodeSize == 128,
+              "The hamming distance kernel requires 128-bit hash codes.");
+
 namespace {
 
-void GetZeroMeanDescriptor(const std::vector<Eigen::VectorXf>& sift_desc,
-                           Eigen::VectorXf* mean) {
-  mean->setZero(sift_desc[0].size());
-  for (int i = 0; i < sift_desc.size(); i++) {
-    *mean += sift_desc[i];
+// The euclidean distance is only computed for the candidates with the best
+// hamming distances. One more candidate than this number is used.
+static const int kNumTopCandidates = 10;
+
+// Computes the squared euclidean distances between descriptor i of
+// descriptors1 and the candidate descriptors of descriptors2.
+void ComputeCandidateDistances(const DescriptorMatrix& descriptors1,
+                               const int i,
+                               const DescriptorMatrix& descriptors2,
+                               const std::vector<int>& candidates,
+                               std::vector<float>* distances) {
+  L2 l2_distance;
+  for (int j = 0; j < candidates.size(); j++) {
+    (*distances)[j] =
+        l2_distance(descriptors2.row(candidates[j]), descriptors1.row(i));
+  }
+}
+
+// Same as above, but all distances are computed with a single call to the
+// integer kernel and are then scaled back to the distances of the float
+// descriptors.
+void ComputeCandidateDistances(const QuantizedDescriptorMatrix& descriptors1,
+                               const int i,
+                               const QuantizedDescriptorMatrix& descriptors2,
+                               const std::vector<int>& candidates,
+                               std::vector<float>* distances) {
+  static const float kDistanceScale =
+      1.0f / (kDescriptorQuantizationScale * kDescriptorQuantizationScale);
+  int quantized_distances[kNumTopCandidates + 1];
+  ComputeQuantizedSquaredL2Distances(descriptors1.row(i).data(),
+                                     descriptors2.data(),
+                                     descriptors2.cols(),
+                                     candidates.data(),
+                                     candidates.size(),
+                                     quantized_distances);
+  for (int j = 0; j < candidates.size(); j++) {
+    (*distances)[j] = quantized_distances[j] * kDistanceScale;
   }
-  *mean /= static_cast<double>(sift_desc.size());
 }
 
 }  // namespace
@@ -88,40 +125,75 @@ bool CascadeHasher::Initialize(const int num_dimensions_of_descriptor) {
   return true;
 }
 
+uint64_t CascadeHasher::ProjectionFingerprint() const {
+  // A 64-bit FNV-1a hash of the version of the hashing scheme, the sizes and
+  // the values of the projections.
+  uint64_t fingerprint = 14695981039346656037ULL;
+  const auto hash_bytes = [&fingerprint](const void* data, const size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+      fingerprint = (fingerprint ^ bytes[i]) * 1099511628211ULL;
+    }
+  };
+  const int32_t sizes[] = {kCascadeHashingVersion,
+                           kHashCodeSize,
+                           kNumBucketBits,
+                           kNumBucketGroups,
+                           num_dimensions_of_descriptor_};
+  hash_bytes(sizes, sizeof(sizes));
+  hash_bytes(primary_hash_projection_.data(),
+             primary_hash_projection_.size() * sizeof(float));
+  for (int i = 0; i < kNumBucketGroups; i++) {
+    hash_bytes(secondary_hash_projection_[i].data(),
+               secondary_hash_projection_[i].size() * sizeof(float));
+  }
+  return fingerprint;
+}
+
 void CascadeHasher::CreateHashedDescriptors(
-    const std::vector<Eigen::VectorXf>& sift_desc,
+    const DescriptorMatrix& sift_desc,
     HashedImage* hashed_image) const {
-  for (int i = 0; i < sift_desc.size(); i++) {
-    // Use the zero-mean shifted descriptor.
-    const auto descriptor = sift_desc[i] - hashed_image->mean_descriptor;
-    auto& hash_code = hashed_image->hashed_desc[i].hash_code;
-
-    // Compute hash code.
-    const Eigen::VectorXf primary_projection =
-        primary_hash_projection_ * descriptor;
+  // Project all zero-mean shifted descriptors at once. Row i of the projections
+  // corresponds to descriptor i.
+  const DescriptorMatrix zero_mean_descriptors =
+      sift_desc.rowwise() - hashed_image->mean_descriptor.transpose();
+  const Eigen::MatrixXf primary_projections =
+      zero_mean_descriptors * primary_hash_projection_.transpose();
+  Eigen::MatrixXf secondary_projections[kNumBucketGroups];
+  for (int j = 0; j < kNumBucketGroups; j++) {
+    secondary_projections[j] =
+        zero_mean_descriptors * secondary_hash_projection_[j].transpose();
+  }
+
+  for (int i = 0; i < sift_desc.rows(); i++) {
+    // Compute the packed hash code.
+    uint64_t* hash_code = hashed_image->hash_codes.row(i).data();
     for (int j = 0; j < kHashCodeSize; j++) {
-      hash_code[j] = primary_projection(j) > 0;
+      if (primary_projections(i, j) > 0) {
+        hash_code[j / 64] |= uint64_t(1) << (j % 64);
+      }
     }
 
     // Determine the bucket index for each group.
     for (int j = 0; j < kNumBucketGroups; j++) {
       uint16_t bucket_id = 0;
-      const Eigen::VectorXf secondary_projection =
-          secondary_hash_projection_[j] * descriptor;
-
       for (int k = 0; k < kNumBucketBits; k++) {
-        bucket_id = (bucket_id << 1) + (secondary_projection(k) > 0 ? 1 : 0);
+        bucket_id =
+            (bucket_id << 1) + (secondary_projections[j](i, k) > 0 ? 1 : 0);
       }
-      hashed_image->hashed_desc[i].bucket_ids[j] = bucket_id;
+      hashed_image->bucket_ids(i, j) = bucket_id;
     }
   }
 }
 
 void CascadeHasher::BuildBuckets(HashedImage* hashed_image) const {
+  // Allocate the buckets even if no descriptors exist to fill them.
+  hashed_image->buckets.assign(kNumBucketGroups,
+                               std::vector<Bucket>(kNumBucketsPerGroup));
   for (int i = 0; i < kNumBucketGroups; i++) {
     // Add the descriptor ID to the proper bucket group and id.
-    for (int j = 0; j < hashed_image->hashed_desc.size(); j++) {
-      const uint16_t bucket_id = hashed_image->hashed_desc[j].bucket_ids[i];
+    for (int j = 0; j < hashed_image->NumDescriptors(); j++) {
+      const uint16_t bucket_id = hashed_image->bucket_ids(j, i);
       hashed_image->buckets[i][bucket_id].push_back(j);
     }
   }
@@ -132,28 +204,19 @@ void CascadeHasher::BuildBuckets(HashedImage* hashed_image) const {
 //   2) Compute hash code and hash buckets.
 //   3) Construct buckets.
 HashedImage CascadeHasher::CreateHashedSiftDescriptors(
-    const std::vector<Eigen::VectorXf>& sift_desc) const {
+    const DescriptorMatrix& sift_desc) const {
   HashedImage hashed_image;
-
-  // Allocate the buckets even if no descriptors exist to fill them.
-  hashed_image.buckets.resize(kNumBucketGroups);
-  for (int i = 0; i < kNumBucketGroups; i++) {
-    hashed_image.buckets[i].resize(kNumBucketsPerGroup);
-  }
-
-  if (sift_desc.size() == 0) {
+  if (sift_desc.rows() == 0) {
+    BuildBuckets(&hashed_image);
     return hashed_image;
   }
 
-  GetZeroMeanDescriptor(sift_desc, &hashed_image.mean_descriptor);
-
-  // Allocate space for hash codes and bucket ids.
-  hashed_image.hashed_desc.resize(sift_desc.size());
+  hashed_image.mean_descriptor = sift_desc.colwise().mean().transpose();
 
-  // Allocate space for each bucket id.
-  for (int i = 0; i < sift_desc.size(); i++) {
-    hashed_image.hashed_desc[i].bucket_ids.resize(kNumBucketGroups);
-  }
+  // Allocate space for hash codes and bucket ids. The hash codes are zero
+  // initialized so that only the set bits need to be written.
+  hashed_image.hash_codes.setZero(sift_desc.rows(), kNumHashCodeWords);
+  hashed_image.bucket_ids.resize(sift_desc.rows(), kNumBucketGroups);
 
   // Create hash codes for each feature.
   CreateHashedDescriptors(sift_desc, &hashed_image);
@@ -163,57 +226,104 @@ HashedImage CascadeHasher::CreateHashedSiftDescriptors(
   return hashed_image;
 }
 
+HashedImage CascadeHasher::CreateHashedSiftDescriptors(
+    const QuantizedDescriptorMatrix& sift_desc) const {
+  // The hash codes only depend on the signs of the projections of the zero
+  // mean descriptors, so the quantization scale does not need to be undone.
+  return CreateHashedSiftDescriptors(
+      DescriptorMatrix(sift_desc.cast<float>()));
+}
+
+void CascadeHasher::MatchImages(
+    const HashedImage& hashed_image1,
+    const DescriptorMatrix& descriptors1,
+    const HashedImage& hashed_image2,
+    const DescriptorMatrix& descriptors2,
+    const double lowes_ratio,
+    std::vector<IndexedFeatureMatch>* matches) const {
+  MatchHashedImages(hashed_image1,
+                    descriptors1,
+                    hashed_image2,
+                    descriptors2,
+                    lowes_ratio,
+                    matches);
+}
+
+void CascadeHasher::MatchImages(
+    const HashedImage& hashed_image1,
+    const QuantizedDescriptorMatrix& descriptors1,
+    const HashedImage& hashed_image2,
+    const QuantizedDescriptorMatrix& descriptors2,
+    const double lowes_ratio,
+    std::vector<IndexedFeatureMatch>* matches) const {
+  MatchHashedImages(hashed_image1,
+                    descriptors1,
+                    hashed_image2,
+                    descriptors2,
+                    lowes_ratio,
+                    matches);
+}
+
 // Matches images with a fast matching scheme based on the hash codes
 // previously generated.
-void CascadeHasher::MatchImages(
+template <class DescriptorMatrixType>
+void CascadeHasher::MatchHashedImages(
     const HashedImage& hashed_image1,
-    const std::vector<Eigen::VectorXf>& descriptors1,
+    const DescriptorMatrixType& descriptors1,
     const HashedImage& hashed_image2,
-    const std::vector<Eigen::VectorXf>& descriptors2,
+    const DescriptorMatrixType& descriptors2,
     const double lowes_ratio,
     std::vector<IndexedFeatureMatch>* matches) const {
-  if (descriptors1.size() == 0 || descriptors2.size() == 0) {
+  if (descriptors1.rows() == 0 || descriptors2.rows() == 0) {
     return;
   }
 
-  static const int kNumTopCandidates = 10;
   const double sq_lowes_ratio = lowes_ratio * lowes_ratio;
-  L2 l2_distance;
 
   // Reserve space for the matches.
   matches->reserve(
-      static_cast<int>(std::min(descriptors1.size(), descriptors2.size())));
+      static_cast<int>(std::min(descriptors1.rows(), descriptors2.rows())));
 
   // Preallocate the candidate descriptors container.
   std::vector<int> candidate_descriptors;
-  candidate_descriptors.reserve(descriptors2.size());
+  candidate_descriptors.reserve(descriptors2.rows());
+
+  // Preallocate the container of the unique candidate descriptors and their
+  // hamming distances to the query descriptor.
+  std::vector<int> unique_candidate_descriptors;
+  unique_candidate_descriptors.reserve(descriptors2.rows());
+  std::vector<uint8_t> candidate_hamming_distance(descriptors2.rows());
 
   // Preallocated hamming distances. Each column indicates the hamming distance
   // and the rows collect the descriptor ids with that
   // distance. num_descriptors_with_hamming_distance keeps track of how many
   // descriptors have that distance.
-  Eigen::MatrixXi candidate_hamming_distances(descriptors2.size(),
+  Eigen::MatrixXi candidate_hamming_distances(descriptors2.rows(),
                                               kHashCodeSize + 1);
   Eigen::VectorXi num_descriptors_with_hamming_distance(kHashCodeSize + 1);
 
-  // Preallocate the container for keeping euclidean distances.
+  // Preallocate the containers of the candidates with the best hamming
+  // distances and their euclidean distances.
+  std::vector<int> top_candidate_descriptors;
+  top_candidate_descriptors.reserve(kNumTopCandidates + 1);
+  std::vector<float> top_candidate_distances(kNumTopCandidates + 1);
   std::vector<std::pair<float, int> > candidate_euclidean_distances;
-  candidate_euclidean_distances.reserve(kNumTopCandidates);
+  candidate_euclidean_distances.reserve(kNumTopCandidates + 1);
 
   // A preallocated vector to determine if we have already used a particular
   // feature for matching (i.e., prevents duplicates).
-  std::vector<bool> used_descriptor(descriptors2.size());
-  for (int i = 0; i < hashed_image1.hashed_desc.size(); i++) {
+  std::vector<bool> used_descriptor(descriptors2.rows());
+  for (int i = 0; i < hashed_image1.NumDescriptors(); i++) {
     candidate_descriptors.clear();
+    unique_candidate_descriptors.clear();
     num_descriptors_with_hamming_distance.setZero();
+    top_candidate_descriptors.clear();
     candidate_euclidean_distances.clear();
 
-    const auto& hashed_desc = hashed_image1.hashed_desc[i];
-
     // Accumulate all descriptors in each bucket group that are in the same
     // bucket id as the query descriptor.
     for (int j = 0; j < kNumBucketGroups; j++) {
-      const uint16_t bucket_id = hashed_desc.bucket_ids[j];
+      const uint16_t bucket_id = hashed_image1.bucket_ids(i, j);
       for (const auto& feature_id : hashed_image2.buckets[j][bucket_id]) {
         candidate_descriptors.emplace_back(feature_id);
         used_descriptor[feature_id] = false;
@@ -225,40 +335,58 @@ void CascadeHasher::MatchImages(
       continue;
     }
 
-    // Compute the hamming distance of all candidates based on the comp hash
-    // code. Put the descriptors into buckets corresponding to their hamming
-    // distance.
+    // Remove the duplicate candidates that were found in multiple bucket
+    // groups.
     for (const int candidate_id : candidate_descriptors) {
       if (used_descriptor[candidate_id]) {
         continue;
       }
       used_descriptor[candidate_id] = true;
-      const uint8_t hamming_distance =
-          (hashed_desc.hash_code ^
-           hashed_image2.hashed_desc[candidate_id].hash_code).count();
+      unique_candidate_descriptors.emplace_back(candidate_id);
+    }
+
+    // Compute the hamming distance of all candidates based on the comp hash
+    // code with the vectorized popcount kernel. Put the descriptors into
+    // buckets corresponding to their hamming distance.
+    ComputeHammingDistances128(
+        hashed_image1.hash_codes.row(i).data(),
+        hashed_image2.hash_codes.data(),
+        unique_candidate_descriptors.data(),
+        unique_candidate_descriptors.size(),
+        candidate_hamming_distance.data());
+    for (int j = 0; j < unique_candidate_descriptors.size(); j++) {
+      const uint8_t hamming_distance = candidate_hamming_distance[j];
       candidate_hamming_distances(
           num_descriptors_with_hamming_distance(hamming_distance)++,
-          hamming_distance) = candidate_id;
+          hamming_distance) = unique_candidate_descriptors[j];
     }
 
-    // Compute the euclidean distance of the k descriptors with the best hamming
-    // distance.
-    candidate_euclidean_distances.reserve(kNumTopCandidates);
+    // Collect the k descriptors with the best hamming distance.
     for (int j = 0; j < candidate_hamming_distances.cols(); j++) {
       for (int k = 0; k < num_descriptors_with_hamming_distance(j); k++) {
-        const int candidate_id = candidate_hamming_distances(k, j);
-        const float distance =
-            l2_distance(descriptors2[candidate_id], descriptors1[i]);
-        candidate_euclidean_distances.emplace_back(distance, candidate_id);
-        if (candidate_euclidean_distances.size() > kNumTopCandidates) {
+        top_candidate_descriptors.emplace_back(
+            candidate_hamming_distances(k, j));
+        if (top_candidate_descriptors.size() > kNumTopCandidates) {
           break;
         }
       }
-      if (candidate_euclidean_distances.size() > kNumTopCandidates) {
+      if (top_candidate_descriptors.size() > kNumTopCandidates) {
         break;
       }
     }
 
+    // Compute the euclidean distance of the k descriptors with the best
+    // hamming distance.
+    ComputeCandidateDistances(descriptors1,
+                              i,
+                              descriptors2,
+                              top_candidate_descriptors,
+                              &top_candidate_distances);
+    for (int j = 0; j < top_candidate_descriptors.size(); j++) {
+      candidate_euclidean_distances.emplace_back(top_candidate_distances[j],
+                                                 top_candidate_descriptors[j]);
+    }
+
     // Find the top 2 candidates based on euclidean distance.
     std::partial_sort(candidate_euclidean_distances.begin(),
                       candidate_euclidean_distances.begin() + 2,
@@ -36,11 +36,14 @@
 #define THEIA_MATCHING_CASCADE_HASHER_H_
 
 #include <Eigen/Core>
+#include <cereal/access.hpp>
+#include <cereal/cereal.hpp>
 #include <stdint.h>
-#include <bitset>
 #include <memory>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/io/eigen_serializable.h"
 #include "theia/util/random.h"
 
 namespace theia {
@@ -56,26 +59,60 @@ static const int kNumBucketBits = 10;
 static const int kNumBucketGroups = 6;
 // The number of buckets in each group.
 static const int kNumBucketsPerGroup = 1 << kNumBucketBits;
-
-struct HashedSiftDescriptor {
-  // Hash code generated by the primary hashing function.
-  std::bitset<kHashCodeSize> hash_code;
-  // Each bucket_ids[x] = y means the descriptor belongs to bucket y in bucket
-  // group x.
-  std::vector<uint16_t> bucket_ids;
-};
+// The number of 64-bit words used to store a packed hash code.
+static const int kNumHashCodeWords = kHashCodeSize / 64;
+// The version of the hashing scheme. This must be incremented whenever the hash
+// codes that are computed from the same projections change, so that hashed
+// images that were stored by an earlier version are not used.
+static const int kCascadeHashingVersion = 1;
 
 struct HashedImage {
   HashedImage() {}
 
+  // The number of hashed descriptors.
+  int NumDescriptors() const { return bucket_ids.rows(); }
+
+  // Returns an estimate of the memory used by the hashed image.
+  size_t SizeInBytes() const {
+    size_t size_in_bytes = sizeof(*this) +
+                           mean_descriptor.size() * sizeof(float) +
+                           hash_codes.size() * sizeof(uint64_t) +
+                           bucket_ids.size() * sizeof(uint16_t);
+    for (const std::vector<Bucket>& bucket_group : buckets) {
+      size_in_bytes += bucket_group.capacity() * sizeof(Bucket);
+      for (const Bucket& bucket : bucket_group) {
+        size_in_bytes += bucket.capacity() * sizeof(int);
+      }
+    }
+    return size_in_bytes;
+  }
+
   // The mean of all descriptors (used for hashing).
   Eigen::VectorXf mean_descriptor;
 
-  // The hash information.
-  std::vector<HashedSiftDescriptor> hashed_desc;
+  // The hash codes generated by the primary hashing function for all
+  // descriptors, packed into a single contiguous buffer. Row i holds the code
+  // of descriptor i, and bit b of the code is bit (b % 64) of word (b / 64).
+  Eigen::Matrix<uint64_t, Eigen::Dynamic, kNumHashCodeWords, Eigen::RowMajor>
+      hash_codes;
+
+  // Each bucket_ids(i, x) = y means descriptor i belongs to bucket y in bucket
+  // group x.
+  Eigen::Matrix<uint16_t, Eigen::Dynamic, kNumBucketGroups, Eigen::RowMajor>
+      bucket_ids;
 
   // buckets[bucket_group][bucket_id] = bucket (container of sift ids).
   std::vector<std::vector<Bucket> > buckets;
+
+ private:
+  // Templated method for disk I/O with cereal. The buckets are not stored since
+  // they are cheap to rebuild from the bucket ids with
+  // CascadeHasher::BuildBuckets.
+  friend class cereal::access;
+  template <class Archive>
+  void serialize(Archive& ar, const std::uint32_t version) {  // NOLINT
+    ar(mean_descriptor, hash_codes, bucket_ids);
+  }
 };
 
 // This hasher will hash SIFT descriptors with a two-step hashing system. The
@@ -95,32 +132,60 @@ class CascadeHasher {
   // cascade hasher.
   bool Initialize(const int num_dimensions_of_descriptor);
 
+  // Returns a fingerprint of the hashing projections. Hashed images that were
+  // created by hashers with the same fingerprint are interchangeable, so the
+  // fingerprint identifies which stored hashed images may be reused.
+  uint64_t ProjectionFingerprint() const;
+
+  // Builds the buckets of the hashed image from its bucket ids. This must be
+  // called on hashed images that are read from disk.
+  void BuildBuckets(HashedImage* hashed_image) const;
+
   // Creates the hash codes for the sift descriptors and returns the hashed
   // information.
   HashedImage CreateHashedSiftDescriptors(
-      const std::vector<Eigen::VectorXf>& sift_desc) const;
+      const DescriptorMatrix& sift_desc) const;
+
+  // Same as above, but for sift descriptors that are quantized to one byte per
+  // dimension.
+  HashedImage CreateHashedSiftDescriptors(
+      const QuantizedDescriptorMatrix& sift_desc) const;
 
   // Matches images with a fast matching scheme based on the hash codes
   // previously generated.
   void MatchImages(const HashedImage& hashed_desc1,
-                   const std::vector<Eigen::VectorXf>& descriptors1,
+                   const DescriptorMatrix& descriptors1,
                    const HashedImage& hashed_desc2,
-                   const std::vector<Eigen::VectorXf>& descriptors2,
+                   const DescriptorMatrix& descriptors2,
+                   const double lowes_ratio,
+                   std::vector<IndexedFeatureMatch>* matches) const;
+
+  // Same as above, but the euclidean distances between the candidates are
+  // computed from quantized descriptors with integer arithmetic.
+  void MatchImages(const HashedImage& hashed_desc1,
+                   const QuantizedDescriptorMatrix& descriptors1,
+                   const HashedImage& hashed_desc2,
+                   const QuantizedDescriptorMatrix& descriptors2,
                    const double lowes_ratio,
                    std::vector<IndexedFeatureMatch>* matches) const;
 
  private:
+  // Implements MatchImages for both float and quantized descriptors.
+  template <class DescriptorMatrixType>
+  void MatchHashedImages(const HashedImage& hashed_desc1,
+                         const DescriptorMatrixType& descriptors1,
+                         const HashedImage& hashed_desc2,
+                         const DescriptorMatrixType& descriptors2,
+                         const double lowes_ratio,
+                         std::vector<IndexedFeatureMatch>* matches) const;
+
   std::shared_ptr<RandomNumberGenerator> rng_;
 
   // Creates the hash code for each descriptor and determines which buckets each
   // descriptor belongs to.
-  void CreateHashedDescriptors(const std::vector<Eigen::VectorXf>& sift_desc,
+  void CreateHashedDescriptors(const DescriptorMatrix& sift_desc,
                                HashedImage* hashed_image) const;
 
-  // Builds the buckets for an image based on the bucket ids and groups of the
-  // sift descriptors.
-  void BuildBuckets(HashedImage* hashed_image) const;
-
   // Number of dimensions of the descriptors.
   int num_dimensions_of_descriptor_;
 
@@ -133,4 +198,6 @@ class CascadeHasher {
 
 }  // namespace theia
 
+CEREAL_CLASS_VERSION(theia::HashedImage, 0);
+
 #endif  // THEIA_MATCHING_CASCADE_HASHER_H_
@@ -37,6 +37,7 @@
 #include <Eigen/Core>
 #include <glog/logging.h>
 
+#include <chrono>  // NOLINT
 #include <memory>
 #include <mutex>  // NOLINT
 #include <string>
@@ -48,8 +49,9 @@
 #include "theia/matching/feature_matcher_utils.h"
 #include "theia/matching/features_and_matches_database.h"
 #include "theia/matching/indexed_feature_match.h"
-#include "theia/util/lru_cache.h"
+#include "theia/util/concurrent_lru_cache.h"
 #include "theia/util/map_util.h"
+#include "theia/util/random.h"
 #include "theia/util/threadpool.h"
 #include "theia/util/util.h"
 
@@ -57,36 +59,76 @@ namespace theia {
 CascadeHashingFeatureMatcher::CascadeHashingFeatureMatcher(
     const FeatureMatcherOptions& options,
     FeaturesAndMatchesDatabase* features_and_matches_database)
-    : FeatureMatcher(options, features_and_matches_database) {
+    : FeatureMatcher(options, features_and_matches_database),
+      projection_fingerprint_(0) {
   // Initialize the cache.
   const std::function<std::shared_ptr<HashedImage>(const std::string&)>
       fetch_hashed_images =
           std::bind(&CascadeHashingFeatureMatcher::FetchHashedImage,
                     this,
                     std::placeholders::_1);
-  // TODO: Stop hardcoding this!
-  static constexpr int kNumImagesInCache = 256;
-  hashed_images_.reset(
-      new HashedImageCache(fetch_hashed_images, kNumImagesInCache));
+  if (options.max_cache_size_in_bytes > 0) {
+    const std::function<size_t(const std::shared_ptr<HashedImage>&)>
+        hashed_image_size = [](const std::shared_ptr<HashedImage>& image) {
+          return image->SizeInBytes();
+        };
+    hashed_images_.reset(new HashedImageCache(fetch_hashed_images,
+                                              hashed_image_size,
+                                              options.max_cache_size_in_bytes));
+  } else {
+    static constexpr int kNumImagesInCache = 256;
+    hashed_images_.reset(
+        new HashedImageCache(fetch_hashed_images, kNumImagesInCache));
+  }
 }
 
 CascadeHashingFeatureMatcher::~CascadeHashingFeatureMatcher() {}
 
 std::shared_ptr<HashedImage> CascadeHashingFeatureMatcher::FetchHashedImage(
     const std::string& image_name) {
-  const auto features = this->feature_and_matches_db_->GetFeatures(image_name);
-  return std::make_shared<HashedImage>(
-      cascade_hasher_->CreateHashedSiftDescriptors(features.descriptors));
+  const std::shared_ptr<const KeypointsAndDescriptors> features_handle =
+      this->feature_and_matches_db_->GetFeaturesShared(image_name);
+  const KeypointsAndDescriptors& features = *features_handle;
+
+  // Reuse the hash codes stored in the database if they were created with the
+  // same projections. Only the buckets must be rebuilt from the bucket ids.
+  std::shared_ptr<HashedImage> hashed_image = std::make_shared<HashedImage>();
+  if (this->feature_and_matches_db_->GetHashedImage(
+          image_name, projection_fingerprint_, hashed_image.get())) {
+    cascade_hasher_->BuildBuckets(hashed_image.get());
+    return hashed_image;
+  }
+
+  if (features.HasQuantizedDescriptors()) {
+    *hashed_image = cascade_hasher_->CreateHashedSiftDescriptors(
+        features.quantized_descriptors);
+  } else {
+    *hashed_image =
+        cascade_hasher_->CreateHashedSiftDescriptors(features.descriptors);
+  }
+  this->feature_and_matches_db_->PutHashedImage(
+      image_name, projection_fingerprint_, *hashed_image);
+  return hashed_image;
 }
 
 // Initializes the cascade hasher (only if needed).
 void CascadeHashingFeatureMatcher::InitializeCascadeHasher(
     int descriptor_dimension) {
   CHECK_GT(descriptor_dimension, 0);
+  // The projections are created from the seed stored in the database so that
+  // the hashed images stored by previous runs remain valid.
+  unsigned seed;
+  if (!this->feature_and_matches_db_->GetCascadeHashingSeed(&seed)) {
+    seed = std::chrono::system_clock::now().time_since_epoch().count();
+    this->feature_and_matches_db_->PutCascadeHashingSeed(seed);
+  }
+
   // Initialize the cascade hasher
-  cascade_hasher_.reset(new CascadeHasher());
+  cascade_hasher_.reset(
+      new CascadeHasher(std::make_shared<RandomNumberGenerator>(seed)));
   CHECK(cascade_hasher_->Initialize(descriptor_dimension))
       << "Could not initialize the cascade hasher.";
+  projection_fingerprint_ = cascade_hasher_->ProjectionFingerprint();
 }
 
 void CascadeHashingFeatureMatcher::AddImage(const std::string& image_name) {
@@ -98,15 +140,22 @@ void CascadeHashingFeatureMatcher::AddImage(const std::string& image_name) {
   }
 
   // Get the features from the db and create hashed descriptors.
-  const KeypointsAndDescriptors& features =
-      this->feature_and_matches_db_->GetFeatures(image_name);
+  const std::shared_ptr<const KeypointsAndDescriptors> features_handle =
+      this->feature_and_matches_db_->GetFeaturesShared(image_name);
+  const KeypointsAndDescriptors& features = *features_handle;
+  CHECK(!features.HasBinaryDescriptors())
+      << "Cascade hashing can only be used with float descriptors. Please use "
+         "BRUTE_FORCE or MULTI_INDEX_HASHING for binary descriptors.";
 
-  if (features.descriptors.size() == 0) {
+  const int descriptor_dimension = features.HasQuantizedDescriptors()
+                                       ? features.quantized_descriptors.cols()
+                                       : features.descriptors.cols();
+  if (descriptor_dimension == 0) {
     return;
   }
 
   // Initialize the cascade hasher if needed.
-  InitializeCascadeHasher(features.descriptors[0].size());
+  InitializeCascadeHasher(descriptor_dimension);
 }
 
 void CascadeHashingFeatureMatcher::AddImages(
@@ -118,15 +167,52 @@ void CascadeHashingFeatureMatcher::AddImages(
 
   // Initialize cascade hasher (if needed).
   for (int i = 0; i < image_names.size(); i++) {
-    const KeypointsAndDescriptors& init_features =
-        this->feature_and_matches_db_->GetFeatures(image_names[i]);
-    if (init_features.descriptors.size() > 0) {
-      InitializeCascadeHasher(init_features.descriptors[0].size());
+    const std::shared_ptr<const KeypointsAndDescriptors> features_handle =
+        this->feature_and_matches_db_->GetFeaturesShared(image_names[i]);
+    const KeypointsAndDescriptors& init_features = *features_handle;
+    CHECK(!init_features.HasBinaryDescriptors())
+        << "Cascade hashing can only be used with float descriptors. Please "
+           "use BRUTE_FORCE or MULTI_INDEX_HASHING for binary descriptors.";
+    if (init_features.HasQuantizedDescriptors()) {
+      InitializeCascadeHasher(init_features.quantized_descriptors.cols());
       return;
     }
+    if (init_features.descriptors.rows() > 0) {
+      InitializeCascadeHasher(init_features.descriptors.cols());
+      return;
+    }
+  }
+}
+
+void CascadeHashingFeatureMatcher::MatchHashedImages(
+    const HashedImage& hashed_features1,
+    const KeypointsAndDescriptors& features1,
+    const HashedImage& hashed_features2,
+    const KeypointsAndDescriptors& features2,
+    const double lowes_ratio,
+    std::vector<IndexedFeatureMatch>* matches) {
+  if (features1.HasQuantizedDescriptors()) {
+    cascade_hasher_->MatchImages(hashed_features1,
+                                 features1.quantized_descriptors,
+                                 hashed_features2,
+                                 features2.quantized_descriptors,
+                                 lowes_ratio,
+                                 matches);
+  } else {
+    cascade_hasher_->MatchImages(hashed_features1,
+                                 features1.descriptors,
+                                 hashed_features2,
+                                 features2.descriptors,
+                                 lowes_ratio,
+                                 matches);
   }
 }
 
+void CascadeHashingFeatureMatcher::PrefetchImage(
+    const std::string& image_name) {
+  hashed_images_->Fetch(image_name);
+}
+
 bool CascadeHashingFeatureMatcher::MatchImagePair(
     const KeypointsAndDescriptors& features1,
     const KeypointsAndDescriptors& features2,
@@ -140,25 +226,29 @@ bool CascadeHashingFeatureMatcher::MatchImagePair(
     return false;
   }
 
+  CHECK_EQ(features1.HasQuantizedDescriptors(),
+           features2.HasQuantizedDescriptors())
+      << "Cannot match quantized descriptors to float descriptors.";
+
   // Match features between the images.
   const double lowes_ratio =
       (this->options_.use_lowes_ratio) ? this->options_.lowes_ratio : 1.0;
-  cascade_hasher_->MatchImages(*hashed_features1,
-                               features1.descriptors,
-                               *hashed_features2,
-                               features2.descriptors,
-                               lowes_ratio,
-                               matches);
+  MatchHashedImages(*hashed_features1,
+                    features1,
+                    *hashed_features2,
+                    features2,
+                    lowes_ratio,
+                    matches);
   // Only do symmetric matching if enough matches exist to begin with.
   if (matches->size() >= this->options_.min_num_feature_matches &&
       this->options_.keep_only_symmetric_matches) {
     std::vector<IndexedFeatureMatch> backwards_matches;
-    cascade_hasher_->MatchImages(*hashed_features2,
-                                 features2.descriptors,
-                                 *hashed_features1,
-                                 features1.descriptors,
-                                 lowes_ratio,
-                                 &backwards_matches);
+    MatchHashedImages(*hashed_features2,
+                      features2,
+                      *hashed_features1,
+                      features1,
+                      lowes_ratio,
+                      &backwards_matches);
     IntersectMatches(backwards_matches, matches);
   }
 
@@ -44,7 +44,7 @@
 #include "theia/matching/cascade_hasher.h"
 #include "theia/matching/feature_matcher.h"
 #include "theia/matching/features_and_matches_database.h"
-#include "theia/util/lru_cache.h"
+#include "theia/util/concurrent_lru_cache.h"
 
 namespace theia {
 class Keypoint;
@@ -54,7 +54,8 @@ struct KeypointsAndDescriptors;
 
 // Performs features matching between two sets of features using a cascade
 // hashing approach. This hashing does not require any training and is extremely
-// efficient but can only be used with float features like SIFT.
+// efficient but can only be used with float features like SIFT. The float
+// descriptors may be quantized to one byte per dimension.
 class CascadeHashingFeatureMatcher : public FeatureMatcher {
  public:
   CascadeHashingFeatureMatcher(
@@ -75,15 +76,32 @@ class CascadeHashingFeatureMatcher : public FeatureMatcher {
                       const KeypointsAndDescriptors& features2,
                       std::vector<IndexedFeatureMatch>* matches) override;
 
-  // Method to fetch hashed images and store them in a cache.
+  // Prefetches the hashed image, which also loads the features of the image.
+  void PrefetchImage(const std::string& image_name) override;
+
+  // Method to fetch hashed images and store them in a cache. The hashed image
+  // is read from the database if it was stored with the current projections,
+  // otherwise it is computed and stored in the database.
   std::shared_ptr<HashedImage> FetchHashedImage(const std::string& image_name);
 
-  // Initializes the cascade hasher (only if needed).
+  // Initializes the cascade hasher (only if needed). The projections are
+  // seeded with the seed stored in the database, if any.
   void InitializeCascadeHasher(int descriptor_dimension);
 
-  using HashedImageCache = LRUCache<std::string, std::shared_ptr<HashedImage>>;
+  // Matches the hashed images with either the float or the quantized
+  // descriptors of the features.
+  void MatchHashedImages(const HashedImage& hashed_features1,
+                         const KeypointsAndDescriptors& features1,
+                         const HashedImage& hashed_features2,
+                         const KeypointsAndDescriptors& features2,
+                         const double lowes_ratio,
+                         std::vector<IndexedFeatureMatch>* matches);
+
+  using HashedImageCache =
+      ConcurrentLRUCache<std::string, std::shared_ptr<HashedImage>>;
   std::unique_ptr<HashedImageCache> hashed_images_;
   std::unique_ptr<CascadeHasher> cascade_hasher_;
+  uint64_t projection_fingerprint_;
 
   DISALLOW_COPY_AND_ASSIGN(CascadeHashingFeatureMatcher);
 };
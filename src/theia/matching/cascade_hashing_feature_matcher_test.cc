@@ -33,8 +33,14 @@
 // Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
 
 #include <Eigen/Core>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_quantization.h"
+#include "theia/matching/cascade_hasher.h"
 #include "theia/matching/cascade_hashing_feature_matcher.h"
 #include "theia/matching/distance.h"
 #include "theia/matching/feature_matcher.h"
@@ -50,19 +56,74 @@ using Eigen::VectorXf;
 static const int kNumDescriptors = 10;
 static const int kNumDescriptorDimensions = 10;
 
+// An in-memory database that stores the cascade hashing seed and the hashed
+// images, like a persistent database does, and counts how often the stored
+// hashed images are reused.
+class HashedImagesDatabase : public InMemoryFeaturesAndMatchesDatabase {
+ public:
+  HashedImagesDatabase()
+      : has_seed_(false), seed_(0), num_reused_images_(0), num_put_images_(0) {}
+
+  bool GetCascadeHashingSeed(unsigned* seed) override {
+    *seed = seed_;
+    return has_seed_;
+  }
+
+  void PutCascadeHashingSeed(const unsigned seed) override {
+    has_seed_ = true;
+    seed_ = seed;
+  }
+
+  bool GetHashedImage(const std::string& image_name,
+                      const uint64_t projection_fingerprint,
+                      HashedImage* hashed_image) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = hashed_images_.find(image_name);
+    if (it == hashed_images_.end() ||
+        it->second.first != projection_fingerprint) {
+      return false;
+    }
+    // Only the hash codes and bucket ids are persisted.
+    hashed_image->mean_descriptor = it->second.second.mean_descriptor;
+    hashed_image->hash_codes = it->second.second.hash_codes;
+    hashed_image->bucket_ids = it->second.second.bucket_ids;
+    ++num_reused_images_;
+    return true;
+  }
+
+  void PutHashedImage(const std::string& image_name,
+                      const uint64_t projection_fingerprint,
+                      const HashedImage& hashed_image) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    hashed_images_[image_name] =
+        std::make_pair(projection_fingerprint, hashed_image);
+    ++num_put_images_;
+  }
+
+  bool has_seed_;
+  unsigned seed_;
+  int num_reused_images_;
+  int num_put_images_;
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::pair<uint64_t, HashedImage>>
+      hashed_images_;
+};
+
 TEST(CascadeHashingFeatureMatcherTest, NoOptions) {
   // Set up descriptors.
   KeypointsAndDescriptors features1, features2;
   features1.image_name = "1";
   features2.image_name = "2";
-  features1.descriptors.resize(kNumDescriptors);
-  features2.descriptors.resize(kNumDescriptors);
+  features1.descriptors.resize(kNumDescriptors, kNumDescriptorDimensions);
+  features2.descriptors.resize(kNumDescriptors, kNumDescriptorDimensions);
   for (int i = 0; i < kNumDescriptors; i++) {
     // Avoid a zero vector.
-    features1.descriptors[i] = VectorXf::Constant(kNumDescriptorDimensions, 1);
-    features2.descriptors[i] = VectorXf::Constant(kNumDescriptorDimensions, 1);
-    features1.descriptors[i].normalize();
-    features2.descriptors[i].normalize();
+    features1.descriptors.row(i).setConstant(1);
+    features2.descriptors.row(i).setConstant(1);
+    features1.descriptors.row(i).normalize();
+    features2.descriptors.row(i).normalize();
   }
 
   // Set options.
@@ -73,8 +134,8 @@ TEST(CascadeHashingFeatureMatcherTest, NoOptions) {
   options.perform_geometric_verification = false;
 
   // Add features.
-  features1.keypoints.resize(features1.descriptors.size());
-  features2.keypoints.resize(features2.descriptors.size());
+  features1.keypoints.resize(features1.descriptors.rows());
+  features2.keypoints.resize(features2.descriptors.rows());
 
   InMemoryFeaturesAndMatchesDatabase database;
   database.PutFeatures("1", features1);
@@ -91,24 +152,57 @@ TEST(CascadeHashingFeatureMatcherTest, NoOptions) {
   EXPECT_GT(database.NumMatches(), 0);
 }
 
+// A memory budget that is smaller than a single hashed image must still allow
+// all image pairs to be matched.
+TEST(CascadeHashingFeatureMatcherTest, CacheSizeInBytes) {
+  static const int kNumImages = 3;
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = false;
+  options.use_lowes_ratio = false;
+  options.perform_geometric_verification = false;
+  options.max_cache_size_in_bytes = 1;
+
+  InMemoryFeaturesAndMatchesDatabase database;
+  CascadeHashingFeatureMatcher matcher(options, &database);
+  for (int i = 0; i < kNumImages; i++) {
+    KeypointsAndDescriptors features;
+    features.image_name = std::to_string(i);
+    features.descriptors.resize(kNumDescriptors, kNumDescriptorDimensions);
+    features.descriptors.setConstant(1);
+    features.descriptors.rowwise().normalize();
+    features.keypoints.resize(kNumDescriptors);
+    database.PutFeatures(features.image_name, features);
+    matcher.AddImage(features.image_name);
+  }
+
+  // Match features.
+  matcher.MatchImages();
+
+  // Check that all image pairs were matched.
+  EXPECT_EQ(database.NumMatches(), kNumImages * (kNumImages - 1) / 2);
+}
+
 TEST(CascadeHashingFeatureMatcherTest, RatioTest) {
   // Set up descriptors.
   KeypointsAndDescriptors features1, features2;
   features1.image_name = "1";
   features2.image_name = "2";
-  features1.descriptors.resize(1);
-  features2.descriptors.resize(2);
-  features1.descriptors[0] =
-      VectorXf::Constant(kNumDescriptorDimensions, 1).normalized();
+  features1.descriptors.resize(1, kNumDescriptorDimensions);
+  features2.descriptors.resize(2, kNumDescriptorDimensions);
+  features1.descriptors.row(0).setConstant(1);
+  features1.descriptors.row(0).normalize();
 
   // Set the two descriptors to be very close to each other so that they do not
   // pass the ratio test.
-  features2.descriptors[0] = VectorXf::Constant(kNumDescriptorDimensions, 1);
-  features2.descriptors[0](0) = 0.9;
-  features2.descriptors[0].normalize();
-  features2.descriptors[1] = VectorXf::Constant(kNumDescriptorDimensions, 1);
-  features2.descriptors[1](0) = 0.89;
-  features2.descriptors[1].normalize();
+  features2.descriptors.row(0).setConstant(1);
+  features2.descriptors(0, 0) = 0.9;
+  features2.descriptors.row(0).normalize();
+  features2.descriptors.row(1).setConstant(1);
+  features2.descriptors(1, 0) = 0.89;
+  features2.descriptors.row(1).normalize();
 
   // Set options.
   FeatureMatcherOptions options;
@@ -118,8 +212,8 @@ TEST(CascadeHashingFeatureMatcherTest, RatioTest) {
   options.perform_geometric_verification = false;
 
   // Add features.
-  features1.keypoints.resize(features1.descriptors.size());
-  features2.keypoints.resize(features2.descriptors.size());
+  features1.keypoints.resize(features1.descriptors.rows());
+  features2.keypoints.resize(features2.descriptors.rows());
 
   InMemoryFeaturesAndMatchesDatabase database;
   database.PutFeatures("1", features1);
@@ -136,4 +230,134 @@ TEST(CascadeHashingFeatureMatcherTest, RatioTest) {
   EXPECT_GT(database.NumMatches(), 0);
 }
 
+TEST(CascadeHashingFeatureMatcherTest, QuantizedDescriptors) {
+  // Enough descriptors are needed for the buckets to contain the minimum number
+  // of candidates.
+  static const int kNumSiftDescriptors = 2000;
+  static const int kNumSiftDimensions = 128;
+
+  // Set up random unit norm descriptors with non-negative entries (like SIFT)
+  // such that descriptor i of features2 is a small perturbation of descriptor
+  // i of features1.
+  DescriptorMatrix descriptors1 =
+      DescriptorMatrix::Random(kNumSiftDescriptors, kNumSiftDimensions)
+          .cwiseAbs();
+  DescriptorMatrix descriptors2 =
+      descriptors1 +
+      0.05 * DescriptorMatrix::Random(kNumSiftDescriptors, kNumSiftDimensions);
+  descriptors1.rowwise().normalize();
+  descriptors2 = descriptors2.cwiseAbs();
+  descriptors2.rowwise().normalize();
+
+  KeypointsAndDescriptors features1, features2;
+  features1.image_name = "1";
+  features2.image_name = "2";
+  QuantizeDescriptors(descriptors1, &features1.quantized_descriptors);
+  QuantizeDescriptors(descriptors2, &features2.quantized_descriptors);
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = true;
+  options.use_lowes_ratio = true;
+  options.perform_geometric_verification = false;
+
+  // Add features.
+  features1.keypoints.resize(kNumSiftDescriptors);
+  features2.keypoints.resize(kNumSiftDescriptors);
+
+  InMemoryFeaturesAndMatchesDatabase database;
+  database.PutFeatures("1", features1);
+  database.PutFeatures("2", features2);
+
+  CascadeHashingFeatureMatcher matcher(options, &database);
+  matcher.AddImage("1");
+  matcher.AddImage("2");
+
+  // Match features.
+  matcher.MatchImages();
+
+  // Cascade hashing is approximate, but nearly all of the perturbed copies
+  // should be found.
+  EXPECT_EQ(database.NumMatches(), 1);
+  const ImagePairMatch match = database.GetImagePairMatch("1", "2");
+  EXPECT_GT(match.correspondences.size(), 0.9 * kNumSiftDescriptors);
+}
+
+// The hashed images stored by a previous matcher must be reused as long as the
+// projections are unchanged, and give the same matches as fresh hashed images.
+TEST(CascadeHashingFeatureMatcherTest, ReuseStoredHashedImages) {
+  static const int kNumSiftDescriptors = 2000;
+  static const int kNumSiftDimensions = 128;
+
+  KeypointsAndDescriptors features1, features2;
+  features1.image_name = "1";
+  features2.image_name = "2";
+  features1.descriptors =
+      DescriptorMatrix::Random(kNumSiftDescriptors, kNumSiftDimensions)
+          .cwiseAbs();
+  features2.descriptors =
+      features1.descriptors +
+      0.05 * DescriptorMatrix::Random(kNumSiftDescriptors, kNumSiftDimensions);
+  features1.descriptors.rowwise().normalize();
+  features2.descriptors = features2.descriptors.cwiseAbs();
+  features2.descriptors.rowwise().normalize();
+  features1.keypoints.resize(kNumSiftDescriptors);
+  features2.keypoints.resize(kNumSiftDescriptors);
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = true;
+  options.use_lowes_ratio = true;
+  options.perform_geometric_verification = false;
+
+  HashedImagesDatabase database;
+  database.PutFeatures("1", features1);
+  database.PutFeatures("2", features2);
+
+  // The first matcher hashes both images and stores them with the seed.
+  {
+    CascadeHashingFeatureMatcher matcher(options, &database);
+    matcher.AddImage("1");
+    matcher.AddImage("2");
+    matcher.MatchImages();
+  }
+  EXPECT_TRUE(database.has_seed_);
+  EXPECT_EQ(database.num_put_images_, 2);
+  EXPECT_EQ(database.num_reused_images_, 0);
+  ASSERT_EQ(database.NumMatches(), 1);
+  const int num_correspondences =
+      database.GetImagePairMatch("1", "2").correspondences.size();
+  EXPECT_GT(num_correspondences, 0);
+
+  // A second matcher reuses the stored hashed images.
+  database.RemoveAllMatches();
+  {
+    CascadeHashingFeatureMatcher matcher(options, &database);
+    matcher.AddImage("1");
+    matcher.AddImage("2");
+    matcher.MatchImages();
+  }
+  EXPECT_EQ(database.num_put_images_, 2);
+  EXPECT_EQ(database.num_reused_images_, 2);
+  ASSERT_EQ(database.NumMatches(), 1);
+  EXPECT_EQ(database.GetImagePairMatch("1", "2").correspondences.size(),
+            num_correspondences);
+
+  // Changing the seed changes the projections, so the stored hashed images are
+  // stale and must be rebuilt.
+  database.RemoveAllMatches();
+  database.seed_ += 1;
+  {
+    CascadeHashingFeatureMatcher matcher(options, &database);
+    matcher.AddImage("1");
+    matcher.AddImage("2");
+    matcher.MatchImages();
+  }
+  EXPECT_EQ(database.num_put_images_, 4);
+  EXPECT_EQ(database.num_reused_images_, 2);
+  EXPECT_EQ(database.NumMatches(), 1);
+}
+
 }  // namespace theia
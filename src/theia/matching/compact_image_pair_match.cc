@@ -0,0 +1,237 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/compact_image_pair_match.h"
+
+#include <glog/logging.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+
+namespace theia {
+
+namespace {
+
+void AppendVarint(uint64_t value, std::string* bytes) {
+  while (value >= 0x80) {
+    bytes->push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  bytes->push_back(static_cast<char>(value));
+}
+
+// Reads the variable-length integer at the position and advances the position
+// past it. Returns false if the bytes end before the integer does.
+bool ReadVarint(const std::string& bytes, size_t* position, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *position < bytes.size(); shift += 7) {
+    const uint8_t byte = static_cast<uint8_t>(bytes[(*position)++]);
+    *value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Maps signed differences to unsigned integers so that differences of small
+// magnitude are encoded with few bytes: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+uint64_t ZigZagEncode(const int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+int64_t ZigZagDecode(const uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// Accessors that let the correspondences be expanded from either the keypoints
+// or the keypoint coordinates of the images.
+int NumKeypoints(const KeypointsAndDescriptors& features) {
+  return features.keypoints.size();
+}
+
+int NumKeypoints(const KeypointCoordinates& keypoint_coordinates) {
+  return keypoint_coordinates.rows();
+}
+
+Feature KeypointCoordinate(const KeypointsAndDescriptors& features,
+                           const int index) {
+  const Keypoint& keypoint = features.keypoints[index];
+  return Feature(keypoint.x(), keypoint.y());
+}
+
+Feature KeypointCoordinate(const KeypointCoordinates& keypoint_coordinates,
+                           const int index) {
+  return keypoint_coordinates.row(index).transpose();
+}
+
+template <class KeypointsType>
+ImagePairMatch ExpandCompactImagePairMatchImpl(
+    const std::string& image1,
+    const std::string& image2,
+    const CompactImagePairMatch& compact_image_pair_match,
+    const KeypointsType* keypoints1,
+    const KeypointsType* keypoints2) {
+  ImagePairMatch image_pair_match;
+  image_pair_match.image1 = image1;
+  image_pair_match.image2 = image2;
+  image_pair_match.twoview_info = compact_image_pair_match.twoview_info;
+  if (compact_image_pair_match.feature_indices.empty()) {
+    image_pair_match.correspondences =
+        compact_image_pair_match.correspondences;
+    return image_pair_match;
+  }
+
+  CHECK_NOTNULL(keypoints1);
+  CHECK_NOTNULL(keypoints2);
+  const std::vector<FeatureIndexPair>& feature_indices =
+      compact_image_pair_match.feature_indices;
+  image_pair_match.feature_indices = feature_indices;
+  image_pair_match.correspondences.reserve(feature_indices.size());
+  for (const FeatureIndexPair& indices : feature_indices) {
+    CHECK_LT(indices.first, NumKeypoints(*keypoints1));
+    CHECK_LT(indices.second, NumKeypoints(*keypoints2));
+    image_pair_match.correspondences.emplace_back(
+        KeypointCoordinate(*keypoints1, indices.first),
+        KeypointCoordinate(*keypoints2, indices.second));
+  }
+  return image_pair_match;
+}
+
+}  // namespace
+
+void EncodeFeatureIndices(
+    const std::vector<FeatureIndexPair>& feature_indices,
+    std::string* encoded_feature_indices) {
+  encoded_feature_indices->clear();
+  encoded_feature_indices->reserve(4 * feature_indices.size() + 4);
+  AppendVarint(feature_indices.size(), encoded_feature_indices);
+  int64_t previous_index1 = 0;
+  for (const FeatureIndexPair& indices : feature_indices) {
+    AppendVarint(ZigZagEncode(indices.first - previous_index1),
+                 encoded_feature_indices);
+    AppendVarint(indices.second, encoded_feature_indices);
+    previous_index1 = indices.first;
+  }
+}
+
+bool DecodeFeatureIndices(
+    const std::string& encoded_feature_indices,
+    std::vector<FeatureIndexPair>* feature_indices) {
+  feature_indices->clear();
+  size_t position = 0;
+  uint64_t num_feature_indices;
+  if (!ReadVarint(encoded_feature_indices, &position, &num_feature_indices) ||
+      num_feature_indices > encoded_feature_indices.size()) {
+    return false;
+  }
+
+  feature_indices->reserve(num_feature_indices);
+  int64_t index1 = 0;
+  for (uint64_t i = 0; i < num_feature_indices; i++) {
+    uint64_t index1_difference, index2;
+    if (!ReadVarint(encoded_feature_indices, &position, &index1_difference) ||
+        !ReadVarint(encoded_feature_indices, &position, &index2)) {
+      return false;
+    }
+    index1 += ZigZagDecode(index1_difference);
+    if (index1 < 0 || index1 > UINT32_MAX || index2 > UINT32_MAX) {
+      return false;
+    }
+    feature_indices->emplace_back(static_cast<uint32_t>(index1),
+                                  static_cast<uint32_t>(index2));
+  }
+  return position == encoded_feature_indices.size();
+}
+
+bool HasFeatureIndices(const ImagePairMatch& image_pair_match) {
+  return image_pair_match.feature_indices.size() ==
+         image_pair_match.correspondences.size();
+}
+
+CompactImagePairMatch MakeCompactImagePairMatch(
+    const ImagePairMatch& image_pair_match, const bool store_feature_indices) {
+  CompactImagePairMatch compact_image_pair_match;
+  compact_image_pair_match.twoview_info = image_pair_match.twoview_info;
+  if (store_feature_indices) {
+    CHECK(HasFeatureIndices(image_pair_match))
+        << "The feature indices of the correspondences between "
+        << image_pair_match.image1 << " and " << image_pair_match.image2
+        << " are not set.";
+    compact_image_pair_match.feature_indices = image_pair_match.feature_indices;
+  } else {
+    compact_image_pair_match.correspondences =
+        image_pair_match.correspondences;
+  }
+  return compact_image_pair_match;
+}
+
+KeypointCoordinates GetKeypointCoordinates(
+    const std::vector<Keypoint>& keypoints) {
+  KeypointCoordinates keypoint_coordinates(keypoints.size(), 2);
+  for (int i = 0; i < keypoints.size(); i++) {
+    keypoint_coordinates(i, 0) = keypoints[i].x();
+    keypoint_coordinates(i, 1) = keypoints[i].y();
+  }
+  return keypoint_coordinates;
+}
+
+ImagePairMatch ExpandCompactImagePairMatch(
+    const std::string& image1,
+    const std::string& image2,
+    const CompactImagePairMatch& compact_image_pair_match,
+    const KeypointsAndDescriptors* features1,
+    const KeypointsAndDescriptors* features2) {
+  return ExpandCompactImagePairMatchImpl(
+      image1, image2, compact_image_pair_match, features1, features2);
+}
+
+ImagePairMatch ExpandCompactImagePairMatch(
+    const std::string& image1,
+    const std::string& image2,
+    const CompactImagePairMatch& compact_image_pair_match,
+    const KeypointCoordinates* keypoint_coordinates1,
+    const KeypointCoordinates* keypoint_coordinates2) {
+  return ExpandCompactImagePairMatchImpl(image1,
+                                         image2,
+                                         compact_image_pair_match,
+                                         keypoint_coordinates1,
+                                         keypoint_coordinates2);
+}
+
+}  // namespace theia
@@ -0,0 +1,161 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_COMPACT_IMAGE_PAIR_MATCH_H_
+#define THEIA_MATCHING_COMPACT_IMAGE_PAIR_MATCH_H_
+
+#include <cereal/access.hpp>
+#include <cereal/cereal.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+#include <Eigen/Core>
+#include <glog/logging.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "theia/matching/feature_correspondence.h"
+#include "theia/matching/image_pair_match.h"
+#include "theia/sfm/twoview_info.h"
+
+namespace theia {
+class Keypoint;
+struct KeypointsAndDescriptors;
+
+// The coordinates of the keypoints of an image, where row i holds the x and y
+// coordinates of keypoint i. These are all that is needed to expand the feature
+// indices of a match, and they take a fraction of the memory of the features.
+typedef Eigen::Matrix<double, Eigen::Dynamic, 2, Eigen::RowMajor>
+    KeypointCoordinates;
+
+// Returns the coordinates of the keypoints.
+KeypointCoordinates GetKeypointCoordinates(
+    const std::vector<Keypoint>& keypoints);
+
+// Writes the number of feature index pairs followed by the difference of the
+// index in the first image to that of the previous pair and the index in the
+// second image for each pair, as variable-length integers. The matches are
+// usually ordered by the index in the first image, so the differences are
+// small. The order of the pairs is preserved.
+void EncodeFeatureIndices(
+    const std::vector<FeatureIndexPair>& feature_indices,
+    std::string* encoded_feature_indices);
+
+// Reverses EncodeFeatureIndices. Returns false if the encoding is invalid.
+bool DecodeFeatureIndices(
+    const std::string& encoded_feature_indices,
+    std::vector<FeatureIndexPair>* feature_indices);
+
+// The form in which the databases hold an ImagePairMatch. The names of the
+// images are not stored since they are given by the key of the match, and the
+// correspondences are stored as the indices of the matched features (8 bytes
+// per correspondence) whenever the features of both images are in the
+// database. The coordinates of the correspondences (32 bytes each) are then
+// looked up from the keypoints of the images when the match is expanded. When
+// serialized, the feature indices are delta and variable-length encoded, which
+// typically takes 3-4 bytes per correspondence.
+struct CompactImagePairMatch {
+ public:
+  TwoViewInfo twoview_info;
+
+  // The indices of the features of each correspondence.
+  std::vector<FeatureIndexPair> feature_indices;
+
+  // The coordinates of the correspondences, if they are not stored as feature
+  // indices.
+  std::vector<FeatureCorrespondence> correspondences;
+
+ private:
+  // Templated methods for disk I/O with cereal. The feature indices are written
+  // in their encoded form. Values of an earlier layout or with invalid feature
+  // indices throw a cereal::Exception when they are loaded.
+  friend class cereal::access;
+  template <class Archive>
+  void save(Archive& ar, const std::uint32_t version) const {  // NOLINT
+    std::string encoded_feature_indices;
+    EncodeFeatureIndices(feature_indices, &encoded_feature_indices);
+    ar(twoview_info, correspondences, encoded_feature_indices);
+  }
+
+  template <class Archive>
+  void load(Archive& ar, const std::uint32_t version) {  // NOLINT
+    if (version < 2) {
+      throw cereal::Exception(
+          "The image pair match was written with an earlier layout.");
+    }
+    std::string encoded_feature_indices;
+    ar(twoview_info, correspondences, encoded_feature_indices);
+    if (!DecodeFeatureIndices(encoded_feature_indices, &feature_indices)) {
+      throw cereal::Exception(
+          "The feature indices of the image pair match are corrupted.");
+    }
+  }
+};
+
+// Returns the compact form of the image pair match. If store_feature_indices
+// is true, the correspondences are stored as their feature indices, which
+// requires that the feature indices of all correspondences are set.
+CompactImagePairMatch MakeCompactImagePairMatch(
+    const ImagePairMatch& image_pair_match, const bool store_feature_indices);
+
+// Returns true if the feature indices of all correspondences of the image pair
+// match are set, i.e. if its correspondences may be stored as feature indices.
+bool HasFeatureIndices(const ImagePairMatch& image_pair_match);
+
+// Returns the image pair match of the images from its compact form. The
+// features of the images are only used if the correspondences are stored as
+// feature indices, and may be null otherwise.
+ImagePairMatch ExpandCompactImagePairMatch(
+    const std::string& image1,
+    const std::string& image2,
+    const CompactImagePairMatch& compact_image_pair_match,
+    const KeypointsAndDescriptors* features1,
+    const KeypointsAndDescriptors* features2);
+
+// Same as above, but the correspondences are looked up from the coordinates of
+// the keypoints of the images.
+ImagePairMatch ExpandCompactImagePairMatch(
+    const std::string& image1,
+    const std::string& image2,
+    const CompactImagePairMatch& compact_image_pair_match,
+    const KeypointCoordinates* keypoint_coordinates1,
+    const KeypointCoordinates* keypoint_coordinates2);
+
+}  // namespace theia
+
+// Version 2 is the first one that cannot be confused with the version of a
+// serialized ImagePairMatch, which the databases stored before.
+CEREAL_CLASS_VERSION(theia::CompactImagePairMatch, 2);
+
+#endif  // THEIA_MATCHING_COMPACT_IMAGE_PAIR_MATCH_H_
@@ -0,0 +1,203 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/compact_image_pair_match.h"
+
+#include <cereal/archives/portable_binary.hpp>
+#include <stdint.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/matching/image_pair_match.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+
+namespace theia {
+
+namespace {
+
+KeypointsAndDescriptors CreateFeatures(const int num_features,
+                                       const double offset) {
+  KeypointsAndDescriptors features;
+  for (int i = 0; i < num_features; i++) {
+    features.keypoints.emplace_back(
+        offset + i, 2.0 * i, Keypoint::OTHER);
+  }
+  return features;
+}
+
+}  // namespace
+
+TEST(CompactImagePairMatch, EncodeAndDecodeFeatureIndices) {
+  const std::vector<FeatureIndexPair> feature_indices = {
+      {0, 17}, {3, 2}, {4, 1000}, {2, 5}, {UINT32_MAX, 0}, {1, UINT32_MAX}};
+  std::string encoded_feature_indices;
+  EncodeFeatureIndices(feature_indices, &encoded_feature_indices);
+
+  std::vector<FeatureIndexPair> decoded_feature_indices;
+  EXPECT_TRUE(DecodeFeatureIndices(encoded_feature_indices,
+                                   &decoded_feature_indices));
+  EXPECT_EQ(decoded_feature_indices, feature_indices);
+
+  // Truncated encodings are rejected.
+  encoded_feature_indices.pop_back();
+  EXPECT_FALSE(DecodeFeatureIndices(encoded_feature_indices,
+                                    &decoded_feature_indices));
+}
+
+TEST(CompactImagePairMatch, EncodingIsSmallForSortedIndices) {
+  static const int kNumMatches = 1000;
+  std::vector<FeatureIndexPair> feature_indices;
+  for (int i = 0; i < kNumMatches; i++) {
+    feature_indices.emplace_back(5 * i, (7919 * i) % 10000);
+  }
+  std::string encoded_feature_indices;
+  EncodeFeatureIndices(feature_indices, &encoded_feature_indices);
+
+  // One byte for each difference in the first image and at most two bytes for
+  // each index into the second image.
+  EXPECT_LE(encoded_feature_indices.size(), 3 * kNumMatches + 2);
+}
+
+TEST(CompactImagePairMatch, ExpandFeatureIndices) {
+  const KeypointsAndDescriptors features1 = CreateFeatures(10, 0.0);
+  const KeypointsAndDescriptors features2 = CreateFeatures(10, 100.0);
+
+  ImagePairMatch image_pair_match;
+  image_pair_match.image1 = "1";
+  image_pair_match.image2 = "2";
+  image_pair_match.twoview_info.num_verified_matches = 3;
+  image_pair_match.feature_indices = {{1, 2}, {5, 3}, {9, 0}};
+  for (const FeatureIndexPair& indices : image_pair_match.feature_indices) {
+    const Keypoint& keypoint1 = features1.keypoints[indices.first];
+    const Keypoint& keypoint2 = features2.keypoints[indices.second];
+    image_pair_match.correspondences.emplace_back(
+        Feature(keypoint1.x(), keypoint1.y()),
+        Feature(keypoint2.x(), keypoint2.y()));
+  }
+  EXPECT_TRUE(HasFeatureIndices(image_pair_match));
+
+  const CompactImagePairMatch compact_image_pair_match =
+      MakeCompactImagePairMatch(image_pair_match, true);
+  EXPECT_TRUE(compact_image_pair_match.correspondences.empty());
+  EXPECT_EQ(compact_image_pair_match.feature_indices.size(), 3);
+
+  const ImagePairMatch expanded_image_pair_match = ExpandCompactImagePairMatch(
+      "1", "2", compact_image_pair_match, &features1, &features2);
+  EXPECT_EQ(expanded_image_pair_match.image1, "1");
+  EXPECT_EQ(expanded_image_pair_match.image2, "2");
+  EXPECT_EQ(expanded_image_pair_match.twoview_info.num_verified_matches, 3);
+  EXPECT_EQ(expanded_image_pair_match.feature_indices,
+            image_pair_match.feature_indices);
+  EXPECT_EQ(expanded_image_pair_match.correspondences,
+            image_pair_match.correspondences);
+
+  // Expanding the match from the keypoint coordinates gives the same match.
+  const KeypointCoordinates keypoint_coordinates1 =
+      GetKeypointCoordinates(features1.keypoints);
+  const KeypointCoordinates keypoint_coordinates2 =
+      GetKeypointCoordinates(features2.keypoints);
+  const ImagePairMatch expanded_from_coordinates = ExpandCompactImagePairMatch(
+      "1",
+      "2",
+      compact_image_pair_match,
+      &keypoint_coordinates1,
+      &keypoint_coordinates2);
+  EXPECT_EQ(expanded_from_coordinates.feature_indices,
+            image_pair_match.feature_indices);
+  EXPECT_EQ(expanded_from_coordinates.correspondences,
+            image_pair_match.correspondences);
+}
+
+TEST(CompactImagePairMatch, KeepCorrespondencesWithoutFeatureIndices) {
+  ImagePairMatch image_pair_match;
+  image_pair_match.correspondences.emplace_back(Feature(1.0, 2.0),
+                                                Feature(3.0, 4.0));
+  EXPECT_FALSE(HasFeatureIndices(image_pair_match));
+
+  const CompactImagePairMatch compact_image_pair_match =
+      MakeCompactImagePairMatch(image_pair_match, false);
+  EXPECT_TRUE(compact_image_pair_match.feature_indices.empty());
+
+  const KeypointCoordinates* no_keypoint_coordinates = nullptr;
+  const ImagePairMatch expanded_image_pair_match =
+      ExpandCompactImagePairMatch("1",
+                                  "2",
+                                  compact_image_pair_match,
+                                  no_keypoint_coordinates,
+                                  no_keypoint_coordinates);
+  EXPECT_EQ(expanded_image_pair_match.correspondences,
+            image_pair_match.correspondences);
+}
+
+TEST(CompactImagePairMatch, Serialization) {
+  CompactImagePairMatch compact_image_pair_match;
+  compact_image_pair_match.twoview_info.num_homography_inliers = 7;
+  compact_image_pair_match.feature_indices = {{4, 2}, {8, 16}, {6, 1}};
+
+  std::stringstream ss;
+  {
+    cereal::PortableBinaryOutputArchive output_archive(ss);
+    output_archive(compact_image_pair_match);
+  }
+  CompactImagePairMatch read_compact_image_pair_match;
+  {
+    cereal::PortableBinaryInputArchive input_archive(ss);
+    input_archive(read_compact_image_pair_match);
+  }
+  EXPECT_EQ(read_compact_image_pair_match.twoview_info.num_homography_inliers,
+            7);
+  EXPECT_EQ(read_compact_image_pair_match.feature_indices,
+            compact_image_pair_match.feature_indices);
+}
+
+TEST(CompactImagePairMatch, EarlierLayoutThrows) {
+  ImagePairMatch image_pair_match;
+  image_pair_match.image1 = "a";
+  image_pair_match.image2 = "b";
+
+  std::stringstream ss;
+  {
+    cereal::PortableBinaryOutputArchive output_archive(ss);
+    output_archive(image_pair_match);
+  }
+  CompactImagePairMatch read_compact_image_pair_match;
+  cereal::PortableBinaryInputArchive input_archive(ss);
+  EXPECT_THROW(input_archive(read_compact_image_pair_match), cereal::Exception);
+}
+
+}  // namespace theia
@@ -37,11 +37,14 @@
 #include <glog/logging.h>
 #include <memory>
 
+#include "theia/matching/blocked_brute_force_feature_matcher.h"
 #include "theia/matching/brute_force_feature_matcher.h"
 #include "theia/matching/cascade_hashing_feature_matcher.h"
 #include "theia/matching/distance.h"
 #include "theia/matching/feature_matcher.h"
 #include "theia/matching/features_and_matches_database.h"
+#include "theia/matching/kd_tree_feature_matcher.h"
+#include "theia/matching/multi_index_hashing_feature_matcher.h"
 
 namespace theia {
 
@@ -56,6 +59,15 @@ std::unique_ptr<FeatureMatcher> CreateFeatureMatcher(
   } else if (matching_strategy == MatchingStrategy::BRUTE_FORCE) {
     matcher.reset(
         new BruteForceFeatureMatcher(options, features_and_matches_database));
+  } else if (matching_strategy == MatchingStrategy::BLOCKED_BRUTE_FORCE) {
+    matcher.reset(new BlockedBruteForceFeatureMatcher(
+        options, features_and_matches_database));
+  } else if (matching_strategy == MatchingStrategy::MULTI_INDEX_HASHING) {
+    matcher.reset(new MultiIndexHashingFeatureMatcher(
+        options, features_and_matches_database));
+  } else if (matching_strategy == MatchingStrategy::KD_TREE) {
+    matcher.reset(
+        new KdTreeFeatureMatcher(options, features_and_matches_database));
   } else {
     LOG(FATAL) << "Invalid matching strategy specified.";
   }
@@ -46,10 +46,17 @@ struct FeatureMatcherOptions;
 enum class MatchingStrategy {
   BRUTE_FORCE = 0,
   CASCADE_HASHING = 1,
+  BLOCKED_BRUTE_FORCE = 2,
+  // Only for binary descriptors.
+  MULTI_INDEX_HASHING = 3,
+  // Only for float descriptors.
+  KD_TREE = 4,
 };
 
-// A factory method for creating an L2-based feature matcher (i.e. for float
-// descriptors).
+// A factory method for creating a feature matcher. BRUTE_FORCE may be used with
+// float or binary descriptors, CASCADE_HASHING, BLOCKED_BRUTE_FORCE and KD_TREE
+// only with float descriptors, and MULTI_INDEX_HASHING only with binary
+// descriptors.
 std::unique_ptr<FeatureMatcher> CreateFeatureMatcher(
     const MatchingStrategy& matching_strategy,
     const FeatureMatcherOptions& options,
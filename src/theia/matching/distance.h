@@ -37,10 +37,14 @@
 
 #include <Eigen/Core>
 #include <glog/logging.h>
+#include <stdint.h>
+
+#include "theia/matching/hamming_distance.h"
 
 namespace theia {
 // This file includes all of the distance metrics that are used:
 // L2 distance for euclidean features.
+// Hamming distance for binary vectors.
 
 // Squared Euclidean distance functor. We let Eigen handle the SSE optimization.
 // NOTE: This assumes that each vector has a unit norm:
@@ -49,13 +53,36 @@ struct L2 {
   typedef float DistanceType;
   typedef Eigen::VectorXf DescriptorType;
 
-  DistanceType operator()(const Eigen::VectorXf& descriptor_a,
-                          const Eigen::VectorXf& descriptor_b) const {
+  // The descriptors may be any Eigen vector expression (e.g., a row of a
+  // DescriptorMatrix) so that no temporary copies are made.
+  template <typename DerivedA, typename DerivedB>
+  DistanceType operator()(
+      const Eigen::MatrixBase<DerivedA>& descriptor_a,
+      const Eigen::MatrixBase<DerivedB>& descriptor_b) const {
     DCHECK_EQ(descriptor_a.size(), descriptor_b.size());
     return (descriptor_a - descriptor_b).squaredNorm();
   }
 };
 
+// Hamming distance functor for bit-packed binary descriptors. The population
+// count is computed with the fastest instruction set supported by the CPU.
+struct Hamming {
+  typedef int DistanceType;
+  typedef Eigen::Matrix<uint8_t, Eigen::Dynamic, 1> DescriptorType;
+
+  // The descriptors may be any Eigen vector expression with direct access to
+  // contiguous storage (e.g., a row of a BinaryDescriptorMatrix).
+  template <typename DerivedA, typename DerivedB>
+  DistanceType operator()(
+      const Eigen::MatrixBase<DerivedA>& descriptor_a,
+      const Eigen::MatrixBase<DerivedB>& descriptor_b) const {
+    DCHECK_EQ(descriptor_a.size(), descriptor_b.size());
+    return HammingDistance(descriptor_a.derived().data(),
+                           descriptor_b.derived().data(),
+                           descriptor_a.size());
+  }
+};
+
 }  // namespace theia
 
 #endif  // THEIA_MATCHING_DISTANCE_H_
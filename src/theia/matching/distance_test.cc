@@ -76,5 +76,34 @@ TEST(L2Distance, KnownDistance) {
   }
 }
 
+// Zero distance.
+TEST(HammingDistance, ZeroDistance) {
+  Hamming::DescriptorType descriptor1(16);
+  for (int i = 0; i < descriptor1.size(); i++) {
+    descriptor1[i] = rng.RandInt(0, 255);
+  }
+  Hamming::DescriptorType descriptor2 = descriptor1;
+  Hamming hamming_dist;
+  ASSERT_EQ(hamming_dist(descriptor1, descriptor2), 0);
+}
+
+// Known distance.
+TEST(HammingDistance, KnownDistance) {
+  // The size of the M-LDB descriptor in bytes.
+  const int num_bytes = 61;
+  Hamming::DescriptorType descriptor1(num_bytes);
+  Hamming::DescriptorType descriptor2(num_bytes);
+  for (int n = 0; n < kNumTrials; n++) {
+    int dist = 0;
+    for (int i = 0; i < num_bytes; i++) {
+      descriptor1[i] = rng.RandInt(0, 255);
+      descriptor2[i] = rng.RandInt(0, 255);
+      dist += std::bitset<8>(descriptor1[i] ^ descriptor2[i]).count();
+    }
+    Hamming hamming_dist;
+    ASSERT_EQ(hamming_dist(descriptor1, descriptor2), dist);
+  }
+}
+
 }  // namespace
 }  // namespace theia
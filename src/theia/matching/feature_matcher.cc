@@ -37,29 +37,40 @@
 #include <glog/logging.h>
 
 #include <algorithm>
+#include <functional>
 #include <limits>
 #include <memory>
+#include <numeric>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "theia/image/keypoint_detector/keypoint.h"
 
+#include "theia/matching/brute_force_feature_matcher.h"
 #include "theia/matching/feature_correspondence.h"
 #include "theia/matching/feature_matcher_options.h"
+#include "theia/matching/feature_matcher_utils.h"
 #include "theia/matching/features_and_matches_database.h"
 #include "theia/matching/image_pair_match.h"
 #include "theia/matching/keypoints_and_descriptors.h"
 #include "theia/sfm/camera_intrinsics_prior.h"
 #include "theia/sfm/two_view_match_geometric_verification.h"
 
+#include "theia/util/bounded_queue.h"
+#include "theia/util/concurrent_lru_cache.h"
 #include "theia/util/map_util.h"
 #include "theia/util/threadpool.h"
 #include "theia/util/util.h"
 
 namespace theia {
 namespace {
+// The number of images whose features selected for preemptive matching are
+// kept in memory. These are only a small subset of the features of each image.
+static const int kNumImagesInPreemptiveFeaturesCache = 1024;
+
 void SelectAllPairs(
     const std::vector<std::string>& image_names,
     std::vector<std::pair<std::string, std::string>>* pairs_to_match) {
@@ -75,14 +86,91 @@ void SelectAllPairs(
     }
   }
 }
+
+// Copies the given rows of the descriptor matrix, if it is used.
+template <class DescriptorMatrixType>
+void SelectDescriptors(const DescriptorMatrixType& descriptors,
+                       const std::vector<int>& indices,
+                       DescriptorMatrixType* selected_descriptors) {
+  if (descriptors.cols() == 0) {
+    return;
+  }
+  selected_descriptors->resize(indices.size(), descriptors.cols());
+  for (int i = 0; i < indices.size(); i++) {
+    selected_descriptors->row(i) = descriptors.row(indices[i]);
+  }
+}
+
+// Selects the num_features features with the largest scale, or with the
+// largest strength for keypoints that do not have a scale. Keypoints without
+// either are selected in the order that they were detected.
+void SelectFeaturesForPreemptiveMatching(
+    const KeypointsAndDescriptors& features,
+    const int num_features,
+    KeypointsAndDescriptors* selected_features) {
+  const auto& keypoints = features.keypoints;
+  const auto size = [&keypoints](const int i) {
+    if (keypoints[i].has_scale()) {
+      return keypoints[i].scale();
+    }
+    return keypoints[i].has_strength() ? keypoints[i].strength() : 0.0;
+  };
+
+  std::vector<int> indices(keypoints.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  if (indices.size() > num_features) {
+    std::partial_sort(indices.begin(),
+                      indices.begin() + num_features,
+                      indices.end(),
+                      [&size](const int i, const int j) {
+                        return size(i) > size(j);
+                      });
+    indices.resize(num_features);
+  }
+
+  selected_features->image_name = features.image_name;
+  selected_features->keypoints.reserve(indices.size());
+  for (const int i : indices) {
+    selected_features->keypoints.emplace_back(keypoints[i]);
+  }
+  SelectDescriptors(
+      features.descriptors, indices, &selected_features->descriptors);
+  SelectDescriptors(features.binary_descriptors,
+                    indices,
+                    &selected_features->binary_descriptors);
+  SelectDescriptors(features.quantized_descriptors,
+                    indices,
+                    &selected_features->quantized_descriptors);
+}
+
 }  // namespace
 
+struct FeatureMatcher::MatchedImagePair {
+  int pair_index;
+  std::shared_ptr<const KeypointsAndDescriptors> features1;
+  std::shared_ptr<const KeypointsAndDescriptors> features2;
+  std::vector<IndexedFeatureMatch> putative_matches;
+};
+
 FeatureMatcher::~FeatureMatcher() {}
 
 FeatureMatcher::FeatureMatcher(
     const FeatureMatcherOptions& options,
     FeaturesAndMatchesDatabase* feature_and_matches_db)
-    : options_(options), feature_and_matches_db_(feature_and_matches_db) {}
+    : options_(options),
+      feature_and_matches_db_(feature_and_matches_db),
+      num_preemptively_rejected_pairs_(0) {
+  if (options_.num_features_for_preemptive_matching > 0) {
+    const std::function<std::shared_ptr<const KeypointsAndDescriptors>(
+        const std::string&)>
+        fetch_preemptive_features =
+            std::bind(&FeatureMatcher::FetchPreemptiveFeatures,
+                      this,
+                      std::placeholders::_1);
+    preemptive_features_.reset(new PreemptiveFeaturesCache(
+        fetch_preemptive_features, kNumImagesInPreemptiveFeaturesCache));
+  }
+}
 
 void FeatureMatcher::AddImage(const std::string& image_name) {
   image_names_.push_back(image_name);
@@ -108,93 +196,291 @@ void FeatureMatcher::MatchImages() {
     SelectAllPairs(image_names_, &pairs_to_match_);
   }
 
+  num_preemptively_rejected_pairs_ = 0;
+
+  // Order the pairs so that the features of each image are loaded once per
+  // block of pairs instead of once per pair.
+  ScheduleImagePairsForMatching(options_.max_num_images_per_matching_block,
+                                &pairs_to_match_);
+
   // Add workers for matching. It is more efficient to let each thread compute
   // multiple matches at a time than add each matching task to the pool. This is
   // sort of like OpenMP's dynamic schedule in that it is able to balance
-  // threads fairly efficiently.
+  // threads fairly efficiently. The workers take the intervals in schedule
+  // order, so all threads work on the same few blocks of pairs at any time.
   const int num_matches = pairs_to_match_.size();
   const int num_threads =
       std::min(options_.num_threads, static_cast<int>(num_matches));
-  std::unique_ptr<ThreadPool> pool(new ThreadPool(num_threads));
   const int interval_step =
       std::min(this->kMaxThreadingStepSize_, num_matches / num_threads);
+
+  // If enabled, the images of upcoming intervals are loaded into the caches by
+  // a separate pool of threads so that reading features overlaps with
+  // matching. Each interval prefetches the interval that is one interval per
+  // matching thread ahead of it, which bounds how far ahead of the matching
+  // threads the prefetching runs.
+  std::unique_ptr<ThreadPool> prefetch_pool;
+  if (options_.num_prefetch_threads > 0) {
+    prefetch_pool.reset(new ThreadPool(options_.num_prefetch_threads));
+  }
+  const int prefetch_distance = num_threads * interval_step;
+  const auto prefetch_interval = [&](const int start_index) {
+    if (prefetch_pool && start_index < num_matches) {
+      prefetch_pool->Add(&FeatureMatcher::PrefetchImagePairs,
+                         this,
+                         start_index,
+                         std::min(num_matches, start_index + interval_step));
+    }
+  };
+  for (int i = 0; i < prefetch_distance; i += interval_step) {
+    prefetch_interval(i);
+  }
+
+  // If enabled, geometric verification and writing the matches to the database
+  // run on their own threads. They are started before the matching threads so
+  // that they consume the matched pairs as soon as they are produced.
+  const bool use_pipeline = options_.num_verification_threads > 0;
+  const size_t queue_capacity =
+      std::max(options_.max_num_queued_image_pairs, 1);
+  BoundedQueue<MatchedImagePair> verification_queue(queue_capacity);
+  BoundedQueue<ImagePairMatch> writer_queue(queue_capacity);
+  std::unique_ptr<ThreadPool> verification_pool, writer_pool;
+  if (use_pipeline) {
+    const int num_writer_threads =
+        std::max(options_.num_database_writer_threads, 1);
+    writer_pool.reset(new ThreadPool(num_writer_threads));
+    for (int i = 0; i < num_writer_threads; i++) {
+      writer_pool->Add(
+          &FeatureMatcher::WriteImagePairMatches, this, &writer_queue);
+    }
+    verification_pool.reset(
+        new ThreadPool(options_.num_verification_threads));
+    for (int i = 0; i < options_.num_verification_threads; i++) {
+      verification_pool->Add(&FeatureMatcher::VerifyImagePairs,
+                             this,
+                             &verification_queue,
+                             &writer_queue);
+    }
+  }
+
+  std::unique_ptr<ThreadPool> pool(new ThreadPool(num_threads));
   for (int i = 0; i < num_matches; i += interval_step) {
     const int end_interval = std::min(num_matches, i + interval_step);
-    pool->Add(&FeatureMatcher::MatchAndVerifyImagePairs, this, i, end_interval);
+    pool->Add([&, this, i, end_interval, prefetch_distance]() {
+      prefetch_interval(i + prefetch_distance);
+      if (use_pipeline) {
+        MatchImagePairs(i, end_interval, &verification_queue);
+      } else {
+        MatchAndVerifyImagePairs(i, end_interval);
+      }
+    });
   }
-  // Wait for all threads to finish.
+  // Wait for all threads to finish. Each stage of the pipeline is shut down
+  // once the stage that feeds it has finished, so that it drains its queue.
   pool.reset(nullptr);
+  prefetch_pool.reset(nullptr);
+  verification_queue.Close();
+  verification_pool.reset(nullptr);
+  writer_queue.Close();
+  writer_pool.reset(nullptr);
 
   VLOG(1) << "Matched " << feature_and_matches_db_->NumMatches()
           << " image pairs out of " << num_matches
           << " pairs selected for matching.";
+  if (options_.num_features_for_preemptive_matching > 0) {
+    VLOG(1) << "Preemptive matching rejected "
+            << num_preemptively_rejected_pairs_
+            << " image pairs with fewer than "
+            << options_.min_num_preemptive_matches << " matches among the "
+            << options_.num_features_for_preemptive_matching
+            << " largest features of each image.";
+  }
+}
+
+void FeatureMatcher::PrefetchImage(const std::string& image_name) {
+  feature_and_matches_db_->GetFeaturesShared(image_name);
+}
+
+void FeatureMatcher::PrefetchImagePairs(const int start_index,
+                                        const int end_index) {
+  std::unordered_set<std::string> prefetched_images;
+  for (int i = start_index; i < end_index; i++) {
+    for (const std::string& image_name :
+         {pairs_to_match_[i].first, pairs_to_match_[i].second}) {
+      if (prefetched_images.insert(image_name).second) {
+        PrefetchImage(image_name);
+      }
+    }
+  }
 }
 
 void FeatureMatcher::MatchAndVerifyImagePairs(const int start_index,
                                               const int end_index) {
   for (int i = start_index; i < end_index; i++) {
-    const std::string image1_name = pairs_to_match_[i].first;
-    const std::string image2_name = pairs_to_match_[i].second;
-
     // Match the image pair. If the pair fails to match then continue to the
     // next match.
+    MatchedImagePair matched_image_pair;
     ImagePairMatch image_pair_match;
-    image_pair_match.image1 = image1_name;
-    image_pair_match.image2 = image2_name;
-
-    // Get the keypoints and descriptors from the db.
-    const KeypointsAndDescriptors& features1 =
-        feature_and_matches_db_->GetFeatures(image1_name);
-    const KeypointsAndDescriptors& features2 =
-        feature_and_matches_db_->GetFeatures(image2_name);
-
-    // Compute the visual matches from feature descriptors.
-    std::vector<IndexedFeatureMatch> putative_matches;
-    if (!MatchImagePair(features1, features2, &putative_matches)) {
-      VLOG(2)
-          << "Could not match a sufficient number of features between images "
-          << image1_name << " and " << image2_name;
+    if (!ComputePutativeMatches(i, &matched_image_pair) ||
+        !VerifyImagePair(matched_image_pair, &image_pair_match)) {
       continue;
     }
 
-    // Perform geometric verification if applicable.
-    if (options_.perform_geometric_verification) {
-      // If geometric verification fails, do not add the match to the output.
-      if (!GeometricVerification(
-              features1, features2, putative_matches, &image_pair_match)) {
-        VLOG(2) << "Geometric verification between images " << image1_name
-                << " and " << image2_name << " failed.";
-        continue;
-      }
-    } else {
-      // If no geometric verification is performed then the putative matches are
-      // output.
-      image_pair_match.correspondences.reserve(putative_matches.size());
-      for (int i = 0; i < putative_matches.size(); i++) {
-        const Keypoint& keypoint1 =
-            features1.keypoints[putative_matches[i].feature1_ind];
-        const Keypoint& keypoint2 =
-            features2.keypoints[putative_matches[i].feature2_ind];
-        image_pair_match.correspondences.emplace_back(
-            Feature(keypoint1.x(), keypoint1.y()),
-            Feature(keypoint2.x(), keypoint2.y()));
-      }
+    // This operation is thread safe.
+    feature_and_matches_db_->PutImagePairMatch(
+        image_pair_match.image1, image_pair_match.image2, image_pair_match);
+  }
+}
+
+void FeatureMatcher::MatchImagePairs(
+    const int start_index,
+    const int end_index,
+    BoundedQueue<MatchedImagePair>* verification_queue) {
+  for (int i = start_index; i < end_index; i++) {
+    MatchedImagePair matched_image_pair;
+    if (ComputePutativeMatches(i, &matched_image_pair)) {
+      // Blocks while the verification threads are behind.
+      verification_queue->Push(std::move(matched_image_pair));
     }
+  }
+}
 
-    // Log information about the matching results.
-    VLOG(1) << "Images " << image1_name << " and " << image2_name
-            << " were matched with " << image_pair_match.correspondences.size()
-            << " verified matches and "
-            << image_pair_match.twoview_info.num_homography_inliers
-            << " homography matches out of " << putative_matches.size()
-            << " putative matches.";
+void FeatureMatcher::VerifyImagePairs(
+    BoundedQueue<MatchedImagePair>* verification_queue,
+    BoundedQueue<ImagePairMatch>* writer_queue) {
+  MatchedImagePair matched_image_pair;
+  while (verification_queue->Pop(&matched_image_pair)) {
+    ImagePairMatch image_pair_match;
+    if (VerifyImagePair(matched_image_pair, &image_pair_match)) {
+      writer_queue->Push(std::move(image_pair_match));
+    }
+  }
+}
 
+void FeatureMatcher::WriteImagePairMatches(
+    BoundedQueue<ImagePairMatch>* writer_queue) {
+  ImagePairMatch image_pair_match;
+  while (writer_queue->Pop(&image_pair_match)) {
     // This operation is thread safe.
     feature_and_matches_db_->PutImagePairMatch(
-        image1_name, image2_name, image_pair_match);
+        image_pair_match.image1, image_pair_match.image2, image_pair_match);
   }
 }
 
+bool FeatureMatcher::ComputePutativeMatches(
+    const int pair_index, MatchedImagePair* matched_image_pair) {
+  const std::string& image1_name = pairs_to_match_[pair_index].first;
+  const std::string& image2_name = pairs_to_match_[pair_index].second;
+  matched_image_pair->pair_index = pair_index;
+
+  // Get the keypoints and descriptors from the db. The handles share the
+  // features owned by the db so that no copy is made for each image pair.
+  matched_image_pair->features1 =
+      feature_and_matches_db_->GetFeaturesShared(image1_name);
+  matched_image_pair->features2 =
+      feature_and_matches_db_->GetFeaturesShared(image2_name);
+
+  // Skip pairs that are unlikely to match before matching all features.
+  if (!PassesPreemptiveMatching(image1_name, image2_name)) {
+    VLOG(2) << "Images " << image1_name << " and " << image2_name
+            << " were rejected by preemptive matching.";
+    ++num_preemptively_rejected_pairs_;
+    return false;
+  }
+
+  // Compute the visual matches from feature descriptors.
+  if (!MatchImagePair(*matched_image_pair->features1,
+                      *matched_image_pair->features2,
+                      &matched_image_pair->putative_matches)) {
+    VLOG(2)
+        << "Could not match a sufficient number of features between images "
+        << image1_name << " and " << image2_name;
+    return false;
+  }
+  return true;
+}
+
+std::shared_ptr<const KeypointsAndDescriptors>
+FeatureMatcher::FetchPreemptiveFeatures(const std::string& image_name) {
+  const std::shared_ptr<const KeypointsAndDescriptors> features =
+      feature_and_matches_db_->GetFeaturesShared(image_name);
+  std::shared_ptr<KeypointsAndDescriptors> selected_features =
+      std::make_shared<KeypointsAndDescriptors>();
+  SelectFeaturesForPreemptiveMatching(
+      *features,
+      options_.num_features_for_preemptive_matching,
+      selected_features.get());
+  return selected_features;
+}
+
+bool FeatureMatcher::PassesPreemptiveMatching(const std::string& image1_name,
+                                              const std::string& image2_name) {
+  if (options_.num_features_for_preemptive_matching <= 0) {
+    return true;
+  }
+
+  const std::shared_ptr<const KeypointsAndDescriptors> selected_features1 =
+      preemptive_features_->Fetch(image1_name);
+  const std::shared_ptr<const KeypointsAndDescriptors> selected_features2 =
+      preemptive_features_->Fetch(image2_name);
+
+  std::vector<IndexedFeatureMatch> preemptive_matches;
+  ComputeBruteForceFeatureMatches(
+      options_, *selected_features1, *selected_features2, &preemptive_matches);
+  return preemptive_matches.size() >= options_.min_num_preemptive_matches;
+}
+
+bool FeatureMatcher::VerifyImagePair(const MatchedImagePair& matched_image_pair,
+                                     ImagePairMatch* image_pair_match) {
+  const std::string& image1_name =
+      pairs_to_match_[matched_image_pair.pair_index].first;
+  const std::string& image2_name =
+      pairs_to_match_[matched_image_pair.pair_index].second;
+  const KeypointsAndDescriptors& features1 = *matched_image_pair.features1;
+  const KeypointsAndDescriptors& features2 = *matched_image_pair.features2;
+  const std::vector<IndexedFeatureMatch>& putative_matches =
+      matched_image_pair.putative_matches;
+
+  image_pair_match->image1 = image1_name;
+  image_pair_match->image2 = image2_name;
+
+  // Perform geometric verification if applicable.
+  if (options_.perform_geometric_verification) {
+    // If geometric verification fails, do not add the match to the output.
+    if (!GeometricVerification(
+            features1, features2, putative_matches, image_pair_match)) {
+      VLOG(2) << "Geometric verification between images " << image1_name
+              << " and " << image2_name << " failed.";
+      return false;
+    }
+  } else {
+    // If no geometric verification is performed then the putative matches are
+    // output.
+    image_pair_match->correspondences.reserve(putative_matches.size());
+    image_pair_match->feature_indices.reserve(putative_matches.size());
+    for (int i = 0; i < putative_matches.size(); i++) {
+      const Keypoint& keypoint1 =
+          features1.keypoints[putative_matches[i].feature1_ind];
+      const Keypoint& keypoint2 =
+          features2.keypoints[putative_matches[i].feature2_ind];
+      image_pair_match->correspondences.emplace_back(
+          Feature(keypoint1.x(), keypoint1.y()),
+          Feature(keypoint2.x(), keypoint2.y()));
+      image_pair_match->feature_indices.emplace_back(
+          putative_matches[i].feature1_ind, putative_matches[i].feature2_ind);
+    }
+  }
+
+  // Log information about the matching results.
+  VLOG(1) << "Images " << image1_name << " and " << image2_name
+          << " were matched with " << image_pair_match->correspondences.size()
+          << " verified matches and "
+          << image_pair_match->twoview_info.num_homography_inliers
+          << " homography matches out of " << putative_matches.size()
+          << " putative matches.";
+  return true;
+}
+
 bool FeatureMatcher::GeometricVerification(
     const KeypointsAndDescriptors& features1,
     const KeypointsAndDescriptors& features2,
@@ -222,9 +508,22 @@ bool FeatureMatcher::GeometricVerification(
       features2,
       putative_matches);
 
-  // Return whether geometric verification succeeds.
-  return geometric_verification.VerifyMatches(
-      &image_pair_match->correspondences, &image_pair_match->twoview_info);
+  if (!geometric_verification.VerifyMatches(
+          &image_pair_match->correspondences,
+          &image_pair_match->twoview_info)) {
+    return false;
+  }
+
+  // Keep the feature indices of the verified matches so that the database may
+  // store the matches compactly.
+  const std::vector<IndexedFeatureMatch>& verified_feature_matches =
+      geometric_verification.verified_feature_matches();
+  image_pair_match->feature_indices.reserve(verified_feature_matches.size());
+  for (const IndexedFeatureMatch& match : verified_feature_matches) {
+    image_pair_match->feature_indices.emplace_back(match.feature1_ind,
+                                                   match.feature2_ind);
+  }
+  return true;
 }
 
 }  // namespace theia
@@ -37,6 +37,7 @@
 
 #include <Eigen/Core>
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -44,9 +45,11 @@
 #include <vector>
 
 #include "theia/matching/feature_matcher_options.h"
+#include "theia/util/concurrent_lru_cache.h"
 #include "theia/util/util.h"
 
 namespace theia {
+template <typename T> class BoundedQueue;
 class FeaturesAndMatchesDatabase;
 class Keypoint;
 struct ImagePairMatch;
@@ -112,12 +115,63 @@ class FeatureMatcher {
       const KeypointsAndDescriptors& features2,
       std::vector<IndexedFeatureMatch>* matched_features) = 0;
 
+  // Loads the data that is needed to match the image into the caches of the
+  // database (and of the matcher) ahead of time. Derived classes that cache
+  // data per image should override this method to fill their caches as well.
+  // This is called from the prefetch threads, so it must be thread-safe.
+  virtual void PrefetchImage(const std::string& image_name);
+
+  // Prefetches each image of the pairs_to_match_ between the specified indices
+  // once.
+  void PrefetchImagePairs(const int start_index, const int end_index);
+
   // Performs matching and geometric verification (if desired) on the
   // pairs_to_match_ between the specified indices. This is useful for thread
   // pooling.
   virtual void MatchAndVerifyImagePairs(const int start_index,
                                         const int end_index);
 
+  // An image pair whose descriptors have been matched and that waits for
+  // geometric verification. It holds the features of both images so that they
+  // are not evicted from the caches before the pair is verified.
+  struct MatchedImagePair;
+
+  // The stages of the pipeline that is used when
+  // options_.num_verification_threads > 0. The matching threads match the
+  // pairs_to_match_ between the specified indices and push the pairs that
+  // matched onto the verification queue. The verification threads pop these
+  // pairs, verify them, and push the verified matches onto the writer queue,
+  // from which the writer threads add them to the database. Each stage returns
+  // once its input queue is closed and empty.
+  void MatchImagePairs(const int start_index,
+                       const int end_index,
+                       BoundedQueue<MatchedImagePair>* verification_queue);
+  void VerifyImagePairs(BoundedQueue<MatchedImagePair>* verification_queue,
+                        BoundedQueue<ImagePairMatch>* writer_queue);
+  void WriteImagePairMatches(BoundedQueue<ImagePairMatch>* writer_queue);
+
+  // Returns true if the image pair passes preemptive matching (see
+  // FeatureMatcherOptions::num_features_for_preemptive_matching), i.e. the pair
+  // may have enough feature matches to be matched successfully.
+  bool PassesPreemptiveMatching(const std::string& image1_name,
+                                const std::string& image2_name);
+
+  // Selects the features of the image that are used for preemptive matching.
+  // This is the cache miss function of the preemptive features cache.
+  std::shared_ptr<const KeypointsAndDescriptors> FetchPreemptiveFeatures(
+      const std::string& image_name);
+
+  // Matches the descriptors of the image pair pairs_to_match_[pair_index].
+  // Returns false if the pair could not be matched.
+  bool ComputePutativeMatches(const int pair_index,
+                              MatchedImagePair* matched_image_pair);
+
+  // Performs geometric verification on the matched image pair (if desired) and
+  // outputs the matches that should be added to the database. Returns false if
+  // the pair fails geometric verification.
+  bool VerifyImagePair(const MatchedImagePair& matched_image_pair,
+                       ImagePairMatch* image_pair_match);
+
   // Performs geometric verification. By making this a virtual method, derived
   // classes may implement custom verification methods (e.g., if rotations are
   // known then custom solvers can be used to solve for only the relative
@@ -145,6 +199,17 @@ class FeatureMatcher {
   // Pairs that we will perform matching on.
   std::vector<std::pair<std::string, std::string> > pairs_to_match_;
 
+  // The number of image pairs that were rejected by preemptive matching.
+  std::atomic<int> num_preemptively_rejected_pairs_;
+
+  // The features selected for preemptive matching, so that they are selected
+  // once per image instead of once per image pair. Only set if preemptive
+  // matching is enabled.
+  using PreemptiveFeaturesCache =
+      ConcurrentLRUCache<std::string,
+                         std::shared_ptr<const KeypointsAndDescriptors>>;
+  std::unique_ptr<PreemptiveFeaturesCache> preemptive_features_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(FeatureMatcher);
 };
@@ -46,6 +46,26 @@ struct FeatureMatcherOptions {
   // Number of threads to use in parallel for matching.
   int num_threads = 1;
 
+  // Number of threads that load the features of upcoming image pairs while the
+  // matching threads work on the current ones. This hides the time spent
+  // reading features when the database is out-of-core, and has no benefit for
+  // features that are held in memory. If set to 0, features are only loaded by
+  // the matching threads when they are needed.
+  int num_prefetch_threads = 0;
+
+  // If greater than 0, matching runs as a pipeline of three stages with their
+  // own threads: num_threads match the descriptors of image pairs,
+  // num_verification_threads perform geometric verification on the matched
+  // pairs, and num_database_writer_threads add the verified matches to the
+  // database. The stages are connected by queues that hold at most
+  // max_num_queued_image_pairs pairs, and a stage that falls behind blocks the
+  // stage that feeds it. This keeps the memory-bound descriptor matching and
+  // the compute-bound verification from competing for the same threads. If set
+  // to 0, each matching thread verifies and writes its own pairs.
+  int num_verification_threads = 0;
+  int num_database_writer_threads = 1;
+  int max_num_queued_image_pairs = 64;
+
   // Only symmetric matches are kept.
   bool keep_only_symmetric_matches = true;
 
@@ -68,6 +88,36 @@ struct FeatureMatcherOptions {
   // Only images that contain more feature matches than this number will be
   // returned.
   int min_num_feature_matches = 30;
+
+  // If greater than 0, each image pair is first matched preemptively with only
+  // the num_features_for_preemptive_matching features of each image that have
+  // the largest scale (or the largest strength for keypoints without a scale).
+  // Pairs with fewer than min_num_preemptive_matches matches among these
+  // features are rejected without matching all features or performing
+  // geometric verification. Features at large scales are the most likely to be
+  // matched again across images, so few of them match when the images do not
+  // overlap. This saves most of the matching time when many of the selected
+  // image pairs do not overlap, at the cost of rejecting some valid pairs.
+  int num_features_for_preemptive_matching = 0;
+  int min_num_preemptive_matches = 4;
+
+  // The image pairs are matched in blocks that involve at most this many images
+  // so that the features of a block are loaded once and then reused from the
+  // caches (see ScheduleImagePairsForMatching). It should be no larger than
+  // half the number of images whose features fit in the caches of the database
+  // and the matcher, since threads may be working on two blocks at once.
+  int max_num_images_per_matching_block = 32;
+
+  // The memory budget of the caches that the matcher holds per image (e.g., the
+  // hashed images of CASCADE_HASHING). If set to 0, a fixed number of images
+  // is cached regardless of their size.
+  size_t max_cache_size_in_bytes = 0;
+
+  // The randomized kd-forest used by KD_TREE matching. Each search visits at
+  // most kd_tree_max_num_checks leaves of the forest, so more checks (and more
+  // trees) make the nearest neighbors more accurate but slower to find.
+  int kd_tree_num_trees = 4;
+  int kd_tree_max_num_checks = 256;
 };
 
 }  // namespace theia
@@ -35,7 +35,11 @@
 #include "theia/matching/feature_matcher_utils.h"
 
 #include <glog/logging.h>
+#include <algorithm>
+#include <string>
+#include <tuple>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "theia/matching/indexed_feature_match.h"
@@ -70,4 +74,48 @@ void IntersectMatches(const std::vector<IndexedFeatureMatch>& backwards_matches,
   }
 }
 
+void ScheduleImagePairsForMatching(
+    const int max_num_images_per_block,
+    std::vector<std::pair<std::string, std::string> >* image_pairs) {
+  CHECK_GT(max_num_images_per_block, 0);
+  const int num_images_per_group = std::max(max_num_images_per_block / 2, 1);
+
+  // Index the images in the order that they first appear.
+  std::unordered_map<std::string, int> image_indices;
+  for (const auto& image_pair : *image_pairs) {
+    image_indices.emplace(image_pair.first, image_indices.size());
+    image_indices.emplace(image_pair.second, image_indices.size());
+  }
+  const int num_groups =
+      (image_indices.size() + num_images_per_group - 1) / num_images_per_group;
+
+  // The position of each pair in the schedule is given by its block, followed
+  // by the smaller and then the larger index of its images.
+  typedef std::tuple<int, int, int, int, int> ScheduleKey;
+  std::vector<ScheduleKey> schedule;
+  schedule.reserve(image_pairs->size());
+  for (int i = 0; i < image_pairs->size(); i++) {
+    const int index1 = FindOrDie(image_indices, (*image_pairs)[i].first);
+    const int index2 = FindOrDie(image_indices, (*image_pairs)[i].second);
+    const int min_index = std::min(index1, index2);
+    const int max_index = std::max(index1, index2);
+    const int row = min_index / num_images_per_group;
+    const int col = max_index / num_images_per_group;
+
+    // Even rows of blocks are visited left to right and odd rows right to left
+    // so that the last block of an even row and the first block of the next
+    // row share their column of images.
+    const int col_order = (row % 2 == 0) ? col : num_groups - 1 - col;
+    schedule.emplace_back(row, col_order, min_index, max_index, i);
+  }
+  std::sort(schedule.begin(), schedule.end());
+
+  std::vector<std::pair<std::string, std::string> > scheduled_pairs;
+  scheduled_pairs.reserve(image_pairs->size());
+  for (const ScheduleKey& key : schedule) {
+    scheduled_pairs.emplace_back((*image_pairs)[std::get<4>(key)]);
+  }
+  image_pairs->swap(scheduled_pairs);
+}
+
 }  // namespace theia
@@ -35,6 +35,8 @@
 #ifndef THEIA_MATCHING_FEATURE_MATCHER_UTILS_H_
 #define THEIA_MATCHING_FEATURE_MATCHER_UTILS_H_
 
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace theia {
@@ -45,6 +47,17 @@ struct IndexedFeatureMatch;
 void IntersectMatches(const std::vector<IndexedFeatureMatch>& backwards_matches,
                       std::vector<IndexedFeatureMatch>* forward_matches);
 
+// Reorders the image pairs so that consecutive pairs share their images, which
+// keeps the features of the images being matched in the LRU caches of the
+// matcher. The images are split into groups of max_num_images_per_block / 2 in
+// the order that they first appear in the pairs. This tiles the matrix of image
+// pairs into blocks that each involve at most max_num_images_per_block images.
+// The blocks are visited in a serpentine order so that adjacent blocks share a
+// group of images, and the pairs of a block are sorted by their first image.
+void ScheduleImagePairsForMatching(
+    const int max_num_images_per_block,
+    std::vector<std::pair<std::string, std::string> >* image_pairs);
+
 }  // namespace theia
 
 #endif  // THEIA_MATCHING_FEATURE_MATCHER_UTILS_H_
@@ -32,6 +32,10 @@
 // Please contact the author of this library if you have any questions.
 // Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
 
+#include <algorithm>
+#include <list>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -53,4 +57,64 @@ TEST(FeatureMatcherUtils, IntersectMatches) {
   EXPECT_EQ(matches[0].feature2_ind, 1);
 }
 
+namespace {
+
+// Returns the number of times that features must be loaded when the image
+// pairs are matched in order with an LRU cache of the given size.
+int NumCacheMisses(
+    const std::vector<std::pair<std::string, std::string> >& image_pairs,
+    const int cache_size) {
+  std::list<std::string> cache;
+  int num_cache_misses = 0;
+  for (const auto& image_pair : image_pairs) {
+    for (const std::string& image : {image_pair.first, image_pair.second}) {
+      const auto it = std::find(cache.begin(), cache.end(), image);
+      if (it != cache.end()) {
+        cache.erase(it);
+      } else {
+        ++num_cache_misses;
+        if (cache.size() == cache_size) {
+          cache.pop_front();
+        }
+      }
+      cache.push_back(image);
+    }
+  }
+  return num_cache_misses;
+}
+
+}  // namespace
+
+TEST(FeatureMatcherUtils, ScheduleImagePairsForMatching) {
+  static const int kNumImages = 100;
+  static const int kMaxNumImagesPerBlock = 16;
+  static const int kCacheSize = 2 * kMaxNumImagesPerBlock;
+
+  std::vector<std::pair<std::string, std::string> > image_pairs;
+  for (int i = 0; i < kNumImages; i++) {
+    for (int j = i + 1; j < kNumImages; j++) {
+      image_pairs.emplace_back(std::to_string(i), std::to_string(j));
+    }
+  }
+  std::vector<std::pair<std::string, std::string> > scheduled_pairs =
+      image_pairs;
+  ScheduleImagePairsForMatching(kMaxNumImagesPerBlock, &scheduled_pairs);
+
+  // Matching all pairs in insertion order reloads nearly every image for
+  // every pair, while each block of the schedule only loads its images once.
+  const int num_cache_misses = NumCacheMisses(image_pairs, kCacheSize);
+  const int num_scheduled_cache_misses =
+      NumCacheMisses(scheduled_pairs, kCacheSize);
+  EXPECT_LT(num_scheduled_cache_misses, num_cache_misses / 4);
+
+  // The schedule must be a permutation of the pairs that keeps the order of
+  // the images within each pair.
+  ASSERT_EQ(scheduled_pairs.size(), image_pairs.size());
+  std::vector<std::pair<std::string, std::string> > sorted_pairs =
+      scheduled_pairs;
+  std::sort(sorted_pairs.begin(), sorted_pairs.end());
+  std::sort(image_pairs.begin(), image_pairs.end());
+  EXPECT_EQ(sorted_pairs, image_pairs);
+}
+
 }  // namespace theia
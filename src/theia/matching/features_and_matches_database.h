@@ -35,6 +35,8 @@
 #ifndef THEIA_MATCHING_FEATURES_AND_MATCHES_DATABASE_H_
 #define THEIA_MATCHING_FEATURES_AND_MATCHES_DATABASE_H_
 
+#include <stdint.h>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -44,6 +46,7 @@
 #include "theia/sfm/camera_intrinsics_prior.h"
 
 namespace theia {
+struct HashedImage;
 
 // An interface for retreiving feature and match related data. This data is
 // typically memory intensive so caches or database systems may be used to
@@ -73,6 +76,17 @@ class FeaturesAndMatchesDatabase {
   virtual KeypointsAndDescriptors GetFeatures(
       const std::string& image_name) = 0;
 
+  // Returns a shared handle to the features for the image. Unlike GetFeatures,
+  // this does not copy the keypoints and descriptors if the database already
+  // holds them in memory, so it should be preferred for read-only access. The
+  // features remain valid for as long as the handle is held, even if the
+  // database replaces or evicts them in the meantime.
+  virtual std::shared_ptr<const KeypointsAndDescriptors> GetFeaturesShared(
+      const std::string& image_name) {
+    return std::make_shared<const KeypointsAndDescriptors>(
+        GetFeatures(image_name));
+  }
+
   // Set the features for the image.
   virtual void PutFeatures(const std::string& image_name,
                            const KeypointsAndDescriptors& features) = 0;
@@ -95,8 +109,35 @@ class FeaturesAndMatchesDatabase {
   ImageNamesOfMatches() = 0;
   virtual size_t NumMatches() = 0;
 
+  // Records that the image was matched against the other images of the
+  // database, whether or not any of its image pairs passed verification. The
+  // record of an image is removed when its features are replaced, and all
+  // records are removed with the matches.
+  virtual void PutMatchedImage(const std::string& image_name) = 0;
+  virtual std::vector<std::string> ImageNamesOfMatchedImages() = 0;
+
   // Clear all matches from the DB.
   virtual void RemoveAllMatches() = 0;
+
+  // The CascadeHashingFeatureMatcher stores the seed of its hashing projections
+  // and the hashed images (i.e. the hash codes and bucket ids of the features)
+  // so that the features of an image are only hashed once for all runs over
+  // the same database. Databases that do not persist this data keep the default
+  // implementations, which store nothing.
+  virtual bool GetCascadeHashingSeed(unsigned* seed) { return false; }
+  virtual void PutCascadeHashingSeed(const unsigned seed) {}
+
+  // Returns false if no hashed image of the features of the image is stored or
+  // if it was created with projections of a different fingerprint (see
+  // CascadeHasher::ProjectionFingerprint).
+  virtual bool GetHashedImage(const std::string& image_name,
+                              const uint64_t projection_fingerprint,
+                              HashedImage* hashed_image) {
+    return false;
+  }
+  virtual void PutHashedImage(const std::string& image_name,
+                              const uint64_t projection_fingerprint,
+                              const HashedImage& hashed_image) {}
 };
 }  // namespace theia
 #endif  // THEIA_MATCHING_FEATURES_AND_MATCHES_DATABASE_H_
@@ -33,19 +33,51 @@
 // Author: Chris Sweeney (sweeney.chris.m@gmail.com)
 
 extern "C" {
-#include <vl/fisher.h>
-#include <vl/gmm.h>
+#include <vl/kmeans.h>
 }
 
+#include "theia/matching/fisher_vector_extractor.h"
+
+#include <cereal/archives/portable_binary.hpp>
 #include <Eigen/Core>
 #include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>  // NOLINT
+#include <limits>
 #include <memory>
+#include <mutex>  // NOLINT
+#include <string>
 #include <vector>
 
-#include "theia/matching/fisher_vector_extractor.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/io/eigen_serializable.h"
+#include "theia/util/threadpool.h"
 
 namespace theia {
 namespace {
+
+// The number of training features that each thread processes at a time during
+// EM.
+const int kBlockSize = 4096;
+
+// The variances of the GMM are bounded from below to avoid degenerate modes.
+const float kMinVariance = 1e-4;
+
+// Modes with a smaller prior are ignored.
+const float kMinPrior = 1e-6;
+
+// Modes with a prior smaller than kMinModeMass / num_clusters are considered
+// empty during training.
+const float kMinModeMass = 1e-2;
+
+// Posteriors smaller than this are ignored when computing the Fisher Vector.
+const float kMinFisherVectorPosterior = 1e-6;
+
+// EM stops once the relative change in log-likelihood is below this threshold.
+const double kConvergenceThreshold = 1e-5;
+
 Eigen::MatrixXf ConvertVectorOfFeaturesToMatrix(
     const std::vector<Eigen::VectorXf>& features) {
   Eigen::MatrixXf feature_table(features[0].size(), features.size());
@@ -54,101 +86,369 @@ Eigen::MatrixXf ConvertVectorOfFeaturesToMatrix(
   }
   return feature_table;
 }
-}  // namespace
-
-// Wrapper for the VlFeat gmm.
-class FisherVectorExtractor::GaussianMixtureModel {
- public:
-  // NOTE: We need the unique_ptr to use vlfeat's delete function for the GMM.
-  GaussianMixtureModel(const int num_clusters)
-      : num_clusters_(num_clusters), gmm_(nullptr, vl_gmm_delete) {}
-
-  int num_clusters() const { return num_clusters_; }
-
-  // Computes the Gaussian mixture model based on the input training features.
-  bool Compute(const Eigen::MatrixXf& data_points) {
-    CHECK(!data_points.hasNaN());
 
-    // Create the GMM instance.
-    gmm_.reset(vl_gmm_new(VL_TYPE_FLOAT, data_points.rows(), num_clusters_));
-    if (!gmm_) {
-      return false;
-    }
-    // Compute the model.
-    const double distortion =
-        vl_gmm_cluster(gmm_.get(), data_points.data(), data_points.cols());
-    CHECK(!std::isnan(distortion));
-    return true;
-  }
-
-  // Helper accessor methods for retreiving VLFeat types.
-  void const* GetMeans() const { return vl_gmm_get_means(gmm_.get()); }
-  void const* GetCovariances() const {
-    return vl_gmm_get_covariances(gmm_.get());
-  }
-  void const* GetPriors() const { return vl_gmm_get_priors(gmm_.get()); }
+}  // namespace
 
- private:
-  // Number of clusters.
-  const int num_clusters_;
-  // The VlFeat GMM model.
-  std::unique_ptr<VlGMM, void (*)(VlGMM*)> gmm_;
+struct FisherVectorExtractor::SufficientStatistics {
+  double log_likelihood = 0;
+  // The sum of the posteriors of each mode, and the sums of the features and of
+  // the squared features weighted by the posteriors of each mode.
+  Eigen::VectorXd mass;
+  Eigen::MatrixXd first_moments;
+  Eigen::MatrixXd second_moments;
 };
 
 FisherVectorExtractor::FisherVectorExtractor(const Options& options)
-    : gmm_(new GaussianMixtureModel(options.num_gmm_clusters)),
+    : options_(options),
       training_feature_sampler_(options.max_num_features_for_training) {}
 
 FisherVectorExtractor::~FisherVectorExtractor() {}
 
 void FisherVectorExtractor::AddFeaturesForTraining(
-    const std::vector<Eigen::VectorXf>& features) {
-  for (const Eigen::VectorXf& feature : features) {
-    CHECK(!feature.hasNaN()) << "Feature: " << feature.transpose();
-    training_feature_sampler_.AddElementToSampler(feature);
+    const DescriptorMatrix& features) {
+  std::lock_guard<std::mutex> lock(training_mutex_);
+  for (int i = 0; i < features.rows(); i++) {
+    CHECK(!features.row(i).hasNaN()) << "Feature: " << features.row(i);
+    training_feature_sampler_.AddElementToSampler(features.row(i).transpose());
   }
 }
 
 bool FisherVectorExtractor::Train() {
+  std::lock_guard<std::mutex> lock(training_mutex_);
   // Get the features randomly sampled for training.
   const auto& sampled_features = training_feature_sampler_.GetAllSamples();
-  CHECK_GT(sampled_features.size(), 0);
+  if (sampled_features.size() < options_.num_gmm_clusters) {
+    LOG(ERROR) << "Cannot train a GMM with " << options_.num_gmm_clusters
+               << " clusters from " << sampled_features.size()
+               << " features.";
+    return false;
+  }
   LOG(INFO) << "Training GMM for Fisher Vector extractin with "
             << sampled_features.size() << " features sampled from "
             << training_feature_sampler_.NumElementsAdded()
             << " total features.";
 
-  // Train the GMM using the training feaures.
-  const Eigen::MatrixXf feature_table =
-      ConvertVectorOfFeaturesToMatrix(sampled_features);
-  return gmm_->Compute(feature_table);
+  // Gather the training features into a contiguous matrix with one feature per
+  // column. The features are centered so that the second moments accumulated
+  // by EM are well conditioned in single precision.
+  Eigen::MatrixXf features = ConvertVectorOfFeaturesToMatrix(sampled_features);
+  const Eigen::VectorXf data_mean = features.rowwise().mean();
+  features.colwise() -= data_mean;
+
+  if (IsTrained() && means_.rows() == features.rows()) {
+    LOG(INFO) << "Warm-starting EM from the current GMM.";
+    means_.colwise() -= data_mean;
+  } else {
+    LOG_IF(WARNING, IsTrained())
+        << "The current GMM has descriptors of dimension " << means_.rows()
+        << " but the training features have dimension " << features.rows()
+        << ". The GMM will be trained from scratch.";
+    InitializeGMM(features);
+  }
+  variances_ = variances_.cwiseMax(kMinVariance);
+
+  double previous_log_likelihood = -std::numeric_limits<double>::infinity();
+  for (int i = 0; i < options_.max_num_em_iterations; i++) {
+    const double log_likelihood = RunExpectationMaximizationIteration(features);
+    VLOG(2) << "EM iteration " << i
+            << ": log-likelihood = " << log_likelihood;
+    CHECK(std::isfinite(log_likelihood));
+    if (i > 0 && std::abs((log_likelihood - previous_log_likelihood) /
+                          log_likelihood) < kConvergenceThreshold) {
+      break;
+    }
+    previous_log_likelihood = log_likelihood;
+
+    // Give the restarted modes at least one EM iteration to settle.
+    if (i + 1 < options_.max_num_em_iterations) {
+      RestartEmptyModes();
+    }
+  }
+
+  means_.colwise() += data_mean;
+  return true;
+}
+
+void FisherVectorExtractor::InitializeGMM(const Eigen::MatrixXf& features) {
+  const int descriptor_dimension = features.rows();
+  const int num_features = features.cols();
+  const int num_clusters = options_.num_gmm_clusters;
+
+  // NOTE: We need the unique_ptr to use vlfeat's delete function for k-means.
+  std::unique_ptr<VlKMeans, void (*)(VlKMeans*)> kmeans(
+      vl_kmeans_new(VL_TYPE_FLOAT, VlDistanceL2), vl_kmeans_delete);
+  vl_kmeans_init_centers_plus_plus(kmeans.get(),
+                                   features.data(),
+                                   descriptor_dimension,
+                                   num_features,
+                                   num_clusters);
+  means_ = Eigen::Map<const Eigen::MatrixXf>(
+      static_cast<const float*>(vl_kmeans_get_centers(kmeans.get())),
+      descriptor_dimension,
+      num_clusters);
+
+  // The features are centered, so their variance is the mean squared value.
+  const Eigen::VectorXf data_variance =
+      features.rowwise().squaredNorm() / std::max(num_features - 1, 1);
+  variances_ = data_variance.replicate(1, num_clusters);
+  priors_.setConstant(num_clusters, 1.0f / num_clusters);
+}
+
+double FisherVectorExtractor::ComputePosteriors(
+    const Eigen::Ref<const Eigen::MatrixXf>& features,
+    Eigen::MatrixXf* posteriors) const {
+  const int num_clusters = means_.cols();
+  const Eigen::MatrixXf inv_variances = variances_.cwiseInverse();
+
+  // The Mahalanobis distance of a feature x to mode k is expanded as
+  //   x^2 . (1 / s_k) - 2 * x . (mu_k / s_k) + mu_k^2 . (1 / s_k)
+  // so that the distances of all features to all modes are two matrix
+  // products. The last term is folded into the log-weight of the mode.
+  const float half_dim_log_2_pi =
+      0.5 * means_.rows() * std::log(2.0 * M_PI);
+  Eigen::VectorXf log_weights(num_clusters);
+  for (int i = 0; i < num_clusters; i++) {
+    if (priors_(i) < kMinPrior) {
+      log_weights(i) = -std::numeric_limits<float>::infinity();
+      continue;
+    }
+    log_weights(i) =
+        std::log(priors_(i)) - half_dim_log_2_pi -
+        0.5 * (variances_.col(i).array().log().sum() +
+               means_.col(i).cwiseAbs2().dot(inv_variances.col(i)));
+  }
+
+  posteriors->noalias() = (-0.5f * inv_variances).transpose() *
+                          features.array().square().matrix();
+  posteriors->noalias() +=
+      means_.cwiseProduct(inv_variances).transpose() * features;
+  posteriors->colwise() += log_weights;
+
+  // Normalize the posteriors of each feature with the log-sum-exp trick.
+  double log_likelihood = 0;
+  for (int i = 0; i < posteriors->cols(); i++) {
+    const float max_log_posterior = posteriors->col(i).maxCoeff();
+    posteriors->col(i) =
+        (posteriors->col(i).array() - max_log_posterior).exp().matrix();
+    const float sum = posteriors->col(i).sum();
+    posteriors->col(i) /= sum;
+    log_likelihood += std::log(sum) + max_log_posterior;
+  }
+  return log_likelihood;
+}
+
+void FisherVectorExtractor::ComputeSufficientStatistics(
+    const Eigen::Ref<const Eigen::MatrixXf>& features,
+    SufficientStatistics* statistics) const {
+  Eigen::MatrixXf posteriors;
+  statistics->log_likelihood = ComputePosteriors(features, &posteriors);
+  statistics->mass = posteriors.rowwise().sum().cast<double>();
+  statistics->first_moments =
+      (features * posteriors.transpose()).cast<double>();
+  statistics->second_moments =
+      (features.array().square().matrix() * posteriors.transpose())
+          .cast<double>();
+}
+
+double FisherVectorExtractor::RunExpectationMaximizationIteration(
+    const Eigen::MatrixXf& features) {
+  // E-step: each task accumulates the sufficient statistics of one block of
+  // features. The tasks write to disjoint entries of block_statistics.
+  const int num_features = features.cols();
+  const int num_blocks = (num_features + kBlockSize - 1) / kBlockSize;
+  std::vector<SufficientStatistics> block_statistics(num_blocks);
+  {
+    ThreadPool pool(options_.num_threads);
+    for (int i = 0; i < num_blocks; i++) {
+      const int block_start = i * kBlockSize;
+      const int block_size = std::min(kBlockSize, num_features - block_start);
+      pool.Add([this, &features, &block_statistics, i, block_start,
+                block_size]() {
+        ComputeSufficientStatistics(
+            features.middleCols(block_start, block_size),
+            &block_statistics[i]);
+      });
+    }
+  }
+
+  // Sum the statistics in block order so that the GMM does not depend on the
+  // number of threads.
+  SufficientStatistics statistics = block_statistics[0];
+  for (int i = 1; i < num_blocks; i++) {
+    statistics.log_likelihood += block_statistics[i].log_likelihood;
+    statistics.mass += block_statistics[i].mass;
+    statistics.first_moments += block_statistics[i].first_moments;
+    statistics.second_moments += block_statistics[i].second_moments;
+  }
+
+  // M-step: modes that received no features keep their parameters.
+  const int num_clusters = means_.cols();
+  const double min_mass = kMinPrior / num_clusters;
+  for (int i = 0; i < num_clusters; i++) {
+    const double mass = statistics.mass(i);
+    if (mass < min_mass) {
+      continue;
+    }
+    const Eigen::VectorXd mean = statistics.first_moments.col(i) / mass;
+    const Eigen::VectorXd variance =
+        statistics.second_moments.col(i) / mass - mean.cwiseAbs2();
+    means_.col(i) = mean.cast<float>();
+    variances_.col(i) = variance.cast<float>().cwiseMax(kMinVariance);
+  }
+  priors_ = (statistics.mass / std::max(statistics.mass.sum(), 1e-12))
+                .cast<float>();
+  return statistics.log_likelihood;
+}
+
+void FisherVectorExtractor::RestartEmptyModes() {
+  // An empty mode takes half of the mode with the largest prior, which is split
+  // along its dimension of largest variance.
+  const int num_clusters = means_.cols();
+  const float min_prior = kMinModeMass / num_clusters;
+  for (int i = 0; i < num_clusters; i++) {
+    if (priors_(i) >= min_prior) {
+      continue;
+    }
+
+    int largest_mode;
+    priors_.maxCoeff(&largest_mode);
+    if (largest_mode == i) {
+      continue;
+    }
+    VLOG(2) << "Restarting empty GMM mode " << i << " by splitting mode "
+            << largest_mode;
+
+    int split_dimension;
+    variances_.col(largest_mode).maxCoeff(&split_dimension);
+    const float offset =
+        std::sqrt(variances_(split_dimension, largest_mode));
+    means_.col(i) = means_.col(largest_mode);
+    variances_.col(i) = variances_.col(largest_mode);
+    means_(split_dimension, i) -= offset;
+    means_(split_dimension, largest_mode) += offset;
+    priors_(i) = priors_(largest_mode) =
+        0.5 * (priors_(i) + priors_(largest_mode));
+  }
 }
 
 Eigen::VectorXf FisherVectorExtractor::ExtractGlobalDescriptor(
-    const std::vector<Eigen::VectorXf>& features) {
+    const DescriptorMatrix& features) {
+  CHECK(IsTrained()) << "The GMM must be trained first.";
   // Ensure there are input features and they are not zero dimensions.
-  CHECK_GT(features.size(), 0);
-  CHECK_GT(features[0].size(), 0);
-
-  // Convert the features into a continuous memory block. The matrix is of size
-  // D x N where D is the number of descrip
-  const Eigen::MatrixXf feature_table =
-      ConvertVectorOfFeaturesToMatrix(features);
-  // Compute the fisher vector encoding.
-  Eigen::VectorXf fisher_vector(2 * feature_table.rows() *
-                                gmm_->num_clusters());
-  vl_fisher_encode(fisher_vector.data(),
-                   VL_TYPE_FLOAT,
-                   gmm_->GetMeans(),
-                   feature_table.rows(),
-                   gmm_->num_clusters(),
-                   gmm_->GetCovariances(),
-                   gmm_->GetPriors(),
-                   feature_table.data(),
-                   feature_table.cols(),
-                   VL_FISHER_FLAG_IMPROVED);
+  CHECK_GT(features.rows(), 0);
+  CHECK_GT(features.cols(), 0);
+  CHECK_EQ(features.cols(), means_.rows());
+
+  // The descriptors are stored contiguously with one descriptor per row, which
+  // is exactly a column-major D x N matrix where D is the descriptor dimension
+  // and N is the number of descriptors, so no copy is needed.
+  const int descriptor_dimension = features.cols();
+  const int num_features = features.rows();
+  const int num_clusters = means_.cols();
+  const Eigen::Map<const Eigen::MatrixXf> data(
+      features.data(), descriptor_dimension, num_features);
+
+  // Soft-assign all features at once and pool them into the zeroth, first, and
+  // second order statistics of each mode with matrix products.
+  Eigen::MatrixXf posteriors;
+  ComputePosteriors(data, &posteriors);
+  posteriors = (posteriors.array() < kMinFisherVectorPosterior)
+                   .select(0.0f, posteriors.array())
+                   .matrix();
+  const Eigen::VectorXf mass = posteriors.rowwise().sum();
+  const Eigen::MatrixXf first_moments = data * posteriors.transpose();
+  const Eigen::MatrixXf second_moments =
+      data.array().square().matrix() * posteriors.transpose();
+
+  // The Fisher Vector holds the deviations from the means of all modes followed
+  // by the deviations from the variances of all modes, i.e.,
+  //   u_k = sum_i p_ik (x_i - mu_k) / sigma_k / (N sqrt(pi_k))
+  //   v_k = sum_i p_ik ((x_i - mu_k)^2 / sigma_k^2 - 1) / (N sqrt(2 pi_k))
+  // where both sums are expanded in terms of the moments above.
+  Eigen::VectorXf fisher_vector =
+      Eigen::VectorXf::Zero(2 * descriptor_dimension * num_clusters);
+  Eigen::Map<Eigen::MatrixXf> mean_deviations(
+      fisher_vector.data(), descriptor_dimension, num_clusters);
+  Eigen::Map<Eigen::MatrixXf> variance_deviations(
+      fisher_vector.data() + descriptor_dimension * num_clusters,
+      descriptor_dimension,
+      num_clusters);
+  for (int i = 0; i < num_clusters; i++) {
+    if (priors_(i) < kMinPrior) {
+      continue;
+    }
+    const Eigen::VectorXf mean = means_.col(i);
+    const Eigen::VectorXf variance = variances_.col(i);
+    mean_deviations.col(i) =
+        (first_moments.col(i) - mass(i) * mean)
+            .cwiseQuotient(variance.cwiseSqrt()) /
+        (num_features * std::sqrt(priors_(i)));
+    variance_deviations.col(i) =
+        ((second_moments.col(i) -
+          2.0f * mean.cwiseProduct(first_moments.col(i)) +
+          mass(i) * mean.cwiseAbs2())
+             .cwiseQuotient(variance)
+             .array() -
+         mass(i))
+            .matrix() /
+        (num_features * std::sqrt(2.0f * priors_(i)));
+  }
+
+  // Apply the signed square root and L2 normalization of the improved Fisher
+  // Vector.
+  fisher_vector = fisher_vector.array().sign() *
+                  fisher_vector.array().abs().sqrt();
+  fisher_vector /= std::max(fisher_vector.norm(), 1e-12f);
   DCHECK(std::isfinite(fisher_vector.sum()));
   return fisher_vector;
 }
 
+bool FisherVectorExtractor::IsTrained() const { return priors_.size() > 0; }
+
+int FisherVectorExtractor::DescriptorDimension() const { return means_.rows(); }
+
+bool FisherVectorExtractor::WriteToFile(const std::string& filename) const {
+  std::ofstream output_writer(filename, std::ios::out | std::ios::binary);
+  if (!output_writer.is_open()) {
+    LOG(ERROR) << "Could not open the GMM file: " << filename
+               << " for writing.";
+    return false;
+  }
+
+  cereal::PortableBinaryOutputArchive output_archive(output_writer);
+  output_archive(means_, variances_, priors_);
+  return true;
+}
+
+bool FisherVectorExtractor::ReadFromFile(const std::string& filename) {
+  std::ifstream input_reader(filename, std::ios::in | std::ios::binary);
+  if (!input_reader.is_open()) {
+    LOG(ERROR) << "Could not open the GMM file: " << filename
+               << " for reading.";
+    return false;
+  }
+
+  Eigen::MatrixXf means, variances;
+  Eigen::VectorXf priors;
+  try {
+    cereal::PortableBinaryInputArchive input_archive(input_reader);
+    input_archive(means, variances, priors);
+  } catch (const cereal::Exception& e) {
+    LOG(ERROR) << "Could not read the GMM file: " << filename << ": "
+               << e.what();
+    return false;
+  }
+  if (means.size() == 0 || means.rows() != variances.rows() ||
+      means.cols() != variances.cols() || means.cols() != priors.size()) {
+    LOG(ERROR) << "The GMM file: " << filename << " is corrupted.";
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(training_mutex_);
+  means_.swap(means);
+  variances_.swap(variances);
+  priors_.swap(priors);
+  return true;
+}
+
 }  // namespace theia
@@ -36,11 +36,14 @@
 #define THEIA_MATCHING_FISHER_VECTOR_EXTRACTOR_H_
 
 #include <Eigen/Core>
-#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/matching/global_descriptor_extractor.h"
 #include "theia/math/reservoir_sampler.h"
+#include "theia/util/util.h"
 
 namespace theia {
 
@@ -49,6 +52,12 @@ namespace theia {
 // classification. A Gaussian Mixture Model is fitted to the training data, and
 // the Fisher Vector is computed as as the mean and covariance deviation vectors
 // from the modes of the distribution of the GMM.
+//
+// The GMM is fitted with Expectation-Maximization. Each EM iteration splits the
+// training features into blocks that are processed in parallel, and the soft
+// assignments and sufficient statistics of a block are computed with dense
+// matrix products. A trained GMM does not depend on the images it was trained
+// on, so it may be written to disk once and reused for other datasets.
 class FisherVectorExtractor : public GlobalDescriptorExtractor {
  public:
   struct Options {
@@ -61,37 +70,95 @@ class FisherVectorExtractor : public GlobalDescriptorExtractor {
     // max_num_features_for_training using a memory efficient Reservoir sampler
     // to avoid holding all features in memory.
     int max_num_features_for_training = 100000;
+
+    // The maximum number of EM iterations used to fit the GMM. EM stops early
+    // once the relative change of the log-likelihood is negligible.
+    int max_num_em_iterations = 50;
+
+    // The number of threads used to fit the GMM.
+    int num_threads = 1;
   };
 
-  // The number of clusters to use for the GMM.
-  FisherVectorExtractor(const Options& options);
+  explicit FisherVectorExtractor(const Options& options);
 
   ~FisherVectorExtractor();
 
   // Add features to the descriptor extractor for training. This method may be
   // called multiple times to add multiple sets of features (e.g., once per
-  // image) to the global descriptor extractor for training.
-  void AddFeaturesForTraining(
-      const std::vector<Eigen::VectorXf>& features) override;
+  // image) to the global descriptor extractor for training. This method is
+  // thread-safe.
+  void AddFeaturesForTraining(const DescriptorMatrix& features) override;
 
   // Train the global descriptor extracto with the given set of feature
   // descriptors added with AddFeaturesForTraining. It is assumed that all
-  // descriptors have the same length.
+  // descriptors have the same length. If a GMM has already been trained or
+  // read from disk then EM is warm-started from it, otherwise the GMM is
+  // initialized with k-means++ seeding. Returns false if there are fewer
+  // training features than GMM clusters.
   bool Train() override;
 
-  // Compute a global image descriptor for the set of input features.
+  // Compute a global image descriptor for the set of input features. The
+  // descriptor is the improved Fisher Vector (i.e., signed square-rooted and
+  // L2-normalized) with 2 * num_gmm_clusters * features.cols() entries.
   Eigen::VectorXf ExtractGlobalDescriptor(
-      const std::vector<Eigen::VectorXf>& features) override;
+      const DescriptorMatrix& features) override;
+
+  // Returns true if the GMM has been trained or read from disk.
+  bool IsTrained() const;
+
+  // The dimension of the descriptors that the GMM was trained on.
+  int DescriptorDimension() const;
+
+  // Writes the GMM to disk. Returns false if the file could not be written.
+  bool WriteToFile(const std::string& filename) const;
+
+  // Reads a GMM that was written with WriteToFile. Returns false if the file
+  // could not be read or does not hold a valid GMM, in which case the GMM is
+  // left unchanged.
+  bool ReadFromFile(const std::string& filename);
 
  private:
-  // A Gaussian Mixture Model is used to compute the Fisher Kernel.
-  class GaussianMixtureModel;
-  std::unique_ptr<GaussianMixtureModel> gmm_;
+  // The sufficient statistics of a set of features for an EM iteration.
+  struct SufficientStatistics;
+
+  // Computes the posterior probability of each GMM mode for each feature (one
+  // per column of features). On output, column i of posteriors holds the
+  // posteriors of feature i. Returns the log-likelihood of the features.
+  double ComputePosteriors(const Eigen::Ref<const Eigen::MatrixXf>& features,
+                           Eigen::MatrixXf* posteriors) const;
+
+  // Accumulates the sufficient statistics of the features for the M-step.
+  void ComputeSufficientStatistics(
+      const Eigen::Ref<const Eigen::MatrixXf>& features,
+      SufficientStatistics* statistics) const;
+
+  // Initializes the GMM from the training features with k-means++ seeding for
+  // the means, the variance of the data for the variances, and equal priors.
+  void InitializeGMM(const Eigen::MatrixXf& features);
+
+  // Runs one EM iteration over the training features in parallel and returns
+  // the log-likelihood of the features under the GMM before the update.
+  double RunExpectationMaximizationIteration(const Eigen::MatrixXf& features);
+
+  // Moves the modes that received (almost) no features to split the mode with
+  // the largest prior so that all modes are used.
+  void RestartEmptyModes();
+
+  const Options options_;
 
   // The GMM is trained from a set of feature descriptors. A reservoir sampler
   // is used to randomly sample features from an unknown number of input
   // features for training.
+  std::mutex training_mutex_;
   ReservoirSampler<Eigen::VectorXf> training_feature_sampler_;
+
+  // The parameters of the GMM. Column k of means_ and variances_ holds the mean
+  // and the diagonal of the covariance of the k-th mode, respectively.
+  Eigen::MatrixXf means_;
+  Eigen::MatrixXf variances_;
+  Eigen::VectorXf priors_;
+
+  DISALLOW_COPY_AND_ASSIGN(FisherVectorExtractor);
 };
 
 }  // namespace theia
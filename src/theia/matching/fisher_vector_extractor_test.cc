@@ -0,0 +1,355 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+extern "C" {
+#include <vl/fisher.h>
+#include <vl/generic.h>
+#include <vl/gmm.h>
+#include <vl/random.h>
+}
+
+#include <cereal/archives/portable_binary.hpp>
+#include <Eigen/Core>
+#include <cmath>
+#include <fstream>  // NOLINT
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/io/eigen_serializable.h"
+#include "theia/matching/fisher_vector_extractor.h"
+#include "theia/util/random.h"
+
+namespace theia {
+
+namespace {
+
+static const int kNumDimensions = 16;
+static const int kNumModes = 4;
+
+// Creates the features of an image as noisy observations of the modes. All
+// features of the image are shifted by the same offset, which models the
+// appearance of a place.
+DescriptorMatrix CreateImageFeatures(const DescriptorMatrix& modes,
+                                     const Eigen::RowVectorXf& offset,
+                                     const int num_features,
+                                     RandomNumberGenerator* rng) {
+  DescriptorMatrix features(num_features, kNumDimensions);
+  for (int i = 0; i < num_features; i++) {
+    const int mode = rng->RandInt(0, kNumModes - 1);
+    for (int d = 0; d < kNumDimensions; d++) {
+      features(i, d) =
+          modes(mode, d) + offset(d) + rng->RandGaussian(0.0f, 0.05f);
+    }
+  }
+  return features;
+}
+
+Eigen::RowVectorXf CreateOffset(RandomNumberGenerator* rng) {
+  Eigen::RowVectorXf offset(kNumDimensions);
+  for (int d = 0; d < kNumDimensions; d++) {
+    offset(d) = rng->RandGaussian(0.0f, 0.02f);
+  }
+  return offset;
+}
+
+DescriptorMatrix CreateModes(RandomNumberGenerator* rng) {
+  DescriptorMatrix modes(kNumModes, kNumDimensions);
+  for (int i = 0; i < modes.size(); i++) {
+    modes.data()[i] = rng->RandFloat(0.0f, 1.0f);
+  }
+  return modes;
+}
+
+FisherVectorExtractor::Options SmallFisherVectorOptions() {
+  FisherVectorExtractor::Options options;
+  options.num_gmm_clusters = kNumModes;
+  return options;
+}
+
+void AddTrainingFeatures(const DescriptorMatrix& modes,
+                         RandomNumberGenerator* rng,
+                         FisherVectorExtractor* extractor) {
+  for (int i = 0; i < 10; i++) {
+    extractor->AddFeaturesForTraining(
+        CreateImageFeatures(modes, CreateOffset(rng), 500, rng));
+  }
+}
+
+// The GMM of an extractor is accessed through the files written by
+// FisherVectorExtractor::WriteToFile so that it can be compared with the GMM of
+// VLFeat.
+void WriteGMM(const std::string& filename,
+              const Eigen::MatrixXf& means,
+              const Eigen::MatrixXf& variances,
+              const Eigen::VectorXf& priors) {
+  std::ofstream output_writer(filename, std::ios::out | std::ios::binary);
+  ASSERT_TRUE(output_writer.is_open());
+  cereal::PortableBinaryOutputArchive output_archive(output_writer);
+  output_archive(means, variances, priors);
+}
+
+void ReadGMM(const std::string& filename,
+             Eigen::MatrixXf* means,
+             Eigen::MatrixXf* variances,
+             Eigen::VectorXf* priors) {
+  std::ifstream input_reader(filename, std::ios::in | std::ios::binary);
+  ASSERT_TRUE(input_reader.is_open());
+  cereal::PortableBinaryInputArchive input_archive(input_reader);
+  input_archive(*means, *variances, *priors);
+}
+
+}  // namespace
+
+TEST(FisherVectorExtractor, TrainAndExtract) {
+  // NOTE: The extractors are created before the random number generator is
+  // seeded because their reservoir samplers reseed it.
+  FisherVectorExtractor extractor(SmallFisherVectorOptions());
+  RandomNumberGenerator rng(59);
+  const DescriptorMatrix modes = CreateModes(&rng);
+  EXPECT_FALSE(extractor.IsTrained());
+  EXPECT_FALSE(extractor.Train());
+
+  AddTrainingFeatures(modes, &rng, &extractor);
+  EXPECT_TRUE(extractor.Train());
+  EXPECT_TRUE(extractor.IsTrained());
+
+  // Images of the same place have more similar Fisher Vectors than images of
+  // different places.
+  const Eigen::RowVectorXf place1 = CreateOffset(&rng);
+  const Eigen::RowVectorXf place2 = CreateOffset(&rng);
+  const Eigen::VectorXf fisher_vector1 = extractor.ExtractGlobalDescriptor(
+      CreateImageFeatures(modes, place1, 200, &rng));
+  const Eigen::VectorXf fisher_vector2 = extractor.ExtractGlobalDescriptor(
+      CreateImageFeatures(modes, place1, 200, &rng));
+  const Eigen::VectorXf fisher_vector3 = extractor.ExtractGlobalDescriptor(
+      CreateImageFeatures(modes, place2, 200, &rng));
+  ASSERT_EQ(fisher_vector1.size(), 2 * kNumModes * kNumDimensions);
+  EXPECT_NEAR(fisher_vector1.norm(), 1.0, 1e-4);
+  EXPECT_TRUE(std::isfinite(fisher_vector1.sum()));
+  EXPECT_GT(fisher_vector1.dot(fisher_vector2),
+            fisher_vector1.dot(fisher_vector3) + 0.25);
+}
+
+TEST(FisherVectorExtractor, MultithreadedTrainingIsDeterministic) {
+  RandomNumberGenerator rng(59);
+  const DescriptorMatrix modes = CreateModes(&rng);
+  FisherVectorExtractor extractor(SmallFisherVectorOptions());
+  RandomNumberGenerator training_rng(61);
+  AddTrainingFeatures(modes, &training_rng, &extractor);
+
+  FisherVectorExtractor::Options options = SmallFisherVectorOptions();
+  options.num_threads = 4;
+  FisherVectorExtractor multithreaded_extractor(options);
+  RandomNumberGenerator multithreaded_training_rng(61);
+  AddTrainingFeatures(
+      modes, &multithreaded_training_rng, &multithreaded_extractor);
+
+  // The training features are identical, so the GMMs only differ by the
+  // seeding of the modes unless the random generator of VLFeat is reset.
+  const DescriptorMatrix features =
+      CreateImageFeatures(modes, CreateOffset(&rng), 200, &rng);
+  vl_rand_seed(vl_get_rand(), 0);
+  ASSERT_TRUE(extractor.Train());
+  vl_rand_seed(vl_get_rand(), 0);
+  ASSERT_TRUE(multithreaded_extractor.Train());
+  EXPECT_NEAR(extractor.ExtractGlobalDescriptor(features).dot(
+                  multithreaded_extractor.ExtractGlobalDescriptor(features)),
+              1.0,
+              1e-4);
+}
+
+TEST(FisherVectorExtractor, WriteAndReadFromFile) {
+  const std::string filename = THEIA_DATA_DIR + std::string("/gmm.bin");
+  FisherVectorExtractor extractor(SmallFisherVectorOptions());
+  FisherVectorExtractor read_extractor(SmallFisherVectorOptions());
+  RandomNumberGenerator rng(59);
+  const DescriptorMatrix modes = CreateModes(&rng);
+  AddTrainingFeatures(modes, &rng, &extractor);
+  ASSERT_TRUE(extractor.Train());
+  ASSERT_TRUE(extractor.WriteToFile(filename));
+
+  // The GMM read from disk extracts identical Fisher Vectors.
+  ASSERT_TRUE(read_extractor.ReadFromFile(filename));
+  EXPECT_TRUE(read_extractor.IsTrained());
+  const DescriptorMatrix features =
+      CreateImageFeatures(modes, CreateOffset(&rng), 200, &rng);
+  const Eigen::VectorXf fisher_vector =
+      extractor.ExtractGlobalDescriptor(features);
+  EXPECT_EQ(read_extractor.ExtractGlobalDescriptor(features), fisher_vector);
+
+  // Warm-starting EM from the GMM read from disk with other features from the
+  // same distribution keeps the GMM close to the original one.
+  AddTrainingFeatures(modes, &rng, &read_extractor);
+  ASSERT_TRUE(read_extractor.Train());
+  EXPECT_GT(read_extractor.ExtractGlobalDescriptor(features).dot(fisher_vector),
+            0.8);
+}
+
+TEST(FisherVectorExtractor, ReadInvalidFile) {
+  const std::string filename = THEIA_DATA_DIR + std::string("/gmm.bin");
+  FisherVectorExtractor extractor(SmallFisherVectorOptions());
+  RandomNumberGenerator rng(61);
+  AddTrainingFeatures(CreateModes(&rng), &rng, &extractor);
+  ASSERT_TRUE(extractor.Train());
+  ASSERT_TRUE(extractor.WriteToFile(filename));
+
+  // A truncated file is not read.
+  std::string contents;
+  {
+    std::ifstream input(filename, std::ios::in | std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(input),
+                    std::istreambuf_iterator<char>());
+  }
+  {
+    std::ofstream output(filename, std::ios::out | std::ios::binary);
+    output << contents.substr(0, contents.size() / 2);
+  }
+  FisherVectorExtractor read_extractor(SmallFisherVectorOptions());
+  EXPECT_FALSE(read_extractor.ReadFromFile(filename));
+  EXPECT_FALSE(read_extractor.IsTrained());
+
+  // Neither is a GMM whose parameters do not have matching shapes.
+  {
+    std::ofstream output(filename, std::ios::out | std::ios::binary);
+    cereal::PortableBinaryOutputArchive output_archive(output);
+    output_archive(Eigen::MatrixXf(Eigen::MatrixXf::Ones(4, 2)),
+                   Eigen::MatrixXf(Eigen::MatrixXf::Ones(4, 2)),
+                   Eigen::VectorXf(Eigen::VectorXf::Ones(3)));
+  }
+  EXPECT_FALSE(read_extractor.ReadFromFile(filename));
+  EXPECT_FALSE(read_extractor.IsTrained());
+}
+
+// The Fisher Vector must be the same as the improved Fisher Vector of VLFeat
+// for the same GMM.
+TEST(FisherVectorExtractor, FisherVectorMatchesVLFeat) {
+  const std::string filename = THEIA_DATA_DIR + std::string("/gmm.bin");
+  FisherVectorExtractor extractor(SmallFisherVectorOptions());
+  RandomNumberGenerator rng(59);
+  const DescriptorMatrix modes = CreateModes(&rng);
+  AddTrainingFeatures(modes, &rng, &extractor);
+  ASSERT_TRUE(extractor.Train());
+  ASSERT_TRUE(extractor.WriteToFile(filename));
+  Eigen::MatrixXf means, variances;
+  Eigen::VectorXf priors;
+  ReadGMM(filename, &means, &variances, &priors);
+
+  const DescriptorMatrix features =
+      CreateImageFeatures(modes, CreateOffset(&rng), 200, &rng);
+  const Eigen::VectorXf fisher_vector =
+      extractor.ExtractGlobalDescriptor(features);
+  Eigen::VectorXf vlfeat_fisher_vector(2 * kNumDimensions * kNumModes);
+  vl_fisher_encode(vlfeat_fisher_vector.data(),
+                   VL_TYPE_FLOAT,
+                   means.data(),
+                   kNumDimensions,
+                   kNumModes,
+                   variances.data(),
+                   priors.data(),
+                   features.data(),
+                   features.rows(),
+                   VL_FISHER_FLAG_IMPROVED);
+  ASSERT_EQ(fisher_vector.size(), vlfeat_fisher_vector.size());
+  EXPECT_LT((fisher_vector - vlfeat_fisher_vector).cwiseAbs().maxCoeff(),
+            1e-4);
+}
+
+// One EM iteration must update the GMM in the same way as one EM iteration of
+// VLFeat from the same GMM.
+TEST(FisherVectorExtractor, EMIterationMatchesVLFeat) {
+  const std::string filename = THEIA_DATA_DIR + std::string("/gmm.bin");
+  FisherVectorExtractor::Options options = SmallFisherVectorOptions();
+  options.max_num_em_iterations = 1;
+  FisherVectorExtractor extractor(options);
+  RandomNumberGenerator rng(59);
+  const DescriptorMatrix modes = CreateModes(&rng);
+
+  // The initial GMM has modes that are close to the modes of the features.
+  Eigen::MatrixXf means = modes.transpose();
+  for (int i = 0; i < means.size(); i++) {
+    means.data()[i] += rng.RandGaussian(0.0f, 0.05f);
+  }
+  const Eigen::MatrixXf variances =
+      Eigen::MatrixXf::Constant(kNumDimensions, kNumModes, 0.01f);
+  const Eigen::VectorXf priors =
+      Eigen::VectorXf::Constant(kNumModes, 1.0f / kNumModes);
+  WriteGMM(filename, means, variances, priors);
+
+  ASSERT_TRUE(extractor.ReadFromFile(filename));
+  DescriptorMatrix training_features(0, kNumDimensions);
+  for (int i = 0; i < 10; i++) {
+    const DescriptorMatrix features =
+        CreateImageFeatures(modes, CreateOffset(&rng), 500, &rng);
+    extractor.AddFeaturesForTraining(features);
+    training_features.conservativeResize(
+        training_features.rows() + features.rows(), Eigen::NoChange);
+    training_features.bottomRows(features.rows()) = features;
+  }
+  ASSERT_TRUE(extractor.Train());
+  ASSERT_TRUE(extractor.WriteToFile(filename));
+  Eigen::MatrixXf em_means, em_variances;
+  Eigen::VectorXf em_priors;
+  ReadGMM(filename, &em_means, &em_variances, &em_priors);
+
+  // NOTE: We need the unique_ptr to use vlfeat's delete function for the GMM.
+  std::unique_ptr<VlGMM, void (*)(VlGMM*)> gmm(
+      vl_gmm_new(VL_TYPE_FLOAT, kNumDimensions, kNumModes), vl_gmm_delete);
+  vl_gmm_set_means(gmm.get(), means.data());
+  vl_gmm_set_covariances(gmm.get(), variances.data());
+  vl_gmm_set_priors(gmm.get(), priors.data());
+  vl_gmm_set_max_num_iterations(gmm.get(), 1);
+  vl_gmm_em(gmm.get(), training_features.data(), training_features.rows());
+  const Eigen::Map<const Eigen::MatrixXf> vlfeat_means(
+      static_cast<const float*>(vl_gmm_get_means(gmm.get())),
+      kNumDimensions,
+      kNumModes);
+  const Eigen::Map<const Eigen::MatrixXf> vlfeat_variances(
+      static_cast<const float*>(vl_gmm_get_covariances(gmm.get())),
+      kNumDimensions,
+      kNumModes);
+  const Eigen::Map<const Eigen::VectorXf> vlfeat_priors(
+      static_cast<const float*>(vl_gmm_get_priors(gmm.get())), kNumModes);
+
+  ASSERT_EQ(em_means.rows(), kNumDimensions);
+  ASSERT_EQ(em_means.cols(), kNumModes);
+  EXPECT_LT((em_means - vlfeat_means).cwiseAbs().maxCoeff(), 1e-4);
+  EXPECT_LT((em_variances - vlfeat_variances).cwiseAbs().maxCoeff(), 1e-5);
+  EXPECT_LT((em_priors - vlfeat_priors).cwiseAbs().maxCoeff(), 1e-5);
+}
+
+}  // namespace theia
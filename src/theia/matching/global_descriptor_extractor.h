@@ -36,10 +36,19 @@
 #define THEIA_MATCHING_GLOBAL_DESCRIPTOR_EXTRACTOR_H_
 
 #include <Eigen/Core>
-#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
 
 namespace theia {
 
+// The global image descriptors that may be used to select the image pairs to
+// match. Fisher vectors are compared densely, while the vocabulary tree scores
+// images with an inverted file (see vocabulary_tree.h).
+enum class GlobalDescriptorExtractorType {
+  FISHER_VECTOR = 0,
+  VOCABULARY_TREE = 1,
+};
+
 // Global descriptors provide a summary of an entire image into a single feature
 // descriptor. These descriptors may be formed using training data (e.g., SIFT
 // features) or may be directly computed from the image itself. Global
@@ -52,17 +61,17 @@ class GlobalDescriptorExtractor {
   // Add features to the descriptor extractor for training. This method may be
   // called multiple times to add multiple sets of features (e.g., once per
   // image) to the global descriptor extractor for training.
-  virtual void AddFeaturesForTraining(
-      const std::vector<Eigen::VectorXf>& features) = 0;
+  virtual void AddFeaturesForTraining(const DescriptorMatrix& features) = 0;
 
   // Train the global descriptor extracto with the given set of feature
   // descriptors added with AddFeaturesForTraining. It is assumed that all
   // descriptors have the same length.
   virtual bool Train() = 0;
 
-  // Compute a global image descriptor for the set of input features.
+  // Compute a global image descriptor for the set of input features. Each row
+  // of the matrix is a single feature descriptor.
   virtual Eigen::VectorXf ExtractGlobalDescriptor(
-      const std::vector<Eigen::VectorXf>& features) = 0;
+      const DescriptorMatrix& features) = 0;
 };
 
 }  // namespace theia
@@ -0,0 +1,197 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/global_descriptor_nearest_neighbors.h"
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/util/threadpool.h"
+
+namespace theia {
+
+namespace {
+
+// The number of global descriptors on each side of a tile of distances. Global
+// descriptors are long (e.g., several thousand dimensions for Fisher vectors),
+// so the tile is kept small enough that the descriptor blocks it is computed
+// from remain in the cache.
+static const int kTileSize = 128;
+
+// The squared distance to a neighbor followed by its index. Comparing these
+// pairs orders the neighbors by distance and breaks ties by index.
+typedef std::pair<float, int> ScoredNeighbor;
+
+// Finds the nearest neighbors of the global descriptors of the query images
+// query_indices[query_start, query_start + num_rows).
+void ComputeNearestNeighborsOfBlock(
+    const DescriptorMatrix& global_descriptors,
+    const Eigen::VectorXf& sq_norms,
+    const std::vector<int>& query_indices,
+    const int num_nearest_neighbors,
+    const int query_start,
+    const int num_rows,
+    std::vector<std::vector<int> >* nearest_neighbors) {
+  const int num_descriptors = global_descriptors.rows();
+
+  // Gather the query descriptors so that the tiles are computed from a
+  // contiguous block of rows.
+  DescriptorMatrix descriptors_block(num_rows, global_descriptors.cols());
+  for (int i = 0; i < num_rows; i++) {
+    descriptors_block.row(i) =
+        global_descriptors.row(query_indices[query_start + i]);
+  }
+
+  // The best neighbors of each row are kept in a max-heap so that the worst of
+  // them can be replaced in logarithmic time.
+  std::vector<std::vector<ScoredNeighbor> > best_neighbors(num_rows);
+  for (std::vector<ScoredNeighbor>& neighbors : best_neighbors) {
+    neighbors.reserve(num_nearest_neighbors);
+  }
+
+  Eigen::MatrixXf dot_products(num_rows, kTileSize);
+  for (int col_start = 0; col_start < num_descriptors;
+       col_start += kTileSize) {
+    const int num_cols = std::min(kTileSize, num_descriptors - col_start);
+    auto tile = dot_products.leftCols(num_cols);
+    tile.noalias() =
+        descriptors_block *
+        global_descriptors.middleRows(col_start, num_cols).transpose();
+
+    for (int i = 0; i < num_rows; i++) {
+      const int index1 = query_indices[query_start + i];
+      std::vector<ScoredNeighbor>& neighbors = best_neighbors[i];
+      for (int j = 0; j < num_cols; j++) {
+        const int index2 = col_start + j;
+        if (index1 == index2) {
+          continue;
+        }
+
+        // The squared L2 distance is |a|^2 + |b|^2 - 2 * a^T * b. It is clamped
+        // to avoid small negative values caused by floating point round-off.
+        const ScoredNeighbor neighbor(
+            std::max(sq_norms(index1) + sq_norms(index2) - 2.0f * tile(i, j),
+                     0.0f),
+            index2);
+        if (neighbors.size() < num_nearest_neighbors) {
+          neighbors.emplace_back(neighbor);
+          std::push_heap(neighbors.begin(), neighbors.end());
+        } else if (neighbor < neighbors.front()) {
+          std::pop_heap(neighbors.begin(), neighbors.end());
+          neighbors.back() = neighbor;
+          std::push_heap(neighbors.begin(), neighbors.end());
+        }
+      }
+    }
+  }
+
+  for (int i = 0; i < num_rows; i++) {
+    std::vector<ScoredNeighbor>& neighbors = best_neighbors[i];
+    std::sort_heap(neighbors.begin(), neighbors.end());
+    std::vector<int>& neighbor_indices =
+        (*nearest_neighbors)[query_indices[query_start + i]];
+    neighbor_indices.reserve(neighbors.size());
+    for (const ScoredNeighbor& neighbor : neighbors) {
+      neighbor_indices.emplace_back(neighbor.second);
+    }
+  }
+}
+
+}  // namespace
+
+void ComputeGlobalDescriptorNearestNeighbors(
+    const DescriptorMatrix& global_descriptors,
+    const int num_nearest_neighbors,
+    const int num_threads,
+    std::vector<std::vector<int> >* nearest_neighbors) {
+  std::vector<int> query_indices(global_descriptors.rows());
+  std::iota(query_indices.begin(), query_indices.end(), 0);
+  ComputeGlobalDescriptorNearestNeighbors(global_descriptors,
+                                          query_indices,
+                                          num_nearest_neighbors,
+                                          num_threads,
+                                          nearest_neighbors);
+}
+
+void ComputeGlobalDescriptorNearestNeighbors(
+    const DescriptorMatrix& global_descriptors,
+    const std::vector<int>& query_indices,
+    const int num_nearest_neighbors,
+    const int num_threads,
+    std::vector<std::vector<int> >* nearest_neighbors) {
+  CHECK_GE(num_nearest_neighbors, 0);
+  CHECK_GT(num_threads, 0);
+  CHECK_NOTNULL(nearest_neighbors)->clear();
+
+  const int num_descriptors = global_descriptors.rows();
+  nearest_neighbors->resize(num_descriptors);
+  const int num_neighbors =
+      std::min(num_nearest_neighbors, num_descriptors - 1);
+  if (num_neighbors <= 0) {
+    return;
+  }
+
+  const Eigen::VectorXf sq_norms = global_descriptors.rowwise().squaredNorm();
+
+  // Each task finds the nearest neighbors of one tile of query images. The
+  // tasks write to disjoint entries of the output.
+  const int num_queries = query_indices.size();
+  ThreadPool pool(num_threads);
+  for (int query_start = 0; query_start < num_queries;
+       query_start += kTileSize) {
+    const int num_rows = std::min(kTileSize, num_queries - query_start);
+    pool.Add([&global_descriptors,
+              &sq_norms,
+              &query_indices,
+              num_neighbors,
+              query_start,
+              num_rows,
+              nearest_neighbors]() {
+      ComputeNearestNeighborsOfBlock(global_descriptors,
+                                     sq_norms,
+                                     query_indices,
+                                     num_neighbors,
+                                     query_start,
+                                     num_rows,
+                                     nearest_neighbors);
+    });
+  }
+}
+
+}  // namespace theia
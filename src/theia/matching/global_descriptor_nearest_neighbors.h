@@ -0,0 +1,75 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_GLOBAL_DESCRIPTOR_NEAREST_NEIGHBORS_H_
+#define THEIA_MATCHING_GLOBAL_DESCRIPTOR_NEAREST_NEIGHBORS_H_
+
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+
+namespace theia {
+
+// Finds the num_nearest_neighbors most similar images of each image, i.e. the
+// images with the smallest squared L2 distance between their global
+// descriptors. Row i of global_descriptors is the global descriptor of image i.
+// On output, (*nearest_neighbors)[i] holds the indices of the nearest neighbors
+// of image i (excluding image i itself) ordered from the most to the least
+// similar.
+//
+// The distances are computed as matrix products between tiles of the global
+// descriptors, and the tiles of rows are processed in parallel with num_threads
+// threads. Only the best neighbors found so far are kept for each image, so the
+// memory used is linear in the number of images.
+void ComputeGlobalDescriptorNearestNeighbors(
+    const DescriptorMatrix& global_descriptors,
+    const int num_nearest_neighbors,
+    const int num_threads,
+    std::vector<std::vector<int> >* nearest_neighbors);
+
+// Same as above, but only the nearest neighbors of the images in query_indices
+// are computed. The neighbors are still searched among all images, so that new
+// images may be retrieved against an existing image collection without
+// recomputing the neighbors of the existing images. The output holds one entry
+// per image, and the entries of images that are not queried are empty.
+void ComputeGlobalDescriptorNearestNeighbors(
+    const DescriptorMatrix& global_descriptors,
+    const std::vector<int>& query_indices,
+    const int num_nearest_neighbors,
+    const int num_threads,
+    std::vector<std::vector<int> >* nearest_neighbors);
+
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_GLOBAL_DESCRIPTOR_NEAREST_NEIGHBORS_H_
@@ -0,0 +1,149 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/matching/global_descriptor_nearest_neighbors.h"
+
+namespace theia {
+
+namespace {
+
+// Finds the nearest neighbors by sorting the distances to all other images.
+std::vector<std::vector<int> > BruteForceNearestNeighbors(
+    const DescriptorMatrix& global_descriptors,
+    const int num_nearest_neighbors) {
+  std::vector<std::vector<int> > nearest_neighbors(global_descriptors.rows());
+  for (int i = 0; i < global_descriptors.rows(); i++) {
+    std::vector<std::pair<float, int> > scores;
+    for (int j = 0; j < global_descriptors.rows(); j++) {
+      if (i != j) {
+        scores.emplace_back(
+            (global_descriptors.row(i) - global_descriptors.row(j))
+                .squaredNorm(),
+            j);
+      }
+    }
+    std::sort(scores.begin(), scores.end());
+    for (int j = 0; j < num_nearest_neighbors; j++) {
+      nearest_neighbors[i].emplace_back(scores[j].second);
+    }
+  }
+  return nearest_neighbors;
+}
+
+}  // namespace
+
+TEST(GlobalDescriptorNearestNeighbors, MatchesBruteForce) {
+  // Use enough images for several tiles of rows and columns.
+  static const int kNumImages = 300;
+  static const int kNumDimensions = 64;
+  static const int kNumNearestNeighbors = 10;
+  static const int kNumThreads = 4;
+
+  DescriptorMatrix global_descriptors(kNumImages, kNumDimensions);
+  global_descriptors.setRandom();
+
+  std::vector<std::vector<int> > nearest_neighbors;
+  ComputeGlobalDescriptorNearestNeighbors(global_descriptors,
+                                          kNumNearestNeighbors,
+                                          kNumThreads,
+                                          &nearest_neighbors);
+  const std::vector<std::vector<int> > expected_nearest_neighbors =
+      BruteForceNearestNeighbors(global_descriptors, kNumNearestNeighbors);
+
+  ASSERT_EQ(nearest_neighbors.size(), kNumImages);
+  for (int i = 0; i < kNumImages; i++) {
+    EXPECT_EQ(nearest_neighbors[i], expected_nearest_neighbors[i]);
+  }
+}
+
+TEST(GlobalDescriptorNearestNeighbors, QueryIndices) {
+  static const int kNumImages = 300;
+  static const int kNumDimensions = 64;
+  static const int kNumNearestNeighbors = 10;
+  static const int kNumThreads = 4;
+
+  DescriptorMatrix global_descriptors(kNumImages, kNumDimensions);
+  global_descriptors.setRandom();
+
+  // Only every third image is queried, but its neighbors are searched among all
+  // images.
+  std::vector<int> query_indices;
+  for (int i = 0; i < kNumImages; i += 3) {
+    query_indices.emplace_back(i);
+  }
+
+  std::vector<std::vector<int> > nearest_neighbors;
+  ComputeGlobalDescriptorNearestNeighbors(global_descriptors,
+                                          query_indices,
+                                          kNumNearestNeighbors,
+                                          kNumThreads,
+                                          &nearest_neighbors);
+  const std::vector<std::vector<int> > expected_nearest_neighbors =
+      BruteForceNearestNeighbors(global_descriptors, kNumNearestNeighbors);
+
+  ASSERT_EQ(nearest_neighbors.size(), kNumImages);
+  for (int i = 0; i < kNumImages; i++) {
+    if (i % 3 == 0) {
+      EXPECT_EQ(nearest_neighbors[i], expected_nearest_neighbors[i]);
+    } else {
+      EXPECT_TRUE(nearest_neighbors[i].empty());
+    }
+  }
+}
+
+TEST(GlobalDescriptorNearestNeighbors, FewerImagesThanNeighbors) {
+  static const int kNumImages = 3;
+  static const int kNumNearestNeighbors = 10;
+
+  DescriptorMatrix global_descriptors(kNumImages, 2);
+  global_descriptors << 0, 0, 1, 0, 3, 0;
+
+  std::vector<std::vector<int> > nearest_neighbors;
+  ComputeGlobalDescriptorNearestNeighbors(
+      global_descriptors, kNumNearestNeighbors, 1, &nearest_neighbors);
+  ASSERT_EQ(nearest_neighbors.size(), kNumImages);
+  EXPECT_EQ(nearest_neighbors[0], std::vector<int>({1, 2}));
+  EXPECT_EQ(nearest_neighbors[1], std::vector<int>({0, 2}));
+  EXPECT_EQ(nearest_neighbors[2], std::vector<int>({1, 0}));
+}
+
+}  // namespace theia
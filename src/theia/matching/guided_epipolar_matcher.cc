@@ -37,25 +37,47 @@
 #include <Eigen/Core>
 #include <stdint.h>
 #include <algorithm>
+#include <cmath>
 #include <limits>
 #include <vector>
-#include <unordered_map>
 #include <unordered_set>
 
-#include "flann/flann.hpp"
-
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/descriptor_quantization.h"
 #include "theia/matching/keypoints_and_descriptors.h"
 #include "theia/matching/distance.h"
 #include "theia/matching/indexed_feature_match.h"
 #include "theia/sfm/camera/camera.h"
 #include "theia/sfm/pose/fundamental_matrix_util.h"
 #include "theia/util/map_util.h"
-#include "theia/util/hash.h"
 #include "theia/util/random.h"
 
 namespace theia {
 namespace {
 
+// The grid cells are enlarged if needed so that the grid has at most this many
+// cells, which bounds the memory of the grid for large images.
+static const int kMaxNumGridCells = 1 << 20;
+
+// Returns the number of dimensions of the float descriptors, which may be
+// stored quantized.
+int NumFloatDescriptorDimensions(const KeypointsAndDescriptors& features) {
+  return features.HasQuantizedDescriptors()
+             ? features.quantized_descriptors.cols()
+             : features.descriptors.cols();
+}
+
+// Returns the float descriptor of feature i. Quantized descriptors are
+// converted back to float.
+Eigen::RowVectorXf GetFloatDescriptor(const KeypointsAndDescriptors& features,
+                                      const int i) {
+  if (features.HasQuantizedDescriptors()) {
+    return features.quantized_descriptors.row(i).cast<float>() /
+           kDescriptorQuantizationScale;
+  }
+  return features.descriptors.row(i);
+}
+
 // Encodes the line endpoints into an uint64_t for fast sorting.
 uint64_t EncodeLineEndpoints(const std::vector<Eigen::Vector2d>& endpoints) {
   uint64_t encoded_endpoint = 0;
@@ -105,42 +127,41 @@ bool GuidedEpipolarMatcher::Initialize(
     matched_features2_.insert(match.feature2_ind);
   }
 
-  const double half_cell_width = options_.guided_matching_max_distance_pixels;
-  const double offset = half_cell_width;
-  image_grids_.emplace_back(ImageGrid(half_cell_width, 0, 0));
-  image_grids_.emplace_back(ImageGrid(half_cell_width, offset, 0));
-  image_grids_.emplace_back(ImageGrid(half_cell_width, 0, offset));
-  image_grids_.emplace_back(ImageGrid(half_cell_width, offset, offset));
-
-  // These helper vectors will be used to find the bounding box of the
-  // features. This will help constrain the search along epipolar lines later.
-  std::vector<double> x, y;
-  x.reserve(features2_.keypoints.size());
-  y.reserve(features2_.keypoints.size());
-  // For each grid, add all features from features2.
+  // Collect the unmatched features of image 2 and their bounding box. The
+  // bounding box will help constrain the search along epipolar lines later.
+  std::vector<int> unmatched_features2;
+  unmatched_features2.reserve(features2_.keypoints.size());
+  top_left_.setConstant(std::numeric_limits<double>::max());
+  bottom_right_.setConstant(-std::numeric_limits<double>::max());
   for (int i = 0; i < features2_.keypoints.size(); i++) {
     // TODO(csweeney): Test if the epipolar line of feature2 features is within
     // the image bounds of image 1. If not, we can skip the feature entirely.
     if (ContainsKey(matched_features2_, i)) {
       continue;
     }
-    for (int j = 0; j < image_grids_.size(); j++) {
-      image_grids_[j].AddFeature(i,
-                                 features2_.keypoints[i].x(),
-                                 features2_.keypoints[i].y());
-    }
-    x.emplace_back(features2_.keypoints[i].x());
-    y.emplace_back(features2_.keypoints[i].y());
+    const Eigen::Vector2d point(features2_.keypoints[i].x(),
+                                features2_.keypoints[i].y());
+    top_left_ = top_left_.cwiseMin(point);
+    bottom_right_ = bottom_right_.cwiseMax(point);
+    unmatched_features2.emplace_back(i);
+  }
+  if (unmatched_features2.empty()) {
+    return false;
   }
 
-  // Set the bounding box of the features.
-  const auto& minmax_x = std::minmax_element(x.begin(), x.end());
-  const auto& minmax_y = std::minmax_element(y.begin(), y.end());
-  top_left_.x() = *minmax_x.first;
-  top_left_.y() = *minmax_y.first;
-  bottom_right_.x() = *minmax_x.second;
-  bottom_right_.y() = *minmax_y.second;
-
+  // The cells are as large as the maximum distance to the epipolar lines so
+  // that only few cells are visited per line, unless the grid would have too
+  // many cells.
+  const Eigen::Vector2d extent = bottom_right_ - top_left_;
+  const double cell_size =
+      std::max(options_.guided_matching_max_distance_pixels,
+               std::sqrt((extent.x() + 1.0) * (extent.y() + 1.0) /
+                         static_cast<double>(kMaxNumGridCells)));
+  image_grid_.Build(cell_size,
+                    top_left_,
+                    bottom_right_,
+                    features2_.keypoints,
+                    unmatched_features2);
   return true;
 }
 
@@ -149,7 +170,10 @@ bool GuidedEpipolarMatcher::GetMatches(
   const int num_input_matches = matches->size();
   const double lowes_ratio_sq = options_.lowes_ratio * options_.lowes_ratio;
 
-  Initialize(*matches);
+  // Nothing is left to match if all features of image 2 are matched.
+  if (!Initialize(*matches)) {
+    return true;
+  }
 
   // Group all epipolar lines.
   std::vector<EpilineGroup> epiline_groups;
@@ -162,8 +186,9 @@ bool GuidedEpipolarMatcher::GetMatches(
     std::vector<int> candidate_keypoint_indices;
     FindFeaturesNearEpipolarLines(epiline_group, &candidate_keypoint_indices);
 
-    // Build a KD-tree for those features and query the tree to get the nearest
-    // neighbor matches for each feature in this epiline group.
+    // Compute the descriptor distances between the features of this epiline
+    // group and the candidates as one matrix product, and keep the 2 nearest
+    // neighbors of each feature.
     std::vector<std::vector<float> > nn_distances;
     std::vector<std::vector<int> > nn_indices;
     FindKNearestNeighbors(epiline_group.features, candidate_keypoint_indices,
@@ -247,10 +272,13 @@ void GuidedEpipolarMatcher::GroupEpipolarLines(
     std::vector<Eigen::Vector2d> line_endpoints;
     DecodeLineEndpoints(sorted_endpoints[i].first, &line_endpoints);
 
-    // See if an epipolar endpoint exists nearby. If it does not, then add a new
-    // endpoint group.
+    // See if an epipolar line with nearby endpoints exists. If it does not,
+    // then add a new endpoint group. Both endpoints must be close so that all
+    // epipolar lines of a group stay close to the mean line of the group.
     if (i == 0 ||
         (epiline_groups->back().endpoints[0] - line_endpoints[0])
+                .squaredNorm() > sq_max_distance_pixels ||
+        (epiline_groups->back().endpoints[1] - line_endpoints[1])
                 .squaredNorm() > sq_max_distance_pixels) {
       // Create a new epiline group.
       EpilineGroup epiline_group;
@@ -278,43 +306,35 @@ void GuidedEpipolarMatcher::FindFeaturesNearEpipolarLines(
     std::vector<int>* candidate_keypoint_indices) {
   static const int kMinNumMatchesFound = 50;
 
+  // Traverse the grid cells along the epipolar line between the points where
+  // it intersects the features bounding box. The epipolar lines of the group
+  // are within the max distance of the mean line of the group, so the features
+  // are searched within twice that distance.
   const std::vector<Eigen::Vector2d>& line_endpoints = epiline_group.endpoints;
-
-  // The number of steps required to "walk" between the line endpoints.
-  const int num_steps =
-    static_cast<int>((line_endpoints[1] - line_endpoints[0]).norm() /
-                     options_.guided_matching_max_distance_pixels);
-
-  // Sample the epipolar line equally between the points where it intersects
-  // the features bounding box.
-  std::unordered_set<int> candidate_keypoints;
-  const Eigen::Vector2d line_delta =
-      (line_endpoints[0] - line_endpoints[1]) / static_cast<double>(num_steps);
-  Eigen::Vector2d sample_point = line_endpoints[1];
-
-  for (int i = 0; i < num_steps; i++) {
-    sample_point += line_delta;
-
-    // Find the cell center among all grids that is closest and add the
-    // keypoints belonging to that cell.
-    std::vector<int> new_keypoints;
-    FindClosestCellAndKeypoints(sample_point, &new_keypoints);
-    candidate_keypoints.insert(new_keypoints.begin(), new_keypoints.end());
-  }
+  const int num_existing_candidates = candidate_keypoint_indices->size();
+  image_grid_.GetFeaturesNearLineSegment(
+      line_endpoints[0],
+      line_endpoints[1],
+      2.0 * options_.guided_matching_max_distance_pixels,
+      candidate_keypoint_indices);
 
   // If we do not have enough features then the lowes ratio test is not
   // meaningful. Add some random features here so that lowes ratio is more
   // informative of whether we have a good match or not.
-  if (candidate_keypoints.size() < kMinNumMatchesFound) {
-    const int num_current_keypoints = candidate_keypoints.size();
-    for (int i = num_current_keypoints; i < kMinNumMatchesFound; i++) {
-      candidate_keypoints.insert(
-          rng_->RandInt(0, features2_.keypoints.size() - 1));
+  const int num_candidates =
+      candidate_keypoint_indices->size() - num_existing_candidates;
+  if (num_candidates < kMinNumMatchesFound) {
+    std::unordered_set<int> candidate_keypoints(
+        candidate_keypoint_indices->begin() + num_existing_candidates,
+        candidate_keypoint_indices->end());
+    for (int i = num_candidates; i < kMinNumMatchesFound; i++) {
+      const int random_keypoint =
+          rng_->RandInt(0, features2_.keypoints.size() - 1);
+      if (candidate_keypoints.insert(random_keypoint).second) {
+        candidate_keypoint_indices->emplace_back(random_keypoint);
+      }
     }
   }
-  candidate_keypoint_indices->insert(candidate_keypoint_indices->end(),
-                                     candidate_keypoints.begin(),
-                                     candidate_keypoints.end());
 }
 
 void GuidedEpipolarMatcher::FindEpipolarLineIntersection(
@@ -361,110 +381,171 @@ void GuidedEpipolarMatcher::FindKNearestNeighbors(
     std::vector<std::vector<float> >* nn_distances,
     std::vector<std::vector<int> >* nn_indices) {
   static const int kNumNearestNeighbors = 2;
-  static const int kMinNumLeafsVisited = 50;
-  const int num_descriptor_dimensions = features1_.descriptors[0].size();
+  const int num_descriptor_dimensions =
+      NumFloatDescriptorDimensions(features1_);
 
-  // Gather the query descriptors.
-  Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
-      query_descriptors(query_feature_indices.size(),
-                        num_descriptor_dimensions);
+  // Gather the query and the candidate descriptors.
+  DescriptorMatrix query_descriptors(query_feature_indices.size(),
+                                     num_descriptor_dimensions);
   for (int i = 0; i < query_feature_indices.size(); i++) {
-    const int match_index = query_feature_indices[i];
-    query_descriptors.row(i) = features1_.descriptors[match_index];
+    query_descriptors.row(i) =
+        GetFloatDescriptor(features1_, query_feature_indices[i]);
   }
-  flann::Matrix<float> flann_query_descriptors(query_descriptors.data(),
-                                               query_descriptors.rows(),
-                                               query_descriptors.cols());
-
-  // Gather the candidate matching descriptors.
-  Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
-      candidate_descriptors(candidate_feature_indices.size(),
-                            num_descriptor_dimensions);
+  DescriptorMatrix candidate_descriptors(candidate_feature_indices.size(),
+                                         num_descriptor_dimensions);
   for (int i = 0; i < candidate_feature_indices.size(); i++) {
-    const int match_index = candidate_feature_indices[i];
-    candidate_descriptors.row(i) = features2_.descriptors[match_index];
+    candidate_descriptors.row(i) =
+        GetFloatDescriptor(features2_, candidate_feature_indices[i]);
   }
 
-  // Create the searchable KD-tree with FLANN.
-  flann::Matrix<float> flann_candidate_descriptors(
-      candidate_descriptors.data(), candidate_descriptors.rows(),
-      candidate_descriptors.cols());
-
-  flann::Index<flann::L2<float> > flann_kd_tree(
-      flann_candidate_descriptors, flann::KDTreeSingleIndexParams());
-  flann_kd_tree.buildIndex();
-
-  // Query the KD-tree to get the top 2 nearest neighbors.
-  const int max_leafs_to_check =
-      std::max(static_cast<int>(candidate_descriptors.rows() * 0.2),
-               kMinNumLeafsVisited);
-  flann_kd_tree.knnSearch(flann_query_descriptors, *nn_indices, *nn_distances,
-                          kNumNearestNeighbors,
-                          flann::SearchParams(max_leafs_to_check));
-
-  // Output the top 2 matches.
+  // The squared L2 distances between all queries and candidates are
+  // |a|^2 + |b|^2 - 2 * a^T * b, where the dot products are computed as one
+  // matrix product.
+  const Eigen::VectorXf query_sq_norms =
+      query_descriptors.rowwise().squaredNorm();
+  const Eigen::RowVectorXf candidate_sq_norms =
+      candidate_descriptors.rowwise().squaredNorm().transpose();
+  Eigen::MatrixXf sq_distances(query_descriptors.rows(),
+                               candidate_descriptors.rows());
+  sq_distances.noalias() =
+      -2.0f * query_descriptors * candidate_descriptors.transpose();
+
+  // Output the top 2 matches of each query. The second nearest neighbor has an
+  // infinite distance if there is only one candidate, and a query without any
+  // candidate is matched to no feature.
+  nn_distances->assign(
+      query_feature_indices.size(),
+      std::vector<float>(kNumNearestNeighbors,
+                         std::numeric_limits<float>::max()));
+  nn_indices->assign(query_feature_indices.size(),
+                     std::vector<int>(kNumNearestNeighbors, -1));
   for (int i = 0; i < query_feature_indices.size(); i++) {
-    // Change the NN indices to be the feature index instead of the index of the
-    // FLANN matrix.
-    for (int j = 0; j < kNumNearestNeighbors; j++) {
-      const int flann_index = (*nn_indices)[i][j];
-      (*nn_indices)[i][j] = candidate_feature_indices[flann_index];
+    std::vector<float>& distances = (*nn_distances)[i];
+    std::vector<int>& indices = (*nn_indices)[i];
+    for (int j = 0; j < candidate_feature_indices.size(); j++) {
+      // Clamp to avoid small negative values caused by floating point
+      // round-off.
+      const float sq_distance = std::max(
+          sq_distances(i, j) + query_sq_norms(i) + candidate_sq_norms(j),
+          0.0f);
+      if (sq_distance < distances[0]) {
+        distances[1] = distances[0];
+        indices[1] = indices[0];
+        distances[0] = sq_distance;
+        indices[0] = candidate_feature_indices[j];
+      } else if (sq_distance < distances[1]) {
+        distances[1] = sq_distance;
+        indices[1] = candidate_feature_indices[j];
+      }
     }
   }
 }
 
-void GuidedEpipolarMatcher::FindClosestCellAndKeypoints(
-    const Eigen::Vector2d& point, std::vector<int>* new_keypoints) {
-  int min_grid = 0;
-  Eigen::Vector2i min_grid_center;
-  double min_dist = std::numeric_limits<double>::max();
-
-  // Find the grid cell with the closest center.
-  for (int i = 0; i < 4; i++) {
-    Eigen::Vector2i grid_center;
-    image_grids_[i].GetClosestGridCenter(point.x(), point.y(), &grid_center);
-    const double dist = (grid_center.cast<double>() - point).squaredNorm();
-    if (dist < min_dist) {
-      min_grid = i;
-      min_dist = dist;
-      std::swap(min_grid_center, grid_center);
-    }
+GuidedEpipolarMatcher::ImageGrid::ImageGrid()
+    : cell_size_(1.0), num_cols_(0), num_rows_(0) {}
+
+void GuidedEpipolarMatcher::ImageGrid::Build(
+    const double cell_size,
+    const Eigen::Vector2d& top_left,
+    const Eigen::Vector2d& bottom_right,
+    const std::vector<Keypoint>& keypoints,
+    const std::vector<int>& keypoint_indices) {
+  CHECK_GT(cell_size, 0.0);
+  cell_size_ = cell_size;
+  top_left_ = top_left;
+  num_cols_ =
+      static_cast<int>((bottom_right.x() - top_left.x()) / cell_size_) + 1;
+  num_rows_ =
+      static_cast<int>((bottom_right.y() - top_left.y()) / cell_size_) + 1;
+
+  // Find the cell of each keypoint and count the keypoints per cell.
+  std::vector<int> keypoint_cells(keypoint_indices.size());
+  cell_offsets_.assign(num_cols_ * num_rows_ + 1, 0);
+  for (int i = 0; i < keypoint_indices.size(); i++) {
+    const Keypoint& keypoint = keypoints[keypoint_indices[i]];
+    const int col = std::min(
+        static_cast<int>((keypoint.x() - top_left_.x()) / cell_size_),
+        num_cols_ - 1);
+    const int row = std::min(
+        static_cast<int>((keypoint.y() - top_left_.y()) / cell_size_),
+        num_rows_ - 1);
+    keypoint_cells[i] = row * num_cols_ + col;
+    ++cell_offsets_[keypoint_cells[i] + 1];
   }
 
-  // Get the features from the closest grid cell.
-  image_grids_[min_grid].GetFeaturesFromCell(min_grid_center, new_keypoints);
-}
-
-GuidedEpipolarMatcher::ImageGrid::ImageGrid(const double cell_size,
-                                            const double cell_offset_x,
-                                            const double cell_offset_y)
-    : cell_size_(cell_size),
-      cell_offset_x_(cell_offset_x),
-      cell_offset_y_(cell_offset_y) {
-  cells_.reserve(10000);
-}
-
-void GuidedEpipolarMatcher::ImageGrid::AddFeature(const int feature_index,
-                                                  const double x,
-                                                  const double y) {
-  Eigen::Vector2i grid_center;
-  GetClosestGridCenter(x, y, &grid_center);
-  cells_[grid_center].emplace_back(feature_index);
-}
-
-void GuidedEpipolarMatcher::ImageGrid::GetClosestGridCenter(
-    const double x, const double y, Eigen::Vector2i* grid_center) {
-  grid_center->x() = static_cast<int>(
-      std::floor((x - cell_offset_x_) / (2.0 * cell_size_)) * 2.0 * cell_size_ +
-      cell_size_ + cell_offset_x_);
-  grid_center->y() = static_cast<int>(
-      std::floor((y - cell_offset_y_) / (2.0 * cell_size_)) * 2.0 * cell_size_ +
-      + cell_size_ + cell_offset_y_);
+  // The prefix sum of the counts gives the offsets of the cells, and the
+  // keypoints are then placed into their cells with a counting sort.
+  for (int i = 1; i < cell_offsets_.size(); i++) {
+    cell_offsets_[i] += cell_offsets_[i - 1];
+  }
+  feature_indices_.resize(keypoint_indices.size());
+  std::vector<int> cell_sizes(num_cols_ * num_rows_, 0);
+  for (int i = 0; i < keypoint_indices.size(); i++) {
+    const int cell = keypoint_cells[i];
+    feature_indices_[cell_offsets_[cell] + cell_sizes[cell]++] =
+        keypoint_indices[i];
+  }
 }
 
-void GuidedEpipolarMatcher::ImageGrid::GetFeaturesFromCell(
-    const Eigen::Vector2i& cell_center, std::vector<int>* feature_indices) {
-  *feature_indices = FindWithDefault(cells_, cell_center, std::vector<int>());
+void GuidedEpipolarMatcher::ImageGrid::GetFeaturesNearLineSegment(
+    const Eigen::Vector2d& endpoint1,
+    const Eigen::Vector2d& endpoint2,
+    const double max_distance,
+    std::vector<int>* feature_indices) const {
+  // Transform the endpoints into grid coordinates, in which the cells have unit
+  // size.
+  Eigen::Vector2d start = (endpoint1 - top_left_) / cell_size_;
+  Eigen::Vector2d end = (endpoint2 - top_left_) / cell_size_;
+  const double radius = max_distance / cell_size_;
+
+  // The line is traversed along its major axis one column (or row) of cells at
+  // a time, so that the slope along the minor axis is at most 1.
+  const int major = std::abs(end.x() - start.x()) >=
+                            std::abs(end.y() - start.y())
+                        ? 0
+                        : 1;
+  const int minor = 1 - major;
+  if (start[major] > end[major]) {
+    std::swap(start, end);
+  }
+  const double major_length = end[major] - start[major];
+  const double slope =
+      major_length > 0.0 ? (end[minor] - start[minor]) / major_length : 0.0;
+  // Points within the radius of the line deviate from it by at most this much
+  // along the minor axis.
+  const double minor_radius = radius * std::sqrt(1.0 + slope * slope);
+
+  const int num_major_cells = major == 0 ? num_cols_ : num_rows_;
+  const int num_minor_cells = major == 0 ? num_rows_ : num_cols_;
+  const int first_major =
+      std::max(static_cast<int>(std::floor(start[major] - radius)), 0);
+  const int last_major = std::min(
+      static_cast<int>(std::floor(end[major] + radius)), num_major_cells - 1);
+  for (int i = first_major; i <= last_major; i++) {
+    // The extent of the line segment along the minor axis within this column
+    // (or row) of cells. The segment is clamped to its endpoints, and the
+    // radius accounts for the points beyond them.
+    const double segment_start = std::min(
+        std::max(static_cast<double>(i), start[major]), end[major]);
+    const double segment_end = std::min(
+        std::max(static_cast<double>(i + 1), start[major]), end[major]);
+    const double minor1 = start[minor] + slope * (segment_start - start[major]);
+    const double minor2 = start[minor] + slope * (segment_end - start[major]);
+    const int first_minor = std::max(
+        static_cast<int>(std::floor(std::min(minor1, minor2) - minor_radius)),
+        0);
+    const int last_minor = std::min(
+        static_cast<int>(std::floor(std::max(minor1, minor2) + minor_radius)),
+        num_minor_cells - 1);
+
+    for (int j = first_minor; j <= last_minor; j++) {
+      const int cell = major == 0 ? j * num_cols_ + i : i * num_cols_ + j;
+      feature_indices->insert(
+          feature_indices->end(),
+          feature_indices_.begin() + cell_offsets_[cell],
+          feature_indices_.begin() + cell_offsets_[cell + 1]);
+    }
+  }
 }
 
 }  // namespace theia
@@ -37,15 +37,14 @@
 
 #include <Eigen/Core>
 #include <memory>
-#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "theia/alignment/alignment.h"
+#include "theia/image/keypoint_detector/keypoint.h"
 #include "theia/matching/keypoints_and_descriptors.h"
 #include "theia/sfm/camera/camera.h"
-#include "theia/util/hash.h"
 
 namespace theia {
 class RandomNumberGenerator;
@@ -86,30 +85,39 @@ class GuidedEpipolarMatcher {
   bool GetMatches(std::vector<IndexedFeatureMatch>* matches);
 
  private:
-  // This helper class provides quick and easy access to the image grids that
-  // are used to rapidly find features near epipolar lines.
+  // This helper class provides quick and easy access to the image grid that is
+  // used to rapidly find features near epipolar lines. The grid is stored flat
+  // in compressed sparse row format: the features of cell i are
+  // feature_indices_[cell_offsets_[i]] to feature_indices_[cell_offsets_[i + 1]
+  // - 1], and the cells are stored in row-major order.
   class ImageGrid {
    public:
-    ImageGrid(const double cell_size,
-              const double cell_offset_x,
-              const double cell_offset_y);
-
-    // Add a feature the the grid and assign it to a cell.
-    void AddFeature(const int feature_index, const double x, const double y);
-
-    // Retrieve the closest cell center to the point.
-    void GetClosestGridCenter(const double x, const double y,
-                              Eigen::Vector2i* grid_center);
-
-    // Get all features that lie within the cell specified by the center.
-    void GetFeaturesFromCell(const Eigen::Vector2i& cell_center,
-                             std::vector<int>* feature_indices);
+    ImageGrid();
+
+    // Builds the grid with square cells of size cell_size that covers the
+    // bounding box given by the top left and bottom right corners, and adds
+    // the keypoints with the given indices to the grid.
+    void Build(const double cell_size,
+               const Eigen::Vector2d& top_left,
+               const Eigen::Vector2d& bottom_right,
+               const std::vector<Keypoint>& keypoints,
+               const std::vector<int>& keypoint_indices);
+
+    // Appends the features of all cells that contain points within
+    // max_distance of the line segment between the endpoints. The cells are
+    // found by rasterizing the line along its major axis, so each cell is
+    // visited at most once and no feature is appended twice.
+    void GetFeaturesNearLineSegment(const Eigen::Vector2d& endpoint1,
+                                    const Eigen::Vector2d& endpoint2,
+                                    const double max_distance,
+                                    std::vector<int>* feature_indices) const;
 
    private:
-    // A container for the grid cells. The mapping is such the the cell center
-    // contains all keypoints in the cell.
-    std::unordered_map<Eigen::Vector2i, std::vector<int>> cells_;
-    double cell_size_, cell_offset_x_, cell_offset_y_;
+    double cell_size_;
+    Eigen::Vector2d top_left_;
+    int num_cols_, num_rows_;
+    std::vector<int> cell_offsets_;
+    std::vector<int> feature_indices_;
   };
 
   // Holds a group of features with similar epiplines as a single epiline.
@@ -138,16 +146,13 @@ class GuidedEpipolarMatcher {
   // Computes a fundamental matrix from the cameras.
   Eigen::Matrix3d ComputeFundamentalMatrix();
 
-  // Finds the closest grid cell among all image grids and returns the keypoints
-  // in that cell.
-  void FindClosestCellAndKeypoints(const Eigen::Vector2d& point,
-                                   std::vector<int>* new_keypoints);
-
   // Given the set of query descriptors (in features1) and the candidate matches
   // (in features2), return the top 2 nearest neighbor distances and indices
   // where the index is the index in features2 of the match. The format is
   // nn_distances[query_feature_index][nn_number] where nn_number == 0 is the
-  // closest neighbor by descriptor distance.
+  // closest neighbor by descriptor distance. The squared distances between all
+  // queries and candidates of an epiline group are computed exactly as a
+  // single matrix product.
   void FindKNearestNeighbors(const std::vector<int>& query_feature_indices,
                              const std::vector<int>& candidate_feature_indices,
                              std::vector<std::vector<float> >* nn_distances,
@@ -160,7 +165,7 @@ class GuidedEpipolarMatcher {
   std::shared_ptr<RandomNumberGenerator> rng_;
 
   Eigen::Vector2d top_left_, bottom_right_;
-  std::vector<ImageGrid> image_grids_;
+  ImageGrid image_grid_;
   std::unordered_set<int> matched_features1_, matched_features2_;
 };
 
@@ -70,7 +70,10 @@ void TestGuidedEpipolarMatcher(const int num_valid_matches,
 
   // Create 3d points and reproject them into both images to form
   // correspondences.
+  const int num_features = num_valid_matches + num_invalid_matches;
   KeypointsAndDescriptors features1, features2;
+  features1.descriptors.resize(num_features, kNumDescriptorDimensions);
+  features2.descriptors.resize(num_features, kNumDescriptorDimensions);
   for (int i = 0; i < num_valid_matches; i++) {
     Eigen::Vector4d point(rng->RandDouble(-2.0, 2.0),
                           rng->RandDouble(-2.0, 2.0),
@@ -93,8 +96,8 @@ void TestGuidedEpipolarMatcher(const int num_valid_matches,
     Eigen::VectorXf descriptor(kNumDescriptorDimensions);
     rng->SetRandom(&descriptor);
     descriptor.normalize();
-    features1.descriptors.emplace_back(descriptor);
-    features2.descriptors.emplace_back(descriptor);
+    features1.descriptors.row(i) = descriptor.transpose();
+    features2.descriptors.row(i) = descriptor.transpose();
   }
 
   // Add bogus features to the image that have no matches.
@@ -108,9 +111,11 @@ void TestGuidedEpipolarMatcher(const int num_valid_matches,
                                      Keypoint::OTHER);
     Eigen::VectorXf rand_vec(kNumDescriptorDimensions);
     rng->SetRandom(&rand_vec);
-    features1.descriptors.emplace_back(rand_vec.normalized());
+    features1.descriptors.row(num_valid_matches + i) =
+        rand_vec.normalized().transpose();
     rng->SetRandom(&rand_vec);
-    features2.descriptors.emplace_back(rand_vec.normalized());
+    features2.descriptors.row(num_valid_matches + i) =
+        rand_vec.normalized().transpose();
   }
 
   // Add some pre-computed matches if applicable.
@@ -120,7 +125,8 @@ void TestGuidedEpipolarMatcher(const int num_valid_matches,
     match.feature1_ind = i;
     match.feature2_ind = i;
     match.distance =
-        (features1.descriptors[i] - features2.descriptors[i]).squaredNorm();
+        (features1.descriptors.row(i) - features2.descriptors.row(i))
+            .squaredNorm();
     matches.emplace_back(match);
   }
 
@@ -137,11 +143,19 @@ void TestGuidedEpipolarMatcher(const int num_valid_matches,
   EXPECT_GT(matches.size(), num_provided_matches);
 
   // Ensure that all matches are valid matches.
+  int num_correct_matches = 0;
   for (const IndexedFeatureMatch match : matches) {
     if (match.feature1_ind < num_valid_matches) {
       EXPECT_EQ(match.feature1_ind, match.feature2_ind);
+      if (match.feature1_ind == match.feature2_ind) {
+        ++num_correct_matches;
+      }
     }
   }
+
+  // The features of the valid matches lie on their epipolar lines, so nearly
+  // all of them should be found.
+  EXPECT_GE(num_correct_matches, 0.9 * num_valid_matches);
 }
 
 TEST(GuidedEpipolarMatcherTest, NoInputMatchesSmall) {
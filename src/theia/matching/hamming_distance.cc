@@ -0,0 +1,470 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/hamming_distance.h"
+
+#include <glog/logging.h>
+#include <stdint.h>
+#include <cstring>
+
+// The SIMD kernels are compiled with function-level target attributes and
+// selected at runtime, so they are only available with GCC and Clang on x86-64.
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    defined(__x86_64__)
+#define THEIA_HAMMING_DISTANCE_USE_AVX2
+#if (defined(__clang__) && __clang_major__ >= 6) || \
+    (!defined(__clang__) && __GNUC__ >= 8)
+#define THEIA_HAMMING_DISTANCE_USE_AVX512
+#endif
+#include <immintrin.h>
+#endif
+
+namespace theia {
+
+namespace {
+
+inline int Popcount64(const uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(x);
+#else
+  uint64_t count = x - ((x >> 1) & 0x5555555555555555ULL);
+  count = (count & 0x3333333333333333ULL) +
+          ((count >> 2) & 0x3333333333333333ULL);
+  count = (count + (count >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return static_cast<int>((count * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+void ComputeHammingDistances128Scalar(const uint64_t* query_code,
+                                      const uint64_t* codes,
+                                      const int* indices,
+                                      const int num_indices,
+                                      uint8_t* distances) {
+  for (int i = 0; i < num_indices; i++) {
+    const uint64_t* code = codes + 2 * indices[i];
+    distances[i] = Popcount64(query_code[0] ^ code[0]) +
+                   Popcount64(query_code[1] ^ code[1]);
+  }
+}
+
+#ifdef THEIA_HAMMING_DISTANCE_USE_AVX2
+// Two codes are processed per 256-bit register. AVX2 does not have a popcount
+// instruction, so the bits are counted with a 4-bit lookup table through
+// vpshufb and summed per 64-bit lane with vpsadbw (Mula et al.).
+__attribute__((target("avx2"))) void ComputeHammingDistances128Avx2(
+    const uint64_t* query_code,
+    const uint64_t* codes,
+    const int* indices,
+    const int num_indices,
+    uint8_t* distances) {
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                          1, 2, 2, 3, 2, 3, 3, 4,
+                                          0, 1, 1, 2, 1, 2, 2, 3,
+                                          1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0F);
+  const __m256i query = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(query_code)));
+
+  int i = 0;
+  for (; i + 2 <= num_indices; i += 2) {
+    const __m128i code1 = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(codes + 2 * indices[i]));
+    const __m128i code2 = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(codes + 2 * indices[i + 1]));
+    const __m256i code_pair =
+        _mm256_inserti128_si256(_mm256_castsi128_si256(code1), code2, 1);
+    const __m256i difference = _mm256_xor_si256(query, code_pair);
+
+    const __m256i low_bits = _mm256_and_si256(difference, low_mask);
+    const __m256i high_bits =
+        _mm256_and_si256(_mm256_srli_epi16(difference, 4), low_mask);
+    const __m256i byte_counts =
+        _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low_bits),
+                        _mm256_shuffle_epi8(lookup, high_bits));
+    // Sum the bytes of each 64-bit word.
+    const __m256i word_counts =
+        _mm256_sad_epu8(byte_counts, _mm256_setzero_si256());
+
+    distances[i] = _mm256_extract_epi64(word_counts, 0) +
+                   _mm256_extract_epi64(word_counts, 1);
+    distances[i + 1] = _mm256_extract_epi64(word_counts, 2) +
+                       _mm256_extract_epi64(word_counts, 3);
+  }
+
+  // Handle the remaining code, if any.
+  ComputeHammingDistances128Scalar(
+      query_code, codes, indices + i, num_indices - i, distances + i);
+}
+#endif  // THEIA_HAMMING_DISTANCE_USE_AVX2
+
+#ifdef THEIA_HAMMING_DISTANCE_USE_AVX512
+// Four codes are gathered into each 512-bit register and the bits of all eight
+// 64-bit words are counted with a single vpopcntq.
+__attribute__((target("avx512f,avx512vpopcntdq")))
+void ComputeHammingDistances128Avx512(const uint64_t* query_code,
+                                      const uint64_t* codes,
+                                      const int* indices,
+                                      const int num_indices,
+                                      uint8_t* distances) {
+  const __m512i query = _mm512_broadcast_i32x4(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(query_code)));
+  // Lane offsets of the two words of each code.
+  const __m256i word_offsets = _mm256_setr_epi32(0, 1, 0, 1, 0, 1, 0, 1);
+
+  int i = 0;
+  for (; i + 4 <= num_indices; i += 4) {
+    // The word indices of the four codes, i.e. 2 * index and 2 * index + 1.
+    const __m128i code_indices =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i));
+    const __m256i duplicated_indices = _mm256_permutevar8x32_epi32(
+        _mm256_castsi128_si256(code_indices),
+        _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3));
+    const __m256i word_indices = _mm256_add_epi32(
+        _mm256_slli_epi32(duplicated_indices, 1), word_offsets);
+
+    const __m512i code_words = _mm512_i32gather_epi64(
+        word_indices, reinterpret_cast<const void*>(codes), 8);
+    const __m512i word_counts =
+        _mm512_popcnt_epi64(_mm512_xor_si512(query, code_words));
+    // Add the counts of the two words of each code.
+    const __m512i code_counts = _mm512_add_epi64(
+        word_counts, _mm512_shuffle_epi32(word_counts, _MM_PERM_BADC));
+
+    alignas(64) uint64_t counts[8];
+    _mm512_store_si512(reinterpret_cast<void*>(counts), code_counts);
+    distances[i] = counts[0];
+    distances[i + 1] = counts[2];
+    distances[i + 2] = counts[4];
+    distances[i + 3] = counts[6];
+  }
+
+  // Handle the remaining codes, if any.
+  ComputeHammingDistances128Scalar(
+      query_code, codes, indices + i, num_indices - i, distances + i);
+}
+#endif  // THEIA_HAMMING_DISTANCE_USE_AVX512
+
+// Returns the descriptor that the i-th distance is computed for. If no indices
+// are given then the descriptors are used in order.
+inline const uint8_t* GetDescriptor(const uint8_t* descriptors,
+                                    const int num_bytes,
+                                    const int* indices,
+                                    const int i) {
+  const int index = indices == nullptr ? i : indices[i];
+  return descriptors + static_cast<size_t>(index) * num_bytes;
+}
+
+void ComputeHammingDistancesScalar(const uint8_t* query_descriptor,
+                                   const uint8_t* descriptors,
+                                   const int num_bytes,
+                                   const int* indices,
+                                   const int num_indices,
+                                   int* distances) {
+  for (int i = 0; i < num_indices; i++) {
+    const uint8_t* descriptor =
+        GetDescriptor(descriptors, num_bytes, indices, i);
+    int distance = 0;
+    int j = 0;
+    for (; j + 8 <= num_bytes; j += 8) {
+      uint64_t query_word, descriptor_word;
+      std::memcpy(&query_word, query_descriptor + j, sizeof(query_word));
+      std::memcpy(&descriptor_word, descriptor + j, sizeof(descriptor_word));
+      distance += Popcount64(query_word ^ descriptor_word);
+    }
+    for (; j < num_bytes; j++) {
+      distance += Popcount64(query_descriptor[j] ^ descriptor[j]);
+    }
+    distances[i] = distance;
+  }
+}
+
+#ifdef THEIA_HAMMING_DISTANCE_USE_AVX2
+// Each descriptor is processed in 32 byte blocks with the same lookup table
+// popcount as above. The remaining bytes are counted with the scalar popcnt
+// instruction, which all CPUs with AVX2 support.
+__attribute__((target("avx2,popcnt"))) void ComputeHammingDistancesAvx2(
+    const uint8_t* query_descriptor,
+    const uint8_t* descriptors,
+    const int num_bytes,
+    const int* indices,
+    const int num_indices,
+    int* distances) {
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                          1, 2, 2, 3, 2, 3, 3, 4,
+                                          0, 1, 1, 2, 1, 2, 2, 3,
+                                          1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0F);
+  const int num_block_bytes = num_bytes - num_bytes % 32;
+
+  for (int i = 0; i < num_indices; i++) {
+    const uint8_t* descriptor =
+        GetDescriptor(descriptors, num_bytes, indices, i);
+    __m256i word_counts = _mm256_setzero_si256();
+    for (int j = 0; j < num_block_bytes; j += 32) {
+      const __m256i query_block = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(query_descriptor + j));
+      const __m256i descriptor_block = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(descriptor + j));
+      const __m256i difference =
+          _mm256_xor_si256(query_block, descriptor_block);
+
+      const __m256i low_bits = _mm256_and_si256(difference, low_mask);
+      const __m256i high_bits =
+          _mm256_and_si256(_mm256_srli_epi16(difference, 4), low_mask);
+      const __m256i byte_counts =
+          _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low_bits),
+                          _mm256_shuffle_epi8(lookup, high_bits));
+      word_counts = _mm256_add_epi64(
+          word_counts, _mm256_sad_epu8(byte_counts, _mm256_setzero_si256()));
+    }
+    int distance = _mm256_extract_epi64(word_counts, 0) +
+                   _mm256_extract_epi64(word_counts, 1) +
+                   _mm256_extract_epi64(word_counts, 2) +
+                   _mm256_extract_epi64(word_counts, 3);
+
+    int j = num_block_bytes;
+    for (; j + 8 <= num_bytes; j += 8) {
+      uint64_t query_word, descriptor_word;
+      std::memcpy(&query_word, query_descriptor + j, sizeof(query_word));
+      std::memcpy(&descriptor_word, descriptor + j, sizeof(descriptor_word));
+      distance += __builtin_popcountll(query_word ^ descriptor_word);
+    }
+    for (; j < num_bytes; j++) {
+      distance += __builtin_popcount(query_descriptor[j] ^ descriptor[j]);
+    }
+    distances[i] = distance;
+  }
+}
+#endif  // THEIA_HAMMING_DISTANCE_USE_AVX2
+
+#ifdef THEIA_HAMMING_DISTANCE_USE_AVX512
+// Each descriptor is processed in 64 byte blocks. The last block is loaded with
+// a byte mask, so descriptors of up to 64 bytes (e.g., the 61 byte M-LDB
+// descriptor) only need a single vpopcntq.
+__attribute__((target("avx512f,avx512bw,avx512vpopcntdq")))
+void ComputeHammingDistancesAvx512(const uint8_t* query_descriptor,
+                                   const uint8_t* descriptors,
+                                   const int num_bytes,
+                                   const int* indices,
+                                   const int num_indices,
+                                   int* distances) {
+  for (int i = 0; i < num_indices; i++) {
+    const uint8_t* descriptor =
+        GetDescriptor(descriptors, num_bytes, indices, i);
+    __m512i word_counts = _mm512_setzero_si512();
+    for (int j = 0; j < num_bytes; j += 64) {
+      const int num_remaining_bytes = num_bytes - j;
+      const __mmask64 mask =
+          num_remaining_bytes >= 64
+              ? ~static_cast<__mmask64>(0)
+              : (static_cast<__mmask64>(1) << num_remaining_bytes) - 1;
+      const __m512i query_block =
+          _mm512_maskz_loadu_epi8(mask, query_descriptor + j);
+      const __m512i descriptor_block =
+          _mm512_maskz_loadu_epi8(mask, descriptor + j);
+      word_counts = _mm512_add_epi64(
+          word_counts,
+          _mm512_popcnt_epi64(_mm512_xor_si512(query_block, descriptor_block)));
+    }
+    distances[i] = _mm512_reduce_add_epi64(word_counts);
+  }
+}
+#endif  // THEIA_HAMMING_DISTANCE_USE_AVX512
+
+}  // namespace
+
+bool IsPopcountInstructionSetSupported(
+    const PopcountInstructionSet instruction_set) {
+  switch (instruction_set) {
+    case PopcountInstructionSet::SCALAR:
+      return true;
+    case PopcountInstructionSet::AVX2:
+#ifdef THEIA_HAMMING_DISTANCE_USE_AVX2
+      return __builtin_cpu_supports("avx2");
+#else
+      return false;
+#endif
+    case PopcountInstructionSet::AVX512_VPOPCNTDQ:
+#ifdef THEIA_HAMMING_DISTANCE_USE_AVX512
+      return __builtin_cpu_supports("avx512f") &&
+             __builtin_cpu_supports("avx512bw") &&
+             __builtin_cpu_supports("avx512vpopcntdq");
+#else
+      return false;
+#endif
+    default:
+      return false;
+  }
+}
+
+PopcountInstructionSet GetFastestPopcountInstructionSet() {
+  // The CPU features cannot change while running, so they are only queried
+  // once.
+  static const PopcountInstructionSet fastest_instruction_set = []() {
+    if (IsPopcountInstructionSetSupported(
+            PopcountInstructionSet::AVX512_VPOPCNTDQ)) {
+      return PopcountInstructionSet::AVX512_VPOPCNTDQ;
+    }
+    if (IsPopcountInstructionSetSupported(PopcountInstructionSet::AVX2)) {
+      return PopcountInstructionSet::AVX2;
+    }
+    return PopcountInstructionSet::SCALAR;
+  }();
+  return fastest_instruction_set;
+}
+
+void ComputeHammingDistances128(const uint64_t* query_code,
+                                const uint64_t* codes,
+                                const int* indices,
+                                const int num_indices,
+                                uint8_t* distances) {
+  ComputeHammingDistances128(GetFastestPopcountInstructionSet(),
+                             query_code,
+                             codes,
+                             indices,
+                             num_indices,
+                             distances);
+}
+
+void ComputeHammingDistances128(const PopcountInstructionSet instruction_set,
+                                const uint64_t* query_code,
+                                const uint64_t* codes,
+                                const int* indices,
+                                const int num_indices,
+                                uint8_t* distances) {
+  DCHECK(IsPopcountInstructionSetSupported(instruction_set));
+  switch (instruction_set) {
+#ifdef THEIA_HAMMING_DISTANCE_USE_AVX512
+    case PopcountInstructionSet::AVX512_VPOPCNTDQ:
+      ComputeHammingDistances128Avx512(
+          query_code, codes, indices, num_indices, distances);
+      break;
+#endif
+#ifdef THEIA_HAMMING_DISTANCE_USE_AVX2
+    case PopcountInstructionSet::AVX2:
+      ComputeHammingDistances128Avx2(
+          query_code, codes, indices, num_indices, distances);
+      break;
+#endif
+    default:
+      ComputeHammingDistances128Scalar(
+          query_code, codes, indices, num_indices, distances);
+      break;
+  }
+}
+
+int HammingDistance(const uint8_t* descriptor1,
+                    const uint8_t* descriptor2,
+                    const int num_bytes) {
+  int distance;
+  ComputeHammingDistances(GetFastestPopcountInstructionSet(),
+                          descriptor1,
+                          descriptor2,
+                          num_bytes,
+                          nullptr,
+                          1,
+                          &distance);
+  return distance;
+}
+
+void ComputeHammingDistances(const uint8_t* query_descriptor,
+                             const uint8_t* descriptors,
+                             const int num_bytes,
+                             const int num_descriptors,
+                             int* distances) {
+  ComputeHammingDistances(GetFastestPopcountInstructionSet(),
+                          query_descriptor,
+                          descriptors,
+                          num_bytes,
+                          nullptr,
+                          num_descriptors,
+                          distances);
+}
+
+void ComputeHammingDistances(const uint8_t* query_descriptor,
+                             const uint8_t* descriptors,
+                             const int num_bytes,
+                             const int* indices,
+                             const int num_indices,
+                             int* distances) {
+  ComputeHammingDistances(GetFastestPopcountInstructionSet(),
+                          query_descriptor,
+                          descriptors,
+                          num_bytes,
+                          indices,
+                          num_indices,
+                          distances);
+}
+
+void ComputeHammingDistances(const PopcountInstructionSet instruction_set,
+                             const uint8_t* query_descriptor,
+                             const uint8_t* descriptors,
+                             const int num_bytes,
+                             const int* indices,
+                             const int num_indices,
+                             int* distances) {
+  DCHECK(IsPopcountInstructionSetSupported(instruction_set));
+  switch (instruction_set) {
+#ifdef THEIA_HAMMING_DISTANCE_USE_AVX512
+    case PopcountInstructionSet::AVX512_VPOPCNTDQ:
+      ComputeHammingDistancesAvx512(query_descriptor,
+                                    descriptors,
+                                    num_bytes,
+                                    indices,
+                                    num_indices,
+                                    distances);
+      break;
+#endif
+#ifdef THEIA_HAMMING_DISTANCE_USE_AVX2
+    case PopcountInstructionSet::AVX2:
+      ComputeHammingDistancesAvx2(query_descriptor,
+                                  descriptors,
+                                  num_bytes,
+                                  indices,
+                                  num_indices,
+                                  distances);
+      break;
+#endif
+    default:
+      ComputeHammingDistancesScalar(query_descriptor,
+                                    descriptors,
+                                    num_bytes,
+                                    indices,
+                                    num_indices,
+                                    distances);
+      break;
+  }
+}
+
+}  // namespace theia
@@ -0,0 +1,120 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_HAMMING_DISTANCE_H_
+#define THEIA_MATCHING_HAMMING_DISTANCE_H_
+
+#include <stdint.h>
+
+namespace theia {
+
+// The instruction sets that may be used to compute the population count (i.e.,
+// the number of set bits) for Hamming distances. The fastest instruction set
+// supported by the CPU is determined at runtime so that the library does not
+// have to be compiled for a specific architecture. AVX512_VPOPCNTDQ also
+// requires AVX512BW for the masked byte loads of binary descriptors.
+enum class PopcountInstructionSet {
+  SCALAR = 0,
+  AVX2 = 1,
+  AVX512_VPOPCNTDQ = 2,
+};
+
+// Returns the fastest instruction set for computing popcounts that is supported
+// by this CPU.
+PopcountInstructionSet GetFastestPopcountInstructionSet();
+
+// Returns true if the instruction set may be used on this CPU.
+bool IsPopcountInstructionSetSupported(
+    const PopcountInstructionSet instruction_set);
+
+// Computes the Hamming distances between a 128-bit query code and a subset of
+// 128-bit codes. Each code is packed into two consecutive uint64_t words, so
+// that code i occupies codes[2 * i] and codes[2 * i + 1]. The distance between
+// the query code and code indices[i] is written to distances[i] for each of the
+// num_indices indices.
+void ComputeHammingDistances128(const uint64_t* query_code,
+                                const uint64_t* codes,
+                                const int* indices,
+                                const int num_indices,
+                                uint8_t* distances);
+
+// Same as above, but the distances are computed with the given instruction set
+// instead of the fastest one available. The instruction set must be supported
+// by the CPU. This is mostly useful for testing.
+void ComputeHammingDistances128(const PopcountInstructionSet instruction_set,
+                                const uint64_t* query_code,
+                                const uint64_t* codes,
+                                const int* indices,
+                                const int num_indices,
+                                uint8_t* distances);
+
+// Computes the Hamming distance between two bit-packed binary descriptors
+// (e.g., a row of a BinaryDescriptorMatrix) of num_bytes bytes each.
+int HammingDistance(const uint8_t* descriptor1,
+                    const uint8_t* descriptor2,
+                    const int num_bytes);
+
+// Computes the Hamming distances between a binary query descriptor and
+// num_descriptors binary descriptors that are stored contiguously, i.e. in a
+// row-major BinaryDescriptorMatrix with num_bytes columns. The distance to
+// descriptor i is written to distances[i].
+void ComputeHammingDistances(const uint8_t* query_descriptor,
+                             const uint8_t* descriptors,
+                             const int num_bytes,
+                             const int num_descriptors,
+                             int* distances);
+
+// Same as above, but only the distances to the descriptors indices[i] for each
+// of the num_indices indices are computed and written to distances[i].
+void ComputeHammingDistances(const uint8_t* query_descriptor,
+                             const uint8_t* descriptors,
+                             const int num_bytes,
+                             const int* indices,
+                             const int num_indices,
+                             int* distances);
+
+// Same as above, with the given instruction set instead of the fastest one
+// available. If indices is NULL then the distances to the first num_indices
+// descriptors are computed. This is mostly useful for testing.
+void ComputeHammingDistances(const PopcountInstructionSet instruction_set,
+                             const uint8_t* query_descriptor,
+                             const uint8_t* descriptors,
+                             const int num_bytes,
+                             const int* indices,
+                             const int num_indices,
+                             int* distances);
+
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_HAMMING_DISTANCE_H_
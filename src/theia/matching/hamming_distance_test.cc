@@ -0,0 +1,224 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <glog/logging.h>
+#include <stdint.h>
+#include <bitset>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "theia/matching/hamming_distance.h"
+#include "theia/util/random.h"
+
+namespace theia {
+
+namespace {
+
+RandomNumberGenerator rng(57);
+
+uint64_t RandomWord() {
+  return (static_cast<uint64_t>(rng.RandInt(0, 0xFFFF)) << 48) |
+         (static_cast<uint64_t>(rng.RandInt(0, 0xFFFF)) << 32) |
+         (static_cast<uint64_t>(rng.RandInt(0, 0xFFFF)) << 16) |
+         static_cast<uint64_t>(rng.RandInt(0, 0xFFFF));
+}
+
+int ReferenceHammingDistance(const uint64_t* code1, const uint64_t* code2) {
+  return std::bitset<64>(code1[0] ^ code2[0]).count() +
+         std::bitset<64>(code1[1] ^ code2[1]).count();
+}
+
+void TestHammingDistances(const PopcountInstructionSet instruction_set) {
+  static const int kNumCodes = 200;
+  std::vector<uint64_t> codes(2 * kNumCodes);
+  for (int i = 0; i < codes.size(); i++) {
+    codes[i] = RandomWord();
+  }
+  // Include codes with no bits and all bits set.
+  codes[0] = codes[1] = 0;
+  codes[2] = codes[3] = ~uint64_t(0);
+  const uint64_t query_code[2] = { RandomWord(), RandomWord() };
+
+  // Test all numbers of indices to cover the remainders of the SIMD kernels,
+  // with the indices in arbitrary order and containing duplicates.
+  for (int num_indices = 0; num_indices < 16; num_indices++) {
+    std::vector<int> indices(num_indices);
+    for (int i = 0; i < num_indices; i++) {
+      indices[i] = rng.RandInt(0, kNumCodes - 1);
+    }
+    if (num_indices > 2) {
+      indices[0] = 0;
+      indices[1] = 1;
+      indices[2] = indices[1];
+    }
+
+    std::vector<uint8_t> distances(num_indices);
+    ComputeHammingDistances128(instruction_set,
+                               query_code,
+                               codes.data(),
+                               indices.data(),
+                               num_indices,
+                               distances.data());
+    for (int i = 0; i < num_indices; i++) {
+      EXPECT_EQ(distances[i],
+                ReferenceHammingDistance(query_code,
+                                         codes.data() + 2 * indices[i]));
+    }
+  }
+}
+
+int ReferenceHammingDistance(const uint8_t* descriptor1,
+                             const uint8_t* descriptor2,
+                             const int num_bytes) {
+  int distance = 0;
+  for (int i = 0; i < num_bytes; i++) {
+    distance += std::bitset<8>(descriptor1[i] ^ descriptor2[i]).count();
+  }
+  return distance;
+}
+
+void TestBinaryDescriptorHammingDistances(
+    const PopcountInstructionSet instruction_set) {
+  static const int kNumDescriptors = 20;
+  // Test sizes below, at, and above the SIMD block sizes as well as the size of
+  // the M-LDB descriptor (61 bytes).
+  const std::vector<int> descriptor_sizes = { 1, 7, 8, 31, 32, 33, 61, 64, 65,
+                                              130 };
+  for (const int num_bytes : descriptor_sizes) {
+    std::vector<uint8_t> descriptors(kNumDescriptors * num_bytes);
+    for (int i = 0; i < descriptors.size(); i++) {
+      descriptors[i] = rng.RandInt(0, 255);
+    }
+    std::vector<uint8_t> query(num_bytes);
+    for (int i = 0; i < num_bytes; i++) {
+      query[i] = rng.RandInt(0, 255);
+    }
+
+    // Compute the distances to all descriptors in order.
+    std::vector<int> distances(kNumDescriptors);
+    ComputeHammingDistances(instruction_set,
+                            query.data(),
+                            descriptors.data(),
+                            num_bytes,
+                            nullptr,
+                            kNumDescriptors,
+                            distances.data());
+    for (int i = 0; i < kNumDescriptors; i++) {
+      EXPECT_EQ(distances[i],
+                ReferenceHammingDistance(query.data(),
+                                         descriptors.data() + i * num_bytes,
+                                         num_bytes));
+    }
+
+    // Compute the distances to a subset of the descriptors.
+    const std::vector<int> indices = { 5, 0, 19, 5, 11 };
+    distances.resize(indices.size());
+    ComputeHammingDistances(instruction_set,
+                            query.data(),
+                            descriptors.data(),
+                            num_bytes,
+                            indices.data(),
+                            indices.size(),
+                            distances.data());
+    for (int i = 0; i < indices.size(); i++) {
+      EXPECT_EQ(distances[i],
+                ReferenceHammingDistance(
+                    query.data(),
+                    descriptors.data() + indices[i] * num_bytes,
+                    num_bytes));
+    }
+  }
+}
+
+}  // namespace
+
+TEST(HammingDistance, Scalar) {
+  TestHammingDistances(PopcountInstructionSet::SCALAR);
+  TestBinaryDescriptorHammingDistances(PopcountInstructionSet::SCALAR);
+}
+
+TEST(HammingDistance, AVX2) {
+  if (!IsPopcountInstructionSetSupported(PopcountInstructionSet::AVX2)) {
+    LOG(INFO) << "AVX2 is not supported on this CPU. Skipping the test.";
+    return;
+  }
+  TestHammingDistances(PopcountInstructionSet::AVX2);
+  TestBinaryDescriptorHammingDistances(PopcountInstructionSet::AVX2);
+}
+
+TEST(HammingDistance, AVX512) {
+  if (!IsPopcountInstructionSetSupported(
+          PopcountInstructionSet::AVX512_VPOPCNTDQ)) {
+    LOG(INFO) << "AVX-512 VPOPCNTDQ is not supported on this CPU. Skipping the "
+                 "test.";
+    return;
+  }
+  TestHammingDistances(PopcountInstructionSet::AVX512_VPOPCNTDQ);
+  TestBinaryDescriptorHammingDistances(
+      PopcountInstructionSet::AVX512_VPOPCNTDQ);
+}
+
+TEST(HammingDistance, SingleDescriptorPair) {
+  const uint8_t descriptor1[3] = { 0x00, 0xFF, 0x0F };
+  const uint8_t descriptor2[3] = { 0x01, 0xFF, 0xF0 };
+  EXPECT_EQ(HammingDistance(descriptor1, descriptor2, 3), 9);
+  EXPECT_EQ(HammingDistance(descriptor1, descriptor1, 3), 0);
+}
+
+TEST(HammingDistance, ContiguousAndIndexedDescriptors) {
+  static const int kNumDescriptors = 3;
+  static const int kNumBytes = 2;
+  const uint8_t query[kNumBytes] = { 0x00, 0x00 };
+  const uint8_t descriptors[kNumDescriptors * kNumBytes] = { 0x01, 0x00,
+                                                             0x03, 0x01,
+                                                             0xFF, 0xFF };
+  int distances[kNumDescriptors];
+  ComputeHammingDistances(
+      query, descriptors, kNumBytes, kNumDescriptors, distances);
+  EXPECT_EQ(distances[0], 1);
+  EXPECT_EQ(distances[1], 3);
+  EXPECT_EQ(distances[2], 16);
+
+  const int indices[2] = { 2, 0 };
+  ComputeHammingDistances(query, descriptors, kNumBytes, indices, 2, distances);
+  EXPECT_EQ(distances[0], 16);
+  EXPECT_EQ(distances[1], 1);
+}
+
+TEST(HammingDistance, FastestInstructionSetIsSupported) {
+  EXPECT_TRUE(
+      IsPopcountInstructionSetSupported(GetFastestPopcountInstructionSet()));
+}
+
+}  // namespace theia
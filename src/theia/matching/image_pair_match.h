@@ -37,9 +37,11 @@
 
 #include <cereal/access.hpp>
 #include <cereal/cereal.hpp>
+#include <cereal/types/utility.hpp>
 #include <cereal/types/vector.hpp>
 #include <stdint.h>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "theia/alignment/alignment.h"
@@ -48,6 +50,10 @@
 
 namespace theia {
 
+// The indices of the two features of a correspondence in the keypoints of the
+// first and the second image.
+typedef std::pair<uint32_t, uint32_t> FeatureIndexPair;
+
 struct ImagePairMatch {
  public:
   std::string image1;
@@ -61,6 +67,13 @@ struct ImagePairMatch {
   // then this only contains inlier correspondences.
   std::vector<FeatureCorrespondence> correspondences;
 
+  // The indices of the features of each correspondence in the keypoints of the
+  // images, in the same order as the correspondences. These are set by the
+  // feature matcher so that the databases may store the correspondences as
+  // feature indices (see CompactImagePairMatch). They may be left empty if the
+  // correspondences do not come from the features of the images.
+  std::vector<FeatureIndexPair> feature_indices;
+
  private:
   // Templated method for disk I/O with cereal. This method tells cereal which
   // data members should be used when reading/writing to/from disk.
@@ -68,11 +81,14 @@ struct ImagePairMatch {
   template <class Archive>
   void serialize(Archive& ar, const std::uint32_t version) {  // NOLINT
     ar(image1, image2, twoview_info, correspondences);
+    if (version > 0) {
+      ar(feature_indices);
+    }
   }
 };
 
 }  // namespace theia
 
-CEREAL_CLASS_VERSION(theia::ImagePairMatch, 0);
+CEREAL_CLASS_VERSION(theia::ImagePairMatch, 1);
 
 #endif  // THEIA_MATCHING_IMAGE_PAIR_MATCH_H_
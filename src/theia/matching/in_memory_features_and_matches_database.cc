@@ -43,9 +43,13 @@
 #include <fstream>  // NOLINT
 #include <glog/logging.h>
 #include <iostream>  // NOLINT
+#include <memory>
 #include <mutex>     // NOLINT
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "theia/matching/compact_image_pair_match.h"
 #include "theia/matching/image_pair_match.h"
 #include "theia/matching/keypoints_and_descriptors.h"
 #include "theia/util/map_util.h"
@@ -93,13 +97,24 @@ bool InMemoryFeaturesAndMatchesDatabase::ContainsFeatures(
 // Get/set the features for the image.
 KeypointsAndDescriptors InMemoryFeaturesAndMatchesDatabase::GetFeatures(
     const std::string& image_name) {
+  return *FindOrDie(features_, image_name);
+}
+
+std::shared_ptr<const KeypointsAndDescriptors>
+InMemoryFeaturesAndMatchesDatabase::GetFeaturesShared(
+    const std::string& image_name) {
   return FindOrDie(features_, image_name);
 }
 
 // Set the features for the image.
 void InMemoryFeaturesAndMatchesDatabase::PutFeatures(
     const std::string& image_name, const KeypointsAndDescriptors& features) {
-  features_[image_name] = features;
+  // The matches of the image refer to its previous features by their index.
+  if (ContainsFeatures(image_name)) {
+    RemoveMatchesOfImage(image_name);
+  }
+  features_[image_name] =
+      std::make_shared<const KeypointsAndDescriptors>(features);
 }
 
 std::vector<std::string>
@@ -116,10 +131,56 @@ size_t InMemoryFeaturesAndMatchesDatabase::NumImages() {
   return features_.size();
 }
 
+uint32_t InMemoryFeaturesAndMatchesDatabase::GetOrAddImageId(
+    const std::string& image_name) {
+  const auto it = image_ids_.emplace(image_name, image_names_.size());
+  if (it.second) {
+    image_names_.emplace_back(image_name);
+  }
+  return it.first->second;
+}
+
+void InMemoryFeaturesAndMatchesDatabase::RemoveMatchesOfImage(
+    const std::string& image_name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  matched_images_.erase(image_name);
+  const auto image_id = image_ids_.find(image_name);
+  if (image_id == image_ids_.end()) {
+    return;
+  }
+  for (auto it = matches_.begin(); it != matches_.end();) {
+    if (it->first.first == image_id->second ||
+        it->first.second == image_id->second) {
+      it = matches_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
 // Get the image pair match for the images.
 ImagePairMatch InMemoryFeaturesAndMatchesDatabase::GetImagePairMatch(
     const std::string& image_name1, const std::string& image_name2) {
-  return FindOrDieNoPrint(matches_, std::make_pair(image_name1, image_name2));
+  CompactImagePairMatch compact_matches;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const std::pair<uint32_t, uint32_t> image_ids(
+        FindOrDie(image_ids_, image_name1), FindOrDie(image_ids_, image_name2));
+    compact_matches = FindOrDieNoPrint(matches_, image_ids);
+  }
+
+  // Look up the coordinates of the correspondences if they are stored as
+  // feature indices.
+  std::shared_ptr<const KeypointsAndDescriptors> features1, features2;
+  if (!compact_matches.feature_indices.empty()) {
+    features1 = GetFeaturesShared(image_name1);
+    features2 = GetFeaturesShared(image_name2);
+  }
+  return ExpandCompactImagePairMatch(image_name1,
+                                     image_name2,
+                                     compact_matches,
+                                     features1.get(),
+                                     features2.get());
 }
 
 // Set the image pair match for the images.
@@ -127,16 +188,26 @@ void InMemoryFeaturesAndMatchesDatabase::PutImagePairMatch(
     const std::string& image_name1,
     const std::string& image_name2,
     const ImagePairMatch& matches) {
+  const bool store_feature_indices = HasFeatureIndices(matches) &&
+                                     ContainsFeatures(image_name1) &&
+                                     ContainsFeatures(image_name2);
+  CompactImagePairMatch compact_matches =
+      MakeCompactImagePairMatch(matches, store_feature_indices);
+
   std::lock_guard<std::mutex> lock(mutex_);
-  matches_[std::make_pair(image_name1, image_name2)] = matches;
+  const std::pair<uint32_t, uint32_t> image_ids(GetOrAddImageId(image_name1),
+                                                GetOrAddImageId(image_name2));
+  matches_[image_ids] = std::move(compact_matches);
 }
 
 std::vector<std::pair<std::string, std::string>>
 InMemoryFeaturesAndMatchesDatabase::ImageNamesOfMatches() {
+  std::lock_guard<std::mutex> lock(mutex_);
   std::vector<std::pair<std::string, std::string>> match_keys;
   match_keys.reserve(matches_.size());
   for (const auto& match : matches_) {
-    match_keys.push_back(match.first);
+    match_keys.emplace_back(image_names_[match.first.first],
+                            image_names_[match.first.second]);
   }
   return match_keys;
 }
@@ -145,6 +216,19 @@ size_t InMemoryFeaturesAndMatchesDatabase::NumMatches() {
   return matches_.size();
 }
 
+void InMemoryFeaturesAndMatchesDatabase::PutMatchedImage(
+    const std::string& image_name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  matched_images_.emplace(image_name);
+}
+
+std::vector<std::string>
+InMemoryFeaturesAndMatchesDatabase::ImageNamesOfMatchedImages() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::vector<std::string>(matched_images_.begin(),
+                                  matched_images_.end());
+}
+
 bool InMemoryFeaturesAndMatchesDatabase::ReadFromFile(
     const std::string& filepath) {
   // Return false if the file cannot be opened.
@@ -167,7 +251,9 @@ bool InMemoryFeaturesAndMatchesDatabase::ReadFromFile(
 
   matches_.reserve(matches.size());
   for (const auto& match : matches) {
-    matches_[std::make_pair(match.image1, match.image2)] = match;
+    PutImagePairMatch(match.image1, match.image2, match);
+    PutMatchedImage(match.image1);
+    PutMatchedImage(match.image2);
   }
 
   intrinsics_priors_.reserve(camera_intrinsics_prior.size());
@@ -190,8 +276,9 @@ bool InMemoryFeaturesAndMatchesDatabase::WriteToFile(
   // Make sure that Cereal is able to finish executing before returning.
   std::vector<ImagePairMatch> matches;
   matches.reserve(matches_.size());
-  for (const auto& match : matches_) {
-    matches.push_back(match.second);
+  for (const auto& match_key : ImageNamesOfMatches()) {
+    matches.emplace_back(
+        GetImagePairMatch(match_key.first, match_key.second));
   }
 
   std::vector<std::string> view_names;
@@ -211,7 +298,9 @@ bool InMemoryFeaturesAndMatchesDatabase::WriteToFile(
 }
 
 void InMemoryFeaturesAndMatchesDatabase::RemoveAllMatches() {
+  std::lock_guard<std::mutex> lock(mutex_);
   matches_.clear();
+  matched_images_.clear();
 }
 
 }  // namespace theia
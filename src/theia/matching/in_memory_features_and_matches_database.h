@@ -35,13 +35,18 @@
 #ifndef THEIA_MATCHING_IN_MEMORY_FEATURES_AND_MATCHES_DATABASE_H_
 #define THEIA_MATCHING_IN_MEMORY_FEATURES_AND_MATCHES_DATABASE_H_
 
+#include <stdint.h>
+#include <memory>
 #include <mutex>  // NOLINT
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "theia/io/read_keypoints_and_descriptors.h"
 #include "theia/io/write_keypoints_and_descriptors.h"
+#include "theia/matching/compact_image_pair_match.h"
 #include "theia/matching/features_and_matches_database.h"
 #include "theia/matching/image_pair_match.h"
 #include "theia/matching/keypoints_and_descriptors.h"
@@ -52,6 +57,9 @@
 namespace theia {
 
 // A simple implementation for storing features and feature matches in memory.
+// The matches are held in their compact form (see CompactImagePairMatch) and
+// are keyed by ids that are assigned to the image names, so the names are only
+// stored once no matter how many matches an image has.
 class InMemoryFeaturesAndMatchesDatabase : public FeaturesAndMatchesDatabase {
  public:
   InMemoryFeaturesAndMatchesDatabase() = default;
@@ -76,8 +84,12 @@ class InMemoryFeaturesAndMatchesDatabase : public FeaturesAndMatchesDatabase {
 
   // Get/set the features for the image.
   KeypointsAndDescriptors GetFeatures(const std::string& image_name) override;
+  std::shared_ptr<const KeypointsAndDescriptors> GetFeaturesShared(
+      const std::string& image_name) override;
 
-  // Set the features for the image.
+  // Set the features for the image. If the image already has features, its
+  // matches are removed since their feature indices refer to the previous
+  // features.
   void PutFeatures(const std::string& image_name,
                    const KeypointsAndDescriptors& features) override;
 
@@ -90,7 +102,9 @@ class InMemoryFeaturesAndMatchesDatabase : public FeaturesAndMatchesDatabase {
   ImagePairMatch GetImagePairMatch(const std::string& image_name1,
                                    const std::string& image_name2) override;
 
-  // Set the image pair match for the images.
+  // Set the image pair match for the images. The correspondences are stored as
+  // feature indices if the match has them and the features of both images are
+  // in the database.
   void PutImagePairMatch(const std::string& image_name1,
                          const std::string& image_name2,
                          const ImagePairMatch& matches) override;
@@ -99,6 +113,11 @@ class InMemoryFeaturesAndMatchesDatabase : public FeaturesAndMatchesDatabase {
       override;
   size_t NumMatches() override;
 
+  void PutMatchedImage(const std::string& image_name) override;
+  std::vector<std::string> ImageNamesOfMatchedImages() override;
+
+  // The matched images are not written to the file. When the matches are read,
+  // the images of the matches are recorded as matched.
   bool ReadFromFile(const std::string& filepath);
   bool WriteToFile(const std::string& filepath);
 
@@ -109,9 +128,24 @@ class InMemoryFeaturesAndMatchesDatabase : public FeaturesAndMatchesDatabase {
 
   std::mutex mutex_;
   std::unordered_map<std::string, CameraIntrinsicsPrior> intrinsics_priors_;
-  std::unordered_map<std::string, KeypointsAndDescriptors> features_;
-  std::unordered_map<std::pair<std::string, std::string>, ImagePairMatch>
+  // The features are held by shared pointers so that they can be handed out
+  // without copying them.
+  std::unordered_map<std::string,
+                     std::shared_ptr<const KeypointsAndDescriptors>>
+      features_;
+
+  // Returns the id of the image name, assigning a new id if needed. The mutex
+  // must be held by the caller.
+  uint32_t GetOrAddImageId(const std::string& image_name);
+
+  // Removes all matches that contain the image and its matched record.
+  void RemoveMatchesOfImage(const std::string& image_name);
+
+  std::unordered_map<std::string, uint32_t> image_ids_;
+  std::vector<std::string> image_names_;
+  std::unordered_map<std::pair<uint32_t, uint32_t>, CompactImagePairMatch>
       matches_;
+  std::unordered_set<std::string> matched_images_;
 };
 }  // namespace theia
 #endif  // THEIA_MATCHING_IN_MEMORY_FEATURES_AND_MATCHES_DATABASE_H_
@@ -0,0 +1,232 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/kd_tree_feature_matcher.h"
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "flann/flann.hpp"
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/descriptor_quantization.h"
+#include "theia/matching/feature_matcher.h"
+#include "theia/matching/feature_matcher_utils.h"
+#include "theia/matching/features_and_matches_database.h"
+#include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/util/concurrent_lru_cache.h"
+
+namespace theia {
+
+class KdTreeFeatureMatcher::KdTreeImage {
+ public:
+  // Builds a forest of num_trees randomized kd-trees over the descriptors.
+  KdTreeImage(DescriptorMatrix descriptors, const int num_trees)
+      : descriptors_(std::move(descriptors)) {
+    if (descriptors_.rows() == 0) {
+      return;
+    }
+
+    // NOTE: FLANN does not copy the descriptors, so they are owned by this
+    // object for the lifetime of the index.
+    const flann::Matrix<float> flann_descriptors(
+        descriptors_.data(), descriptors_.rows(), descriptors_.cols());
+    index_.reset(new flann::Index<flann::L2<float> >(
+        flann_descriptors, flann::KDTreeIndexParams(num_trees)));
+    index_->buildIndex();
+  }
+
+  const DescriptorMatrix& descriptors() const { return descriptors_; }
+
+  // Returns the kd-forest, or nullptr if the image has no descriptors.
+  const flann::Index<flann::L2<float> >* index() const { return index_.get(); }
+
+  // Returns an estimate of the memory used by the descriptors and the forest.
+  size_t SizeInBytes() const {
+    return sizeof(*this) + descriptors_.size() * sizeof(float) +
+           (index_ ? index_->usedMemory() : 0);
+  }
+
+ private:
+  DescriptorMatrix descriptors_;
+  std::unique_ptr<flann::Index<flann::L2<float> > > index_;
+};
+
+KdTreeFeatureMatcher::KdTreeFeatureMatcher(
+    const FeatureMatcherOptions& options,
+    FeaturesAndMatchesDatabase* features_and_matches_database)
+    : FeatureMatcher(options, features_and_matches_database) {
+  CHECK_GT(options.kd_tree_num_trees, 0);
+  CHECK_GT(options.kd_tree_max_num_checks, 0);
+
+  // Initialize the cache.
+  const std::function<std::shared_ptr<KdTreeImage>(const std::string&)>
+      fetch_kd_tree_images = std::bind(&KdTreeFeatureMatcher::FetchKdTreeImage,
+                                       this,
+                                       std::placeholders::_1);
+  if (options.max_cache_size_in_bytes > 0) {
+    const std::function<size_t(const std::shared_ptr<KdTreeImage>&)>
+        kd_tree_image_size = [](const std::shared_ptr<KdTreeImage>& image) {
+          return image->SizeInBytes();
+        };
+    kd_tree_images_.reset(
+        new KdTreeImageCache(fetch_kd_tree_images,
+                             kd_tree_image_size,
+                             options.max_cache_size_in_bytes));
+  } else {
+    static constexpr int kNumImagesInCache = 256;
+    kd_tree_images_.reset(
+        new KdTreeImageCache(fetch_kd_tree_images, kNumImagesInCache));
+  }
+}
+
+KdTreeFeatureMatcher::~KdTreeFeatureMatcher() {}
+
+std::shared_ptr<KdTreeFeatureMatcher::KdTreeImage>
+KdTreeFeatureMatcher::FetchKdTreeImage(const std::string& image_name) {
+  const std::shared_ptr<const KeypointsAndDescriptors> features_handle =
+      this->feature_and_matches_db_->GetFeaturesShared(image_name);
+  const KeypointsAndDescriptors& features = *features_handle;
+  CHECK(!features.HasBinaryDescriptors())
+      << "KD_TREE matching can only be used with float descriptors. Please "
+         "use BRUTE_FORCE or MULTI_INDEX_HASHING for binary descriptors.";
+
+  DescriptorMatrix descriptors;
+  if (features.HasQuantizedDescriptors()) {
+    DequantizeDescriptors(features.quantized_descriptors, &descriptors);
+  } else {
+    descriptors = features.descriptors;
+  }
+  return std::make_shared<KdTreeImage>(std::move(descriptors),
+                                       this->options_.kd_tree_num_trees);
+}
+
+void KdTreeFeatureMatcher::PrefetchImage(const std::string& image_name) {
+  kd_tree_images_->Fetch(image_name);
+}
+
+void KdTreeFeatureMatcher::ComputeOneWayMatches(
+    const KdTreeImage& image1,
+    const KdTreeImage& image2,
+    std::vector<IndexedFeatureMatch>* matches) const {
+  // The L2 distances returned by FLANN are squared, so the ratio is squared
+  // accordingly. No match passes the ratio test if there is only one
+  // candidate, as for brute force matching.
+  const bool use_lowes_ratio = this->options_.use_lowes_ratio;
+  const int num_nearest_neighbors =
+      std::min(2, static_cast<int>(image2.descriptors().rows()));
+  if (use_lowes_ratio && num_nearest_neighbors < 2) {
+    return;
+  }
+  const float sq_lowes_ratio =
+      this->options_.lowes_ratio * this->options_.lowes_ratio;
+
+  // FLANN takes a non-const pointer to the queries but does not modify them.
+  DescriptorMatrix& query_descriptors =
+      const_cast<DescriptorMatrix&>(image1.descriptors());
+  const flann::Matrix<float> flann_query_descriptors(query_descriptors.data(),
+                                                     query_descriptors.rows(),
+                                                     query_descriptors.cols());
+  std::vector<int> nn_indices(query_descriptors.rows() *
+                              num_nearest_neighbors);
+  std::vector<float> nn_distances(nn_indices.size());
+  flann::Matrix<int> flann_nn_indices(
+      nn_indices.data(), query_descriptors.rows(), num_nearest_neighbors);
+  flann::Matrix<float> flann_nn_distances(
+      nn_distances.data(), query_descriptors.rows(), num_nearest_neighbors);
+  image2.index()->knnSearch(
+      flann_query_descriptors,
+      flann_nn_indices,
+      flann_nn_distances,
+      num_nearest_neighbors,
+      flann::SearchParams(this->options_.kd_tree_max_num_checks));
+
+  matches->reserve(query_descriptors.rows());
+  for (int i = 0; i < query_descriptors.rows(); i++) {
+    const int* indices = flann_nn_indices[i];
+    const float* distances = flann_nn_distances[i];
+    // FLANN marks neighbors that were not found with a negative index.
+    if (indices[0] < 0) {
+      continue;
+    }
+    if (!use_lowes_ratio ||
+        (indices[1] >= 0 && distances[0] < sq_lowes_ratio * distances[1])) {
+      matches->emplace_back(i, indices[0], distances[0]);
+    }
+  }
+}
+
+bool KdTreeFeatureMatcher::MatchImagePair(
+    const KeypointsAndDescriptors& features1,
+    const KeypointsAndDescriptors& features2,
+    std::vector<IndexedFeatureMatch>* matches) {
+  // Get the kd-forests of each set of features.
+  const std::shared_ptr<KdTreeImage> kd_tree_image1 =
+      kd_tree_images_->Fetch(features1.image_name);
+  const std::shared_ptr<KdTreeImage> kd_tree_image2 =
+      kd_tree_images_->Fetch(features2.image_name);
+
+  // If no descriptors exist for either image, skip.
+  if (!kd_tree_image1->index() || !kd_tree_image2->index()) {
+    return false;
+  }
+  CHECK_EQ(kd_tree_image1->descriptors().cols(),
+           kd_tree_image2->descriptors().cols())
+      << "Cannot match descriptors of different dimensions.";
+
+  // Compute forward matches.
+  ComputeOneWayMatches(*kd_tree_image1, *kd_tree_image2, matches);
+  if (matches->size() < this->options_.min_num_feature_matches) {
+    return false;
+  }
+
+  // Compute the symmetric matches, if applicable.
+  if (this->options_.keep_only_symmetric_matches) {
+    std::vector<IndexedFeatureMatch> reverse_matches;
+    ComputeOneWayMatches(*kd_tree_image2, *kd_tree_image1, &reverse_matches);
+    IntersectMatches(reverse_matches, matches);
+  }
+
+  return matches->size() >= this->options_.min_num_feature_matches;
+}
+
+}  // namespace theia
@@ -0,0 +1,93 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_KD_TREE_FEATURE_MATCHER_H_
+#define THEIA_MATCHING_KD_TREE_FEATURE_MATCHER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "theia/matching/feature_matcher.h"
+#include "theia/matching/features_and_matches_database.h"
+#include "theia/util/concurrent_lru_cache.h"
+
+namespace theia {
+struct IndexedFeatureMatch;
+struct KeypointsAndDescriptors;
+
+// Performs approximate feature matching with a randomized kd-forest (FLANN).
+// The forest of each image is built once and kept in a cache, so that it is
+// reused by all the image pairs the image is matched in. The nearest neighbors
+// are searched by visiting at most kd_tree_max_num_checks leaves of the forest,
+// which trades off the accuracy of the matches for speed. This is most useful
+// for images with many features (e.g., FeatureDensity::DENSE), where brute
+// force matching is prohibitively slow. Only float descriptors may be matched;
+// quantized descriptors are converted to float when the forest is built.
+class KdTreeFeatureMatcher : public FeatureMatcher {
+ public:
+  KdTreeFeatureMatcher(
+      const FeatureMatcherOptions& options,
+      FeaturesAndMatchesDatabase* features_and_matches_database);
+  ~KdTreeFeatureMatcher();
+
+ private:
+  // The float descriptors of an image along with their kd-forest.
+  class KdTreeImage;
+
+  bool MatchImagePair(const KeypointsAndDescriptors& features1,
+                      const KeypointsAndDescriptors& features2,
+                      std::vector<IndexedFeatureMatch>* matches) override;
+
+  // Prefetches the kd-forest, which also loads the features of the image.
+  void PrefetchImage(const std::string& image_name) override;
+
+  // Method to build the kd-forest of an image and store it in a cache.
+  std::shared_ptr<KdTreeImage> FetchKdTreeImage(const std::string& image_name);
+
+  // Finds the nearest neighbor of each descriptor of image1 in image2.
+  void ComputeOneWayMatches(const KdTreeImage& image1,
+                            const KdTreeImage& image2,
+                            std::vector<IndexedFeatureMatch>* matches) const;
+
+  using KdTreeImageCache =
+      ConcurrentLRUCache<std::string, std::shared_ptr<KdTreeImage>>;
+  std::unique_ptr<KdTreeImageCache> kd_tree_images_;
+
+  DISALLOW_COPY_AND_ASSIGN(KdTreeFeatureMatcher);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_KD_TREE_FEATURE_MATCHER_H_
@@ -0,0 +1,261 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <Eigen/Core>
+#include <string>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_quantization.h"
+#include "theia/matching/feature_correspondence.h"
+#include "theia/matching/feature_matcher.h"
+#include "theia/matching/image_pair_match.h"
+#include "theia/matching/in_memory_features_and_matches_database.h"
+#include "theia/matching/kd_tree_feature_matcher.h"
+
+#include "gtest/gtest.h"
+
+namespace theia {
+
+namespace {
+
+static const int kNumSiftDescriptors = 2000;
+static const int kNumSiftDimensions = 128;
+
+// Sets up random unit norm descriptors with non-negative entries (like SIFT)
+// such that descriptor i of descriptors2 is a small perturbation of descriptor
+// i of descriptors1.
+void CreatePerturbedDescriptors(DescriptorMatrix* descriptors1,
+                                DescriptorMatrix* descriptors2) {
+  *descriptors1 =
+      DescriptorMatrix::Random(kNumSiftDescriptors, kNumSiftDimensions)
+          .cwiseAbs();
+  *descriptors2 =
+      *descriptors1 +
+      0.05 * DescriptorMatrix::Random(kNumSiftDescriptors, kNumSiftDimensions);
+  descriptors1->rowwise().normalize();
+  *descriptors2 = descriptors2->cwiseAbs();
+  descriptors2->rowwise().normalize();
+}
+
+FeatureMatcherOptions SymmetricMatchingOptions() {
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = true;
+  options.use_lowes_ratio = true;
+  options.perform_geometric_verification = false;
+  return options;
+}
+
+// Matches the two images and checks that nearly all of the perturbed copies
+// were found.
+void MatchAndCheckPerturbedDescriptors(const KeypointsAndDescriptors& features1,
+                                       const KeypointsAndDescriptors& features2,
+                                       const FeatureMatcherOptions& options) {
+  InMemoryFeaturesAndMatchesDatabase database;
+  database.PutFeatures("1", features1);
+  database.PutFeatures("2", features2);
+
+  KdTreeFeatureMatcher matcher(options, &database);
+  matcher.AddImage("1");
+  matcher.AddImage("2");
+  matcher.MatchImages();
+
+  // The kd-forest is approximate, but nearly all of the perturbed copies
+  // should be found.
+  ASSERT_EQ(database.NumMatches(), 1);
+  const ImagePairMatch match = database.GetImagePairMatch("1", "2");
+  EXPECT_GT(match.correspondences.size(), 0.9 * kNumSiftDescriptors);
+}
+
+}  // namespace
+
+TEST(KdTreeFeatureMatcherTest, FloatDescriptors) {
+  DescriptorMatrix descriptors1, descriptors2;
+  CreatePerturbedDescriptors(&descriptors1, &descriptors2);
+
+  KeypointsAndDescriptors features1, features2;
+  features1.image_name = "1";
+  features2.image_name = "2";
+  features1.descriptors = descriptors1;
+  features2.descriptors = descriptors2;
+  features1.keypoints.resize(kNumSiftDescriptors);
+  features2.keypoints.resize(kNumSiftDescriptors);
+
+  MatchAndCheckPerturbedDescriptors(
+      features1, features2, SymmetricMatchingOptions());
+}
+
+TEST(KdTreeFeatureMatcherTest, QuantizedDescriptors) {
+  DescriptorMatrix descriptors1, descriptors2;
+  CreatePerturbedDescriptors(&descriptors1, &descriptors2);
+
+  KeypointsAndDescriptors features1, features2;
+  features1.image_name = "1";
+  features2.image_name = "2";
+  QuantizeDescriptors(descriptors1, &features1.quantized_descriptors);
+  QuantizeDescriptors(descriptors2, &features2.quantized_descriptors);
+  features1.keypoints.resize(kNumSiftDescriptors);
+  features2.keypoints.resize(kNumSiftDescriptors);
+
+  MatchAndCheckPerturbedDescriptors(
+      features1, features2, SymmetricMatchingOptions());
+}
+
+TEST(KdTreeFeatureMatcherTest, RatioTest) {
+  static const int kNumDescriptorDimensions = 10;
+
+  // Set up descriptors.
+  KeypointsAndDescriptors features1, features2;
+  features1.image_name = "1";
+  features2.image_name = "2";
+  features1.descriptors.resize(1, kNumDescriptorDimensions);
+  features2.descriptors.resize(2, kNumDescriptorDimensions);
+  features1.descriptors.row(0).setConstant(1);
+  features1.descriptors.row(0).normalize();
+
+  // Set the two descriptors to be very close to each other so that they do not
+  // pass the ratio test.
+  features2.descriptors.row(0).setConstant(1);
+  features2.descriptors(0, 0) = 0.9;
+  features2.descriptors.row(0).normalize();
+  features2.descriptors.row(1).setConstant(1);
+  features2.descriptors(1, 0) = 0.89;
+  features2.descriptors.row(1).normalize();
+  features1.keypoints.resize(features1.descriptors.rows());
+  features2.keypoints.resize(features2.descriptors.rows());
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 1;
+  options.keep_only_symmetric_matches = false;
+  options.use_lowes_ratio = true;
+  options.perform_geometric_verification = false;
+
+  InMemoryFeaturesAndMatchesDatabase database;
+  database.PutFeatures("1", features1);
+  database.PutFeatures("2", features2);
+
+  KdTreeFeatureMatcher matcher(options, &database);
+  matcher.AddImage("1");
+  matcher.AddImage("2");
+  matcher.MatchImages();
+  EXPECT_EQ(database.NumMatches(), 0);
+
+  // Without the ratio test the closest descriptor is matched.
+  options.use_lowes_ratio = false;
+  KdTreeFeatureMatcher matcher_without_ratio(options, &database);
+  matcher_without_ratio.AddImage("1");
+  matcher_without_ratio.AddImage("2");
+  matcher_without_ratio.MatchImages();
+  ASSERT_EQ(database.NumMatches(), 1);
+  const ImagePairMatch match = database.GetImagePairMatch("1", "2");
+  ASSERT_EQ(match.correspondences.size(), 1);
+}
+
+TEST(KdTreeFeatureMatcherTest, SingleCandidate) {
+  static const int kNumDescriptors = 10;
+  static const int kNumDescriptorDimensions = 10;
+
+  // The second image has a single descriptor, so there is no second nearest
+  // neighbor for the ratio test.
+  KeypointsAndDescriptors features1, features2;
+  features1.image_name = "1";
+  features2.image_name = "2";
+  features1.descriptors =
+      DescriptorMatrix::Random(kNumDescriptors, kNumDescriptorDimensions);
+  features2.descriptors = features1.descriptors.topRows(1);
+  features1.keypoints.resize(features1.descriptors.rows());
+  features2.keypoints.resize(features2.descriptors.rows());
+
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 1;
+  options.keep_only_symmetric_matches = false;
+  options.use_lowes_ratio = true;
+  options.perform_geometric_verification = false;
+
+  InMemoryFeaturesAndMatchesDatabase database;
+  database.PutFeatures("1", features1);
+  database.PutFeatures("2", features2);
+
+  // The single candidate cannot pass the ratio test.
+  KdTreeFeatureMatcher matcher(options, &database);
+  matcher.AddImage("1");
+  matcher.AddImage("2");
+  matcher.MatchImages();
+  EXPECT_EQ(database.NumMatches(), 0);
+
+  // Without the ratio test every descriptor is matched to the candidate.
+  options.use_lowes_ratio = false;
+  KdTreeFeatureMatcher matcher_without_ratio(options, &database);
+  matcher_without_ratio.AddImage("1");
+  matcher_without_ratio.AddImage("2");
+  matcher_without_ratio.MatchImages();
+  ASSERT_EQ(database.NumMatches(), 1);
+  const ImagePairMatch match = database.GetImagePairMatch("1", "2");
+  EXPECT_EQ(match.correspondences.size(), kNumDescriptors);
+}
+
+// A memory budget that is smaller than a single kd-forest must still allow all
+// image pairs to be matched.
+TEST(KdTreeFeatureMatcherTest, CacheSizeInBytes) {
+  static const int kNumImages = 3;
+  static const int kNumDescriptors = 100;
+
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = false;
+  options.use_lowes_ratio = false;
+  options.perform_geometric_verification = false;
+  options.max_cache_size_in_bytes = 1;
+
+  InMemoryFeaturesAndMatchesDatabase database;
+  KdTreeFeatureMatcher matcher(options, &database);
+  for (int i = 0; i < kNumImages; i++) {
+    KeypointsAndDescriptors features;
+    features.image_name = std::to_string(i);
+    features.descriptors =
+        DescriptorMatrix::Random(kNumDescriptors, kNumSiftDimensions);
+    features.descriptors.rowwise().normalize();
+    features.keypoints.resize(kNumDescriptors);
+    database.PutFeatures(features.image_name, features);
+    matcher.AddImage(features.image_name);
+  }
+
+  matcher.MatchImages();
+
+  // Check that all image pairs were matched.
+  EXPECT_EQ(database.NumMatches(), kNumImages * (kNumImages - 1) / 2);
+}
+
+}  // namespace theia
@@ -36,19 +36,44 @@
 #define THEIA_MATCHING_KEYPOINTS_AND_DESCRIPTORS_H_
 
 #include <Eigen/Core>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/image/keypoint_detector/keypoint.h"
 
 namespace theia {
 
 // This struct is used by the internal cache to hold keypoints and descriptors
-// when the are retrieved from the cache.
+// when the are retrieved from the cache. The descriptors are stored as a single
+// contiguous matrix where row i is the descriptor of keypoints[i]. Features
+// hold either float descriptors, quantized float descriptors or bit-packed
+// binary descriptors, and the matrices of the other types are left empty.
 struct KeypointsAndDescriptors {
+  // Returns true if the features are described by binary descriptors.
+  bool HasBinaryDescriptors() const { return binary_descriptors.cols() > 0; }
+
+  // Returns true if the float descriptors are stored quantized to one byte per
+  // dimension (see descriptor_quantization.h).
+  bool HasQuantizedDescriptors() const {
+    return quantized_descriptors.cols() > 0;
+  }
+
+  // Returns an estimate of the memory used by the features.
+  size_t SizeInBytes() const {
+    return sizeof(*this) + image_name.capacity() +
+           keypoints.capacity() * sizeof(Keypoint) +
+           descriptors.size() * sizeof(float) +
+           binary_descriptors.size() * sizeof(uint8_t) +
+           quantized_descriptors.size() * sizeof(uint8_t);
+  }
+
   std::string image_name;
   std::vector<Keypoint> keypoints;
-  std::vector<Eigen::VectorXf> descriptors;
+  DescriptorMatrix descriptors;
+  BinaryDescriptorMatrix binary_descriptors;
+  QuantizedDescriptorMatrix quantized_descriptors;
 };
 
 }  // namespace theia
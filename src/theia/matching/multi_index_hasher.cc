@@ -0,0 +1,228 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/multi_index_hasher.h"
+
+#include <glog/logging.h>
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/matching/hamming_distance.h"
+#include "theia/matching/indexed_feature_match.h"
+
+namespace theia {
+
+// The keys are assembled from two bytes of the descriptors.
+static_assert(kMultiIndexSubstringBits == 16,
+              "The substrings must be 16 bits long.");
+
+MultiIndexHasher::MultiIndexHasher(const int search_radius)
+    : search_radius_(search_radius) {
+  CHECK(search_radius_ == 0 || search_radius_ == 1)
+      << "The search radius of the multi-index hasher must be 0 or 1.";
+}
+
+uint16_t MultiIndexHasher::GetSubstringKey(const uint8_t* descriptor,
+                                           const int num_bytes,
+                                           const int s) {
+  const int first_byte = 2 * s;
+  uint16_t key = descriptor[first_byte];
+  // The last substring may only contain a single byte.
+  if (first_byte + 1 < num_bytes) {
+    key |= static_cast<uint16_t>(descriptor[first_byte + 1]) << 8;
+  }
+  return key;
+}
+
+void MultiIndexHasher::LookupKey(const SubstringHashTable& hash_table,
+                                 const uint16_t key,
+                                 std::vector<int>* candidates) {
+  const int coarse_bucket = key >> 8;
+  const auto begin = hash_table.keys.begin() + hash_table.offsets[coarse_bucket];
+  const auto end =
+      hash_table.keys.begin() + hash_table.offsets[coarse_bucket + 1];
+  const auto range = std::equal_range(begin, end, key);
+  for (auto it = range.first; it != range.second; ++it) {
+    candidates->emplace_back(hash_table.ids[it - hash_table.keys.begin()]);
+  }
+}
+
+MultiIndexHashedImage MultiIndexHasher::CreateHashedDescriptors(
+    const BinaryDescriptorMatrix& descriptors) const {
+  const int num_bytes = descriptors.cols();
+  const int num_substrings =
+      (num_bytes * 8 + kMultiIndexSubstringBits - 1) / kMultiIndexSubstringBits;
+
+  MultiIndexHashedImage hashed_image;
+  hashed_image.num_descriptors = descriptors.rows();
+  hashed_image.hash_tables.resize(num_substrings);
+
+  std::vector<std::pair<uint16_t, int> > keys_and_ids(descriptors.rows());
+  for (int s = 0; s < num_substrings; s++) {
+    for (int i = 0; i < descriptors.rows(); i++) {
+      keys_and_ids[i] = std::make_pair(
+          GetSubstringKey(descriptors.row(i).data(), num_bytes, s), i);
+    }
+    std::sort(keys_and_ids.begin(), keys_and_ids.end());
+
+    SubstringHashTable& hash_table = hashed_image.hash_tables[s];
+    hash_table.keys.resize(keys_and_ids.size());
+    hash_table.ids.resize(keys_and_ids.size());
+    hash_table.offsets.assign(kMultiIndexNumCoarseBuckets + 1, 0);
+    for (int i = 0; i < keys_and_ids.size(); i++) {
+      hash_table.keys[i] = keys_and_ids[i].first;
+      hash_table.ids[i] = keys_and_ids[i].second;
+      ++hash_table.offsets[(keys_and_ids[i].first >> 8) + 1];
+    }
+
+    // Accumulate the bucket sizes into the offsets of the coarse buckets.
+    for (int b = 0; b < kMultiIndexNumCoarseBuckets; b++) {
+      hash_table.offsets[b + 1] += hash_table.offsets[b];
+    }
+  }
+  return hashed_image;
+}
+
+void MultiIndexHasher::MatchImages(
+    const MultiIndexHashedImage& hashed_image1,
+    const BinaryDescriptorMatrix& descriptors1,
+    const MultiIndexHashedImage& hashed_image2,
+    const BinaryDescriptorMatrix& descriptors2,
+    const double lowes_ratio,
+    std::vector<IndexedFeatureMatch>* matches) const {
+  if (descriptors1.rows() == 0 || descriptors2.rows() == 0) {
+    return;
+  }
+  CHECK_EQ(descriptors1.cols(), descriptors2.cols())
+      << "The binary descriptors must have the same size.";
+  const int num_bytes = descriptors2.cols();
+  const int num_bits = num_bytes * 8;
+
+  // Reserve space for the matches.
+  matches->reserve(
+      static_cast<int>(std::min(descriptors1.rows(), descriptors2.rows())));
+
+  // Preallocate the candidate descriptors containers and their distances to the
+  // query descriptor.
+  std::vector<int> candidate_descriptors;
+  candidate_descriptors.reserve(descriptors2.rows());
+  std::vector<int> unique_candidate_descriptors;
+  unique_candidate_descriptors.reserve(descriptors2.rows());
+  std::vector<int> candidate_hamming_distances(descriptors2.rows());
+
+  // A preallocated vector to determine if we have already used a particular
+  // feature for matching (i.e., prevents duplicates).
+  std::vector<bool> used_descriptor(descriptors2.rows(), false);
+  for (int i = 0; i < hashed_image1.NumDescriptors(); i++) {
+    candidate_descriptors.clear();
+    unique_candidate_descriptors.clear();
+    const uint8_t* query_descriptor = descriptors1.row(i).data();
+
+    // Accumulate all descriptors that are within the search radius of the
+    // query descriptor in any substring.
+    for (int s = 0; s < hashed_image2.hash_tables.size(); s++) {
+      const SubstringHashTable& hash_table = hashed_image2.hash_tables[s];
+      const uint16_t key = GetSubstringKey(query_descriptor, num_bytes, s);
+      LookupKey(hash_table, key, &candidate_descriptors);
+      if (search_radius_ == 0) {
+        continue;
+      }
+
+      // Probe all keys that differ from the query key in a single bit. The
+      // last substring may have fewer bits.
+      const int num_key_bits = std::min(kMultiIndexSubstringBits,
+                                        num_bits - s * kMultiIndexSubstringBits);
+      for (int b = 0; b < num_key_bits; b++) {
+        LookupKey(hash_table, key ^ (1 << b), &candidate_descriptors);
+      }
+    }
+
+    // Remove the duplicate candidates that were found in multiple substrings.
+    for (const int candidate_id : candidate_descriptors) {
+      if (used_descriptor[candidate_id]) {
+        continue;
+      }
+      used_descriptor[candidate_id] = true;
+      unique_candidate_descriptors.emplace_back(candidate_id);
+    }
+    for (const int candidate_id : unique_candidate_descriptors) {
+      used_descriptor[candidate_id] = false;
+    }
+
+    // The ratio test needs at least two candidates. This is rare for images
+    // with many features, so all descriptors are used as candidates instead.
+    if (unique_candidate_descriptors.size() < 2) {
+      unique_candidate_descriptors.resize(descriptors2.rows());
+      std::iota(unique_candidate_descriptors.begin(),
+                unique_candidate_descriptors.end(),
+                0);
+    }
+
+    // Compute the Hamming distances to all candidates and find the two nearest
+    // neighbors.
+    ComputeHammingDistances(query_descriptor,
+                            descriptors2.data(),
+                            num_bytes,
+                            unique_candidate_descriptors.data(),
+                            unique_candidate_descriptors.size(),
+                            candidate_hamming_distances.data());
+    int best_index = -1;
+    int best_distance = std::numeric_limits<int>::max();
+    int second_best_distance = std::numeric_limits<int>::max();
+    for (int j = 0; j < unique_candidate_descriptors.size(); j++) {
+      const int distance = candidate_hamming_distances[j];
+      if (distance < best_distance) {
+        second_best_distance = best_distance;
+        best_distance = distance;
+        best_index = unique_candidate_descriptors[j];
+      } else if (distance < second_best_distance) {
+        second_best_distance = distance;
+      }
+    }
+
+    // A ratio of 1.0 or higher disables the ratio test.
+    if (lowes_ratio < 1.0 &&
+        best_distance >= lowes_ratio * second_best_distance) {
+      continue;
+    }
+    matches->emplace_back(i, best_index, best_distance);
+  }
+}
+
+}  // namespace theia
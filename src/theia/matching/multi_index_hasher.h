@@ -0,0 +1,141 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_MULTI_INDEX_HASHER_H_
+#define THEIA_MATCHING_MULTI_INDEX_HASHER_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+
+namespace theia {
+
+struct IndexedFeatureMatch;
+
+// The number of bits of each substring that the binary descriptors are split
+// into.
+static const int kMultiIndexSubstringBits = 16;
+// The number of buckets of the coarse lookup table of each hash table. The
+// bucket of a key is given by its upper 8 bits.
+static const int kMultiIndexNumCoarseBuckets = 256;
+
+// The hash table of a single substring. The keys of all descriptors are sorted
+// and ids[i] is the index of the descriptor with key keys[i]. The keys with the
+// upper 8 bits equal to b are stored in [offsets[b], offsets[b + 1]).
+struct SubstringHashTable {
+  std::vector<uint16_t> keys;
+  std::vector<int> ids;
+  std::vector<int> offsets;
+};
+
+struct MultiIndexHashedImage {
+  MultiIndexHashedImage() : num_descriptors(0) {}
+
+  // The number of hashed descriptors.
+  int NumDescriptors() const { return num_descriptors; }
+
+  // Returns an estimate of the memory used by the hashed image.
+  size_t SizeInBytes() const {
+    size_t size_in_bytes =
+        sizeof(*this) + hash_tables.capacity() * sizeof(SubstringHashTable);
+    for (const SubstringHashTable& hash_table : hash_tables) {
+      size_in_bytes += hash_table.keys.capacity() * sizeof(uint16_t) +
+                       hash_table.ids.capacity() * sizeof(int) +
+                       hash_table.offsets.capacity() * sizeof(int);
+    }
+    return size_in_bytes;
+  }
+
+  int num_descriptors;
+
+  // One hash table for each substring of the descriptors.
+  std::vector<SubstringHashTable> hash_tables;
+};
+
+// This hasher finds approximate nearest neighbors of bit-packed binary
+// descriptors (e.g., AKAZE's M-LDB) with multi-index hashing. Each descriptor is
+// split into disjoint 16-bit substrings and every substring is indexed in its
+// own hash table. The candidate neighbors of a query descriptor are all
+// descriptors that are within the search radius of the query in at least one
+// substring, and only the Hamming distances to these candidates are computed.
+// By the pigeonhole principle, all descriptors within a Hamming distance of
+// (search_radius + 1) * num_substrings - 1 of the query are candidates.
+//
+// Implementation is based on the paper "Fast Search in Hamming Space with
+// Multi-Index Hashing" by Norouzi et al (CVPR 2012). When using this class we
+// ask that you please cite this paper.
+class MultiIndexHasher {
+ public:
+  // The search radius is the maximum Hamming distance between the substrings of
+  // the query and a candidate and must be 0 or 1. A radius of 1 finds all
+  // neighbors within twice the distance of radius 0, but requires 17 lookups
+  // per substring instead of one. For images with a few thousand features this
+  // is slower than computing all distances, so a radius of 0 is the default.
+  explicit MultiIndexHasher(const int search_radius = 0);
+
+  // Creates the hash tables for the binary descriptors of an image.
+  MultiIndexHashedImage CreateHashedDescriptors(
+      const BinaryDescriptorMatrix& descriptors) const;
+
+  // Matches the descriptors of the first image to the descriptors of the second
+  // image. The nearest and second nearest neighbors are found among the
+  // candidates of each query, so the matches and the ratio test are
+  // approximate. Queries with fewer than two candidates are matched against all
+  // descriptors. A ratio of 1.0 or higher disables the ratio test.
+  void MatchImages(const MultiIndexHashedImage& hashed_image1,
+                   const BinaryDescriptorMatrix& descriptors1,
+                   const MultiIndexHashedImage& hashed_image2,
+                   const BinaryDescriptorMatrix& descriptors2,
+                   const double lowes_ratio,
+                   std::vector<IndexedFeatureMatch>* matches) const;
+
+ private:
+  // Returns the key of substring s of the given descriptor.
+  static uint16_t GetSubstringKey(const uint8_t* descriptor,
+                                  const int num_bytes,
+                                  const int s);
+
+  // Appends the ids of all descriptors with the given key in the hash table to
+  // the candidates.
+  static void LookupKey(const SubstringHashTable& hash_table,
+                        const uint16_t key,
+                        std::vector<int>* candidates);
+
+  const int search_radius_;
+};
+
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_MULTI_INDEX_HASHER_H_
@@ -0,0 +1,141 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/multi_index_hashing_feature_matcher.h"
+
+#include <glog/logging.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "theia/matching/feature_matcher.h"
+#include "theia/matching/feature_matcher_utils.h"
+#include "theia/matching/features_and_matches_database.h"
+#include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/matching/multi_index_hasher.h"
+#include "theia/util/concurrent_lru_cache.h"
+
+namespace theia {
+
+MultiIndexHashingFeatureMatcher::MultiIndexHashingFeatureMatcher(
+    const FeatureMatcherOptions& options,
+    FeaturesAndMatchesDatabase* features_and_matches_database)
+    : FeatureMatcher(options, features_and_matches_database) {
+  // Initialize the cache.
+  const std::function<std::shared_ptr<MultiIndexHashedImage>(
+      const std::string&)>
+      fetch_hashed_images =
+          std::bind(&MultiIndexHashingFeatureMatcher::FetchHashedImage,
+                    this,
+                    std::placeholders::_1);
+  if (options.max_cache_size_in_bytes > 0) {
+    const std::function<size_t(const std::shared_ptr<MultiIndexHashedImage>&)>
+        hashed_image_size =
+            [](const std::shared_ptr<MultiIndexHashedImage>& image) {
+              return image->SizeInBytes();
+            };
+    hashed_images_.reset(new HashedImageCache(fetch_hashed_images,
+                                              hashed_image_size,
+                                              options.max_cache_size_in_bytes));
+  } else {
+    static constexpr int kNumImagesInCache = 256;
+    hashed_images_.reset(
+        new HashedImageCache(fetch_hashed_images, kNumImagesInCache));
+  }
+}
+
+MultiIndexHashingFeatureMatcher::~MultiIndexHashingFeatureMatcher() {}
+
+std::shared_ptr<MultiIndexHashedImage>
+MultiIndexHashingFeatureMatcher::FetchHashedImage(
+    const std::string& image_name) {
+  const std::shared_ptr<const KeypointsAndDescriptors> features_handle =
+      this->feature_and_matches_db_->GetFeaturesShared(image_name);
+  const KeypointsAndDescriptors& features = *features_handle;
+  CHECK(features.keypoints.empty() || features.HasBinaryDescriptors())
+      << "Multi-index hashing can only be used with binary descriptors. The "
+         "features of image "
+      << image_name << " have float descriptors.";
+  return std::make_shared<MultiIndexHashedImage>(
+      multi_index_hasher_.CreateHashedDescriptors(
+          features.binary_descriptors));
+}
+
+void MultiIndexHashingFeatureMatcher::PrefetchImage(
+    const std::string& image_name) {
+  hashed_images_->Fetch(image_name);
+}
+
+bool MultiIndexHashingFeatureMatcher::MatchImagePair(
+    const KeypointsAndDescriptors& features1,
+    const KeypointsAndDescriptors& features2,
+    std::vector<IndexedFeatureMatch>* matches) {
+  // Get pointers to the hashed images for each set of features.
+  auto hashed_features1 = hashed_images_->Fetch(features1.image_name);
+  auto hashed_features2 = hashed_images_->Fetch(features2.image_name);
+
+  // If no hashed features exist for either image, skip.
+  if (!hashed_features1 || !hashed_features2) {
+    return false;
+  }
+
+  // Match features between the images.
+  const double lowes_ratio =
+      (this->options_.use_lowes_ratio) ? this->options_.lowes_ratio : 1.0;
+  multi_index_hasher_.MatchImages(*hashed_features1,
+                                  features1.binary_descriptors,
+                                  *hashed_features2,
+                                  features2.binary_descriptors,
+                                  lowes_ratio,
+                                  matches);
+  // Only do symmetric matching if enough matches exist to begin with.
+  if (matches->size() >= this->options_.min_num_feature_matches &&
+      this->options_.keep_only_symmetric_matches) {
+    std::vector<IndexedFeatureMatch> backwards_matches;
+    multi_index_hasher_.MatchImages(*hashed_features2,
+                                    features2.binary_descriptors,
+                                    *hashed_features1,
+                                    features1.binary_descriptors,
+                                    lowes_ratio,
+                                    &backwards_matches);
+    IntersectMatches(backwards_matches, matches);
+  }
+
+  return matches->size() >= this->options_.min_num_feature_matches;
+}
+
+}  // namespace theia
@@ -0,0 +1,86 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_MULTI_INDEX_HASHING_FEATURE_MATCHER_H_
+#define THEIA_MATCHING_MULTI_INDEX_HASHING_FEATURE_MATCHER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "theia/matching/feature_matcher.h"
+#include "theia/matching/features_and_matches_database.h"
+#include "theia/matching/multi_index_hasher.h"
+#include "theia/util/concurrent_lru_cache.h"
+
+namespace theia {
+struct IndexedFeatureMatch;
+struct KeypointsAndDescriptors;
+
+// Performs features matching between two sets of binary features using
+// multi-index hashing. Only the Hamming distances to descriptors that share a
+// 16-bit substring with the query are computed, which is several times faster
+// than brute force matching. Matches whose descriptors differ in many bits may
+// be missed, so this matcher trades some recall for speed. This matcher can
+// only be used with binary features like BINARY_AKAZE.
+class MultiIndexHashingFeatureMatcher : public FeatureMatcher {
+ public:
+  MultiIndexHashingFeatureMatcher(
+      const FeatureMatcherOptions& options,
+      FeaturesAndMatchesDatabase* features_and_matches_database);
+  ~MultiIndexHashingFeatureMatcher();
+
+ private:
+  bool MatchImagePair(const KeypointsAndDescriptors& features1,
+                      const KeypointsAndDescriptors& features2,
+                      std::vector<IndexedFeatureMatch>* matches) override;
+
+  // Prefetches the hashed image, which also loads the features of the image.
+  void PrefetchImage(const std::string& image_name) override;
+
+  // Method to fetch hashed images and store them in a cache.
+  std::shared_ptr<MultiIndexHashedImage> FetchHashedImage(
+      const std::string& image_name);
+
+  using HashedImageCache =
+      ConcurrentLRUCache<std::string, std::shared_ptr<MultiIndexHashedImage>>;
+  std::unique_ptr<HashedImageCache> hashed_images_;
+  MultiIndexHasher multi_index_hasher_;
+
+  DISALLOW_COPY_AND_ASSIGN(MultiIndexHashingFeatureMatcher);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_MULTI_INDEX_HASHING_FEATURE_MATCHER_H_
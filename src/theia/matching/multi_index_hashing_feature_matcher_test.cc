@@ -0,0 +1,203 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "theia/matching/brute_force_feature_matcher.h"
+#include "theia/matching/feature_matcher.h"
+#include "theia/matching/image_pair_match.h"
+#include "theia/matching/in_memory_features_and_matches_database.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/matching/multi_index_hashing_feature_matcher.h"
+#include "theia/util/random.h"
+
+#include "gtest/gtest.h"
+
+namespace theia {
+
+namespace {
+
+// The size of the M-LDB descriptor in bytes.
+static const int kNumBytes = 61;
+
+RandomNumberGenerator rng(61);
+
+void SetRandomBinaryDescriptors(BinaryDescriptorMatrix* descriptors) {
+  for (int i = 0; i < descriptors->rows(); i++) {
+    for (int j = 0; j < descriptors->cols(); j++) {
+      (*descriptors)(i, j) = rng.RandInt(0, 255);
+    }
+  }
+}
+
+// Flips num_bits distinct random bits of the descriptor.
+void FlipRandomBits(const int num_bits,
+                    Eigen::Ref<BinaryDescriptorMatrix::RowXpr::PlainObject>
+                        descriptor) {
+  std::vector<int> bits(descriptor.size() * 8);
+  for (int i = 0; i < bits.size(); i++) {
+    bits[i] = i;
+  }
+  for (int i = 0; i < num_bits; i++) {
+    std::swap(bits[i], bits[rng.RandInt(i, bits.size() - 1)]);
+    descriptor[bits[i] / 8] ^= 1 << (bits[i] % 8);
+  }
+}
+
+// Returns the sorted matches between images "1" and "2" in the database. The
+// keypoint x-coordinates are set to the feature indices, so the matches can be
+// compared directly.
+std::vector<std::pair<int, int> > GetSortedMatchIndices(
+    InMemoryFeaturesAndMatchesDatabase* database) {
+  const ImagePairMatch match = database->GetImagePairMatch("1", "2");
+  std::vector<std::pair<int, int> > match_indices;
+  for (const FeatureCorrespondence& correspondence : match.correspondences) {
+    match_indices.emplace_back(static_cast<int>(correspondence.feature1.x()),
+                               static_cast<int>(correspondence.feature2.x()));
+  }
+  std::sort(match_indices.begin(), match_indices.end());
+  return match_indices;
+}
+
+}  // namespace
+
+TEST(MultiIndexHashingFeatureMatcherTest, IdenticalDescriptors) {
+  static const int kNumDescriptors = 10;
+
+  // Set up descriptors.
+  KeypointsAndDescriptors features1, features2;
+  features1.image_name = "1";
+  features2.image_name = "2";
+  features1.binary_descriptors.resize(kNumDescriptors, kNumBytes);
+  SetRandomBinaryDescriptors(&features1.binary_descriptors);
+  features2.binary_descriptors = features1.binary_descriptors;
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = true;
+  options.use_lowes_ratio = true;
+  options.perform_geometric_verification = false;
+
+  // Add features.
+  for (int i = 0; i < kNumDescriptors; i++) {
+    features1.keypoints.emplace_back(i, 0, Keypoint::AKAZE);
+    features2.keypoints.emplace_back(i, 0, Keypoint::AKAZE);
+  }
+  InMemoryFeaturesAndMatchesDatabase database;
+  database.PutFeatures("1", features1);
+  database.PutFeatures("2", features2);
+
+  MultiIndexHashingFeatureMatcher matcher(options, &database);
+  matcher.AddImage("1");
+  matcher.AddImage("2");
+
+  // Match features.
+  matcher.MatchImages();
+
+  // Check that each descriptor was matched to itself.
+  ASSERT_EQ(database.NumMatches(), 1);
+  const std::vector<std::pair<int, int> > matches =
+      GetSortedMatchIndices(&database);
+  ASSERT_EQ(matches.size(), kNumDescriptors);
+  for (int i = 0; i < kNumDescriptors; i++) {
+    EXPECT_EQ(matches[i], std::make_pair(i, i));
+  }
+}
+
+TEST(MultiIndexHashingFeatureMatcherTest, AgreesWithBruteForce) {
+  static const int kNumFeatures1 = 600;
+  static const int kNumFeatures2 = 700;
+  // All descriptors within a Hamming distance of 30 of the query are
+  // guaranteed to be candidates for the 31 substrings of the descriptors.
+  static const int kNumFlippedBits = 30;
+
+  KeypointsAndDescriptors features1, features2;
+  features1.image_name = "1";
+  features2.image_name = "2";
+  features1.binary_descriptors.resize(kNumFeatures1, kNumBytes);
+  features2.binary_descriptors.resize(kNumFeatures2, kNumBytes);
+  SetRandomBinaryDescriptors(&features1.binary_descriptors);
+  SetRandomBinaryDescriptors(&features2.binary_descriptors);
+  // Make a subset of the features in the second image close to features in the
+  // first image so that there are good matches.
+  for (int i = 0; i < kNumFeatures1; i += 2) {
+    BinaryDescriptorMatrix::RowXpr::PlainObject descriptor =
+        features1.binary_descriptors.row(i);
+    FlipRandomBits(kNumFlippedBits, descriptor);
+    features2.binary_descriptors.row(i) = descriptor;
+  }
+  for (int i = 0; i < kNumFeatures1; i++) {
+    features1.keypoints.emplace_back(i, 0, Keypoint::AKAZE);
+  }
+  for (int i = 0; i < kNumFeatures2; i++) {
+    features2.keypoints.emplace_back(i, 0, Keypoint::AKAZE);
+  }
+
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = true;
+  options.use_lowes_ratio = true;
+  options.perform_geometric_verification = false;
+
+  InMemoryFeaturesAndMatchesDatabase brute_force_database;
+  brute_force_database.PutFeatures("1", features1);
+  brute_force_database.PutFeatures("2", features2);
+  BruteForceFeatureMatcher brute_force_matcher(options, &brute_force_database);
+  brute_force_matcher.AddImage("1");
+  brute_force_matcher.AddImage("2");
+  brute_force_matcher.MatchImages();
+
+  InMemoryFeaturesAndMatchesDatabase hashing_database;
+  hashing_database.PutFeatures("1", features1);
+  hashing_database.PutFeatures("2", features2);
+  MultiIndexHashingFeatureMatcher hashing_matcher(options, &hashing_database);
+  hashing_matcher.AddImage("1");
+  hashing_matcher.AddImage("2");
+  hashing_matcher.MatchImages();
+
+  // The brute force matches are exactly the perturbed descriptors, and these
+  // must all be found through the hash tables.
+  const std::vector<std::pair<int, int> > expected_matches =
+      GetSortedMatchIndices(&brute_force_database);
+  const std::vector<std::pair<int, int> > matches =
+      GetSortedMatchIndices(&hashing_database);
+  EXPECT_EQ(expected_matches.size(), kNumFeatures1 / 2);
+  EXPECT_EQ(matches, expected_matches);
+}
+
+}  // namespace theia
@@ -0,0 +1,233 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/quantized_l2_distance.h"
+
+#include <glog/logging.h>
+#include <stdint.h>
+#include <cstddef>
+
+// The SIMD kernel is compiled with a function-level target attribute and
+// selected at runtime, so it is only available with GCC and Clang on x86-64.
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define THEIA_QUANTIZED_L2_DISTANCE_USE_AVX2
+#include <immintrin.h>
+#endif
+
+namespace theia {
+
+namespace {
+
+// Returns the descriptor that the i-th distance is computed for. If no indices
+// are given then the descriptors are used in order.
+inline const uint8_t* GetDescriptor(const uint8_t* descriptors,
+                                    const int num_dimensions,
+                                    const int* indices,
+                                    const int i) {
+  const int index = indices == nullptr ? i : indices[i];
+  return descriptors + static_cast<size_t>(index) * num_dimensions;
+}
+
+inline int SquaredL2DistanceScalar(const uint8_t* descriptor1,
+                                   const uint8_t* descriptor2,
+                                   const int num_dimensions) {
+  int distance = 0;
+  for (int j = 0; j < num_dimensions; j++) {
+    const int difference =
+        static_cast<int>(descriptor1[j]) - static_cast<int>(descriptor2[j]);
+    distance += difference * difference;
+  }
+  return distance;
+}
+
+void ComputeQuantizedSquaredL2DistancesScalar(const uint8_t* query_descriptor,
+                                              const uint8_t* descriptors,
+                                              const int num_dimensions,
+                                              const int* indices,
+                                              const int num_indices,
+                                              int* distances) {
+  for (int i = 0; i < num_indices; i++) {
+    distances[i] = SquaredL2DistanceScalar(
+        query_descriptor,
+        GetDescriptor(descriptors, num_dimensions, indices, i),
+        num_dimensions);
+  }
+}
+
+#ifdef THEIA_QUANTIZED_L2_DISTANCE_USE_AVX2
+// vpmaddubsw and vpdpbusd multiply unsigned bytes with signed bytes, which does
+// not fit the differences of two unsigned descriptors. Instead, 16 dimensions
+// at a time are zero-extended to 16 bits and the squared differences are summed
+// in pairs into 32-bit lanes with vpmaddwd. This is exact since a pair of
+// squared differences is at most 2 * 255^2.
+__attribute__((target("avx2")))
+void ComputeQuantizedSquaredL2DistancesAvx2(const uint8_t* query_descriptor,
+                                            const uint8_t* descriptors,
+                                            const int num_dimensions,
+                                            const int* indices,
+                                            const int num_indices,
+                                            int* distances) {
+  const int num_block_dimensions = num_dimensions - num_dimensions % 16;
+  for (int i = 0; i < num_indices; i++) {
+    const uint8_t* descriptor =
+        GetDescriptor(descriptors, num_dimensions, indices, i);
+    __m256i sums = _mm256_setzero_si256();
+    for (int j = 0; j < num_block_dimensions; j += 16) {
+      const __m256i query_block = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(query_descriptor + j)));
+      const __m256i descriptor_block = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(descriptor + j)));
+      const __m256i difference =
+          _mm256_sub_epi16(query_block, descriptor_block);
+      sums = _mm256_add_epi32(sums, _mm256_madd_epi16(difference, difference));
+    }
+
+    // Sum the eight 32-bit lanes.
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(sums),
+                                _mm256_extracti128_si256(sums, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    distances[i] =
+        _mm_cvtsi128_si32(sum) +
+        SquaredL2DistanceScalar(query_descriptor + num_block_dimensions,
+                                descriptor + num_block_dimensions,
+                                num_dimensions - num_block_dimensions);
+  }
+}
+#endif  // THEIA_QUANTIZED_L2_DISTANCE_USE_AVX2
+
+}  // namespace
+
+bool IsQuantizedL2InstructionSetSupported(
+    const QuantizedL2InstructionSet instruction_set) {
+  switch (instruction_set) {
+    case QuantizedL2InstructionSet::SCALAR:
+      return true;
+    case QuantizedL2InstructionSet::AVX2:
+#ifdef THEIA_QUANTIZED_L2_DISTANCE_USE_AVX2
+      return __builtin_cpu_supports("avx2");
+#else
+      return false;
+#endif
+    default:
+      return false;
+  }
+}
+
+QuantizedL2InstructionSet GetFastestQuantizedL2InstructionSet() {
+  // The CPU features cannot change while running, so they are only queried
+  // once.
+  static const QuantizedL2InstructionSet fastest_instruction_set =
+      IsQuantizedL2InstructionSetSupported(QuantizedL2InstructionSet::AVX2)
+          ? QuantizedL2InstructionSet::AVX2
+          : QuantizedL2InstructionSet::SCALAR;
+  return fastest_instruction_set;
+}
+
+int QuantizedSquaredL2Distance(const uint8_t* descriptor1,
+                               const uint8_t* descriptor2,
+                               const int num_dimensions) {
+  int distance;
+  ComputeQuantizedSquaredL2Distances(GetFastestQuantizedL2InstructionSet(),
+                                     descriptor1,
+                                     descriptor2,
+                                     num_dimensions,
+                                     nullptr,
+                                     1,
+                                     &distance);
+  return distance;
+}
+
+void ComputeQuantizedSquaredL2Distances(const uint8_t* query_descriptor,
+                                        const uint8_t* descriptors,
+                                        const int num_dimensions,
+                                        const int num_descriptors,
+                                        int* distances) {
+  ComputeQuantizedSquaredL2Distances(GetFastestQuantizedL2InstructionSet(),
+                                     query_descriptor,
+                                     descriptors,
+                                     num_dimensions,
+                                     nullptr,
+                                     num_descriptors,
+                                     distances);
+}
+
+void ComputeQuantizedSquaredL2Distances(const uint8_t* query_descriptor,
+                                        const uint8_t* descriptors,
+                                        const int num_dimensions,
+                                        const int* indices,
+                                        const int num_indices,
+                                        int* distances) {
+  ComputeQuantizedSquaredL2Distances(GetFastestQuantizedL2InstructionSet(),
+                                     query_descriptor,
+                                     descriptors,
+                                     num_dimensions,
+                                     indices,
+                                     num_indices,
+                                     distances);
+}
+
+void ComputeQuantizedSquaredL2Distances(
+    const QuantizedL2InstructionSet instruction_set,
+    const uint8_t* query_descriptor,
+    const uint8_t* descriptors,
+    const int num_dimensions,
+    const int* indices,
+    const int num_indices,
+    int* distances) {
+  DCHECK(IsQuantizedL2InstructionSetSupported(instruction_set));
+  switch (instruction_set) {
+#ifdef THEIA_QUANTIZED_L2_DISTANCE_USE_AVX2
+    case QuantizedL2InstructionSet::AVX2:
+      ComputeQuantizedSquaredL2DistancesAvx2(query_descriptor,
+                                             descriptors,
+                                             num_dimensions,
+                                             indices,
+                                             num_indices,
+                                             distances);
+      break;
+#endif
+    default:
+      ComputeQuantizedSquaredL2DistancesScalar(query_descriptor,
+                                               descriptors,
+                                               num_dimensions,
+                                               indices,
+                                               num_indices,
+                                               distances);
+      break;
+  }
+}
+
+}  // namespace theia
@@ -0,0 +1,99 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_QUANTIZED_L2_DISTANCE_H_
+#define THEIA_MATCHING_QUANTIZED_L2_DISTANCE_H_
+
+#include <stdint.h>
+
+namespace theia {
+
+// The instruction sets that may be used to compute squared L2 distances between
+// quantized (i.e., one byte per dimension) descriptors. The fastest instruction
+// set supported by the CPU is determined at runtime.
+enum class QuantizedL2InstructionSet {
+  SCALAR = 0,
+  AVX2 = 1,
+};
+
+// Returns the fastest instruction set for computing quantized L2 distances that
+// is supported by this CPU.
+QuantizedL2InstructionSet GetFastestQuantizedL2InstructionSet();
+
+// Returns true if the instruction set may be used on this CPU.
+bool IsQuantizedL2InstructionSetSupported(
+    const QuantizedL2InstructionSet instruction_set);
+
+// Computes the squared L2 distance between two quantized descriptors (e.g., a
+// row of a QuantizedDescriptorMatrix) with num_dimensions dimensions each. The
+// distance is computed exactly with integer arithmetic and is in units of the
+// quantization step squared.
+int QuantizedSquaredL2Distance(const uint8_t* descriptor1,
+                               const uint8_t* descriptor2,
+                               const int num_dimensions);
+
+// Computes the squared L2 distances between a quantized query descriptor and
+// num_descriptors quantized descriptors that are stored contiguously, i.e. in a
+// row-major QuantizedDescriptorMatrix with num_dimensions columns. The distance
+// to descriptor i is written to distances[i].
+void ComputeQuantizedSquaredL2Distances(const uint8_t* query_descriptor,
+                                        const uint8_t* descriptors,
+                                        const int num_dimensions,
+                                        const int num_descriptors,
+                                        int* distances);
+
+// Same as above, but only the distances to the descriptors indices[i] for each
+// of the num_indices indices are computed and written to distances[i].
+void ComputeQuantizedSquaredL2Distances(const uint8_t* query_descriptor,
+                                        const uint8_t* descriptors,
+                                        const int num_dimensions,
+                                        const int* indices,
+                                        const int num_indices,
+                                        int* distances);
+
+// Same as above, with the given instruction set instead of the fastest one
+// available. If indices is NULL then the distances to the first num_indices
+// descriptors are computed. This is mostly useful for testing.
+void ComputeQuantizedSquaredL2Distances(
+    const QuantizedL2InstructionSet instruction_set,
+    const uint8_t* query_descriptor,
+    const uint8_t* descriptors,
+    const int num_dimensions,
+    const int* indices,
+    const int num_indices,
+    int* distances);
+
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_QUANTIZED_L2_DISTANCE_H_
@@ -0,0 +1,157 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <glog/logging.h>
+#include <stdint.h>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "theia/matching/quantized_l2_distance.h"
+#include "theia/util/random.h"
+
+namespace theia {
+
+namespace {
+
+RandomNumberGenerator rng(59);
+
+int ReferenceSquaredL2Distance(const uint8_t* descriptor1,
+                               const uint8_t* descriptor2,
+                               const int num_dimensions) {
+  int distance = 0;
+  for (int i = 0; i < num_dimensions; i++) {
+    distance += (descriptor1[i] - descriptor2[i]) *
+                (descriptor1[i] - descriptor2[i]);
+  }
+  return distance;
+}
+
+void TestQuantizedL2Distances(
+    const QuantizedL2InstructionSet instruction_set) {
+  static const int kNumDescriptors = 50;
+  // Test dimensions that are not a multiple of the SIMD block size as well as
+  // the size of SIFT descriptors.
+  const std::vector<int> num_dimensions_to_test = { 1, 15, 16, 17, 128, 130 };
+  for (const int num_dimensions : num_dimensions_to_test) {
+    std::vector<uint8_t> descriptors(kNumDescriptors * num_dimensions);
+    for (int i = 0; i < descriptors.size(); i++) {
+      descriptors[i] = rng.RandInt(0, 255);
+    }
+    // Include the largest possible distance.
+    for (int i = 0; i < num_dimensions; i++) {
+      descriptors[i] = 0;
+      descriptors[num_dimensions + i] = 255;
+    }
+    const uint8_t* query_descriptor = descriptors.data();
+
+    // Distances to all descriptors in order.
+    std::vector<int> distances(kNumDescriptors);
+    ComputeQuantizedSquaredL2Distances(instruction_set,
+                                       query_descriptor,
+                                       descriptors.data(),
+                                       num_dimensions,
+                                       nullptr,
+                                       kNumDescriptors,
+                                       distances.data());
+    for (int i = 0; i < kNumDescriptors; i++) {
+      EXPECT_EQ(distances[i],
+                ReferenceSquaredL2Distance(
+                    query_descriptor,
+                    descriptors.data() + i * num_dimensions,
+                    num_dimensions));
+    }
+    EXPECT_EQ(distances[0], 0);
+    EXPECT_EQ(distances[1], num_dimensions * 255 * 255);
+
+    // Distances to a subset of the descriptors.
+    std::vector<int> indices = { 7, 3, 3, 42, 1 };
+    ComputeQuantizedSquaredL2Distances(instruction_set,
+                                       query_descriptor,
+                                       descriptors.data(),
+                                       num_dimensions,
+                                       indices.data(),
+                                       indices.size(),
+                                       distances.data());
+    for (int i = 0; i < indices.size(); i++) {
+      EXPECT_EQ(distances[i],
+                ReferenceSquaredL2Distance(
+                    query_descriptor,
+                    descriptors.data() + indices[i] * num_dimensions,
+                    num_dimensions));
+    }
+  }
+}
+
+}  // namespace
+
+TEST(QuantizedL2Distance, Scalar) {
+  TestQuantizedL2Distances(QuantizedL2InstructionSet::SCALAR);
+}
+
+TEST(QuantizedL2Distance, AVX2) {
+  if (!IsQuantizedL2InstructionSetSupported(QuantizedL2InstructionSet::AVX2)) {
+    LOG(INFO) << "AVX2 is not supported on this CPU. Skipping the test.";
+    return;
+  }
+  TestQuantizedL2Distances(QuantizedL2InstructionSet::AVX2);
+}
+
+TEST(QuantizedL2Distance, FastestInstructionSet) {
+  const uint8_t descriptor1[3] = { 10, 20, 30 };
+  const uint8_t descriptor2[3] = { 13, 16, 30 };
+  EXPECT_EQ(QuantizedSquaredL2Distance(descriptor1, descriptor2, 3), 25);
+}
+
+TEST(QuantizedL2Distance, ContiguousAndIndexedDescriptors) {
+  static const int kNumDescriptors = 3;
+  static const int kNumDimensions = 2;
+  const uint8_t query[kNumDimensions] = { 0, 0 };
+  const uint8_t descriptors[kNumDescriptors * kNumDimensions] = { 1, 0,
+                                                                  1, 2,
+                                                                  3, 4 };
+  int distances[kNumDescriptors];
+  ComputeQuantizedSquaredL2Distances(
+      query, descriptors, kNumDimensions, kNumDescriptors, distances);
+  EXPECT_EQ(distances[0], 1);
+  EXPECT_EQ(distances[1], 5);
+  EXPECT_EQ(distances[2], 25);
+
+  const int indices[2] = { 2, 0 };
+  ComputeQuantizedSquaredL2Distances(
+      query, descriptors, kNumDimensions, indices, 2, distances);
+  EXPECT_EQ(distances[0], 25);
+  EXPECT_EQ(distances[1], 1);
+}
+
+}  // namespace theia
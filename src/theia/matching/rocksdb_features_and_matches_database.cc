@@ -35,9 +35,12 @@
 #include "theia/matching/rocksdb_features_and_matches_database.h"
 
 #include <cstdlib>
+#include <functional>
 #include <glog/logging.h>
 #include <istream>
+#include <memory>
 #include <mutex>
+#include <sstream>
 #include <streambuf>
 #include <string>
 
@@ -49,7 +52,11 @@
 #include <rocksdb/db.h>
 #include <rocksdb/filter_policy.h>
 #include <rocksdb/table.h>
+#include <rocksdb/write_batch.h>
 
+#include "theia/io/eigen_serializable.h"
+#include "theia/matching/cascade_hasher.h"
+#include "theia/matching/compact_image_pair_match.h"
 #include "theia/matching/image_pair_match.h"
 #include "theia/matching/keypoints_and_descriptors.h"
 #include "theia/util/filesystem.h"
@@ -65,8 +72,36 @@ static const std::string kFeaturesColumnFamilyName =
 static const std::string kMatchesColumnFamilyName = "image_pair_matches";
 static const std::string kIntrinsicsColumnFamilyName =
     "camera_intrinsics_prior";
+static const std::string kCascadeHashesColumnFamilyName = "cascade_hashes";
+static const std::string kKeypointCoordinatesColumnFamilyName =
+    "keypoint_coordinates";
+static const std::string kMatchedImagesColumnFamilyName = "matched_images";
+static const std::string kMatchIndexColumnFamilyName = "image_pair_match_index";
 static const std::string kNamePairSeparator = "/";
 
+// The seed of the cascade hashing projections is stored with the hashed images
+// under a key that is not a valid image name.
+static const std::string kCascadeHashingSeedKey = "";
+
+// The version of the layout of the features and the matches. It is stored once
+// in the default column family under a key that is not a valid image name and
+// checked when the database is opened, so it must be incremented whenever the
+// layout of the stored values changes.
+static const std::string kLayoutVersionKey = "";
+static const uint32_t kLayoutVersion = 3;
+
+// The number of images whose deserialized features are kept in memory.
+static const int kNumImagesInFeaturesCache = 64;
+
+// The number of images whose keypoint coordinates are kept in memory to expand
+// the matches. The coordinates take 16 bytes per keypoint, so these are 256 MB
+// for images with 16k features.
+static const int kNumImagesInKeypointCoordinatesCache = 1024;
+
+// The keypoint coordinates are a fraction of the size of the features, so they
+// are given a small share of the memory budget of the caches.
+static const double kKeypointCoordinatesCacheMemoryFraction = 0.125;
+
 // For serialization using the Cereal library we must provide a stream for the
 // data. This struct allows for the results from RocksDB to be directly consumed
 // by Cereal without having to copy the data.
@@ -86,6 +121,16 @@ rocksdb::ColumnFamilyHandle* CreateColumnFamily(const rocksdb::Options& options,
   return temp_col_family_handle;
 }
 
+// Removes all key/values of the column family by dropping it and creating it
+// again.
+void ClearColumnFamily(const rocksdb::Options& options,
+                       const std::string& column_name,
+                       rocksdb::DB* database,
+                       std::unique_ptr<rocksdb::ColumnFamilyHandle>* handle) {
+  database->DropColumnFamily(handle->get());
+  handle->reset(CreateColumnFamily(options, column_name, database));
+}
+
 std::string ComposeImageNamePair(const std::string& image1,
                                  const std::string& image2) {
   return image1 + kNamePairSeparator + image2;
@@ -99,10 +144,57 @@ StringPair DecomposeImageNamePair(const std::string& image_pair) {
 }  // namespace
 
 RocksDbFeaturesAndMatchesDatabase::RocksDbFeaturesAndMatchesDatabase(
-    const std::string& directory)
+    const std::string& directory, const size_t max_cache_size_in_bytes)
     : directory_(directory) {
   AppendTrailingSlashIfNeeded(&directory_);
   InitializeRocksDB();
+
+  const std::function<std::shared_ptr<const KeypointsAndDescriptors>(
+      const std::string&)>
+      read_features =
+          std::bind(&RocksDbFeaturesAndMatchesDatabase::ReadFeatures,
+                    this,
+                    std::placeholders::_1);
+  const size_t max_keypoint_coordinates_cache_size_in_bytes =
+      static_cast<size_t>(kKeypointCoordinatesCacheMemoryFraction *
+                          max_cache_size_in_bytes);
+  if (max_cache_size_in_bytes > 0) {
+    const std::function<size_t(
+        const std::shared_ptr<const KeypointsAndDescriptors>&)>
+        features_size =
+            [](const std::shared_ptr<const KeypointsAndDescriptors>& features) {
+              return features->SizeInBytes();
+            };
+    features_cache_.reset(new FeaturesCache(
+        read_features,
+        features_size,
+        max_cache_size_in_bytes -
+            max_keypoint_coordinates_cache_size_in_bytes));
+  } else {
+    features_cache_.reset(
+        new FeaturesCache(read_features, kNumImagesInFeaturesCache));
+  }
+
+  const std::function<std::shared_ptr<const KeypointCoordinates>(
+      const std::string&)>
+      read_keypoint_coordinates = std::bind(
+          &RocksDbFeaturesAndMatchesDatabase::ReadKeypointCoordinates,
+          this,
+          std::placeholders::_1);
+  const std::function<size_t(const std::shared_ptr<const KeypointCoordinates>&)>
+      keypoint_coordinates_size =
+          [](const std::shared_ptr<const KeypointCoordinates>& coordinates) {
+            return sizeof(*coordinates) + coordinates->size() * sizeof(double);
+          };
+  if (max_cache_size_in_bytes > 0) {
+    keypoint_coordinates_cache_.reset(new KeypointCoordinatesCache(
+        read_keypoint_coordinates,
+        keypoint_coordinates_size,
+        max_keypoint_coordinates_cache_size_in_bytes));
+  } else {
+    keypoint_coordinates_cache_.reset(new KeypointCoordinatesCache(
+        read_keypoint_coordinates, kNumImagesInKeypointCoordinatesCache));
+  }
 }
 
 void RocksDbFeaturesAndMatchesDatabase::InitializeRocksDB() {
@@ -182,9 +274,93 @@ void RocksDbFeaturesAndMatchesDatabase::InitializeRocksDB() {
         matches_handle_.reset(temp_col_family_handles[i]);
       } else if (existing_column_families[i] == kIntrinsicsColumnFamilyName) {
         intrinsics_prior_handle_.reset(temp_col_family_handles[i]);
+      } else if (existing_column_families[i] ==
+                 kCascadeHashesColumnFamilyName) {
+        cascade_hashes_handle_.reset(temp_col_family_handles[i]);
+      } else if (existing_column_families[i] ==
+                 kKeypointCoordinatesColumnFamilyName) {
+        keypoint_coordinates_handle_.reset(temp_col_family_handles[i]);
+      } else if (existing_column_families[i] ==
+                 kMatchedImagesColumnFamilyName) {
+        matched_images_handle_.reset(temp_col_family_handles[i]);
+      } else if (existing_column_families[i] == kMatchIndexColumnFamilyName) {
+        match_index_handle_.reset(temp_col_family_handles[i]);
       }
     }
   }
+
+  // Databases that were created before the hashed images were stored do not
+  // have their column family yet.
+  if (!cascade_hashes_handle_) {
+    cascade_hashes_handle_.reset(CreateColumnFamily(
+        *options_, kCascadeHashesColumnFamilyName, database_.get()));
+  }
+  if (!keypoint_coordinates_handle_) {
+    keypoint_coordinates_handle_.reset(CreateColumnFamily(
+        *options_, kKeypointCoordinatesColumnFamilyName, database_.get()));
+  }
+  if (!matched_images_handle_) {
+    matched_images_handle_.reset(CreateColumnFamily(
+        *options_, kMatchedImagesColumnFamilyName, database_.get()));
+  }
+  if (!match_index_handle_) {
+    match_index_handle_.reset(CreateColumnFamily(
+        *options_, kMatchIndexColumnFamilyName, database_.get()));
+  }
+
+  // The features and everything derived from them are removed from databases
+  // that were written with a different layout, so that the features of their
+  // images are extracted and matched again. The intrinsics priors are kept.
+  uint32_t layout_version = 0;
+  std::string layout_version_value;
+  status = database_->Get(
+      rocksdb::ReadOptions(), kLayoutVersionKey, &layout_version_value);
+  if (status.ok()) {
+    std::istringstream ins(layout_version_value);
+    cereal::PortableBinaryInputArchive input_archive(ins);
+    input_archive(layout_version);
+  } else if (existing_column_families.empty()) {
+    layout_version = kLayoutVersion;
+  }
+  if (layout_version != kLayoutVersion) {
+    LOG(WARNING) << "The features and matches of the database at "
+                 << directory_ << " were written with layout version "
+                 << layout_version << " but version " << kLayoutVersion
+                 << " is required. They are removed and will be recomputed.";
+    ClearColumnFamily(*options_,
+                      kFeaturesColumnFamilyName,
+                      database_.get(),
+                      &features_handle_);
+    ClearColumnFamily(*options_,
+                      kKeypointCoordinatesColumnFamilyName,
+                      database_.get(),
+                      &keypoint_coordinates_handle_);
+    ClearColumnFamily(*options_,
+                      kMatchesColumnFamilyName,
+                      database_.get(),
+                      &matches_handle_);
+    ClearColumnFamily(*options_,
+                      kCascadeHashesColumnFamilyName,
+                      database_.get(),
+                      &cascade_hashes_handle_);
+    ClearColumnFamily(*options_,
+                      kMatchedImagesColumnFamilyName,
+                      database_.get(),
+                      &matched_images_handle_);
+    ClearColumnFamily(*options_,
+                      kMatchIndexColumnFamilyName,
+                      database_.get(),
+                      &match_index_handle_);
+  }
+  std::stringstream ss;
+  {
+    cereal::PortableBinaryOutputArchive output_archive(ss);
+    output_archive(kLayoutVersion);
+  }
+  status = database_->Put(rocksdb::WriteOptions(), kLayoutVersionKey, ss.str());
+  CHECK(status.ok()) << "Could not write the layout version of the database at "
+                     << directory_ << "\n"
+                     << status.ToString();
 }
 
 RocksDbFeaturesAndMatchesDatabase::~RocksDbFeaturesAndMatchesDatabase() {}
@@ -277,6 +453,18 @@ bool RocksDbFeaturesAndMatchesDatabase::ContainsFeatures(
 // Get/set the features for the image.
 KeypointsAndDescriptors RocksDbFeaturesAndMatchesDatabase::GetFeatures(
     const std::string& image_name) {
+  return *GetFeaturesShared(image_name);
+}
+
+std::shared_ptr<const KeypointsAndDescriptors>
+RocksDbFeaturesAndMatchesDatabase::GetFeaturesShared(
+    const std::string& image_name) {
+  return features_cache_->Fetch(image_name);
+}
+
+std::shared_ptr<const KeypointsAndDescriptors>
+RocksDbFeaturesAndMatchesDatabase::ReadFeatures(
+    const std::string& image_name) {
   rocksdb::ReadOptions options;
   const rocksdb::Slice key(image_name);
   rocksdb::PinnableSlice value;
@@ -290,31 +478,86 @@ KeypointsAndDescriptors RocksDbFeaturesAndMatchesDatabase::GetFeatures(
   std::istream ins(&buffer);
 
   // Load the keypoints and descriptors.
-  KeypointsAndDescriptors features;
+  std::shared_ptr<KeypointsAndDescriptors> features =
+      std::make_shared<KeypointsAndDescriptors>();
   {
     cereal::PortableBinaryInputArchive input_archive(ins);
-    input_archive(
-        features.image_name, features.keypoints, features.descriptors);
+    input_archive(features->image_name,
+                  features->keypoints,
+                  features->descriptors,
+                  features->binary_descriptors,
+                  features->quantized_descriptors);
   }
   return features;
 }
 
+std::shared_ptr<const KeypointCoordinates>
+RocksDbFeaturesAndMatchesDatabase::ReadKeypointCoordinates(
+    const std::string& image_name) {
+  rocksdb::ReadOptions options;
+  const rocksdb::Slice key(image_name);
+  rocksdb::PinnableSlice value;
+  const rocksdb::Status status =
+      database_->Get(options, keypoint_coordinates_handle_.get(), key, &value);
+
+  // Databases that were written before the keypoint coordinates were stored
+  // only hold the features, so the coordinates are taken from them.
+  if (status.IsNotFound()) {
+    return std::make_shared<const KeypointCoordinates>(
+        GetKeypointCoordinates(ReadFeatures(image_name)->keypoints));
+  }
+
+  // Create a stream wrapped around the rocksdb value.
+  ZeroCopyBuffer buffer(value.data(), value.size());
+  std::istream ins(&buffer);
+
+  std::shared_ptr<KeypointCoordinates> keypoint_coordinates =
+      std::make_shared<KeypointCoordinates>();
+  {
+    cereal::PortableBinaryInputArchive input_archive(ins);
+    input_archive(*keypoint_coordinates);
+  }
+  return keypoint_coordinates;
+}
+
 // Set the features for the image.
 void RocksDbFeaturesAndMatchesDatabase::PutFeatures(
     const std::string& image_name, const KeypointsAndDescriptors& features) {
   std::stringstream ss;
   {
     cereal::PortableBinaryOutputArchive output_archive(ss);
-    output_archive(
-        features.image_name, features.keypoints, features.descriptors);
+    output_archive(features.image_name,
+                   features.keypoints,
+                   features.descriptors,
+                   features.binary_descriptors,
+                   features.quantized_descriptors);
+  }
+  std::stringstream keypoint_coordinates_ss;
+  {
+    cereal::PortableBinaryOutputArchive output_archive(keypoint_coordinates_ss);
+    output_archive(GetKeypointCoordinates(features.keypoints));
   }
 
-  rocksdb::WriteOptions options;
+  // The features and the keypoint coordinates are written atomically, and the
+  // hashed image, the matched record and the matches of the previous features
+  // are removed since the matches refer to the features by their index.
   const rocksdb::Slice key(image_name);
+  rocksdb::WriteBatch batch;
+  RemoveMatchesOfImage(image_name, &batch);
+  batch.Put(features_handle_.get(), key, ss.str());
+  batch.Put(keypoint_coordinates_handle_.get(),
+            key,
+            keypoint_coordinates_ss.str());
+  batch.Delete(cascade_hashes_handle_.get(), key);
+  batch.Delete(matched_images_handle_.get(), key);
   const rocksdb::Status status =
-      database_->Put(options, features_handle_.get(), key, ss.str());
+      database_->Write(rocksdb::WriteOptions(), &batch);
   CHECK(status.ok()) << "Could not insert features for " << image_name
                      << " into the database.";
+
+  // Remove any stale copy of the features from the caches.
+  features_cache_->Erase(image_name);
+  keypoint_coordinates_cache_->Erase(image_name);
 }
 
 std::vector<std::string>
@@ -355,13 +598,34 @@ ImagePairMatch RocksDbFeaturesAndMatchesDatabase::GetImagePairMatch(
   ZeroCopyBuffer buffer(value.data(), value.size());
   std::istream ins(&buffer);
 
-  // Load the keypoints and descriptors.
-  ImagePairMatch matches;
-  {
+  // Load the compact image pair match. A match that cannot be read is returned
+  // without correspondences.
+  CompactImagePairMatch compact_matches;
+  try {
     cereal::PortableBinaryInputArchive input_archive(ins);
-    input_archive(matches);
+    input_archive(compact_matches);
+  } catch (const cereal::Exception& e) {
+    LOG(ERROR) << "Could not read the image pair match for (" << image_name1
+               << ", " << image_name2 << "): " << e.what();
+    ImagePairMatch matches;
+    matches.image1 = image_name1;
+    matches.image2 = image_name2;
+    return matches;
+  }
+
+  // Look up the coordinates of the correspondences if they are stored as
+  // feature indices.
+  std::shared_ptr<const KeypointCoordinates> keypoint_coordinates1,
+      keypoint_coordinates2;
+  if (!compact_matches.feature_indices.empty()) {
+    keypoint_coordinates1 = keypoint_coordinates_cache_->Fetch(image_name1);
+    keypoint_coordinates2 = keypoint_coordinates_cache_->Fetch(image_name2);
   }
-  return matches;
+  return ExpandCompactImagePairMatch(image_name1,
+                                     image_name2,
+                                     compact_matches,
+                                     keypoint_coordinates1.get(),
+                                     keypoint_coordinates2.get());
 }
 
 // Set the image pair match for the images.
@@ -372,16 +636,30 @@ void RocksDbFeaturesAndMatchesDatabase::PutImagePairMatch(
   const std::string image_name_pair =
       ComposeImageNamePair(image_name1, image_name2);
 
+  // The correspondences are stored as feature indices if the features of both
+  // images are in the database.
+  const bool store_feature_indices = HasFeatureIndices(matches) &&
+                                     ContainsFeatures(image_name1) &&
+                                     ContainsFeatures(image_name2);
+  const CompactImagePairMatch compact_matches =
+      MakeCompactImagePairMatch(matches, store_feature_indices);
+
   std::stringstream ss;
   {
     cereal::PortableBinaryOutputArchive output_archive(ss);
-    output_archive(matches);
+    output_archive(compact_matches);
   }
 
-  rocksdb::WriteOptions options;
-  const rocksdb::Slice key(image_name_pair);
+  // The pair is indexed under both images so that the matches of an image can
+  // be found without iterating over all matches.
+  rocksdb::WriteBatch batch;
+  batch.Put(matches_handle_.get(), image_name_pair, ss.str());
+  batch.Put(match_index_handle_.get(), image_name_pair, "");
+  batch.Put(match_index_handle_.get(),
+            ComposeImageNamePair(image_name2, image_name1),
+            "");
   const rocksdb::Status status =
-      database_->Put(options, matches_handle_.get(), key, ss.str());
+      database_->Write(rocksdb::WriteOptions(), &batch);
   CHECK(status.ok());
 }
 
@@ -405,14 +683,143 @@ size_t RocksDbFeaturesAndMatchesDatabase::NumMatches() {
   return static_cast<size_t>(num_matches);
 }
 
+void RocksDbFeaturesAndMatchesDatabase::PutMatchedImage(
+    const std::string& image_name) {
+  const rocksdb::Slice key(image_name);
+  const rocksdb::Status status = database_->Put(
+      rocksdb::WriteOptions(), matched_images_handle_.get(), key, "");
+  CHECK(status.ok()) << "Could not insert the matched image " << image_name
+                     << " into the database.";
+}
+
+std::vector<std::string>
+RocksDbFeaturesAndMatchesDatabase::ImageNamesOfMatchedImages() {
+  std::vector<std::string> image_names;
+  std::unique_ptr<rocksdb::Iterator> it(database_->NewIterator(
+      rocksdb::ReadOptions(), matched_images_handle_.get()));
+  for (it->SeekToFirst(); it->Valid(); it->Next()) {
+    image_names.push_back(it->key().ToString());
+  }
+  return image_names;
+}
+
+void RocksDbFeaturesAndMatchesDatabase::RemoveMatchesOfImage(
+    const std::string& image_name, rocksdb::WriteBatch* batch) {
+  // The index keys of the image share its name as a prefix, so only the pairs
+  // that contain the image are visited.
+  const std::string prefix = image_name + kNamePairSeparator;
+  std::unique_ptr<rocksdb::Iterator> it(database_->NewIterator(
+      rocksdb::ReadOptions(), match_index_handle_.get()));
+  for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix);
+       it->Next()) {
+    const StringPair image_names = DecomposeImageNamePair(it->key().ToString());
+    const std::string reversed_pair =
+        ComposeImageNamePair(image_names.second, image_names.first);
+    // The match is stored in only one of the two orders.
+    batch->Delete(matches_handle_.get(), it->key());
+    batch->Delete(matches_handle_.get(), reversed_pair);
+    batch->Delete(match_index_handle_.get(), it->key());
+    batch->Delete(match_index_handle_.get(), reversed_pair);
+  }
+  CHECK(it->status().ok()) << "Could not read the matches of " << image_name
+                           << " from the database.";
+}
+
 void RocksDbFeaturesAndMatchesDatabase::RemoveAllMatches() {
-  // Drop the column family handle -- this deletes all key/values in the column
-  // family.
-  database_->DropColumnFamily(matches_handle_.get());
+  // The images are no longer matched either.
+  ClearColumnFamily(
+      *options_, kMatchesColumnFamilyName, database_.get(), &matches_handle_);
+  ClearColumnFamily(*options_,
+                    kMatchedImagesColumnFamilyName,
+                    database_.get(),
+                    &matched_images_handle_);
+  ClearColumnFamily(*options_,
+                    kMatchIndexColumnFamilyName,
+                    database_.get(),
+                    &match_index_handle_);
+}
+
+bool RocksDbFeaturesAndMatchesDatabase::GetCascadeHashingSeed(unsigned* seed) {
+  rocksdb::ReadOptions options;
+  const rocksdb::Slice key(kCascadeHashingSeedKey);
+  rocksdb::PinnableSlice value;
+  const rocksdb::Status status =
+      database_->Get(options, cascade_hashes_handle_.get(), key, &value);
+  if (!status.ok()) {
+    return false;
+  }
+
+  // Create a stream wrapped around the rocksdb value.
+  ZeroCopyBuffer buffer(value.data(), value.size());
+  std::istream ins(&buffer);
+  uint32_t stored_seed;
+  {
+    cereal::PortableBinaryInputArchive input_archive(ins);
+    input_archive(stored_seed);
+  }
+  *seed = stored_seed;
+  return true;
+}
+
+void RocksDbFeaturesAndMatchesDatabase::PutCascadeHashingSeed(
+    const unsigned seed) {
+  std::stringstream ss;
+  {
+    cereal::PortableBinaryOutputArchive output_archive(ss);
+    output_archive(static_cast<uint32_t>(seed));
+  }
+
+  rocksdb::WriteOptions options;
+  const rocksdb::Slice key(kCascadeHashingSeedKey);
+  const rocksdb::Status status =
+      database_->Put(options, cascade_hashes_handle_.get(), key, ss.str());
+  CHECK(status.ok());
+}
+
+bool RocksDbFeaturesAndMatchesDatabase::GetHashedImage(
+    const std::string& image_name,
+    const uint64_t projection_fingerprint,
+    HashedImage* hashed_image) {
+  rocksdb::ReadOptions options;
+  const rocksdb::Slice key(image_name);
+  rocksdb::PinnableSlice value;
+  const rocksdb::Status status =
+      database_->Get(options, cascade_hashes_handle_.get(), key, &value);
+  if (!status.ok()) {
+    return false;
+  }
 
-  // Add the column family back again.
-  matches_handle_.reset(
-      CreateColumnFamily(*options_, kMatchesColumnFamilyName, database_.get()));
+  // Create a stream wrapped around the rocksdb value.
+  ZeroCopyBuffer buffer(value.data(), value.size());
+  std::istream ins(&buffer);
+
+  // The hashed image is only read if it was created with the same projections.
+  cereal::PortableBinaryInputArchive input_archive(ins);
+  uint64_t stored_projection_fingerprint;
+  input_archive(stored_projection_fingerprint);
+  if (stored_projection_fingerprint != projection_fingerprint) {
+    return false;
+  }
+  input_archive(*hashed_image);
+  return true;
+}
+
+void RocksDbFeaturesAndMatchesDatabase::PutHashedImage(
+    const std::string& image_name,
+    const uint64_t projection_fingerprint,
+    const HashedImage& hashed_image) {
+  std::stringstream ss;
+  {
+    cereal::PortableBinaryOutputArchive output_archive(ss);
+    output_archive(projection_fingerprint, hashed_image);
+  }
+
+  rocksdb::WriteOptions options;
+  const rocksdb::Slice key(image_name);
+  const rocksdb::Status status =
+      database_->Put(options, cascade_hashes_handle_.get(), key, ss.str());
+  CHECK(status.ok()) << "Could not insert the hashed image of " << image_name
+                     << " into the database.";
 }
 
 }  // namespace theia
@@ -35,23 +35,26 @@
 #ifndef THEIA_MATCHING_ROCKSDB_FEATURES_AND_MATCHES_DATABASE_H_
 #define THEIA_MATCHING_ROCKSDB_FEATURES_AND_MATCHES_DATABASE_H_
 
+#include <memory>
 #include <mutex>  // NOLINT
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "theia/matching/compact_image_pair_match.h"
 #include "theia/matching/features_and_matches_database.h"
 #include "theia/matching/image_pair_match.h"
 #include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/util/concurrent_lru_cache.h"
 #include "theia/util/hash.h"
-#include "theia/util/lru_cache.h"
 #include "theia/util/util.h"
 
 namespace rocksdb {
 class ColumnFamilyHandle;
 class DB;
 struct Options;
+class WriteBatch;
 }  // namespace rocksdb
 
 namespace theia {
@@ -61,7 +64,16 @@ namespace theia {
 // matches are kept in memory. This class is guaranteed to be thread safe.
 class RocksDbFeaturesAndMatchesDatabase : public FeaturesAndMatchesDatabase {
  public:
-  explicit RocksDbFeaturesAndMatchesDatabase(const std::string& directory);
+  // The deserialized features and the keypoint coordinates of the most recently
+  // used images are cached. If max_cache_size_in_bytes is greater than 0 it is
+  // the memory budget of both caches, most of which is given to the features.
+  // Otherwise a fixed number of images are cached. If the
+  // database was written with a different layout of the stored values, its
+  // features and matches are removed when it is opened so that they are
+  // computed again.
+  explicit RocksDbFeaturesAndMatchesDatabase(
+      const std::string& directory,
+      const size_t max_cache_size_in_bytes = 0);
   ~RocksDbFeaturesAndMatchesDatabase();
 
   bool ContainsCameraIntrinsicsPrior(const std::string& image_name) override;
@@ -85,7 +97,16 @@ class RocksDbFeaturesAndMatchesDatabase : public FeaturesAndMatchesDatabase {
   // the database and false otherwise.
   KeypointsAndDescriptors GetFeatures(const std::string& image_name) override;
 
-  // Set the features for the image.
+  // Returns a shared handle to the features for the image. The most recently
+  // used features are kept deserialized in a cache so that they are not read
+  // from the database for each image pair that they are matched in.
+  std::shared_ptr<const KeypointsAndDescriptors> GetFeaturesShared(
+      const std::string& image_name) override;
+
+  // Set the features for the image. The coordinates of the keypoints are also
+  // stored on their own so that matches can be expanded without reading the
+  // descriptors. If the image already has features, its matches are removed
+  // since their feature indices refer to the previous features.
   void PutFeatures(const std::string& image_name,
                    const KeypointsAndDescriptors& features) override;
 
@@ -93,12 +114,17 @@ class RocksDbFeaturesAndMatchesDatabase : public FeaturesAndMatchesDatabase {
   std::vector<std::string> ImageNamesOfFeatures() override;
   size_t NumImages() override;
 
-  // Get the image pair match for the images.Returns true if the features exist
-  // in the database and false otherwise.
+  // Get the image pair match for the images. Correspondences that are stored
+  // as feature indices are looked up from the cached keypoint coordinates of
+  // the images, so the features of the images are not read. A match that
+  // cannot be read is logged and returned without correspondences.
   ImagePairMatch GetImagePairMatch(const std::string& image_name1,
                                    const std::string& image_name2) override;
 
-  // Set the image pair match for the images.
+  // Set the image pair match for the images. The match is stored in its compact
+  // form (see CompactImagePairMatch), with the correspondences stored as
+  // feature indices if the match has them and the features of both images are
+  // in the database.
   void PutImagePairMatch(const std::string& image_name1,
                          const std::string& image_name2,
                          const ImagePairMatch& matches) override;
@@ -107,19 +133,65 @@ class RocksDbFeaturesAndMatchesDatabase : public FeaturesAndMatchesDatabase {
       override;
   size_t NumMatches() override;
 
+  // The matched images are stored in their own column family.
+  void PutMatchedImage(const std::string& image_name) override;
+  std::vector<std::string> ImageNamesOfMatchedImages() override;
+
   void RemoveAllMatches() override;
 
+  // The seed and the hashed images of the cascade hashing matcher are stored
+  // in their own column family. The hashed image of an image is removed when
+  // its features are replaced.
+  bool GetCascadeHashingSeed(unsigned* seed) override;
+  void PutCascadeHashingSeed(const unsigned seed) override;
+  bool GetHashedImage(const std::string& image_name,
+                      const uint64_t projection_fingerprint,
+                      HashedImage* hashed_image) override;
+  void PutHashedImage(const std::string& image_name,
+                      const uint64_t projection_fingerprint,
+                      const HashedImage& hashed_image) override;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(RocksDbFeaturesAndMatchesDatabase);
 
   void InitializeRocksDB();
 
+  // Reads and deserializes the features for the image from the database. This
+  // is the cache miss function of the features cache.
+  std::shared_ptr<const KeypointsAndDescriptors> ReadFeatures(
+      const std::string& image_name);
+
+  // Reads the keypoint coordinates of the image from the database. This is the
+  // cache miss function of the keypoint coordinates cache.
+  std::shared_ptr<const KeypointCoordinates> ReadKeypointCoordinates(
+      const std::string& image_name);
+
+  // Adds the removal of all matches that contain the image to the batch.
+  void RemoveMatchesOfImage(const std::string& image_name,
+                            rocksdb::WriteBatch* batch);
+
   std::unique_ptr<rocksdb::Options> options_;
   std::string directory_;
   std::unique_ptr<rocksdb::DB> database_;
   std::unique_ptr<rocksdb::ColumnFamilyHandle> intrinsics_prior_handle_;
   std::unique_ptr<rocksdb::ColumnFamilyHandle> features_handle_;
+  std::unique_ptr<rocksdb::ColumnFamilyHandle> keypoint_coordinates_handle_;
   std::unique_ptr<rocksdb::ColumnFamilyHandle> matches_handle_;
+  std::unique_ptr<rocksdb::ColumnFamilyHandle> cascade_hashes_handle_;
+  std::unique_ptr<rocksdb::ColumnFamilyHandle> matched_images_handle_;
+  // The pairs of matched images under both orders of the image names, so that
+  // the keys of the matches of an image share the image name as a prefix.
+  std::unique_ptr<rocksdb::ColumnFamilyHandle> match_index_handle_;
+
+  using FeaturesCache = ConcurrentLRUCache<
+      std::string,
+      std::shared_ptr<const KeypointsAndDescriptors>>;
+  std::unique_ptr<FeaturesCache> features_cache_;
+
+  using KeypointCoordinatesCache =
+      ConcurrentLRUCache<std::string,
+                         std::shared_ptr<const KeypointCoordinates>>;
+  std::unique_ptr<KeypointCoordinatesCache> keypoint_coordinates_cache_;
 };
 }  // namespace theia
 #endif  // THEIA_MATCHING_LOCAL_FEATURES_AND_MATCHES_DATABASE_H_
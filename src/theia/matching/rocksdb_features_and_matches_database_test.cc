@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include <rocksdb/db.h>
+#include <memory>
 
+#include "theia/matching/feature_correspondence.h"
 #include "theia/matching/image_pair_match.h"
 #include "theia/matching/keypoints_and_descriptors.h"
 #include "theia/matching/rocksdb_features_and_matches_database.h"
@@ -36,10 +38,10 @@ TEST(RocksDbFeaturesAndMatchesDatabase, PutFeature) {
   // Create some features.
   KeypointsAndDescriptors features;
   features.keypoints.resize(kNumFeatures);
-  features.descriptors.resize(kNumFeatures);
+  features.descriptors.resize(kNumFeatures, 128);
+  features.descriptors.setRandom();
   for (int i = 0; i < kNumFeatures; i++) {
     features.keypoints[i] = Keypoint(i, i + 1, Keypoint::OTHER);
-    features.descriptors[i].setRandom();
   }
 
   RocksDbFeaturesAndMatchesDatabase db(db_directory);
@@ -50,16 +52,80 @@ TEST(RocksDbFeaturesAndMatchesDatabase, PutFeature) {
   // Get the features and ensure they are correct.
   const KeypointsAndDescriptors db_features = db.GetFeatures(kImageName);
   ASSERT_EQ(db_features.keypoints.size(), kNumFeatures);
-  ASSERT_EQ(db_features.descriptors.size(), kNumFeatures);
+  ASSERT_EQ(db_features.descriptors.rows(), kNumFeatures);
   for (int i = 0; i < kNumFeatures; i++) {
     EXPECT_EQ(db_features.keypoints[i].x(), features.keypoints[i].x());
     EXPECT_EQ(db_features.keypoints[i].y(), features.keypoints[i].y());
-    EXPECT_EQ(db_features.descriptors[i], features.descriptors[i]);
+    EXPECT_EQ(db_features.descriptors.row(i), features.descriptors.row(i));
   }
 
   rocksdb::DestroyDB(db_directory, rocksdb::Options());
 }
 
+TEST(RocksDbFeaturesAndMatchesDatabase, PutBinaryFeature) {
+  static const std::string kImageName = "image_name";
+  static const int kNumFeatures = 1000;
+  static const int kNumBytes = 61;
+
+  // Create some features with binary descriptors.
+  KeypointsAndDescriptors features;
+  features.keypoints.resize(kNumFeatures);
+  features.binary_descriptors.resize(kNumFeatures, kNumBytes);
+  for (int i = 0; i < kNumFeatures; i++) {
+    features.keypoints[i] = Keypoint(i, i + 1, Keypoint::AKAZE);
+    for (int j = 0; j < kNumBytes; j++) {
+      features.binary_descriptors(i, j) = rand() % 256;
+    }
+  }
+
+  RocksDbFeaturesAndMatchesDatabase db(db_directory);
+
+  // Add the features.
+  db.PutFeatures(kImageName, features);
+
+  // Get the features and ensure they are correct.
+  const KeypointsAndDescriptors db_features = db.GetFeatures(kImageName);
+  ASSERT_EQ(db_features.keypoints.size(), kNumFeatures);
+  EXPECT_TRUE(db_features.HasBinaryDescriptors());
+  EXPECT_EQ(db_features.descriptors.rows(), 0);
+  ASSERT_EQ(db_features.binary_descriptors.rows(), kNumFeatures);
+  ASSERT_EQ(db_features.binary_descriptors.cols(), kNumBytes);
+  EXPECT_EQ(db_features.binary_descriptors, features.binary_descriptors);
+
+  rocksdb::DestroyDB(db_directory, rocksdb::Options());
+}
+
+TEST(RocksDbFeaturesAndMatchesDatabase, PutQuantizedFeature) {
+  static const std::string kImageName = "image_name";
+  static const int kNumFeatures = 1000;
+
+  // Create some features with quantized descriptors.
+  KeypointsAndDescriptors features;
+  features.keypoints.resize(kNumFeatures);
+  features.quantized_descriptors.resize(kNumFeatures, 128);
+  for (int i = 0; i < kNumFeatures; i++) {
+    features.keypoints[i] = Keypoint(i, i + 1, Keypoint::SIFT);
+    for (int j = 0; j < 128; j++) {
+      features.quantized_descriptors(i, j) = rand() % 256;
+    }
+  }
+
+  RocksDbFeaturesAndMatchesDatabase db(db_directory);
+
+  // Add the features.
+  db.PutFeatures(kImageName, features);
+
+  // Get the features and ensure they are correct.
+  const KeypointsAndDescriptors db_features = db.GetFeatures(kImageName);
+  ASSERT_EQ(db_features.keypoints.size(), kNumFeatures);
+  EXPECT_TRUE(db_features.HasQuantizedDescriptors());
+  EXPECT_FALSE(db_features.HasBinaryDescriptors());
+  EXPECT_EQ(db_features.descriptors.rows(), 0);
+  EXPECT_EQ(db_features.quantized_descriptors, features.quantized_descriptors);
+
+  rocksdb::DestroyDB(db_directory, rocksdb::Options());
+}
+
 TEST(RocksDbFeaturesAndMatchesDatabase, GetFeatureFromInputDB) {
   static const std::string kImageName = "image_name";
   static const int kNumFeatures = 1000;
@@ -67,10 +133,10 @@ TEST(RocksDbFeaturesAndMatchesDatabase, GetFeatureFromInputDB) {
   // Create some features.
   KeypointsAndDescriptors features;
   features.keypoints.resize(kNumFeatures);
-  features.descriptors.resize(kNumFeatures);
+  features.descriptors.resize(kNumFeatures, 128);
+  features.descriptors.setRandom();
   for (int i = 0; i < kNumFeatures; i++) {
     features.keypoints[i] = Keypoint(i, i + 1, Keypoint::OTHER);
-    features.descriptors[i].setRandom();
   }
 
   {
@@ -94,17 +160,53 @@ TEST(RocksDbFeaturesAndMatchesDatabase, GetFeatureFromInputDB) {
     // Get the features and ensure they are correct.
     const KeypointsAndDescriptors db_features = db.GetFeatures(kImageName);
     ASSERT_EQ(db_features.keypoints.size(), kNumFeatures);
-    ASSERT_EQ(db_features.descriptors.size(), kNumFeatures);
+    ASSERT_EQ(db_features.descriptors.rows(), kNumFeatures);
     for (int i = 0; i < kNumFeatures; i++) {
       EXPECT_EQ(db_features.keypoints[i].x(), features.keypoints[i].x());
       EXPECT_EQ(db_features.keypoints[i].y(), features.keypoints[i].y());
-      EXPECT_EQ(db_features.descriptors[i], features.descriptors[i]);
+      EXPECT_EQ(db_features.descriptors.row(i), features.descriptors.row(i));
     }
   }
 
   rocksdb::DestroyDB(db_directory, rocksdb::Options());
 }
 
+TEST(RocksDbFeaturesAndMatchesDatabase, GetFeaturesShared) {
+  static const std::string kImageName = "image_name";
+  static const int kNumFeatures = 1000;
+
+  // Create some features.
+  KeypointsAndDescriptors features;
+  features.keypoints.resize(kNumFeatures);
+  features.descriptors.resize(kNumFeatures, 128);
+  features.descriptors.setRandom();
+  for (int i = 0; i < kNumFeatures; i++) {
+    features.keypoints[i] = Keypoint(i, i + 1, Keypoint::OTHER);
+  }
+
+  RocksDbFeaturesAndMatchesDatabase db(db_directory);
+  db.PutFeatures(kImageName, features);
+
+  // Repeated lookups of the same image should share the same features.
+  const std::shared_ptr<const KeypointsAndDescriptors> db_features1 =
+      db.GetFeaturesShared(kImageName);
+  const std::shared_ptr<const KeypointsAndDescriptors> db_features2 =
+      db.GetFeaturesShared(kImageName);
+  EXPECT_EQ(db_features1.get(), db_features2.get());
+  ASSERT_EQ(db_features1->keypoints.size(), kNumFeatures);
+  EXPECT_EQ(db_features1->descriptors, features.descriptors);
+
+  // Overwriting the features must not return the stale features.
+  features.descriptors.setRandom();
+  db.PutFeatures(kImageName, features);
+  const std::shared_ptr<const KeypointsAndDescriptors> db_features3 =
+      db.GetFeaturesShared(kImageName);
+  EXPECT_EQ(db_features3->descriptors, features.descriptors);
+  EXPECT_NE(db_features1->descriptors, db_features3->descriptors);
+
+  rocksdb::DestroyDB(db_directory, rocksdb::Options());
+}
+
 TEST(RocksDbFeaturesAndMatchesDatabase, ContainsFeature) {
   static const int kNumFeatures = 1000;
   static const int kStringLength = 64;
@@ -182,4 +284,130 @@ TEST(RocksDbFeaturesAndMatchesDatabase, MatchNames) {
 
   rocksdb::DestroyDB(db_directory, rocksdb::Options());
 }
+
+TEST(RocksDbFeaturesAndMatchesDatabase, ReplacingFeaturesRemovesTheirMatches) {
+  static const int kNumFeatures = 10;
+  const std::vector<std::string> image_names = {"a", "b", "c"};
+
+  RocksDbFeaturesAndMatchesDatabase db(db_directory);
+  KeypointsAndDescriptors features;
+  for (int i = 0; i < kNumFeatures; i++) {
+    features.keypoints.emplace_back(i, 2 * i, Keypoint::OTHER);
+  }
+  for (const std::string& image_name : image_names) {
+    db.PutFeatures(image_name, features);
+  }
+
+  // Store matches between all images as feature indices.
+  ImagePairMatch match;
+  match.feature_indices = {{1, 2}, {3, 4}};
+  match.correspondences = {FeatureCorrespondence(Feature(1, 2), Feature(2, 4)),
+                           FeatureCorrespondence(Feature(3, 6), Feature(4, 8))};
+  db.PutImagePairMatch("a", "b", match);
+  db.PutImagePairMatch("a", "c", match);
+  db.PutImagePairMatch("b", "c", match);
+  db.PutImagePairMatch("c", "a", match);
+
+  // The correspondences are expanded from the keypoints of the images.
+  const ImagePairMatch db_match = db.GetImagePairMatch("a", "b");
+  EXPECT_EQ(db_match.feature_indices, match.feature_indices);
+  EXPECT_EQ(db_match.correspondences, match.correspondences);
+
+  // Replacing the features of an image removes the matches that refer to its
+  // previous features.
+  features.keypoints.resize(2);
+  db.PutFeatures("a", features);
+  const std::vector<std::pair<std::string, std::string>> match_names =
+      db.ImageNamesOfMatches();
+  ASSERT_EQ(match_names.size(), 1);
+  EXPECT_EQ(match_names[0], std::make_pair(std::string("b"), std::string("c")));
+
+  rocksdb::DestroyDB(db_directory, rocksdb::Options());
+}
+
+TEST(RocksDbFeaturesAndMatchesDatabase, OlderLayoutIsRemoved) {
+  {
+    RocksDbFeaturesAndMatchesDatabase db(db_directory);
+    KeypointsAndDescriptors features;
+    features.keypoints.emplace_back(1, 2, Keypoint::OTHER);
+    db.PutFeatures("a", features);
+    db.PutImagePairMatch("a", "b", ImagePairMatch());
+    db.PutCameraIntrinsicsPrior("a", CameraIntrinsicsPrior());
+  }
+
+  // Remove the layout version as in databases that were written before it was
+  // stored.
+  {
+    std::vector<std::string> column_families;
+    ASSERT_TRUE(rocksdb::DB::ListColumnFamilies(
+                    rocksdb::Options(), db_directory, &column_families)
+                    .ok());
+    std::vector<rocksdb::ColumnFamilyDescriptor> column_descriptors;
+    for (const std::string& column_family : column_families) {
+      column_descriptors.emplace_back(column_family, rocksdb::Options());
+    }
+    std::vector<rocksdb::ColumnFamilyHandle*> handles;
+    rocksdb::DB* database;
+    ASSERT_TRUE(rocksdb::DB::Open(rocksdb::Options(),
+                                  db_directory,
+                                  column_descriptors,
+                                  &handles,
+                                  &database)
+                    .ok());
+    EXPECT_TRUE(database->Delete(rocksdb::WriteOptions(), "").ok());
+    for (rocksdb::ColumnFamilyHandle* handle : handles) {
+      database->DestroyColumnFamilyHandle(handle);
+    }
+    delete database;
+  }
+
+  // The features and matches are removed, but the intrinsics are kept.
+  {
+    RocksDbFeaturesAndMatchesDatabase db(db_directory);
+    EXPECT_FALSE(db.ContainsFeatures("a"));
+    EXPECT_TRUE(db.ImageNamesOfMatches().empty());
+    EXPECT_TRUE(db.ContainsCameraIntrinsicsPrior("a"));
+  }
+
+  // The layout version is stored again, so nothing is removed on reopening.
+  {
+    RocksDbFeaturesAndMatchesDatabase db(db_directory);
+    KeypointsAndDescriptors features;
+    features.keypoints.emplace_back(1, 2, Keypoint::OTHER);
+    db.PutFeatures("a", features);
+  }
+  {
+    RocksDbFeaturesAndMatchesDatabase db(db_directory);
+    EXPECT_TRUE(db.ContainsFeatures("a"));
+  }
+
+  rocksdb::DestroyDB(db_directory, rocksdb::Options());
+}
+
+TEST(RocksDbFeaturesAndMatchesDatabase, MatchedImages) {
+  RocksDbFeaturesAndMatchesDatabase db(db_directory);
+  KeypointsAndDescriptors features;
+  features.keypoints.emplace_back(1, 2, Keypoint::OTHER);
+  db.PutFeatures("a", features);
+  db.PutFeatures("b", features);
+
+  // An image is recorded as matched even if it has no matches.
+  db.PutMatchedImage("a");
+  db.PutMatchedImage("b");
+  std::vector<std::string> matched_image_names =
+      db.ImageNamesOfMatchedImages();
+  std::sort(matched_image_names.begin(), matched_image_names.end());
+  EXPECT_EQ(matched_image_names, std::vector<std::string>({"a", "b"}));
+  EXPECT_EQ(db.NumMatches(), 0);
+
+  // Replacing the features of an image removes its record.
+  db.PutFeatures("a", features);
+  EXPECT_EQ(db.ImageNamesOfMatchedImages(), std::vector<std::string>({"b"}));
+
+  // Removing all matches removes all records.
+  db.RemoveAllMatches();
+  EXPECT_TRUE(db.ImageNamesOfMatchedImages().empty());
+
+  rocksdb::DestroyDB(db_directory, rocksdb::Options());
+}
 }  // namespace theia
@@ -0,0 +1,527 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+extern "C" {
+#include <vl/kmeans.h>
+}
+
+#include "theia/matching/vocabulary_tree.h"
+
+#include <cereal/archives/portable_binary.hpp>
+#include <cereal/types/vector.hpp>
+#include <Eigen/Core>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>  // NOLINT
+#include <memory>
+#include <mutex>  // NOLINT
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/io/eigen_serializable.h"
+#include "theia/util/threadpool.h"
+
+namespace theia {
+
+namespace {
+
+// The number of images queried by each task of QueryInvertedFile.
+static const int kNumImagesPerQueryTask = 64;
+
+// Returns the index of the row of centers that is closest to the feature.
+int FindClosestCenter(const Eigen::Ref<const DescriptorMatrix>& centers,
+                      const Eigen::Ref<const Eigen::RowVectorXf>& feature) {
+  int closest_center;
+  (centers.rowwise() - feature).rowwise().squaredNorm().minCoeff(
+      &closest_center);
+  return closest_center;
+}
+
+// The IDF weight of a visual word is log(N / N_i) where N is the number of
+// indexed images and N_i is the number of indexed images that contain the
+// visual word. Visual words that occur in every image have a weight of zero.
+float ComputeIdfWeight(const int num_images, const int num_images_with_word) {
+  if (num_images == 0) {
+    return 1.0f;
+  }
+  if (num_images_with_word == 0) {
+    return 0.0f;
+  }
+  return std::log(static_cast<float>(num_images) / num_images_with_word);
+}
+
+}  // namespace
+
+VocabularyTree::VocabularyTree(const Options& options)
+    : options_(options),
+      num_visual_words_(0),
+      training_feature_sampler_(options.max_num_features_for_training),
+      num_indexed_images_(0) {
+  CHECK_GT(options_.branching_factor, 1);
+  CHECK_GT(options_.num_levels, 0);
+}
+
+VocabularyTree::~VocabularyTree() {}
+
+void VocabularyTree::AddFeaturesForTraining(const DescriptorMatrix& features) {
+  std::lock_guard<std::mutex> lock(training_mutex_);
+  for (int i = 0; i < features.rows(); i++) {
+    CHECK(!features.row(i).hasNaN()) << "Feature: " << features.row(i);
+    training_feature_sampler_.AddElementToSampler(features.row(i).transpose());
+  }
+}
+
+bool VocabularyTree::Train() {
+  std::lock_guard<std::mutex> lock(training_mutex_);
+  // Get the features randomly sampled for training.
+  const auto& sampled_features = training_feature_sampler_.GetAllSamples();
+  if (sampled_features.empty()) {
+    LOG(ERROR) << "Cannot train a vocabulary tree without any features.";
+    return false;
+  }
+  LOG(INFO) << "Training vocabulary tree with " << sampled_features.size()
+            << " features sampled from "
+            << training_feature_sampler_.NumElementsAdded()
+            << " total features.";
+
+  const DescriptorMatrix training_features =
+      DescriptorMatrixFromVectors(sampled_features);
+
+  // Start with only the root, which holds all of the training features.
+  std::vector<Eigen::VectorXf> node_centers(
+      1, Eigen::VectorXf::Zero(training_features.cols()));
+  first_child_.assign(1, 0);
+  num_children_.assign(1, 0);
+  std::vector<int> nodes_to_split(1, 0);
+  std::vector<std::vector<int> > features_of_nodes(1);
+  features_of_nodes[0].resize(training_features.rows());
+  for (int i = 0; i < training_features.rows(); i++) {
+    features_of_nodes[0][i] = i;
+  }
+
+  // Build the tree one level at a time by splitting all nodes of the deepest
+  // level.
+  for (int level = 0; level < options_.num_levels; level++) {
+    std::vector<int> children_to_split;
+    std::vector<std::vector<int> > features_of_children;
+    for (int i = 0; i < nodes_to_split.size(); i++) {
+      const int node = nodes_to_split[i];
+      std::vector<std::vector<int> > child_features;
+      SplitNode(training_features,
+                node,
+                features_of_nodes[i],
+                &node_centers,
+                &child_features);
+      for (int j = 0; j < child_features.size(); j++) {
+        children_to_split.emplace_back(first_child_[node] + j);
+        features_of_children.emplace_back(std::move(child_features[j]));
+      }
+    }
+    nodes_to_split.swap(children_to_split);
+    features_of_nodes.swap(features_of_children);
+  }
+  node_centers_ = DescriptorMatrixFromVectors(node_centers);
+
+  // The leaves of the tree are the visual words.
+  num_visual_words_ = 0;
+  visual_word_.assign(first_child_.size(), -1);
+  for (int i = 0; i < visual_word_.size(); i++) {
+    if (num_children_[i] == 0) {
+      visual_word_[i] = num_visual_words_++;
+    }
+  }
+  LOG(INFO) << "The vocabulary tree has " << num_visual_words_
+            << " visual words.";
+
+  // Any images that were indexed with a previous vocabulary are invalid now.
+  std::lock_guard<std::mutex> inverted_file_lock(inverted_file_mutex_);
+  image_histograms_.clear();
+  inverted_file_.clear();
+  inverted_file_.resize(num_visual_words_);
+  num_indexed_images_ = 0;
+  return true;
+}
+
+void VocabularyTree::SplitNode(
+    const DescriptorMatrix& training_features,
+    const int node,
+    const std::vector<int>& node_features,
+    std::vector<Eigen::VectorXf>* node_centers,
+    std::vector<std::vector<int> >* child_features) {
+  child_features->clear();
+  const int num_features = node_features.size();
+  const int num_clusters = options_.branching_factor;
+  if (num_features <= num_clusters) {
+    return;
+  }
+
+  // Gather the features of the node into a contiguous matrix for k-means.
+  const int descriptor_dimension = training_features.cols();
+  DescriptorMatrix features(num_features, descriptor_dimension);
+  for (int i = 0; i < num_features; i++) {
+    features.row(i) = training_features.row(node_features[i]);
+  }
+
+  // NOTE: We need the unique_ptr to use vlfeat's delete function for k-means.
+  std::unique_ptr<VlKMeans, void (*)(VlKMeans*)> kmeans(
+      vl_kmeans_new(VL_TYPE_FLOAT, VlDistanceL2), vl_kmeans_delete);
+  vl_kmeans_set_algorithm(kmeans.get(), VlKMeansElkan);
+  vl_kmeans_set_initialization(kmeans.get(), VlKMeansPlusPlus);
+  vl_kmeans_set_max_num_iterations(kmeans.get(),
+                                   options_.max_num_kmeans_iterations);
+  vl_kmeans_cluster(kmeans.get(),
+                    features.data(),
+                    descriptor_dimension,
+                    num_features,
+                    num_clusters);
+  const Eigen::Map<const DescriptorMatrix> centers(
+      static_cast<const float*>(vl_kmeans_get_centers(kmeans.get())),
+      num_clusters,
+      descriptor_dimension);
+
+  // Add the children to the tree and assign each feature to its closest child.
+  first_child_[node] = node_centers->size();
+  num_children_[node] = num_clusters;
+  for (int i = 0; i < num_clusters; i++) {
+    node_centers->emplace_back(centers.row(i).transpose());
+    first_child_.emplace_back(0);
+    num_children_.emplace_back(0);
+  }
+
+  child_features->resize(num_clusters);
+  for (int i = 0; i < num_features; i++) {
+    const int closest_child = FindClosestCenter(centers, features.row(i));
+    (*child_features)[closest_child].emplace_back(node_features[i]);
+  }
+}
+
+int VocabularyTree::FindClosestChild(
+    const int node,
+    const Eigen::Ref<const Eigen::RowVectorXf>& feature) const {
+  return first_child_[node] +
+         FindClosestCenter(
+             node_centers_.middleRows(first_child_[node], num_children_[node]),
+             feature);
+}
+
+bool VocabularyTree::IsTrained() const { return num_visual_words_ > 0; }
+
+int VocabularyTree::DescriptorDimension() const { return node_centers_.cols(); }
+
+int VocabularyTree::NumVisualWords() const { return num_visual_words_; }
+
+void VocabularyTree::QuantizeFeatures(const DescriptorMatrix& features,
+                                      std::vector<int>* visual_words) const {
+  CHECK(IsTrained()) << "The vocabulary tree must be trained first.";
+  CHECK_EQ(features.cols(), node_centers_.cols());
+  CHECK_NOTNULL(visual_words)->resize(features.rows());
+  for (int i = 0; i < features.rows(); i++) {
+    int node = 0;
+    while (num_children_[node] > 0) {
+      node = FindClosestChild(node, features.row(i));
+    }
+    (*visual_words)[i] = visual_word_[node];
+  }
+}
+
+void VocabularyTree::ComputeVisualWordHistogram(
+    const DescriptorMatrix& features, VisualWordHistogram* histogram) const {
+  std::vector<int> visual_words;
+  QuantizeFeatures(features, &visual_words);
+  std::sort(visual_words.begin(), visual_words.end());
+
+  histogram->clear();
+  for (const int visual_word : visual_words) {
+    if (histogram->empty() || histogram->back().first != visual_word) {
+      histogram->emplace_back(visual_word, 0);
+    }
+    ++histogram->back().second;
+  }
+}
+
+Eigen::VectorXf VocabularyTree::ExtractGlobalDescriptor(
+    const DescriptorMatrix& features) {
+  VisualWordHistogram histogram;
+  ComputeVisualWordHistogram(features, &histogram);
+
+  Eigen::VectorXf global_descriptor =
+      Eigen::VectorXf::Zero(num_visual_words_);
+  std::lock_guard<std::mutex> lock(inverted_file_mutex_);
+  for (const auto& word_count : histogram) {
+    global_descriptor(word_count.first) =
+        word_count.second *
+        ComputeIdfWeight(num_indexed_images_,
+                         inverted_file_[word_count.first].size());
+  }
+
+  const float norm = global_descriptor.norm();
+  if (norm > 0) {
+    global_descriptor /= norm;
+  }
+  return global_descriptor;
+}
+
+void VocabularyTree::AddImageToInvertedFile(const int image_id,
+                                            const DescriptorMatrix& features) {
+  CHECK_GE(image_id, 0);
+  VisualWordHistogram histogram;
+  ComputeVisualWordHistogram(features, &histogram);
+
+  std::lock_guard<std::mutex> lock(inverted_file_mutex_);
+  if (image_id >= image_histograms_.size()) {
+    image_histograms_.resize(image_id + 1);
+  }
+  CHECK(image_histograms_[image_id].empty())
+      << "Image " << image_id << " was already added to the inverted file.";
+  for (const auto& word_count : histogram) {
+    inverted_file_[word_count.first].emplace_back(image_id,
+                                                  word_count.second);
+  }
+  if (!histogram.empty()) {
+    ++num_indexed_images_;
+  }
+  image_histograms_[image_id].swap(histogram);
+}
+
+void VocabularyTree::ComputeInvertedFileWeights() {
+  idf_weights_.resize(num_visual_words_);
+  for (int i = 0; i < num_visual_words_; i++) {
+    idf_weights_[i] =
+        ComputeIdfWeight(num_indexed_images_, inverted_file_[i].size());
+  }
+
+  image_norms_.resize(image_histograms_.size());
+  for (int i = 0; i < image_histograms_.size(); i++) {
+    float sq_norm = 0;
+    for (const auto& word_count : image_histograms_[i]) {
+      const float weight = word_count.second * idf_weights_[word_count.first];
+      sq_norm += weight * weight;
+    }
+    image_norms_[i] = std::sqrt(sq_norm);
+  }
+}
+
+void VocabularyTree::QueryImage(const int image_id,
+                                const int num_nearest_neighbors,
+                                std::vector<float>* image_scores,
+                                std::vector<int>* nearest_neighbors) const {
+  nearest_neighbors->clear();
+  if (image_norms_[image_id] == 0) {
+    return;
+  }
+
+  // Accumulate the dot products with all images that share a visual word with
+  // the query. Visual words with an IDF weight of zero do not contribute to the
+  // scores, so every image with a non-zero score is recorded exactly once.
+  std::vector<int> candidates;
+  for (const auto& word_count : image_histograms_[image_id]) {
+    const float idf_weight = idf_weights_[word_count.first];
+    if (idf_weight == 0) {
+      continue;
+    }
+
+    const float query_weight = word_count.second * idf_weight * idf_weight;
+    for (const auto& entry : inverted_file_[word_count.first]) {
+      float& score = (*image_scores)[entry.first];
+      if (score == 0) {
+        candidates.emplace_back(entry.first);
+      }
+      score += query_weight * entry.second;
+    }
+  }
+
+  // Normalize the scores and reset the scratch space. The scores are negated
+  // so that sorting orders the candidates from the most to the least similar
+  // and breaks ties by image id.
+  std::vector<std::pair<float, int> > scored_candidates;
+  scored_candidates.reserve(candidates.size());
+  for (const int candidate : candidates) {
+    if (candidate != image_id) {
+      scored_candidates.emplace_back(
+          -(*image_scores)[candidate] /
+              (image_norms_[image_id] * image_norms_[candidate]),
+          candidate);
+    }
+    (*image_scores)[candidate] = 0;
+  }
+
+  const int num_neighbors = std::min(
+      num_nearest_neighbors, static_cast<int>(scored_candidates.size()));
+  std::partial_sort(scored_candidates.begin(),
+                    scored_candidates.begin() + num_neighbors,
+                    scored_candidates.end());
+  nearest_neighbors->reserve(num_neighbors);
+  for (int i = 0; i < num_neighbors; i++) {
+    nearest_neighbors->emplace_back(scored_candidates[i].second);
+  }
+}
+
+void VocabularyTree::QueryInvertedFile(
+    const int num_nearest_neighbors,
+    const int num_threads,
+    std::vector<std::vector<int> >* nearest_neighbors) {
+  std::vector<int> query_image_ids;
+  {
+    std::lock_guard<std::mutex> lock(inverted_file_mutex_);
+    query_image_ids.resize(image_histograms_.size());
+  }
+  std::iota(query_image_ids.begin(), query_image_ids.end(), 0);
+  QueryInvertedFile(
+      query_image_ids, num_nearest_neighbors, num_threads, nearest_neighbors);
+}
+
+void VocabularyTree::QueryInvertedFile(
+    const std::vector<int>& query_image_ids,
+    const int num_nearest_neighbors,
+    const int num_threads,
+    std::vector<std::vector<int> >* nearest_neighbors) {
+  CHECK_GE(num_nearest_neighbors, 0);
+  CHECK_GT(num_threads, 0);
+  CHECK_NOTNULL(nearest_neighbors)->clear();
+
+  std::lock_guard<std::mutex> lock(inverted_file_mutex_);
+  ComputeInvertedFileWeights();
+
+  // Each task queries a contiguous range of the query images with its own
+  // scratch space for the scores. The tasks write to disjoint entries of the
+  // output.
+  const int num_images = image_histograms_.size();
+  const int num_queries = query_image_ids.size();
+  nearest_neighbors->resize(num_images);
+  ThreadPool pool(num_threads);
+  for (int start = 0; start < num_queries; start += kNumImagesPerQueryTask) {
+    const int end = std::min(start + kNumImagesPerQueryTask, num_queries);
+    pool.Add([this,
+              &query_image_ids,
+              num_images,
+              num_nearest_neighbors,
+              start,
+              end,
+              nearest_neighbors]() {
+      std::vector<float> image_scores(image_histograms_.size(), 0.0f);
+      for (int i = start; i < end; i++) {
+        const int image_id = query_image_ids[i];
+        CHECK_LT(image_id, num_images)
+            << "Image " << image_id << " is not in the inverted file.";
+        QueryImage(image_id,
+                   num_nearest_neighbors,
+                   &image_scores,
+                   &(*nearest_neighbors)[image_id]);
+      }
+    });
+  }
+}
+
+bool VocabularyTree::WriteToFile(const std::string& filename) const {
+  std::ofstream output_writer(filename, std::ios::out | std::ios::binary);
+  if (!output_writer.is_open()) {
+    LOG(ERROR) << "Could not open the vocabulary tree file: " << filename
+               << " for writing.";
+    return false;
+  }
+
+  cereal::PortableBinaryOutputArchive output_archive(output_writer);
+  output_archive(node_centers_,
+                 first_child_,
+                 num_children_,
+                 visual_word_,
+                 num_visual_words_);
+  return true;
+}
+
+bool VocabularyTree::ReadFromFile(const std::string& filename) {
+  std::ifstream input_reader(filename, std::ios::in | std::ios::binary);
+  if (!input_reader.is_open()) {
+    LOG(ERROR) << "Could not open the vocabulary tree file: " << filename
+               << " for reading.";
+    return false;
+  }
+
+  DescriptorMatrix node_centers;
+  std::vector<int> first_child, num_children, visual_word;
+  int num_visual_words;
+  try {
+    cereal::PortableBinaryInputArchive input_archive(input_reader);
+    input_archive(
+        node_centers, first_child, num_children, visual_word, num_visual_words);
+  } catch (const cereal::Exception& e) {
+    LOG(ERROR) << "Could not read the vocabulary tree file: " << filename
+               << ": " << e.what();
+    return false;
+  }
+
+  // Check that the tree is consistent so that quantizing features stays within
+  // its nodes. The children of a node always come after it, so descending the
+  // tree terminates.
+  const int num_nodes = node_centers.rows();
+  bool is_valid = num_nodes > 0 && first_child.size() == num_nodes &&
+                  num_children.size() == num_nodes &&
+                  visual_word.size() == num_nodes;
+  int num_leaves = 0;
+  for (int i = 0; is_valid && i < num_nodes; i++) {
+    if (num_children[i] == 0) {
+      is_valid = visual_word[i] == num_leaves++;
+    } else {
+      is_valid = num_children[i] > 0 && visual_word[i] == -1 &&
+                 first_child[i] > i &&
+                 first_child[i] <= num_nodes - num_children[i];
+    }
+  }
+  if (!is_valid || num_leaves != num_visual_words) {
+    LOG(ERROR) << "The vocabulary tree file: " << filename
+               << " is corrupted.";
+    return false;
+  }
+
+  node_centers_.swap(node_centers);
+  first_child_.swap(first_child);
+  num_children_.swap(num_children);
+  visual_word_.swap(visual_word);
+  num_visual_words_ = num_visual_words;
+
+  // Any images that were indexed with a previous vocabulary are invalid now.
+  std::lock_guard<std::mutex> lock(inverted_file_mutex_);
+  image_histograms_.clear();
+  inverted_file_.clear();
+  inverted_file_.resize(num_visual_words_);
+  num_indexed_images_ = 0;
+  return true;
+}
+
+}  // namespace theia
@@ -0,0 +1,224 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_VOCABULARY_TREE_H_
+#define THEIA_MATCHING_VOCABULARY_TREE_H_
+
+#include <Eigen/Core>
+#include <mutex>  // NOLINT
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/matching/global_descriptor_extractor.h"
+#include "theia/math/reservoir_sampler.h"
+#include "theia/util/util.h"
+
+namespace theia {
+
+// A vocabulary tree quantizes feature descriptors into visual words by
+// hierarchical k-means clustering, as described in "Scalable Recognition with a
+// Vocabulary Tree" by Nister and Stewenius (CVPR 2006). Each node of the tree
+// is split into branching_factor children by k-means on the training
+// descriptors assigned to it, and the leaves of the tree are the visual words.
+// A descriptor is quantized by descending the tree to the closest child at each
+// level, so quantization costs O(branching_factor * num_levels) distances
+// rather than one distance per visual word.
+//
+// Images are indexed in an inverted file that stores, for each visual word, the
+// images it occurs in. Image similarity is the dot product of the L2-normalized
+// TF-IDF weighted visual word histograms, and it is computed by only visiting
+// the inverted file entries of the visual words of the query image. This is far
+// cheaper than scoring all pairs of dense global descriptors since most images
+// share only a small fraction of their visual words.
+//
+// A trained vocabulary does not depend on the images it was trained on, so it
+// may be written to disk once and reused for other datasets. The inverted file
+// (and thus the IDF weights) is specific to the images that are indexed and is
+// not written to disk.
+class VocabularyTree : public GlobalDescriptorExtractor {
+ public:
+  struct Options {
+    // The number of children of each node of the tree. The vocabulary has at
+    // most branching_factor^num_levels visual words.
+    int branching_factor = 10;
+    int num_levels = 5;
+
+    // If more than this number of features are added to the VocabularyTree
+    // then we randomly sample max_num_features_for_training using a memory
+    // efficient Reservoir sampler to avoid holding all features in memory.
+    int max_num_features_for_training = 1000000;
+
+    // The maximum number of iterations of k-means used to split each node.
+    int max_num_kmeans_iterations = 25;
+  };
+
+  explicit VocabularyTree(const Options& options);
+  ~VocabularyTree();
+
+  // Add features to the vocabulary tree for training. This method may be called
+  // multiple times to add multiple sets of features (e.g., once per image).
+  void AddFeaturesForTraining(const DescriptorMatrix& features) override;
+
+  // Builds the tree by hierarchical k-means on the features added with
+  // AddFeaturesForTraining. Returns false if no features were added.
+  bool Train() override;
+
+  // Returns the TF-IDF weighted and L2-normalized histogram of the visual words
+  // of the features. The IDF weights are computed from the images in the
+  // inverted file, or are all equal to one if the inverted file is empty. The
+  // descriptor has NumVisualWords() entries, so QueryInvertedFile should be
+  // preferred over comparing these descriptors for large vocabularies.
+  Eigen::VectorXf ExtractGlobalDescriptor(
+      const DescriptorMatrix& features) override;
+
+  // Returns true if the tree has been trained or read from disk.
+  bool IsTrained() const;
+
+  // The number of leaves of the tree.
+  int NumVisualWords() const;
+
+  // The dimension of the descriptors that the tree was trained on.
+  int DescriptorDimension() const;
+
+  // Returns the visual word of each row of features.
+  void QuantizeFeatures(const DescriptorMatrix& features,
+                        std::vector<int>* visual_words) const;
+
+  // Quantizes the features of an image and adds the image to the inverted file.
+  // Image ids should be small non-negative integers (e.g., the index of the
+  // image in a list of images) since QueryInvertedFile returns one entry per
+  // id. This method is thread-safe.
+  void AddImageToInvertedFile(const int image_id,
+                              const DescriptorMatrix& features);
+
+  // Finds the num_nearest_neighbors most similar images of each image in the
+  // inverted file. On output, (*nearest_neighbors)[i] holds the ids of the
+  // nearest neighbors of image i (excluding image i itself) ordered from the
+  // most to the least similar. Images that share no visual word with image i
+  // are never returned as its neighbors. The queries are run in parallel with
+  // num_threads threads.
+  void QueryInvertedFile(const int num_nearest_neighbors,
+                         const int num_threads,
+                         std::vector<std::vector<int> >* nearest_neighbors);
+
+  // Same as above, but only the images in query_image_ids are queried. This
+  // allows new images to be retrieved against all indexed images without
+  // querying the images that were indexed before. The output still holds one
+  // entry per image id, and the entries of images that are not queried are
+  // empty.
+  void QueryInvertedFile(const std::vector<int>& query_image_ids,
+                         const int num_nearest_neighbors,
+                         const int num_threads,
+                         std::vector<std::vector<int> >* nearest_neighbors);
+
+  // Writes the trained vocabulary to disk or reads it from disk. Returns false
+  // if the file cannot be opened, or if the vocabulary that is read is not a
+  // valid tree, in which case the tree is left unchanged.
+  bool WriteToFile(const std::string& filename) const;
+  bool ReadFromFile(const std::string& filename);
+
+ private:
+  // The number of occurrences of each visual word of an image, sorted by
+  // visual word.
+  typedef std::vector<std::pair<int, int> > VisualWordHistogram;
+
+  // Returns the index of the child of node whose center is closest to the
+  // feature.
+  int FindClosestChild(
+      const int node,
+      const Eigen::Ref<const Eigen::RowVectorXf>& feature) const;
+
+  // Splits a node into at most branching_factor children by k-means on the
+  // training features assigned to it, and assigns each of the features to the
+  // closest child. The node is left as a leaf if it has too few features.
+  void SplitNode(const DescriptorMatrix& training_features,
+                 const int node,
+                 const std::vector<int>& node_features,
+                 std::vector<Eigen::VectorXf>* node_centers,
+                 std::vector<std::vector<int> >* child_features);
+
+  // Computes the visual word histogram of the features.
+  void ComputeVisualWordHistogram(const DescriptorMatrix& features,
+                                  VisualWordHistogram* histogram) const;
+
+  // Computes the IDF weight of each visual word from the inverted file, and the
+  // norm of the TF-IDF weighted histogram of each image.
+  void ComputeInvertedFileWeights();
+
+  // Finds the nearest neighbors of a single image of the inverted file. The
+  // scores are accumulated into the scratch space image_scores which must have
+  // one entry per image id and be all zero. It is reset to zero on output.
+  void QueryImage(const int image_id,
+                  const int num_nearest_neighbors,
+                  std::vector<float>* image_scores,
+                  std::vector<int>* nearest_neighbors) const;
+
+  const Options options_;
+
+  // The tree is stored as flat arrays indexed by node, with node 0 being the
+  // root. The children of a node are stored contiguously starting at
+  // first_child_[node]. Row i of node_centers_ holds the cluster center of node
+  // i (the root has no center), and visual_word_[node] is the visual word of a
+  // leaf or -1 for interior nodes.
+  DescriptorMatrix node_centers_;
+  std::vector<int> first_child_;
+  std::vector<int> num_children_;
+  std::vector<int> visual_word_;
+  int num_visual_words_;
+
+  // The vocabulary is trained from a set of feature descriptors. A reservoir
+  // sampler is used to randomly sample features from an unknown number of input
+  // features for training.
+  ReservoirSampler<Eigen::VectorXf> training_feature_sampler_;
+  std::mutex training_mutex_;
+
+  // The visual word histogram of each image id, and for each visual word the
+  // image ids that contain it along with the number of occurrences.
+  std::vector<VisualWordHistogram> image_histograms_;
+  std::vector<std::vector<std::pair<int, int> > > inverted_file_;
+  int num_indexed_images_;
+  std::mutex inverted_file_mutex_;
+
+  // The IDF weight of each visual word and the norm of the TF-IDF histogram of
+  // each image. These are computed when the inverted file is queried.
+  std::vector<float> idf_weights_;
+  std::vector<float> image_norms_;
+
+  DISALLOW_COPY_AND_ASSIGN(VocabularyTree);
+};
+
+}  // namespace theia
+#endif  // THEIA_MATCHING_VOCABULARY_TREE_H_
@@ -0,0 +1,282 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <cereal/archives/portable_binary.hpp>
+#include <cereal/types/vector.hpp>
+#include <Eigen/Core>
+#include <algorithm>
+#include <fstream>  // NOLINT
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/io/eigen_serializable.h"
+#include "theia/matching/vocabulary_tree.h"
+#include "theia/util/random.h"
+
+namespace theia {
+
+namespace {
+
+static const int kNumDimensions = 32;
+
+// Each place is observed by several images, and every image sees a noisy
+// version of a random subset of the landmarks of its place.
+struct SyntheticPlaces {
+  std::vector<DescriptorMatrix> image_features;
+  std::vector<int> place_of_image;
+};
+
+SyntheticPlaces CreateSyntheticPlaces(const int num_places,
+                                      const int num_images_per_place,
+                                      const int num_landmarks_per_place,
+                                      const int num_features_per_image) {
+  RandomNumberGenerator rng(59);
+  SyntheticPlaces places;
+  for (int i = 0; i < num_places; i++) {
+    DescriptorMatrix landmarks(num_landmarks_per_place, kNumDimensions);
+    for (int j = 0; j < landmarks.size(); j++) {
+      landmarks.data()[j] = rng.RandFloat(0.0f, 1.0f);
+    }
+
+    for (int j = 0; j < num_images_per_place; j++) {
+      DescriptorMatrix features(num_features_per_image, kNumDimensions);
+      for (int k = 0; k < num_features_per_image; k++) {
+        const int landmark = rng.RandInt(0, num_landmarks_per_place - 1);
+        for (int d = 0; d < kNumDimensions; d++) {
+          features(k, d) =
+              landmarks(landmark, d) + rng.RandGaussian(0.0f, 0.01f);
+        }
+      }
+      places.image_features.emplace_back(features);
+      places.place_of_image.emplace_back(i);
+    }
+  }
+  return places;
+}
+
+VocabularyTree::Options SmallVocabularyTreeOptions() {
+  VocabularyTree::Options options;
+  options.branching_factor = 8;
+  options.num_levels = 3;
+  return options;
+}
+
+}  // namespace
+
+TEST(VocabularyTree, TrainAndQuantize) {
+  const SyntheticPlaces places = CreateSyntheticPlaces(10, 4, 30, 100);
+  VocabularyTree vocabulary_tree(SmallVocabularyTreeOptions());
+  EXPECT_FALSE(vocabulary_tree.IsTrained());
+  EXPECT_FALSE(vocabulary_tree.Train());
+
+  for (const DescriptorMatrix& features : places.image_features) {
+    vocabulary_tree.AddFeaturesForTraining(features);
+  }
+  EXPECT_TRUE(vocabulary_tree.Train());
+  EXPECT_TRUE(vocabulary_tree.IsTrained());
+  EXPECT_GT(vocabulary_tree.NumVisualWords(), 8);
+  EXPECT_LE(vocabulary_tree.NumVisualWords(), 8 * 8 * 8);
+
+  // Features of the same image are quantized to valid and, for identical
+  // features, identical visual words.
+  std::vector<int> visual_words;
+  vocabulary_tree.QuantizeFeatures(places.image_features[0], &visual_words);
+  ASSERT_EQ(visual_words.size(), places.image_features[0].rows());
+  for (const int visual_word : visual_words) {
+    EXPECT_GE(visual_word, 0);
+    EXPECT_LT(visual_word, vocabulary_tree.NumVisualWords());
+  }
+
+  std::vector<int> repeated_visual_words;
+  vocabulary_tree.QuantizeFeatures(places.image_features[0],
+                                   &repeated_visual_words);
+  EXPECT_EQ(visual_words, repeated_visual_words);
+}
+
+TEST(VocabularyTree, GlobalDescriptorIsNormalized) {
+  const SyntheticPlaces places = CreateSyntheticPlaces(5, 2, 30, 100);
+  VocabularyTree vocabulary_tree(SmallVocabularyTreeOptions());
+  for (const DescriptorMatrix& features : places.image_features) {
+    vocabulary_tree.AddFeaturesForTraining(features);
+  }
+  ASSERT_TRUE(vocabulary_tree.Train());
+
+  const Eigen::VectorXf global_descriptor =
+      vocabulary_tree.ExtractGlobalDescriptor(places.image_features[0]);
+  EXPECT_EQ(global_descriptor.size(), vocabulary_tree.NumVisualWords());
+  EXPECT_NEAR(global_descriptor.norm(), 1.0f, 1e-4f);
+}
+
+TEST(VocabularyTree, QueryInvertedFileFindsImagesOfTheSamePlace) {
+  static const int kNumImagesPerPlace = 4;
+  static const int kNumThreads = 4;
+  const SyntheticPlaces places =
+      CreateSyntheticPlaces(20, kNumImagesPerPlace, 30, 100);
+  VocabularyTree vocabulary_tree(SmallVocabularyTreeOptions());
+  for (const DescriptorMatrix& features : places.image_features) {
+    vocabulary_tree.AddFeaturesForTraining(features);
+  }
+  ASSERT_TRUE(vocabulary_tree.Train());
+
+  for (int i = 0; i < places.image_features.size(); i++) {
+    vocabulary_tree.AddImageToInvertedFile(i, places.image_features[i]);
+  }
+
+  std::vector<std::vector<int> > nearest_neighbors;
+  vocabulary_tree.QueryInvertedFile(
+      kNumImagesPerPlace - 1, kNumThreads, &nearest_neighbors);
+  ASSERT_EQ(nearest_neighbors.size(), places.image_features.size());
+  for (int i = 0; i < nearest_neighbors.size(); i++) {
+    ASSERT_EQ(nearest_neighbors[i].size(), kNumImagesPerPlace - 1);
+    for (const int neighbor : nearest_neighbors[i]) {
+      EXPECT_NE(neighbor, i);
+      EXPECT_EQ(places.place_of_image[neighbor], places.place_of_image[i]);
+    }
+  }
+}
+
+// Querying a subset of the images must give the same neighbors for those
+// images as querying all images, and no neighbors for the other images.
+TEST(VocabularyTree, QueryInvertedFileWithQueryImages) {
+  static const int kNumImagesPerPlace = 4;
+  static const int kNumThreads = 4;
+  const SyntheticPlaces places =
+      CreateSyntheticPlaces(20, kNumImagesPerPlace, 30, 100);
+  VocabularyTree vocabulary_tree(SmallVocabularyTreeOptions());
+  for (const DescriptorMatrix& features : places.image_features) {
+    vocabulary_tree.AddFeaturesForTraining(features);
+  }
+  ASSERT_TRUE(vocabulary_tree.Train());
+
+  for (int i = 0; i < places.image_features.size(); i++) {
+    vocabulary_tree.AddImageToInvertedFile(i, places.image_features[i]);
+  }
+
+  std::vector<std::vector<int> > all_nearest_neighbors;
+  vocabulary_tree.QueryInvertedFile(
+      kNumImagesPerPlace - 1, kNumThreads, &all_nearest_neighbors);
+
+  const std::vector<int> query_image_ids = {3, 17, 42, 79};
+  std::vector<std::vector<int> > nearest_neighbors;
+  vocabulary_tree.QueryInvertedFile(query_image_ids,
+                                    kNumImagesPerPlace - 1,
+                                    kNumThreads,
+                                    &nearest_neighbors);
+  ASSERT_EQ(nearest_neighbors.size(), places.image_features.size());
+  for (int i = 0; i < nearest_neighbors.size(); i++) {
+    if (std::find(query_image_ids.begin(), query_image_ids.end(), i) !=
+        query_image_ids.end()) {
+      EXPECT_EQ(nearest_neighbors[i], all_nearest_neighbors[i]);
+    } else {
+      EXPECT_TRUE(nearest_neighbors[i].empty());
+    }
+  }
+}
+
+TEST(VocabularyTree, WriteAndReadFromFile) {
+  const std::string filename =
+      THEIA_DATA_DIR + std::string("/vocabulary_tree.bin");
+  const SyntheticPlaces places = CreateSyntheticPlaces(5, 2, 30, 100);
+  VocabularyTree vocabulary_tree(SmallVocabularyTreeOptions());
+  for (const DescriptorMatrix& features : places.image_features) {
+    vocabulary_tree.AddFeaturesForTraining(features);
+  }
+  ASSERT_TRUE(vocabulary_tree.Train());
+  ASSERT_TRUE(vocabulary_tree.WriteToFile(filename));
+
+  // The vocabulary read from disk quantizes features identically.
+  VocabularyTree read_vocabulary_tree(SmallVocabularyTreeOptions());
+  ASSERT_TRUE(read_vocabulary_tree.ReadFromFile(filename));
+  EXPECT_TRUE(read_vocabulary_tree.IsTrained());
+  EXPECT_EQ(read_vocabulary_tree.NumVisualWords(),
+            vocabulary_tree.NumVisualWords());
+  for (const DescriptorMatrix& features : places.image_features) {
+    std::vector<int> visual_words, read_visual_words;
+    vocabulary_tree.QuantizeFeatures(features, &visual_words);
+    read_vocabulary_tree.QuantizeFeatures(features, &read_visual_words);
+    EXPECT_EQ(visual_words, read_visual_words);
+  }
+  EXPECT_EQ(read_vocabulary_tree.DescriptorDimension(),
+            places.image_features[0].cols());
+}
+
+TEST(VocabularyTree, ReadInvalidFile) {
+  const std::string filename =
+      THEIA_DATA_DIR + std::string("/vocabulary_tree.bin");
+  const auto write_tree = [&](const std::vector<int>& first_child,
+                              const std::vector<int>& num_children,
+                              const std::vector<int>& visual_word,
+                              const int num_visual_words) {
+    std::ofstream output(filename, std::ios::out | std::ios::binary);
+    cereal::PortableBinaryOutputArchive output_archive(output);
+    output_archive(DescriptorMatrix(DescriptorMatrix::Zero(3, 4)),
+                   first_child,
+                   num_children,
+                   visual_word,
+                   num_visual_words);
+  };
+
+  // A root with two leaves is valid.
+  VocabularyTree vocabulary_tree(SmallVocabularyTreeOptions());
+  write_tree({1, 0, 0}, {2, 0, 0}, {-1, 0, 1}, 2);
+  EXPECT_TRUE(vocabulary_tree.ReadFromFile(filename));
+
+  // The children must be within the nodes.
+  VocabularyTree read_vocabulary_tree(SmallVocabularyTreeOptions());
+  write_tree({1, 0, 0}, {3, 0, 0}, {-1, 0, 1}, 2);
+  EXPECT_FALSE(read_vocabulary_tree.ReadFromFile(filename));
+
+  // The children must come after their parent.
+  write_tree({0, 0, 0}, {2, 0, 0}, {-1, 0, 1}, 2);
+  EXPECT_FALSE(read_vocabulary_tree.ReadFromFile(filename));
+
+  // Each node needs an entry.
+  write_tree({1, 0}, {2, 0}, {-1, 0}, 1);
+  EXPECT_FALSE(read_vocabulary_tree.ReadFromFile(filename));
+
+  // The number of visual words is the number of leaves.
+  write_tree({1, 0, 0}, {2, 0, 0}, {-1, 0, 1}, 3);
+  EXPECT_FALSE(read_vocabulary_tree.ReadFromFile(filename));
+  EXPECT_FALSE(read_vocabulary_tree.IsTrained());
+
+  // A truncated file cannot be read.
+  std::ofstream(filename, std::ios::out | std::ios::binary) << "abc";
+  EXPECT_FALSE(read_vocabulary_tree.ReadFromFile(filename));
+  EXPECT_FALSE(read_vocabulary_tree.IsTrained());
+}
+
+}  // namespace theia
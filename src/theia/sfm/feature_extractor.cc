@@ -42,18 +42,68 @@
 
 #include "theia/image/descriptor/create_descriptor_extractor.h"
 #include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor_pool.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/descriptor_quantization.h"
 #include "theia/io/write_keypoints_and_descriptors.h"
 #include "theia/image/image.h"
 #include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/image/keypoint_detector/keypoint_selection.h"
 #include "theia/util/filesystem.h"
 #include "theia/util/threadpool.h"
 
 namespace theia {
 
-bool FeatureExtractor::Extract(
+namespace {
+
+// Runs the detector and extracts float or binary descriptors depending on the
+// type of the descriptor matrix.
+bool DetectAndExtractDescriptors(DescriptorExtractor* descriptor_extractor,
+                                 const FloatImage& image,
+                                 std::vector<Keypoint>* keypoints,
+                                 DescriptorMatrix* descriptors) {
+  return descriptor_extractor->DetectAndExtractDescriptors(
+      image, keypoints, descriptors);
+}
+
+bool DetectAndExtractDescriptors(DescriptorExtractor* descriptor_extractor,
+                                 const FloatImage& image,
+                                 std::vector<Keypoint>* keypoints,
+                                 BinaryDescriptorMatrix* descriptors) {
+  return descriptor_extractor->DetectAndExtractBinaryDescriptors(
+      image, keypoints, descriptors);
+}
+
+// Writes the features to disk. Float descriptors are quantized first if they
+// should be stored with a lower precision.
+bool WriteFeatures(const std::string& features_file,
+                   const std::vector<Keypoint>& keypoints,
+                   const DescriptorMatrix& descriptors,
+                   const DescriptorPrecision descriptor_precision) {
+  if (descriptor_precision == DescriptorPrecision::UINT8) {
+    QuantizedDescriptorMatrix quantized_descriptors;
+    QuantizeDescriptors(descriptors, &quantized_descriptors);
+    return WriteKeypointsAndDescriptors(
+        features_file, keypoints, quantized_descriptors);
+  }
+  return WriteKeypointsAndDescriptors(features_file, keypoints, descriptors);
+}
+
+// Binary descriptors are always written as they are.
+bool WriteFeatures(const std::string& features_file,
+                   const std::vector<Keypoint>& keypoints,
+                   const BinaryDescriptorMatrix& descriptors,
+                   const DescriptorPrecision descriptor_precision) {
+  return WriteKeypointsAndDescriptors(features_file, keypoints, descriptors);
+}
+
+}  // namespace
+
+template <class DescriptorMatrixType>
+bool FeatureExtractor::ExtractFromFiles(
     const std::vector<std::string>& filenames,
     std::vector<std::vector<Keypoint> >* keypoints,
-    std::vector<std::vector<Eigen::VectorXf> >* descriptors) {
+    std::vector<DescriptorMatrixType>* descriptors) {
   CHECK_GT(filenames.size(), 0) << "FeatureExtractor::Extract requires at "
                                    "least one image in order to extract "
                                    "features.";
@@ -72,7 +122,7 @@ bool FeatureExtractor::Extract(
     }
 
     feature_extractor_pool.Add(
-        &FeatureExtractor::ExtractFeatures,
+        &FeatureExtractor::ExtractFeatures<DescriptorMatrixType>,
         this,
         filenames[i],
         &(*keypoints)[i],
@@ -81,10 +131,11 @@ bool FeatureExtractor::Extract(
   return true;
 }
 
-bool FeatureExtractor::Extract(
+template <class DescriptorMatrixType>
+bool FeatureExtractor::ExtractFromImages(
     const std::vector<FloatImage>& images,
     std::vector<std::vector<Keypoint> >* keypoints,
-    std::vector<std::vector<Eigen::VectorXf> >* descriptors) {
+    std::vector<DescriptorMatrixType>* descriptors) {
   CHECK_GT(images.size(), 0) << "FeatureExtractor::Extract requires at "
             "least one image in order to extract "
             "features.";
@@ -97,7 +148,7 @@ bool FeatureExtractor::Extract(
   ThreadPool feature_extractor_pool(num_threads);
   for (int i = 0; i < images.size(); i++) {
     feature_extractor_pool.Add(
-            &FeatureExtractor::ExtractFeaturesFromImage,
+            &FeatureExtractor::ExtractFeaturesFromImage<DescriptorMatrixType>,
             this,
             images[i],
             &(*keypoints)[i],
@@ -106,34 +157,22 @@ bool FeatureExtractor::Extract(
   return true;
 }
 
-bool FeatureExtractor::ExtractToDisk(
-    const std::vector<std::string>& filenames) {
-  write_features_to_disk_ = true;
-  // Determine if the directory for writing out feature exists. If not, try to
-  // create it.
-  if (!DirectoryExists(options_.output_directory)) {
-    CHECK(CreateNewDirectory(options_.output_directory))
-        << "Could not create the directory for storing features: "
-        << options_.output_directory;
-  }
-
-  std::vector<std::vector<Keypoint> > keypoints;
-  std::vector<std::vector<Eigen::VectorXf> > descriptors;
-  return Extract(filenames, &keypoints, &descriptors);
-}
-
+template <class DescriptorMatrixType>
 bool FeatureExtractor::ExtractFeatures(
     const std::string& filename,
     std::vector<Keypoint>* keypoints,
-    std::vector<Eigen::VectorXf>* descriptors) {
-  std::unique_ptr<FloatImage> image(new FloatImage(filename));
+    DescriptorMatrixType* descriptors) {
+  std::unique_ptr<FloatImage> image(new FloatImage());
+  const int downsampling_factor =
+      image->ReadWithMaxDimension(filename, options_.max_image_dimension);
   if (!ExtractFeaturesFromImage(*image, keypoints, descriptors)) {
     LOG(ERROR) << "Could not extract descriptors in image " << filename;
     return false;
   } else {
-    VLOG(1) << "Successfully extracted " << descriptors->size()
+    VLOG(1) << "Successfully extracted " << descriptors->rows()
             << " features from image " << filename;
   }
+  ScaleKeypointsToFullResolution(downsampling_factor, keypoints);
 
   if (write_features_to_disk_) {
     std::string output_dir = options_.output_directory;
@@ -148,45 +187,108 @@ bool FeatureExtractor::ExtractFeatures(
     std::string features_file = output_dir + image_filename + ".features";
 
     // Write the features to disk.
-    CHECK(WriteKeypointsAndDescriptors(features_file, *keypoints, *descriptors))
+    CHECK(WriteFeatures(features_file,
+                        *keypoints,
+                        *descriptors,
+                        options_.descriptor_precision))
       << "Could not write features for image " << image_filename
       << " from file " << features_file;
 
     // Remove the features from memory.
     keypoints->clear();
-    descriptors->clear();
+    descriptors->resize(0, 0);
   }
   return true;
 }
 
+template <class DescriptorMatrixType>
 bool FeatureExtractor::ExtractFeaturesFromImage(
     const FloatImage& image,
     std::vector<Keypoint>* keypoints,
-    std::vector<Eigen::VectorXf>* descriptors) {
-  // We create these variable here instead of upon the construction of the
-  // object so that they can be thread-safe. We *should* be able to use the
-  // static thread_local keywords, but apparently Mac OS-X's version of clang
-  // does not actually support it!
-  //
-  // TODO(cmsweeney): Change this so that each thread in the threadpool receives
-  // exactly one object.
-  std::unique_ptr<DescriptorExtractor> descriptor_extractor =
-      CreateDescriptorExtractor(options_.descriptor_extractor_type,
-                                options_.feature_density);
+    DescriptorMatrixType* descriptors) {
+  // The extractor is not used by any other thread until it is returned to the
+  // pool at the end of this function.
+  DescriptorExtractorPool::Handle descriptor_extractor =
+      descriptor_extractor_pool_.Acquire();
 
   // Exit if the descriptor extraction fails.
-  if (!descriptor_extractor->DetectAndExtractDescriptors(image,
-                                                         keypoints,
-                                                         descriptors)) {
+  if (!DetectAndExtractDescriptors(descriptor_extractor.get(),
+                                   image,
+                                   keypoints,
+                                   descriptors)) {
     return false;
   }
 
+  // The extractors already limit the number of keypoints that they detect, but
+  // tiled images may still have more keypoints than desired. The keypoints are
+  // selected so that they remain spread over the image.
   if (keypoints->size() > options_.max_num_features) {
-    keypoints->resize(options_.max_num_features);
-    descriptors->resize(options_.max_num_features);
+    std::vector<bool> keep;
+    SelectSpatiallyBalancedKeypoints(*keypoints,
+                                     image.Width(),
+                                     image.Height(),
+                                     options_.max_num_features,
+                                     &keep);
+    std::vector<Keypoint> selected_keypoints;
+    selected_keypoints.reserve(options_.max_num_features);
+    for (int i = 0; i < keypoints->size(); i++) {
+      if (keep[i]) {
+        selected_keypoints.emplace_back(keypoints->at(i));
+      }
+    }
+    keypoints->swap(selected_keypoints);
+    FilterDescriptorRows(keep, descriptors);
   }
 
   return true;
 }
 
+bool FeatureExtractor::Extract(
+    const std::vector<std::string>& filenames,
+    std::vector<std::vector<Keypoint> >* keypoints,
+    std::vector<DescriptorMatrix>* descriptors) {
+  return ExtractFromFiles(filenames, keypoints, descriptors);
+}
+
+bool FeatureExtractor::Extract(
+    const std::vector<FloatImage>& images,
+    std::vector<std::vector<Keypoint> >* keypoints,
+    std::vector<DescriptorMatrix>* descriptors) {
+  return ExtractFromImages(images, keypoints, descriptors);
+}
+
+bool FeatureExtractor::Extract(
+    const std::vector<std::string>& filenames,
+    std::vector<std::vector<Keypoint> >* keypoints,
+    std::vector<BinaryDescriptorMatrix>* descriptors) {
+  return ExtractFromFiles(filenames, keypoints, descriptors);
+}
+
+bool FeatureExtractor::Extract(
+    const std::vector<FloatImage>& images,
+    std::vector<std::vector<Keypoint> >* keypoints,
+    std::vector<BinaryDescriptorMatrix>* descriptors) {
+  return ExtractFromImages(images, keypoints, descriptors);
+}
+
+bool FeatureExtractor::ExtractToDisk(
+    const std::vector<std::string>& filenames) {
+  write_features_to_disk_ = true;
+  // Determine if the directory for writing out feature exists. If not, try to
+  // create it.
+  if (!DirectoryExists(options_.output_directory)) {
+    CHECK(CreateNewDirectory(options_.output_directory))
+        << "Could not create the directory for storing features: "
+        << options_.output_directory;
+  }
+
+  std::vector<std::vector<Keypoint> > keypoints;
+  if (IsBinaryDescriptorExtractorType(options_.descriptor_extractor_type)) {
+    std::vector<BinaryDescriptorMatrix> descriptors;
+    return Extract(filenames, &keypoints, &descriptors);
+  }
+  std::vector<DescriptorMatrix> descriptors;
+  return Extract(filenames, &keypoints, &descriptors);
+}
+
 }  // namespace theia
@@ -40,6 +40,9 @@
 
 #include "theia/alignment/alignment.h"
 #include "theia/image/descriptor/create_descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor_pool.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/descriptor_quantization.h"
 #include "theia/util/util.h"
 #include "theia/image/image.h"
 
@@ -60,46 +63,97 @@ class FeatureExtractor {
     // extracted.
     FeatureDensity feature_density = FeatureDensity::NORMAL;
 
-    // The features returned will be no larger than this size.
+    // The features returned will be no larger than this size. The features are
+    // selected by their strength in a way that spreads them over the image, and
+    // the descriptors of the features that are not selected are not computed.
     int max_num_features = 16384;
 
+    // If positive, images read from file are downsampled so that neither
+    // their width nor their height is larger than this value before the
+    // features are extracted. The keypoints are scaled back to the full
+    // resolution of the image. This reduces the time and memory to extract
+    // features from very large images.
+    int max_image_dimension = 0;
+
+    // If positive, features are extracted from images that are wider or taller
+    // than this value in overlapping tiles of at most this size, so that the
+    // memory of each extraction thread is bounded regardless of the image size.
+    int max_tile_dimension = 0;
+
     // If we wish to write the features to disk, they will be output in this
     // directory with the same name as the input image and a ".features"
     // appended.
     std::string output_directory = "";
+
+    // The precision that float descriptors are written to disk with. UINT8
+    // descriptors take a quarter of the disk space. This has no effect on the
+    // descriptors that are returned by Extract() or on binary descriptors.
+    DescriptorPrecision descriptor_precision = DescriptorPrecision::FLOAT;
   };
 
   explicit FeatureExtractor(const Options& options)
-      : options_(options), write_features_to_disk_(false) {}
+      : options_(options),
+        descriptor_extractor_pool_(options.descriptor_extractor_type,
+                                   options.feature_density,
+                                   options.max_num_features,
+                                   options.max_tile_dimension),
+        write_features_to_disk_(false) {}
   ~FeatureExtractor() {}
 
-  // Method to extract descriptors.
+  // Method to extract descriptors. The descriptors of image i are stored in
+  // (*descriptors)[i] with one descriptor per row.
   bool Extract(const std::vector<std::string>& filenames,
                std::vector<std::vector<Keypoint> >* keypoints,
-               std::vector<std::vector<Eigen::VectorXf> >* descriptors);
+               std::vector<DescriptorMatrix>* descriptors);
 
   // Method to extract descriptors from FloatImages
   bool Extract(const std::vector<FloatImage>& images,
                std::vector<std::vector<Keypoint> >* keypoints,
-               std::vector<std::vector<Eigen::VectorXf> >* descriptors);
+               std::vector<DescriptorMatrix>* descriptors);
+
+  // Same as above, but extracts bit-packed binary descriptors. The descriptor
+  // type in the options must be a binary descriptor type (e.g., BINARY_AKAZE).
+  bool Extract(const std::vector<std::string>& filenames,
+               std::vector<std::vector<Keypoint> >* keypoints,
+               std::vector<BinaryDescriptorMatrix>* descriptors);
+  bool Extract(const std::vector<FloatImage>& images,
+               std::vector<std::vector<Keypoint> >* keypoints,
+               std::vector<BinaryDescriptorMatrix>* descriptors);
 
   // Extracts descriptors and writes them to disk. The features from each image
   // are written to individual files in the directory specified in the options.
   bool ExtractToDisk(const std::vector<std::string>& filenames);
 
  private:
+  // Extracts the features of all images with the threadpool. The descriptor
+  // matrix type determines whether float or binary descriptors are extracted.
+  template <class DescriptorMatrixType>
+  bool ExtractFromFiles(const std::vector<std::string>& filenames,
+                        std::vector<std::vector<Keypoint> >* keypoints,
+                        std::vector<DescriptorMatrixType>* descriptors);
+  template <class DescriptorMatrixType>
+  bool ExtractFromImages(const std::vector<FloatImage>& images,
+                         std::vector<std::vector<Keypoint> >* keypoints,
+                         std::vector<DescriptorMatrixType>* descriptors);
+
   // Extracts the features and metadata for a single image. This function is
   // called by the threadpool and is thus thread safe.
+  template <class DescriptorMatrixType>
   bool ExtractFeatures(const std::string& filename,
                        std::vector<Keypoint>* keypoints,
-                       std::vector<Eigen::VectorXf>* descriptors);
+                       DescriptorMatrixType* descriptors);
 
   // Extracts the features from a FloatImage
+  template <class DescriptorMatrixType>
   bool ExtractFeaturesFromImage(const FloatImage& image,
                                 std::vector<Keypoint>* keypoints,
-                                std::vector<Eigen::VectorXf>* descriptors);
+                                DescriptorMatrixType* descriptors);
 
   const Options options_;
+
+  // Each thread acquires a descriptor extractor from the pool for the image it
+  // processes, so the extractors and their buffers are reused across images.
+  DescriptorExtractorPool descriptor_extractor_pool_;
   bool write_features_to_disk_;
 
   DISALLOW_COPY_AND_ASSIGN(FeatureExtractor);
@@ -40,24 +40,33 @@
 #include <memory>
 #include <string>
 #include <thread>  // NOLINT
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "theia/image/descriptor/create_descriptor_extractor.h"
 #include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor_pool.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/descriptor_quantization.h"
 #include "theia/image/image.h"
 #include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/image/keypoint_detector/keypoint_selection.h"
 #include "theia/matching/create_feature_matcher.h"
 #include "theia/matching/feature_correspondence.h"
 #include "theia/matching/feature_matcher_options.h"
 #include "theia/matching/features_and_matches_database.h"
 #include "theia/matching/fisher_vector_extractor.h"
 #include "theia/matching/global_descriptor_extractor.h"
+#include "theia/matching/global_descriptor_nearest_neighbors.h"
 #include "theia/matching/image_pair_match.h"
+#include "theia/matching/vocabulary_tree.h"
 #include "theia/sfm/camera_intrinsics_prior.h"
 #include "theia/sfm/estimate_twoview_info.h"
 #include "theia/sfm/exif_reader.h"
 #include "theia/sfm/two_view_match_geometric_verification.h"
 #include "theia/util/filesystem.h"
+#include "theia/util/map_util.h"
 #include "theia/util/string.h"
 #include "theia/util/threadpool.h"
 
@@ -69,33 +78,49 @@ struct MatchedImages {
   std::unordered_set<int> expanded_matches;
 };
 
+// Returns the float descriptors of the features. Quantized descriptors are
+// converted into dequantized_descriptors, which is then returned.
+const DescriptorMatrix& GetFloatDescriptors(
+    const KeypointsAndDescriptors& features,
+    DescriptorMatrix* dequantized_descriptors) {
+  if (!features.HasQuantizedDescriptors()) {
+    return features.descriptors;
+  }
+  DequantizeDescriptors(features.quantized_descriptors,
+                        dequantized_descriptors);
+  return *dequantized_descriptors;
+}
+
 void ExtractFeatures(const FeatureExtractorAndMatcher::Options& options,
                      const std::string& image_filepath,
                      const std::string& imagemask_filepath,
-                     std::vector<Keypoint>* keypoints,
-                     std::vector<Eigen::VectorXf>* descriptors) {
+                     DescriptorExtractor* descriptor_extractor,
+                     KeypointsAndDescriptors* features) {
   static const float kMaskThreshold = 0.5;
-  std::unique_ptr<FloatImage> image(new FloatImage(image_filepath));
-  // We create these variable here instead of upon the construction of the
-  // object so that they can be thread-safe. We *should* be able to use the
-  // static thread_local keywords, but apparently Mac OS-X's version of clang
-  // does not actually support it!
-  //
-  // TODO(cmsweeney): Change this so that each thread in the threadpool receives
-  // exactly one object.
-  std::unique_ptr<DescriptorExtractor> descriptor_extractor =
-      CreateDescriptorExtractor(options.descriptor_extractor_type,
-                                options.feature_density);
-
-  // Exit if the descriptor extraction fails.
-  if (!descriptor_extractor->DetectAndExtractDescriptors(
-          *image, keypoints, descriptors)) {
+  std::unique_ptr<FloatImage> image(new FloatImage());
+  const int downsampling_factor = image->ReadWithMaxDimension(
+      image_filepath, options.max_image_dimension);
+
+  // Exit if the descriptor extraction fails. Binary descriptors are stored in
+  // their own matrix and the other descriptor matrix is left empty.
+  std::vector<Keypoint>* keypoints = &features->keypoints;
+  const bool extraction_succeeded =
+      descriptor_extractor->ProducesBinaryDescriptors()
+          ? descriptor_extractor->DetectAndExtractBinaryDescriptors(
+                *image, keypoints, &features->binary_descriptors)
+          : descriptor_extractor->DetectAndExtractDescriptors(
+                *image, keypoints, &features->descriptors);
+  if (!extraction_succeeded) {
     LOG(ERROR) << "Could not extract descriptors in image " << image_filepath;
     return;
   }
 
   if (imagemask_filepath.size() > 0) {
-    std::unique_ptr<FloatImage> image_mask(new FloatImage(imagemask_filepath));
+    // The mask is downsampled the same way as the image, so the keypoints are
+    // masked before they are scaled to the full resolution.
+    std::unique_ptr<FloatImage> image_mask(new FloatImage());
+    image_mask->ReadWithMaxDimension(imagemask_filepath,
+                                     options.max_image_dimension);
     // Check the size of the image and its associated mask.
     CHECK(image_mask->Width() == image->Width() &&
           image_mask->Height() == image->Height())
@@ -109,26 +134,59 @@ void ExtractFeatures(const FeatureExtractorAndMatcher::Options& options,
     image_mask->ConvertToGrayscaleImage();
     // Remove keypoints according to the associated mask (remove kp. in black
     // part).
-    for (int i = keypoints->size() - 1; i > -1; i--) {
-      if (image_mask->BilinearInterpolate(
-              keypoints->at(i).x(), keypoints->at(i).y(), 0) < kMaskThreshold) {
-        keypoints->erase(keypoints->begin() + i);
-        descriptors->erase(descriptors->begin() + i);
+    std::vector<bool> inside_mask(keypoints->size());
+    std::vector<Keypoint> masked_keypoints;
+    masked_keypoints.reserve(keypoints->size());
+    for (int i = 0; i < keypoints->size(); i++) {
+      inside_mask[i] =
+          image_mask->BilinearInterpolate(
+              keypoints->at(i).x(), keypoints->at(i).y(), 0) >= kMaskThreshold;
+      if (inside_mask[i]) {
+        masked_keypoints.emplace_back(keypoints->at(i));
       }
     }
+    keypoints->swap(masked_keypoints);
+    FilterDescriptorRows(inside_mask, &features->descriptors);
+    FilterDescriptorRows(inside_mask, &features->binary_descriptors);
   }
 
+  // The extractors already limit the number of keypoints that they detect, but
+  // masked and tiled images may still have more keypoints than desired. The
+  // keypoints are selected so that they remain spread over the image.
   if (keypoints->size() > options.max_num_features) {
-    keypoints->resize(options.max_num_features);
-    descriptors->resize(options.max_num_features);
+    std::vector<bool> keep;
+    SelectSpatiallyBalancedKeypoints(*keypoints,
+                                     image->Width(),
+                                     image->Height(),
+                                     options.max_num_features,
+                                     &keep);
+    std::vector<Keypoint> selected_keypoints;
+    selected_keypoints.reserve(options.max_num_features);
+    for (int i = 0; i < keypoints->size(); i++) {
+      if (keep[i]) {
+        selected_keypoints.emplace_back(keypoints->at(i));
+      }
+    }
+    keypoints->swap(selected_keypoints);
+    FilterDescriptorRows(keep, &features->descriptors);
+    FilterDescriptorRows(keep, &features->binary_descriptors);
+  }
+  ScaleKeypointsToFullResolution(downsampling_factor, keypoints);
+
+  // Store the float descriptors with a lower precision if desired.
+  if (options.descriptor_precision == DescriptorPrecision::UINT8 &&
+      !features->HasBinaryDescriptors()) {
+    QuantizeDescriptors(features->descriptors,
+                        &features->quantized_descriptors);
+    features->descriptors.resize(0, 0);
   }
 
   if (imagemask_filepath.size() > 0) {
-    VLOG(1) << "Successfully extracted " << descriptors->size()
+    VLOG(1) << "Successfully extracted " << keypoints->size()
             << " features from image " << image_filepath
             << " with an image mask.";
   } else {
-    VLOG(1) << "Successfully extracted " << descriptors->size()
+    VLOG(1) << "Successfully extracted " << keypoints->size()
             << " features from image " << image_filepath;
   }
 }
@@ -139,7 +197,13 @@ FeatureExtractorAndMatcher::FeatureExtractorAndMatcher(
     const FeatureExtractorAndMatcher::Options& options,
     FeaturesAndMatchesDatabase* features_and_matches_database)
     : options_(options),
-      features_and_matches_database_(features_and_matches_database) {
+      features_and_matches_database_(features_and_matches_database),
+      descriptor_extractor_pool_(options.descriptor_extractor_type,
+                                 options.feature_density,
+                                 options.max_num_features,
+                                 options.max_tile_dimension),
+      global_image_descriptor_extractor_is_trained_(false),
+      global_image_descriptor_dimension_is_checked_(false) {
   // Create the feature matcher.
   FeatureMatcherOptions matcher_options = options_.feature_matcher_options;
   matcher_options.num_threads = options_.num_threads;
@@ -152,19 +216,77 @@ FeatureExtractorAndMatcher::FeatureExtractorAndMatcher(
                                   matcher_options,
                                   features_and_matches_database_);
 
-  // Initialize the global image descriptor extractor if desired.
-  if (options_.select_image_pairs_with_global_image_descriptor_matching) {
+  // Initialize the global image descriptor extractor if desired. Global
+  // descriptors can only be computed from float descriptors.
+  const bool binary_descriptors =
+      IsBinaryDescriptorExtractorType(options_.descriptor_extractor_type);
+  if (!options_.select_image_pairs_with_global_image_descriptor_matching) {
+    return;
+  }
+
+  if (binary_descriptors) {
+    LOG(WARNING) << "Global descriptor matching cannot be used with binary "
+                    "descriptors. All image pairs will be matched instead.";
+  } else if (options_.global_descriptor_extractor_type ==
+             GlobalDescriptorExtractorType::VOCABULARY_TREE) {
+    CreateGlobalImageDescriptorExtractor();
+
+    // Reuse a previously trained vocabulary if one is available.
+    if (!options_.vocabulary_tree_filepath.empty() &&
+        FileExists(options_.vocabulary_tree_filepath)) {
+      if (vocabulary_tree_->ReadFromFile(options_.vocabulary_tree_filepath)) {
+        LOG(INFO) << "Read a vocabulary tree with "
+                  << vocabulary_tree_->NumVisualWords()
+                  << " visual words from "
+                  << options_.vocabulary_tree_filepath;
+        global_image_descriptor_extractor_is_trained_ = true;
+      } else {
+        LOG(ERROR) << "Could not read the vocabulary tree from "
+                   << options_.vocabulary_tree_filepath
+                   << ". It is trained on the features of the images instead.";
+      }
+    }
+  } else {
+    CreateGlobalImageDescriptorExtractor();
+
+    // Reuse a previously trained GMM if one is available.
+    if (!options_.fisher_vector_gmm_filepath.empty() &&
+        FileExists(options_.fisher_vector_gmm_filepath)) {
+      if (fisher_vector_extractor_->ReadFromFile(
+              options_.fisher_vector_gmm_filepath)) {
+        LOG(INFO) << "Read a GMM for Fisher Vector extraction from "
+                  << options_.fisher_vector_gmm_filepath;
+        global_image_descriptor_extractor_is_trained_ = true;
+      } else {
+        LOG(ERROR) << "Could not read the GMM from "
+                   << options_.fisher_vector_gmm_filepath
+                   << ". It is trained on the features of the images instead.";
+      }
+    }
+  }
+}
+
+FeatureExtractorAndMatcher::~FeatureExtractorAndMatcher() {}
+
+void FeatureExtractorAndMatcher::CreateGlobalImageDescriptorExtractor() {
+  if (options_.global_descriptor_extractor_type ==
+      GlobalDescriptorExtractorType::VOCABULARY_TREE) {
+    VocabularyTree::Options vt_options;
+    vt_options.branching_factor = options_.vocabulary_tree_branching_factor;
+    vt_options.num_levels = options_.vocabulary_tree_num_levels;
+    vt_options.max_num_features_for_training =
+        options_.max_num_features_for_vocabulary_tree_training;
+    vocabulary_tree_.reset(new VocabularyTree(vt_options));
+  } else {
     FisherVectorExtractor::Options fv_options;
     fv_options.num_gmm_clusters = options_.num_gmm_clusters_for_fisher_vector;
     fv_options.max_num_features_for_training =
         options_.max_num_features_for_fisher_vector_training;
-    global_image_descriptor_extractor_.reset(
-        new FisherVectorExtractor(fv_options));
+    fv_options.num_threads = options_.num_threads;
+    fisher_vector_extractor_.reset(new FisherVectorExtractor(fv_options));
   }
 }
 
-FeatureExtractorAndMatcher::~FeatureExtractorAndMatcher() {}
-
 bool FeatureExtractorAndMatcher::AddImage(const std::string& image_filepath) {
   image_filepaths_.emplace_back(image_filepath);
   return true;
@@ -207,7 +329,9 @@ void FeatureExtractorAndMatcher::SetPairsToMatch(
     image_pairs.emplace_back(image1_filename, image2_filename);
   }
 
-  matcher_->SetImagePairsToMatch(image_pairs);
+  // The pairs are passed to the matcher once the features are extracted, so
+  // that the pairs that are already matched may be removed first.
+  pairs_to_match_.swap(image_pairs);
 }
 
 // Performs feature matching between all images provided by the image
@@ -217,6 +341,19 @@ void FeatureExtractorAndMatcher::SetPairsToMatch(
 void FeatureExtractorAndMatcher::ExtractAndMatchFeatures() {
   CHECK_NOTNULL(matcher_.get());
 
+  // Find the image pairs and the images that were matched by a previous run.
+  // The new images are determined as the images are processed.
+  if (options_.incremental_matching) {
+    for (const auto& image_pair :
+         features_and_matches_database_->ImageNamesOfMatches()) {
+      matched_image_pairs_.emplace(image_pair);
+    }
+    for (const std::string& image_name :
+         features_and_matches_database_->ImageNamesOfMatchedImages()) {
+      matched_image_names_.emplace(image_name);
+    }
+  }
+
   // For each image, process the features and add it to the matcher.
   const int num_threads =
       std::min(options_.num_threads, static_cast<int>(image_filepaths_.size()));
@@ -232,13 +369,46 @@ void FeatureExtractorAndMatcher::ExtractAndMatchFeatures() {
   // This forces all tasks to complete before proceeding.
   thread_pool.reset(nullptr);
 
-  // After all threads complete feature extraction, perform matching.
-  SelectImagePairsWithGlobalDescriptorMatching();
+  if (options_.incremental_matching) {
+    LOG(INFO) << new_image_names_.size() << " of " << image_filepaths_.size()
+              << " images are new and will be matched incrementally.";
+    if (new_image_names_.empty()) {
+      return;
+    }
+  }
+
+  // After all threads complete feature extraction, select the image pairs to
+  // match. If no pairs are selected, the matcher matches all image pairs.
+  std::vector<std::pair<std::string, std::string>> image_pairs;
+  image_pairs.swap(pairs_to_match_);
+  if (GlobalImageDescriptorExtractor() != nullptr) {
+    SelectImagePairsWithGlobalDescriptorMatching(&image_pairs);
+  } else if (options_.incremental_matching && image_pairs.empty()) {
+    SelectImagePairsWithNewImages(&image_pairs);
+  }
   // Free up memory.
-  global_image_descriptor_extractor_.release();
-  
-  LOG(INFO) << "Matching images...";
-  matcher_->MatchImages();
+  vocabulary_tree_.reset();
+  fisher_vector_extractor_.reset();
+
+  if (options_.incremental_matching) {
+    RemoveMatchedImagePairs(&image_pairs);
+  }
+  if (options_.incremental_matching && image_pairs.empty()) {
+    LOG(INFO) << "All selected image pairs are already matched.";
+  } else {
+    if (!image_pairs.empty()) {
+      matcher_->SetImagePairsToMatch(image_pairs);
+    }
+
+    LOG(INFO) << "Matching images...";
+    matcher_->MatchImages();
+  }
+
+  // Record the new images as matched so that later incremental runs do not
+  // match them again, even if none of their image pairs passed verification.
+  for (const std::string& image_name : new_image_names_) {
+    features_and_matches_database_->PutMatchedImage(image_name);
+  }
 }
 
 void FeatureExtractorAndMatcher::ProcessImage(const int i) {
@@ -291,6 +461,7 @@ void FeatureExtractorAndMatcher::ProcessImage(const int i) {
   }
 
   // Extract the features if necessary.
+  bool features_extracted = false;
   if (features_and_matches_database_->ContainsFeatures(image_filename)) {
     VLOG(1) << "Loading features for " << image_filename
             << " from the features and matches database.";
@@ -298,104 +469,219 @@ void FeatureExtractorAndMatcher::ProcessImage(const int i) {
     // Extract Features.
     KeypointsAndDescriptors features;
     features.image_name = image_filename;
+    DescriptorExtractorPool::Handle descriptor_extractor =
+        descriptor_extractor_pool_.Acquire();
     ExtractFeatures(options_,
                     image_filepath,
                     mask_filepath,
-                    &features.keypoints,
-                    &features.descriptors);
+                    descriptor_extractor.get(),
+                    &features);
 
     // Skip the image if not descriptors were extracted.
-    if (features.descriptors.size() == 0) {
+    if (features.keypoints.empty()) {
       return;
     }
 
     // Add the features to the DB.
     features_and_matches_database_->PutFeatures(image_filename, features);
+    features_extracted = true;
   }
 
-  // Add the descriptors to the global image descriptor extractor for training
-  // if using a global image descriptor extractor.
-  if (options_.select_image_pairs_with_global_image_descriptor_matching) {
-    const KeypointsAndDescriptors& features =
-        features_and_matches_database_->GetFeatures(image_filename);
-    CHECK_GT(features.descriptors.size(), 0);
-    global_image_descriptor_extractor_->AddFeaturesForTraining(
-        features.descriptors);
-  }
+  AddFeaturesForGlobalDescriptorTraining(image_filename);
 
   // Add the image to the matcher.
   std::lock_guard<std::mutex> lock(matcher_mutex_);
   matcher_->AddImage(image_filename);
+  if (!options_.incremental_matching || features_extracted ||
+      !ContainsKey(matched_image_names_, image_filename)) {
+    new_image_names_.emplace(image_filename);
+  }
   return;
 }
 
+GlobalDescriptorExtractor*
+FeatureExtractorAndMatcher::GlobalImageDescriptorExtractor() const {
+  if (vocabulary_tree_ != nullptr) {
+    return vocabulary_tree_.get();
+  }
+  return fisher_vector_extractor_.get();
+}
+
+void FeatureExtractorAndMatcher::AddFeaturesForGlobalDescriptorTraining(
+    const std::string& image_name) {
+  std::unique_lock<std::mutex> lock(global_image_descriptor_mutex_);
+  if (GlobalImageDescriptorExtractor() == nullptr ||
+      (global_image_descriptor_extractor_is_trained_ &&
+       global_image_descriptor_dimension_is_checked_)) {
+    return;
+  }
+  lock.unlock();
+
+  const std::shared_ptr<const KeypointsAndDescriptors> features_handle =
+      features_and_matches_database_->GetFeaturesShared(image_name);
+  DescriptorMatrix dequantized_descriptors;
+  const DescriptorMatrix& descriptors =
+      GetFloatDescriptors(*features_handle, &dequantized_descriptors);
+  CHECK_GT(descriptors.rows(), 0);
+
+  lock.lock();
+  // An extractor that was read from disk is checked against the descriptors of
+  // the first image. If it was trained on descriptors of another dimension, it
+  // is replaced by an untrained one before any features are added for
+  // training.
+  if (global_image_descriptor_extractor_is_trained_ &&
+      !global_image_descriptor_dimension_is_checked_) {
+    global_image_descriptor_dimension_is_checked_ = true;
+    const int dimension = vocabulary_tree_ != nullptr
+                              ? vocabulary_tree_->DescriptorDimension()
+                              : fisher_vector_extractor_->DescriptorDimension();
+    if (dimension != descriptors.cols()) {
+      LOG(ERROR) << "The global image descriptor extractor that was read from "
+                    "disk was trained on descriptors with "
+                 << dimension << " dimensions, but the descriptors have "
+                 << descriptors.cols()
+                 << ". It is trained on the features of the images instead.";
+      CreateGlobalImageDescriptorExtractor();
+      global_image_descriptor_extractor_is_trained_ = false;
+    }
+  }
+  if (!global_image_descriptor_extractor_is_trained_) {
+    GlobalImageDescriptorExtractor()->AddFeaturesForTraining(descriptors);
+  }
+}
+
+Eigen::VectorXf FeatureExtractorAndMatcher::ExtractGlobalDescriptor(
+    const std::string& image_name) {
+  const std::shared_ptr<const KeypointsAndDescriptors> features_handle =
+      features_and_matches_database_->GetFeaturesShared(image_name);
+  DescriptorMatrix dequantized_descriptors;
+  return GlobalImageDescriptorExtractor()->ExtractGlobalDescriptor(
+      GetFloatDescriptors(*features_handle, &dequantized_descriptors));
+}
+
 void FeatureExtractorAndMatcher::ExtractGlobalDesriptors(
     const std::vector<std::string>& image_names,
-    std::vector<Eigen::VectorXf>* global_descriptors) {
-  // Extract the global descriptors in parallel.
+    DescriptorMatrix* global_descriptors) {
+  if (image_names.empty()) {
+    global_descriptors->resize(0, 0);
+    return;
+  }
+
+  // The first global descriptor determines the size of the output.
+  const Eigen::VectorXf first_global_descriptor =
+      ExtractGlobalDescriptor(image_names[0]);
+  global_descriptors->resize(image_names.size(),
+                             first_global_descriptor.size());
+  global_descriptors->row(0) = first_global_descriptor.transpose();
+
+  // Extract the remaining global descriptors in parallel.
   ThreadPool pool(options_.num_threads);
-  global_descriptors->resize(image_names.size());
-  for (int i = 0; i < image_names.size(); i++) {
+  for (int i = 1; i < image_names.size(); i++) {
     pool.Add(
         [&](const int i) {
-          const KeypointsAndDescriptors& features =
-              features_and_matches_database_->GetFeatures(image_names[i]);
-          // Extract the global descriptors
-          (*global_descriptors)[i] =
-              global_image_descriptor_extractor_->ExtractGlobalDescriptor(
-                  features.descriptors);
+          global_descriptors->row(i) =
+              ExtractGlobalDescriptor(image_names[i]).transpose();
         },
         i);
   }
 }
 
-void FeatureExtractorAndMatcher::
-    SelectImagePairsWithGlobalDescriptorMatching() {
+void FeatureExtractorAndMatcher::QueryVocabularyTree(
+    const std::vector<std::string>& image_names,
+    const std::vector<int>& query_indices,
+    std::vector<std::vector<int> >* nearest_neighbors) {
+  // Add all images to the inverted file in parallel.
+  {
+    ThreadPool pool(options_.num_threads);
+    for (int i = 0; i < image_names.size(); i++) {
+      pool.Add(
+          [&](const int i) {
+            const std::shared_ptr<const KeypointsAndDescriptors>
+                features_handle =
+                    features_and_matches_database_->GetFeaturesShared(
+                        image_names[i]);
+            DescriptorMatrix dequantized_descriptors;
+            vocabulary_tree_->AddImageToInvertedFile(
+                i,
+                GetFloatDescriptors(*features_handle,
+                                    &dequantized_descriptors));
+          },
+          i);
+    }
+  }
+
+  vocabulary_tree_->QueryInvertedFile(
+      query_indices,
+      options_.num_nearest_neighbors_for_global_descriptor_matching,
+      options_.num_threads,
+      nearest_neighbors);
+}
+
+void FeatureExtractorAndMatcher::SelectImagePairsWithGlobalDescriptorMatching(
+    std::vector<std::pair<std::string, std::string>>* image_pairs) {
   // Train the global descriptor extractor based on the input features.
-  VLOG(2) << "Training global image descriptor...";
-  CHECK(global_image_descriptor_extractor_->Train());
+  if (!global_image_descriptor_extractor_is_trained_) {
+    VLOG(2) << "Training global image descriptor...";
+    CHECK(GlobalImageDescriptorExtractor()->Train());
+
+    // Store the vocabulary so that it may be reused by later runs.
+    if (vocabulary_tree_ != nullptr &&
+        !options_.vocabulary_tree_filepath.empty() &&
+        !vocabulary_tree_->WriteToFile(options_.vocabulary_tree_filepath)) {
+      LOG(WARNING) << "Could not write the vocabulary tree to "
+                   << options_.vocabulary_tree_filepath;
+    }
+    if (fisher_vector_extractor_ != nullptr &&
+        !options_.fisher_vector_gmm_filepath.empty() &&
+        !fisher_vector_extractor_->WriteToFile(
+            options_.fisher_vector_gmm_filepath)) {
+      LOG(WARNING) << "Could not write the GMM to "
+                   << options_.fisher_vector_gmm_filepath;
+    }
+  }
 
   // Get the image filename without the directory.
   const std::vector<std::string> image_names =
       features_and_matches_database_->ImageNamesOfFeatures();
 
-  // Extract global image descriptors.
-  std::vector<Eigen::VectorXf> global_descriptors;
-  ExtractGlobalDesriptors(image_names, &global_descriptors);
-
-  VLOG(2) << "Computing image-to-image similarity scores with global "
-             "descriptors...";
-
-  // For each image, find the kNN and add those to our selection for matching.
-  const int num_nearest_neighbors =
-      std::min(static_cast<int>(image_names.size() - 1),
-               options_.num_nearest_neighbors_for_global_descriptor_matching);
-
-  std::unordered_map<int, MatchedImages> pairs_to_match;
-
-  // Match all pairs of global descriptors. For each image, the K most similar
-  // image (i.e. the ones with the lowest distance between global descriptors)
-  // are set for matching.
-  std::vector<std::vector<std::pair<float, int>>> global_matching_scores(
-      global_descriptors.size());
-  for (int i = 0; i < global_descriptors.size(); i++) {
-    // Compute the matching scores between all (i, j) pairs.
-    for (int j = i + 1; j < global_descriptors.size(); j++) {
-      const float global_feature_match_score =
-          (global_descriptors[i] - global_descriptors[j]).squaredNorm();
-      // Add the global feature matching score to both images.
-      global_matching_scores[i].emplace_back(global_feature_match_score, j);
-      global_matching_scores[j].emplace_back(global_feature_match_score, i);
+  // Only the new images are queried for incremental matching. Otherwise, all
+  // images are queried.
+  std::vector<int> query_indices;
+  query_indices.reserve(image_names.size());
+  for (int i = 0; i < image_names.size(); i++) {
+    if (!options_.incremental_matching ||
+        ContainsKey(new_image_names_, image_names[i])) {
+      query_indices.emplace_back(i);
     }
+  }
 
-    // Find the top K matching results for image i.
-    std::partial_sort(global_matching_scores[i].begin(),
-                      global_matching_scores[i].begin() + num_nearest_neighbors,
-                      global_matching_scores[i].end());
+  // For each image, the K most similar images (i.e. the ones with the lowest
+  // distance between global descriptors) are set for matching.
+  std::vector<std::vector<int>> nearest_neighbors;
+  if (vocabulary_tree_ != nullptr) {
+    VLOG(2) << "Retrieving similar images with the vocabulary tree...";
+    QueryVocabularyTree(image_names, query_indices, &nearest_neighbors);
+  } else {
+    // Extract global image descriptors.
+    DescriptorMatrix global_descriptors;
+    ExtractGlobalDesriptors(image_names, &global_descriptors);
+
+    VLOG(2) << "Computing image-to-image similarity scores with global "
+               "descriptors...";
+
+    // Match all pairs of global descriptors.
+    ComputeGlobalDescriptorNearestNeighbors(
+        global_descriptors,
+        query_indices,
+        options_.num_nearest_neighbors_for_global_descriptor_matching,
+        options_.num_threads,
+        &nearest_neighbors);
+  }
 
+  std::unordered_map<int, MatchedImages> pairs_to_match;
+  for (int i = 0; i < nearest_neighbors.size(); i++) {
     // Add each of the kNN to the output indices.
-    for (int j = 0; j < num_nearest_neighbors; j++) {
-      const int second_id = global_matching_scores[i][j].second;
+    for (const int second_id : nearest_neighbors[i]) {
 
       // Perform query expansion by adding image i as a candidate match to all of its matches neighbors.
       const auto& neighbors_of_second_id = pairs_to_match[second_id].ranked_matches;
@@ -408,15 +694,16 @@ void FeatureExtractorAndMatcher::
       pairs_to_match[second_id].ranked_matches.insert(i);
 
     }
-
-    // Remove the matching scores for image i to free up memory.
-    global_matching_scores[i].clear();
   }
 
 
   // Collect all matches into one container.
-  std::vector<std::pair<std::string, std::string>> image_names_to_match;
-  image_names_to_match.reserve(num_nearest_neighbors * global_descriptors.size());
+  std::vector<std::pair<std::string, std::string>>& image_names_to_match =
+      *image_pairs;
+  image_names_to_match.clear();
+  image_names_to_match.reserve(
+      options_.num_nearest_neighbors_for_global_descriptor_matching *
+      image_names.size());
   for (const auto& matches : pairs_to_match) {
     for (const int match : matches.second.ranked_matches) {
       if (matches.first < match) {
@@ -434,9 +721,42 @@ void FeatureExtractorAndMatcher::
   // Uniquify the matches.
   std::sort(image_names_to_match.begin(), image_names_to_match.end());
   image_names_to_match.erase(std::unique(image_names_to_match.begin(), image_names_to_match.end()), image_names_to_match.end());
-  
-  // Tell the matcher which pairs to match.
-  matcher_->SetImagePairsToMatch(image_names_to_match);
+}
+
+void FeatureExtractorAndMatcher::SelectImagePairsWithNewImages(
+    std::vector<std::pair<std::string, std::string>>* image_pairs) {
+  // Each new image is paired with all images whose features are in the
+  // database. Pairs of two new images are only added once.
+  const std::vector<std::string> image_names =
+      features_and_matches_database_->ImageNamesOfFeatures();
+  image_pairs->clear();
+  for (const std::string& new_image_name : new_image_names_) {
+    for (const std::string& image_name : image_names) {
+      if (new_image_name < image_name ||
+          (image_name != new_image_name &&
+           !ContainsKey(new_image_names_, image_name))) {
+        image_pairs->emplace_back(new_image_name, image_name);
+      }
+    }
+  }
+}
+
+void FeatureExtractorAndMatcher::RemoveMatchedImagePairs(
+    std::vector<std::pair<std::string, std::string>>* image_pairs) const {
+  const int num_image_pairs = image_pairs->size();
+  image_pairs->erase(
+      std::remove_if(
+          image_pairs->begin(),
+          image_pairs->end(),
+          [this](const std::pair<std::string, std::string>& image_pair) {
+            return ContainsKey(matched_image_pairs_, image_pair) ||
+                   ContainsKey(matched_image_pairs_,
+                               std::make_pair(image_pair.second,
+                                              image_pair.first));
+          }),
+      image_pairs->end());
+  VLOG(1) << num_image_pairs - image_pairs->size() << " of "
+          << num_image_pairs << " image pairs are already matched.";
 }
 
 }  // namespace theia
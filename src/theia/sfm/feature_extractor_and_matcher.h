@@ -39,16 +39,25 @@
 #include <mutex>  // NOLINT
 #include <string>
 #include <thread>  // NOLINT
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "theia/image/descriptor/create_descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor_pool.h"
+#include "theia/image/descriptor/descriptor_quantization.h"
 #include "theia/matching/create_feature_matcher.h"
 #include "theia/matching/feature_matcher.h"
 #include "theia/matching/feature_matcher_options.h"
+#include "theia/matching/global_descriptor_extractor.h"
 #include "theia/sfm/exif_reader.h"
+#include "theia/util/hash.h"
 
 namespace theia {
+class FisherVectorExtractor;
 class GlobalDescriptorExtractor;
+class VocabularyTree;
 struct CameraIntrinsicsPrior;
 struct ImagePairMatch;
 
@@ -72,9 +81,29 @@ class FeatureExtractorAndMatcher {
     // extracted.
     FeatureDensity feature_density = FeatureDensity::NORMAL;
 
-    // The features returned will be no larger than this size.
+    // The features returned will be no larger than this size. The features are
+    // selected by their strength in a way that spreads them over the image, and
+    // the descriptors of the features that are not selected are not computed.
     int max_num_features = 16384;
 
+    // If positive, the images (and their masks) are downsampled so that
+    // neither their width nor their height is larger than this value before
+    // the features are extracted. The keypoints are scaled back to the full
+    // resolution of the image. This reduces the time and memory to extract
+    // features from very large images.
+    int max_image_dimension = 0;
+
+    // If positive, features are extracted from images that are wider or taller
+    // than this value in overlapping tiles of at most this size, so that the
+    // memory of each extraction thread is bounded regardless of the image size.
+    int max_tile_dimension = 0;
+
+    // The precision that float descriptors are stored with in the features and
+    // matches database. UINT8 descriptors use a quarter of the memory and disk
+    // space and are matched with integer distance kernels. This has no effect
+    // on binary descriptors.
+    DescriptorPrecision descriptor_precision = DescriptorPrecision::FLOAT;
+
     // Minimum number of inliers to consider the matches a good match.
     int min_num_inlier_matches = 30;
 
@@ -91,9 +120,39 @@ class FeatureExtractorAndMatcher {
     bool select_image_pairs_with_global_image_descriptor_matching = true;
     int num_nearest_neighbors_for_global_descriptor_matching = 100;
 
-    // Specific options for Fisher Vector global feature extraction.
+    // The global image descriptor used to select the image pairs to match.
+    GlobalDescriptorExtractorType global_descriptor_extractor_type =
+        GlobalDescriptorExtractorType::FISHER_VECTOR;
+
+    // Specific options for Fisher Vector global feature extraction. If
+    // fisher_vector_gmm_filepath is set and the file exists, the GMM is read
+    // from it instead of being trained. Otherwise the GMM is trained on the
+    // features of the images and written to fisher_vector_gmm_filepath so that
+    // later runs may reuse it.
+    std::string fisher_vector_gmm_filepath = "";
     int num_gmm_clusters_for_fisher_vector = 16;
     int max_num_features_for_fisher_vector_training = 1000000;
+
+    // Specific options for vocabulary tree image retrieval. If
+    // vocabulary_tree_filepath is set and the file exists, the vocabulary is
+    // read from it instead of being trained. Otherwise the vocabulary is
+    // trained on the features of the images and written to
+    // vocabulary_tree_filepath so that later runs may reuse it.
+    std::string vocabulary_tree_filepath = "";
+    int vocabulary_tree_branching_factor = 10;
+    int vocabulary_tree_num_levels = 5;
+    int max_num_features_for_vocabulary_tree_training = 1000000;
+
+    // If true, the features and matches database is assumed to hold the
+    // features and matches of previous runs, and only the image pairs that
+    // contain a new image are matched. An image is new if its features are
+    // extracted by this run or if the database does not record it as matched
+    // (see FeaturesAndMatchesDatabase::PutMatchedImage), so images without
+    // any verified image pairs are not matched again. Image pairs whose
+    // matches are already in the database are not matched again. When global
+    // descriptor matching is used, only the new images are queried for their
+    // nearest neighbors, which are found among all images.
+    bool incremental_matching = false;
   };
 
   explicit FeatureExtractorAndMatcher(
@@ -134,10 +193,44 @@ class FeatureExtractorAndMatcher {
   // If global descriptor matching is used, select the best set of image pairs
   // to perform feature matching on. This dramatically speeds up the matching
   // pipeline over N^2 matching.
-  void SelectImagePairsWithGlobalDescriptorMatching();
-  void ExtractGlobalDesriptors(
-      const std::vector<std::string>& image_names,
-      std::vector<Eigen::VectorXf>* global_descriptors);
+  void SelectImagePairsWithGlobalDescriptorMatching(
+      std::vector<std::pair<std::string, std::string> >* image_pairs);
+
+  // Selects the image pairs between each new image and all other images for
+  // incremental matching.
+  void SelectImagePairsWithNewImages(
+      std::vector<std::pair<std::string, std::string> >* image_pairs);
+
+  // Removes the image pairs whose matches are already in the database.
+  void RemoveMatchedImagePairs(
+      std::vector<std::pair<std::string, std::string> >* image_pairs) const;
+
+  // Returns the global image descriptor extractor that is set, or null if
+  // global descriptor matching is not used.
+  GlobalDescriptorExtractor* GlobalImageDescriptorExtractor() const;
+
+  // Creates an untrained global image descriptor extractor of the type set in
+  // the options, replacing the current one.
+  void CreateGlobalImageDescriptorExtractor();
+
+  // Adds the descriptors of the image for training the global image descriptor
+  // extractor if it is not trained yet. If the extractor was read from disk,
+  // the descriptors of the first image are used to check that it was trained
+  // on descriptors of the same dimension, and it is trained on the features of
+  // the images otherwise.
+  void AddFeaturesForGlobalDescriptorTraining(const std::string& image_name);
+
+  // Extracts the global descriptors of the images. Row i of the output holds
+  // the global descriptor of image_names[i].
+  void ExtractGlobalDesriptors(const std::vector<std::string>& image_names,
+                               DescriptorMatrix* global_descriptors);
+  Eigen::VectorXf ExtractGlobalDescriptor(const std::string& image_name);
+
+  // Finds the nearest neighbors of each image with the inverted file of the
+  // vocabulary tree.
+  void QueryVocabularyTree(const std::vector<std::string>& image_names,
+                           const std::vector<int>& query_indices,
+                           std::vector<std::vector<int> >* nearest_neighbors);
 
   const Options options_;
   FeaturesAndMatchesDatabase* features_and_matches_database_;
@@ -147,15 +240,41 @@ class FeatureExtractorAndMatcher {
   std::vector<std::string> image_filepaths_;
   std::unordered_map<std::string, std::string> image_masks_;
 
+  // The image pairs passed to SetPairsToMatch, converted to image filenames.
+  std::vector<std::pair<std::string, std::string> > pairs_to_match_;
+
+  // For incremental matching, the image pairs whose matches were in the
+  // database before matching and the images that were recorded as matched.
+  // The new images (see Options::incremental_matching) are recorded as matched
+  // after matching. Without incremental matching, all images are new.
+  std::unordered_set<std::pair<std::string, std::string> > matched_image_pairs_;
+  std::unordered_set<std::string> matched_image_names_;
+  std::unordered_set<std::string> new_image_names_;
+
   // Exif reader for loading exif information. This object is created once so
   // that the EXIF focal length database does not have to be loaded multiple
   // times.
   ExifReader exif_reader_;
 
-  // The global image feature descriptor extractor. This is used to extract a
+  // Each thread acquires a descriptor extractor from the pool for the image it
+  // processes, so the extractors and their buffers are reused across images.
+  DescriptorExtractorPool descriptor_extractor_pool_;
+
+  // The global image feature descriptor extractor, which is either a
+  // vocabulary tree or a Fisher Vector extractor. This is used to extract a
   // compact representation for each image and select a subset of kNN images to
-  // perform explicit (and expensive) feature matching.
-  std::unique_ptr<GlobalDescriptorExtractor> global_image_descriptor_extractor_;
+  // perform explicit (and expensive) feature matching. At most one of the two
+  // is set.
+  std::unique_ptr<VocabularyTree> vocabulary_tree_;
+  std::unique_ptr<FisherVectorExtractor> fisher_vector_extractor_;
+
+  // True if the global image descriptor extractor was read from disk and does
+  // not need to be trained on the features of the images, and true once the
+  // dimension of the extractor that was read has been checked against the
+  // descriptors. Both are guarded by the mutex while the images are processed.
+  bool global_image_descriptor_extractor_is_trained_;
+  bool global_image_descriptor_dimension_is_checked_;
+  std::mutex global_image_descriptor_mutex_;
 
   // Feature matcher and mutex for thread-safe access.
   std::unique_ptr<FeatureMatcher> matcher_;
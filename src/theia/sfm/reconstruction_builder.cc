@@ -179,7 +179,11 @@ ReconstructionBuilder::ReconstructionBuilder(
   feam_options.only_calibrated_views = options_.only_calibrated_views;
   feam_options.num_threads = options_.num_threads;
   feam_options.descriptor_extractor_type = options_.descriptor_type;
+  feam_options.descriptor_precision = options_.descriptor_precision;
   feam_options.feature_density = options_.feature_density;
+  feam_options.max_num_features = options_.max_num_features;
+  feam_options.max_image_dimension = options_.max_image_dimension;
+  feam_options.max_tile_dimension = options_.max_tile_dimension;
   feam_options.min_num_inlier_matches = options_.min_num_inlier_matches;
   feam_options.matching_strategy = options_.matching_strategy;
   feam_options.feature_matcher_options = options_.matching_options;
@@ -193,10 +197,22 @@ ReconstructionBuilder::ReconstructionBuilder(
       options_.select_image_pairs_with_global_image_descriptor_matching;
   feam_options.num_nearest_neighbors_for_global_descriptor_matching =
       options_.num_nearest_neighbors_for_global_descriptor_matching;
+  feam_options.fisher_vector_gmm_filepath =
+      options_.fisher_vector_gmm_filepath;
   feam_options.num_gmm_clusters_for_fisher_vector =
       options_.num_gmm_clusters_for_fisher_vector;
   feam_options.max_num_features_for_fisher_vector_training =
       options_.max_num_features_for_fisher_vector_training;
+  feam_options.global_descriptor_extractor_type =
+      options_.global_descriptor_extractor_type;
+  feam_options.vocabulary_tree_filepath = options_.vocabulary_tree_filepath;
+  feam_options.vocabulary_tree_branching_factor =
+      options_.vocabulary_tree_branching_factor;
+  feam_options.vocabulary_tree_num_levels =
+      options_.vocabulary_tree_num_levels;
+  feam_options.max_num_features_for_vocabulary_tree_training =
+      options_.max_num_features_for_vocabulary_tree_training;
+  feam_options.incremental_matching = options_.incremental_matching;
 
   feature_extractor_and_matcher_.reset(new FeatureExtractorAndMatcher(
       feam_options, features_and_matches_database_));
@@ -40,8 +40,10 @@
 #include <vector>
 
 #include "theia/image/descriptor/create_descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_quantization.h"
 #include "theia/matching/create_feature_matcher.h"
 #include "theia/matching/feature_matcher_options.h"
+#include "theia/matching/global_descriptor_extractor.h"
 #include "theia/sfm/reconstruction_estimator_options.h"
 #include "theia/sfm/types.h"
 #include "theia/util/util.h"
@@ -92,11 +94,33 @@ struct ReconstructionBuilderOptions {
   // See //theia/image/descriptor/create_descriptor_extractor.h
   DescriptorExtractorType descriptor_type = DescriptorExtractorType::SIFT;
 
+  // The precision that float descriptors are stored with. UINT8 descriptors
+  // use a quarter of the memory and disk space of FLOAT descriptors and are
+  // matched with integer distance kernels, at the cost of a small quantization
+  // error. See //theia/image/descriptor/descriptor_quantization.h
+  DescriptorPrecision descriptor_precision = DescriptorPrecision::FLOAT;
+
   // The density of features to extract. DENSE means more features are
   // extracted per image and SPARSE means fewer features per image are
   // extracted.
   FeatureDensity feature_density = FeatureDensity::NORMAL;
 
+  // The maximum number of features extracted from each image. The features are
+  // selected by their strength in a way that spreads them over the image, and
+  // the descriptors of the features that are not selected are not computed.
+  int max_num_features = 16384;
+
+  // If positive, images are downsampled so that neither their width nor their
+  // height is larger than this value before features are extracted. The
+  // keypoints are scaled back to the full resolution of the images. This
+  // reduces the time and memory of feature extraction for very large images.
+  int max_image_dimension = 0;
+
+  // If positive, features are extracted from images that are wider or taller
+  // than this value in overlapping tiles of at most this size. This bounds the
+  // memory of each feature extraction thread for very large images.
+  int max_tile_dimension = 0;
+
   // Keypoints and descriptors are stored to disk as they are added to the
   // FeatureMatcher. Features will be stored in this directory, which must be a
   // valid writeable directory.
@@ -118,10 +142,39 @@ struct ReconstructionBuilderOptions {
   bool select_image_pairs_with_global_image_descriptor_matching = true;
   int num_nearest_neighbors_for_global_descriptor_matching = 100;
 
-  // Specific options for Fisher Vector global feature extraction.
+  // The global image descriptor used to select the image pairs to match.
+  // Fisher vectors are compared between all pairs of images, while the
+  // vocabulary tree only scores the images that share visual words through an
+  // inverted file, which scales better to large image collections.
+  GlobalDescriptorExtractorType global_descriptor_extractor_type =
+      GlobalDescriptorExtractorType::FISHER_VECTOR;
+
+  // Specific options for Fisher Vector global feature extraction. If
+  // fisher_vector_gmm_filepath is set and the file exists, the GMM is read from
+  // it instead of being trained. Otherwise the GMM is trained on the features
+  // of the images and written to fisher_vector_gmm_filepath so that later runs
+  // may reuse it.
+  std::string fisher_vector_gmm_filepath = "";
   int num_gmm_clusters_for_fisher_vector = 16;
   int max_num_features_for_fisher_vector_training = 1000000;
 
+  // Specific options for vocabulary tree image retrieval. If
+  // vocabulary_tree_filepath is set and the file exists, the vocabulary is read
+  // from it instead of being trained. Otherwise the vocabulary is trained on
+  // the features of the images and written to vocabulary_tree_filepath so that
+  // later runs may reuse it.
+  std::string vocabulary_tree_filepath = "";
+  int vocabulary_tree_branching_factor = 10;
+  int vocabulary_tree_num_levels = 5;
+  int max_num_features_for_vocabulary_tree_training = 1000000;
+
+  // If true, only the image pairs that contain a new image are matched, where
+  // an image is new if its features are not in the features and matches
+  // database yet or if it has not been matched by a previous run. This
+  // allows new images to be added to a database of a previous run without
+  // matching the existing images again.
+  bool incremental_matching = false;
+
   // Options for estimating the reconstruction.
   // See //theia/sfm/reconstruction_estimator_options.h
   ReconstructionEstimatorOptions reconstruction_estimator_options;
@@ -153,8 +153,9 @@ bool TwoViewMatchGeometricVerification::VerifyMatches(
   // adjustment.
   SetupCameras(intrinsics1_, intrinsics2_, *twoview_info, &camera1_, &camera2_);
 
-  // Perform guided matching if desired.
-  if (options_.guided_matching) {
+  // Perform guided matching if desired. The guided matcher only supports float
+  // descriptors.
+  if (options_.guided_matching && !features1_.HasBinaryDescriptors()) {
     GuidedEpipolarMatcher::Options guided_matching_options;
     guided_matching_options.guided_matching_max_distance_pixels =
         options_.guided_matching_max_distance_pixels;
@@ -106,6 +106,13 @@ class TwoViewMatchGeometricVerification {
   bool VerifyMatches(std::vector<FeatureCorrespondence>* verified_matches,
                      TwoViewInfo* twoview_info);
 
+  // Returns the indices of the features of the verified matches, in the same
+  // order as the verified matches. This is only valid after VerifyMatches
+  // returned true.
+  const std::vector<IndexedFeatureMatch>& verified_feature_matches() const {
+    return matches_;
+  }
+
  private:
   // A helper method that creates a vector of FeatureCorrespondence from the
   // matches_ vector of match indices.
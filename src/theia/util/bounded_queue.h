@@ -0,0 +1,132 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_UTIL_BOUNDED_QUEUE_H_
+#define THEIA_UTIL_BOUNDED_QUEUE_H_
+
+#include <glog/logging.h>
+
+#include <condition_variable>  // NOLINT
+#include <cstddef>
+#include <deque>
+#include <mutex>  // NOLINT
+#include <utility>
+
+#include "theia/util/util.h"
+
+namespace theia {
+
+// A FIFO queue with a fixed capacity that connects the stages of a pipeline of
+// threads. Producers that push into a full queue block until a consumer pops an
+// element, so a slow stage throttles the stages that feed it (backpressure)
+// instead of letting the queue grow without bound. Once all producers are done
+// the queue is closed, and consumers drain the remaining elements before Pop
+// returns false. A typical consumer is:
+//
+//   T element;
+//   while (queue.Pop(&element)) {
+//     Process(element);
+//   }
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(const size_t capacity)
+      : capacity_(capacity), closed_(false) {
+    CHECK_GT(capacity_, 0u) << "The capacity of the queue must be positive.";
+  }
+
+  // Adds the element to the back of the queue, waiting for space if the queue
+  // is full. Returns false (and drops the element) if the queue is closed.
+  bool Push(T element) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this]() {
+      return closed_ || elements_.size() < capacity_;
+    });
+    if (closed_) {
+      return false;
+    }
+    elements_.emplace_back(std::move(element));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Removes the element at the front of the queue, waiting for an element if
+  // the queue is empty. Returns false once the queue is closed and empty.
+  bool Pop(T* element) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this]() { return closed_ || !elements_.empty(); });
+    if (elements_.empty()) {
+      return false;
+    }
+    *element = std::move(elements_.front());
+    elements_.pop_front();
+    lock.unlock();
+    not_full_.notify_one();
+    return true;
+  }
+
+  // Signals that no more elements will be pushed. All waiting threads are
+  // woken up; the elements that are already in the queue may still be popped.
+  void Close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+  size_t Size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return elements_.size();
+  }
+
+  size_t Capacity() const { return capacity_; }
+
+ private:
+  const size_t capacity_;
+  bool closed_;
+  std::deque<T> elements_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+
+  DISALLOW_COPY_AND_ASSIGN(BoundedQueue);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_UTIL_BOUNDED_QUEUE_H_
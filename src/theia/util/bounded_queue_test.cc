@@ -0,0 +1,152 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/util/bounded_queue.h"
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace theia {
+
+TEST(BoundedQueue, PopsInPushOrder) {
+  BoundedQueue<int> queue(4);
+  EXPECT_EQ(queue.Capacity(), 4);
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(queue.Push(i));
+  }
+  EXPECT_EQ(queue.Size(), 4);
+
+  int element;
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(queue.Pop(&element));
+    EXPECT_EQ(element, i);
+  }
+  EXPECT_EQ(queue.Size(), 0);
+}
+
+TEST(BoundedQueue, CloseDrainsRemainingElements) {
+  BoundedQueue<int> queue(4);
+  EXPECT_TRUE(queue.Push(1));
+  EXPECT_TRUE(queue.Push(2));
+  queue.Close();
+
+  // Nothing may be pushed after the queue is closed, but the elements that
+  // were already pushed are still popped.
+  EXPECT_FALSE(queue.Push(3));
+  int element;
+  EXPECT_TRUE(queue.Pop(&element));
+  EXPECT_EQ(element, 1);
+  EXPECT_TRUE(queue.Pop(&element));
+  EXPECT_EQ(element, 2);
+  EXPECT_FALSE(queue.Pop(&element));
+}
+
+TEST(BoundedQueue, PushBlocksWhileFull) {
+  BoundedQueue<int> queue(1);
+  EXPECT_TRUE(queue.Push(0));
+
+  std::atomic<bool> pushed(false);
+  std::thread producer([&]() {
+    queue.Push(1);
+    pushed = true;
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(pushed);
+
+  // Making room in the queue lets the producer continue.
+  int element;
+  EXPECT_TRUE(queue.Pop(&element));
+  EXPECT_EQ(element, 0);
+  producer.join();
+  EXPECT_TRUE(pushed);
+  EXPECT_TRUE(queue.Pop(&element));
+  EXPECT_EQ(element, 1);
+}
+
+TEST(BoundedQueue, CloseWakesUpWaitingConsumers) {
+  BoundedQueue<int> queue(1);
+  std::thread consumer([&]() {
+    int element;
+    EXPECT_FALSE(queue.Pop(&element));
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  queue.Close();
+  consumer.join();
+}
+
+TEST(BoundedQueue, ManyProducersAndConsumers) {
+  static const int kNumThreads = 4;
+  static const int kNumElementsPerProducer = 1000;
+  BoundedQueue<int> queue(8);
+
+  std::vector<std::thread> producers, consumers;
+  for (int i = 0; i < kNumThreads; i++) {
+    producers.emplace_back([&]() {
+      for (int j = 1; j <= kNumElementsPerProducer; j++) {
+        EXPECT_TRUE(queue.Push(j));
+      }
+    });
+  }
+
+  std::atomic<int> num_popped(0), sum(0);
+  for (int i = 0; i < kNumThreads; i++) {
+    consumers.emplace_back([&]() {
+      int element;
+      while (queue.Pop(&element)) {
+        EXPECT_LE(queue.Size(), queue.Capacity());
+        ++num_popped;
+        sum += element;
+      }
+    });
+  }
+
+  for (std::thread& producer : producers) {
+    producer.join();
+  }
+  queue.Close();
+  for (std::thread& consumer : consumers) {
+    consumer.join();
+  }
+
+  EXPECT_EQ(num_popped, kNumThreads * kNumElementsPerProducer);
+  EXPECT_EQ(sum, kNumThreads * kNumElementsPerProducer *
+                     (kNumElementsPerProducer + 1) / 2);
+}
+
+}  // namespace theia
@@ -0,0 +1,382 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_UTIL_CONCURRENT_LRU_CACHE_H_
+#define THEIA_UTIL_CONCURRENT_LRU_CACHE_H_
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdint>
+#include <functional>
+#include <future>  // NOLINT
+#include <list>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "theia/util/timer.h"
+#include "theia/util/util.h"
+
+namespace theia {
+
+// An LRU cache that may be shared by many threads whose cache misses are
+// expensive (e.g., a read from disk followed by deserialization). It has the
+// same interface as LRUCache, but differs in how it behaves under contention:
+//
+//   1) The lock is not held while the cache miss function runs, so misses for
+//      different keys are fetched in parallel.
+//   2) Concurrent misses for the same key are only fetched once. The first
+//      thread performs the fetch and all other threads wait on a future that
+//      shares the fetched value.
+//   3) The cache is split into shards that are each protected by their own
+//      mutex so that cache hits for different keys rarely contend.
+//
+// Each shard is an independent LRU cache that holds an equal part of the
+// capacity, so entries are evicted in LRU order within a shard rather than
+// across the whole cache.
+//
+// The capacity is either a number of entries or, when a function that estimates
+// the size of a value is given, a number of bytes. The size of an entry is only
+// known once it has been fetched, so entries that are being fetched do not
+// count towards the capacity.
+template <class KeyType, class ValueType>
+class ConcurrentLRUCache {
+  typedef std::list<KeyType> CacheList;
+  typedef typename CacheList::iterator CacheListIterator;
+
+ public:
+  static const int kDefaultNumShards = 16;
+
+  // Pass a function that performs the cache miss lookup and returns a value,
+  // as with LRUCache. The fetch function is called from the thread that misses
+  // in the cache without any lock held, so it must be thread-safe. The number
+  // of shards is clamped so that each shard holds at least one entry.
+  ConcurrentLRUCache(
+      const std::function<ValueType(const KeyType&)>& fetch_entry,
+      const int max_cache_entries,
+      const int num_shards = kDefaultNumShards)
+      : fetch_entry_(fetch_entry),
+        entry_size_([](const ValueType&) { return static_cast<size_t>(1); }),
+        max_cache_size_(std::max(max_cache_entries, 0)),
+        cache_misses_(0),
+        cache_hits_(0),
+        cache_waits_(0),
+        wait_time_in_microseconds_(0) {
+    CHECK_GT(max_cache_entries, 0)
+        << "The maximum number of cache entries must be greater than 0.";
+    CHECK_GT(num_shards, 0) << "The number of shards must be greater than 0.";
+    InitializeShards(std::min(num_shards, max_cache_entries));
+  }
+
+  // Same as above, but the capacity of the cache is given in bytes and
+  // entry_size_in_bytes returns the (estimated) memory used by a value. The
+  // most recently fetched entry of a shard is never evicted, so a value that is
+  // larger than the capacity of its shard is still cached until the next fetch
+  // into that shard.
+  ConcurrentLRUCache(
+      const std::function<ValueType(const KeyType&)>& fetch_entry,
+      const std::function<size_t(const ValueType&)>& entry_size_in_bytes,
+      const size_t max_cache_size_in_bytes,
+      const int num_shards = kDefaultNumShards)
+      : fetch_entry_(fetch_entry),
+        entry_size_(entry_size_in_bytes),
+        max_cache_size_(max_cache_size_in_bytes),
+        cache_misses_(0),
+        cache_hits_(0),
+        cache_waits_(0),
+        wait_time_in_microseconds_(0) {
+    CHECK_GT(max_cache_size_, 0)
+        << "The maximum size of the cache must be greater than 0.";
+    CHECK_GT(num_shards, 0) << "The number of shards must be greater than 0.";
+    InitializeShards(num_shards);
+  }
+
+  // Fetch the entry and return the value. If the entry is in the cache then it
+  // will be returned efficiently. If another thread is currently fetching the
+  // entry then this waits for that fetch to finish instead of fetching the
+  // entry again.
+  ValueType Fetch(const KeyType& key) {
+    Shard* shard = GetShard(key);
+    std::shared_future<ValueType> value;
+    std::promise<ValueType> fetched_value;
+    uint64_t fetch_id = 0;
+    {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      const auto it = shard->cache_entries_map.find(key);
+      if (it != shard->cache_entries_map.end()) {
+        ++cache_hits_;
+
+        // Update the access record by moving the entry to the back of the list.
+        shard->cache_entries.splice(shard->cache_entries.end(),
+                                    shard->cache_entries,
+                                    it->second.position);
+        value = it->second.value;
+      } else {
+        ++cache_misses_;
+
+        // Publish the future of the value before fetching so that other
+        // threads that miss on this key will wait for this fetch.
+        fetch_id = ++shard->num_fetches;
+        value = fetched_value.get_future().share();
+        InsertIntoShard(key, value, fetch_id, shard);
+      }
+    }
+
+    // On a cache hit, the value may still be in flight from another thread.
+    if (fetch_id == 0) {
+      if (value.wait_for(std::chrono::seconds(0)) !=
+          std::future_status::ready) {
+        ++cache_waits_;
+        Timer timer;
+        value.wait();
+        wait_time_in_microseconds_ +=
+            static_cast<int64_t>(timer.ElapsedTimeInSeconds() * 1e6);
+      }
+      return value.get();
+    }
+
+    // Fetch the value for this key without holding the lock.
+    try {
+      fetched_value.set_value(fetch_entry_(key));
+    } catch (...) {
+      // Pass the failure on to any waiting threads, and remove the entry so
+      // that the next Fetch of the key will try again.
+      fetched_value.set_exception(std::current_exception());
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      const auto it = shard->cache_entries_map.find(key);
+      if (it != shard->cache_entries_map.end() &&
+          it->second.fetch_id == fetch_id) {
+        shard->cache_entries.erase(it->second.position);
+        shard->cache_entries_map.erase(it);
+      }
+      throw;
+    }
+
+    // Now that the size of the value is known, make room for it in the shard.
+    // If the entry was erased or evicted while it was fetched then the value
+    // is only returned to the waiting threads.
+    const size_t value_size = entry_size_(value.get());
+    {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      const auto it = shard->cache_entries_map.find(key);
+      if (it != shard->cache_entries_map.end() &&
+          it->second.fetch_id == fetch_id) {
+        it->second.size = value_size;
+        shard->cache_size += value_size;
+        EvictEntriesIfNeeded(key, shard);
+      }
+    }
+    return value.get();
+  }
+
+  // Inserts a key-value pair into the cache, evicting the oldest entries of the
+  // shard if it is over capacity. Unlike LRUCache, an existing entry for the
+  // key is replaced.
+  void Insert(const KeyType& key, const ValueType& value) {
+    std::promise<ValueType> inserted_value;
+    inserted_value.set_value(value);
+    const size_t value_size = entry_size_(value);
+
+    Shard* shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    EraseFromShard(key, shard);
+    InsertIntoShard(
+        key, inserted_value.get_future().share(), ++shard->num_fetches, shard);
+    shard->cache_entries_map[key].size = value_size;
+    shard->cache_size += value_size;
+    EvictEntriesIfNeeded(key, shard);
+  }
+
+  // Removes the entry for the key from the cache if it exists, so that the next
+  // Fetch of the key is a cache miss. If the entry is currently being fetched,
+  // the fetched value is returned to the threads already waiting on it but is
+  // not added to the cache.
+  void Erase(const KeyType& key) {
+    Shard* shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    EraseFromShard(key, shard);
+  }
+
+  // Return if the key exists in the cache. Entries that are currently being
+  // fetched are considered to be in the cache.
+  bool ExistsInCache(const KeyType& key) {
+    Shard* shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    return shard->cache_entries_map.count(key) > 0;
+  }
+
+  // Various statistics for the cache. The capacity and the cache size are in
+  // bytes if the cache was constructed with a size function and in number of
+  // entries otherwise, while Size() is always the number of entries. A cache
+  // wait is a cache hit on an entry that was still being fetched by another
+  // thread, and the wait time is the total time that threads have spent
+  // blocked on such entries.
+  size_t CacheCapacity() const { return max_cache_size_; }
+  int NumShards() const { return shards_.size(); }
+  int Size() const {
+    int size = 0;
+    for (const auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      size += shard->cache_entries_map.size();
+    }
+    return size;
+  }
+  size_t CacheSize() const {
+    size_t cache_size = 0;
+    for (const auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      cache_size += shard->cache_size;
+    }
+    return cache_size;
+  }
+  int NumCacheMisses() const { return cache_misses_; }
+  int NumCacheHits() const { return cache_hits_; }
+  int NumCacheWaits() const { return cache_waits_; }
+  double WaitTimeInSeconds() const {
+    return static_cast<double>(wait_time_in_microseconds_) / 1e6;
+  }
+
+ private:
+  struct CacheEntry {
+    std::shared_future<ValueType> value;
+    CacheListIterator position;
+    // Identifies the fetch that created this entry.
+    uint64_t fetch_id;
+    // The size of the value, or 0 while the value is being fetched.
+    size_t size;
+  };
+
+  // A shard is a standalone LRU cache over the keys that hash to it.
+  struct Shard {
+    explicit Shard(const size_t max_cache_size)
+        : max_cache_size(max_cache_size), cache_size(0), num_fetches(0) {}
+
+    const size_t max_cache_size;
+    size_t cache_size;
+    uint64_t num_fetches;
+
+    // The entries are oldest at the front and newest at the back of the list.
+    CacheList cache_entries;
+    std::unordered_map<KeyType, CacheEntry> cache_entries_map;
+    mutable std::mutex mutex;
+  };
+
+  // Splits the capacity evenly among the shards.
+  void InitializeShards(const int num_shards) {
+    const size_t max_cache_size_per_shard =
+        (max_cache_size_ + num_shards - 1) / num_shards;
+    shards_.reserve(num_shards);
+    for (int i = 0; i < num_shards; i++) {
+      shards_.emplace_back(new Shard(max_cache_size_per_shard));
+    }
+  }
+
+  Shard* GetShard(const KeyType& key) {
+    return shards_[std::hash<KeyType>()(key) % shards_.size()].get();
+  }
+
+  // Insert the key/value pair into the shard as the most recently used entry.
+  // The entry does not count towards the size of the shard until its size is
+  // set.
+  //
+  // NOTE: The shard mutex must be held when calling this method.
+  void InsertIntoShard(const KeyType& key,
+                       const std::shared_future<ValueType>& value,
+                       const uint64_t fetch_id,
+                       Shard* shard) {
+    CacheEntry& entry = shard->cache_entries_map[key];
+    entry.value = value;
+    entry.position =
+        shard->cache_entries.insert(shard->cache_entries.end(), key);
+    entry.fetch_id = fetch_id;
+    entry.size = 0;
+  }
+
+  // Evicts the least recently used entries of the shard, other than the entry
+  // of the given key, until the shard is within its capacity.
+  //
+  // NOTE: The shard mutex must be held when calling this method.
+  void EvictEntriesIfNeeded(const KeyType& key, Shard* shard) {
+    auto it = shard->cache_entries.begin();
+    while (shard->cache_size > shard->max_cache_size &&
+           it != shard->cache_entries.end()) {
+      if (*it == key) {
+        ++it;
+        continue;
+      }
+      const auto entry = shard->cache_entries_map.find(*it);
+      shard->cache_size -= entry->second.size;
+      shard->cache_entries_map.erase(entry);
+      it = shard->cache_entries.erase(it);
+    }
+  }
+
+  // NOTE: The shard mutex must be held when calling this method.
+  void EraseFromShard(const KeyType& key, Shard* shard) {
+    const auto it = shard->cache_entries_map.find(key);
+    if (it == shard->cache_entries_map.end()) {
+      return;
+    }
+    shard->cache_size -= it->second.size;
+    shard->cache_entries.erase(it->second.position);
+    shard->cache_entries_map.erase(it);
+  }
+
+  // A function that takes in a KeyType as input and returns the ValueType. This
+  // is utilized for cache misses and e.g., can implement a read from disk.
+  const std::function<ValueType(const KeyType&)> fetch_entry_;
+
+  // Returns the size of a value in the units of the capacity.
+  const std::function<size_t(const ValueType&)> entry_size_;
+
+  // Maximum cache size over all shards.
+  const size_t max_cache_size_;
+
+  std::vector<std::unique_ptr<Shard> > shards_;
+
+  // Some cache statistics.
+  std::atomic<int> cache_misses_, cache_hits_, cache_waits_;
+  std::atomic<int64_t> wait_time_in_microseconds_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConcurrentLRUCache);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_UTIL_CONCURRENT_LRU_CACHE_H_
@@ -0,0 +1,240 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/util/concurrent_lru_cache.h"
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <condition_variable>  // NOLINT
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <unordered_map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "theia/util/map_util.h"
+
+namespace theia {
+
+namespace {
+
+std::unordered_map<int, int> cache_lookup = {
+    {0, 1}, {1, 47}, {2, 14}, {3, 101}, {4, 7}, {5, 29}};
+
+// We will use this as our cache miss function for testing purposes.
+int CacheMissLookup(const int& input) {
+  return FindOrDie(cache_lookup, input);
+}
+
+}  // namespace
+
+TEST(ConcurrentLRUCache, Constructor) {
+  const int kMaxCacheSize = 5;
+  ConcurrentLRUCache<int, int> lru_cache(CacheMissLookup, kMaxCacheSize);
+  EXPECT_EQ(lru_cache.CacheCapacity(), kMaxCacheSize);
+  // There can be no more shards than entries.
+  EXPECT_EQ(lru_cache.NumShards(), kMaxCacheSize);
+  EXPECT_EQ(lru_cache.Size(), 0);
+  EXPECT_EQ(lru_cache.NumCacheHits(), 0);
+  EXPECT_EQ(lru_cache.NumCacheMisses(), 0);
+  EXPECT_EQ(lru_cache.NumCacheWaits(), 0);
+}
+
+TEST(ConcurrentLRUCache, FetchWorksWithManyEntries) {
+  const int kMaxCacheSize = 64;
+  ConcurrentLRUCache<int, int> lru_cache(CacheMissLookup, kMaxCacheSize);
+
+  for (int i = 0; i < 5; i++) {
+    for (const auto& entry : cache_lookup) {
+      EXPECT_EQ(lru_cache.Fetch(entry.first), entry.second);
+      EXPECT_TRUE(lru_cache.ExistsInCache(entry.first));
+    }
+  }
+  EXPECT_EQ(lru_cache.Size(), cache_lookup.size());
+  EXPECT_EQ(lru_cache.NumCacheMisses(), cache_lookup.size());
+  EXPECT_EQ(lru_cache.NumCacheHits(), 4 * cache_lookup.size());
+}
+
+TEST(ConcurrentLRUCache, FetchWithCacheMiss) {
+  const int kMaxCacheSize = 2;
+  const int kNumShards = 1;
+  ConcurrentLRUCache<int, int> lru_cache(
+      CacheMissLookup, kMaxCacheSize, kNumShards);
+  EXPECT_EQ(lru_cache.Fetch(0), FindOrDie(cache_lookup, 0));
+  EXPECT_EQ(lru_cache.Fetch(1), FindOrDie(cache_lookup, 1));
+  // Touch entry 0 so that entry 1 is the least recently used.
+  EXPECT_EQ(lru_cache.Fetch(0), FindOrDie(cache_lookup, 0));
+  EXPECT_EQ(lru_cache.Fetch(2), FindOrDie(cache_lookup, 2));
+  EXPECT_TRUE(lru_cache.ExistsInCache(0));
+  EXPECT_FALSE(lru_cache.ExistsInCache(1));
+  EXPECT_TRUE(lru_cache.ExistsInCache(2));
+  EXPECT_EQ(lru_cache.Size(), 2);
+  EXPECT_EQ(lru_cache.NumCacheMisses(), 3);
+  EXPECT_EQ(lru_cache.NumCacheHits(), 1);
+}
+
+TEST(ConcurrentLRUCache, InsertAndErase) {
+  const int kMaxCacheSize = 5;
+  ConcurrentLRUCache<int, int> lru_cache(CacheMissLookup, kMaxCacheSize);
+  lru_cache.Insert(0, 5);
+  EXPECT_EQ(lru_cache.Fetch(0), 5);
+  // Inserting an existing key replaces the value.
+  lru_cache.Insert(0, 6);
+  EXPECT_EQ(lru_cache.Fetch(0), 6);
+  EXPECT_EQ(lru_cache.Size(), 1);
+
+  lru_cache.Erase(0);
+  EXPECT_FALSE(lru_cache.ExistsInCache(0));
+  EXPECT_EQ(lru_cache.Fetch(0), FindOrDie(cache_lookup, 0));
+  EXPECT_EQ(lru_cache.NumCacheMisses(), 1);
+  EXPECT_EQ(lru_cache.NumCacheHits(), 2);
+}
+
+TEST(ConcurrentLRUCache, FetchWithSizeInBytes) {
+  const size_t kMaxCacheSizeInBytes = 100;
+  const int kNumShards = 1;
+  // The size of each value is the value itself.
+  const auto value_size = [](const int& value) {
+    return static_cast<size_t>(value);
+  };
+  ConcurrentLRUCache<int, int> lru_cache(
+      CacheMissLookup, value_size, kMaxCacheSizeInBytes, kNumShards);
+  EXPECT_EQ(lru_cache.CacheCapacity(), kMaxCacheSizeInBytes);
+
+  // Entries 0, 2 and 4 have a total size of 1 + 14 + 7 bytes.
+  EXPECT_EQ(lru_cache.Fetch(0), FindOrDie(cache_lookup, 0));
+  EXPECT_EQ(lru_cache.Fetch(2), FindOrDie(cache_lookup, 2));
+  EXPECT_EQ(lru_cache.Fetch(4), FindOrDie(cache_lookup, 4));
+  EXPECT_EQ(lru_cache.Size(), 3);
+  EXPECT_EQ(lru_cache.CacheSize(), 22);
+
+  // Entry 1 has 47 bytes and fits in the cache.
+  EXPECT_EQ(lru_cache.Fetch(1), FindOrDie(cache_lookup, 1));
+  EXPECT_EQ(lru_cache.Size(), 4);
+  EXPECT_EQ(lru_cache.CacheSize(), 69);
+
+  EXPECT_EQ(lru_cache.Fetch(5), FindOrDie(cache_lookup, 5));
+  EXPECT_EQ(lru_cache.Size(), 5);
+  EXPECT_EQ(lru_cache.CacheSize(), 98);
+
+  // Touch entry 0 so that entry 2 is the least recently used, then insert an
+  // entry of 10 bytes which requires entry 2 to be evicted.
+  EXPECT_EQ(lru_cache.Fetch(0), FindOrDie(cache_lookup, 0));
+  lru_cache.Insert(10, 10);
+  EXPECT_TRUE(lru_cache.ExistsInCache(0));
+  EXPECT_FALSE(lru_cache.ExistsInCache(2));
+  EXPECT_EQ(lru_cache.Size(), 5);
+  EXPECT_EQ(lru_cache.CacheSize(), 94);
+
+  // Entry 3 has 101 bytes, which is more than the capacity. It evicts all other
+  // entries but is kept in the cache.
+  EXPECT_EQ(lru_cache.Fetch(3), FindOrDie(cache_lookup, 3));
+  EXPECT_TRUE(lru_cache.ExistsInCache(3));
+  EXPECT_EQ(lru_cache.Size(), 1);
+  EXPECT_EQ(lru_cache.CacheSize(), 101);
+
+  lru_cache.Erase(3);
+  EXPECT_EQ(lru_cache.Size(), 0);
+  EXPECT_EQ(lru_cache.CacheSize(), 0);
+}
+
+// Concurrent misses on the same key should only call the fetch function once
+// and every thread should receive the fetched value.
+TEST(ConcurrentLRUCache, ConcurrentMissesAreFetchedOnce) {
+  const int kMaxCacheSize = 5;
+  const int kNumThreads = 8;
+  std::atomic<int> num_fetches(0);
+  const auto slow_lookup = [&num_fetches](const int& input) {
+    ++num_fetches;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return FindOrDie(cache_lookup, input);
+  };
+  ConcurrentLRUCache<int, int> lru_cache(slow_lookup, kMaxCacheSize);
+
+  std::vector<int> values(kNumThreads);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; i++) {
+    threads.emplace_back([&lru_cache, &values, i]() {
+      values[i] = lru_cache.Fetch(3);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(num_fetches, 1);
+  for (int i = 0; i < kNumThreads; i++) {
+    EXPECT_EQ(values[i], FindOrDie(cache_lookup, 3));
+  }
+  EXPECT_EQ(lru_cache.NumCacheMisses(), 1);
+  EXPECT_EQ(lru_cache.NumCacheHits(), kNumThreads - 1);
+  EXPECT_GT(lru_cache.NumCacheWaits(), 0);
+  EXPECT_GT(lru_cache.WaitTimeInSeconds(), 0.0);
+}
+
+// Misses on different keys must be fetched in parallel. Each fetch waits until
+// both fetches are in flight, which can only happen if the cache does not hold
+// a lock during the fetch.
+TEST(ConcurrentLRUCache, MissesForDifferentKeysDoNotBlock) {
+  const int kMaxCacheSize = 5;
+  const int kNumShards = 1;
+  std::mutex mutex;
+  std::condition_variable condition;
+  int num_fetches_in_flight = 0;
+  const auto blocking_lookup = [&](const int& input) {
+    std::unique_lock<std::mutex> lock(mutex);
+    ++num_fetches_in_flight;
+    condition.notify_all();
+    const bool both_in_flight =
+        condition.wait_for(lock, std::chrono::seconds(10), [&]() {
+          return num_fetches_in_flight == 2;
+        });
+    CHECK(both_in_flight);
+    return FindOrDie(cache_lookup, input);
+  };
+  ConcurrentLRUCache<int, int> lru_cache(
+      blocking_lookup, kMaxCacheSize, kNumShards);
+
+  int value0 = 0, value1 = 0;
+  std::thread thread0([&]() { value0 = lru_cache.Fetch(0); });
+  std::thread thread1([&]() { value1 = lru_cache.Fetch(1); });
+  thread0.join();
+  thread1.join();
+  EXPECT_EQ(value0, FindOrDie(cache_lookup, 0));
+  EXPECT_EQ(value1, FindOrDie(cache_lookup, 1));
+  EXPECT_EQ(lru_cache.NumCacheMisses(), 2);
+}
+
+}  // namespace theia
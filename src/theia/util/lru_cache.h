@@ -113,6 +113,19 @@ class LRUCache {
     InsertIntoCache(key, value);
   }
 
+  // Removes the entry for the key from the cache if it exists, so that the next
+  // Fetch of the key is a cache miss. This should be called when the value that
+  // the fetch function returns for the key changes.
+  virtual void Erase(const KeyType& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = cache_entries_map_.find(key);
+    if (it == cache_entries_map_.end()) {
+      return;
+    }
+    cache_entries_.erase(it->second.second);
+    cache_entries_map_.erase(it);
+  }
+
   // Return if the key exists in the cache.
   virtual bool ExistsInCache(const KeyType& key) {
     return ContainsKey(cache_entries_map_, key);
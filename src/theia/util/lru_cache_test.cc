@@ -134,4 +134,27 @@ TEST(LRUCache, FetchWithCacheMiss) {
   EXPECT_EQ(lru_cache.NumCacheHits(), 0);
 }
 
+TEST(LRUCache, Erase) {
+  const int kMaxCacheSize = 5;
+  LRUCache<int, int> lru_cache(CacheMissLookup, kMaxCacheSize);
+  EXPECT_EQ(lru_cache.Fetch(0), FindOrDie(cache_lookup, 0));
+  EXPECT_EQ(lru_cache.Fetch(1), FindOrDie(cache_lookup, 1));
+
+  // Erasing an entry removes only that entry.
+  lru_cache.Erase(0);
+  EXPECT_FALSE(lru_cache.ExistsInCache(0));
+  EXPECT_TRUE(lru_cache.ExistsInCache(1));
+  EXPECT_EQ(lru_cache.Size(), 1);
+
+  // Erasing an entry that is not in the cache does nothing.
+  lru_cache.Erase(2);
+  EXPECT_EQ(lru_cache.Size(), 1);
+
+  // Fetching the erased entry is a cache miss.
+  EXPECT_EQ(lru_cache.Fetch(0), FindOrDie(cache_lookup, 0));
+  EXPECT_EQ(lru_cache.NumCacheMisses(), 3);
+  EXPECT_EQ(lru_cache.NumCacheHits(), 0);
+  EXPECT_EQ(lru_cache.Size(), 2);
+}
+
 }  // namespace theia